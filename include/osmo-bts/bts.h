@@ -22,6 +22,12 @@ enum {
 	BTS_CTR_AGCH_RCVD,
 	BTS_CTR_AGCH_SENT,
 	BTS_CTR_AGCH_DELETED,
+	BTS_CTR_AGCH_DEL_EXPIRED,
+	BTS_CTR_AGCH_DEL_CONGESTION,
+	BTS_CTR_AGCH_DEL_FULL,
+	BTS_CTR_AGCH_REFUSED_FULL,
+	BTS_CTR_AGCH_PCH_PREEMPT,
+	BTS_CTR_PAGING_EXPIRED,
 };
 
 /* Used by OML layer for BTS Attribute reporting */
@@ -83,9 +89,26 @@ struct gprs_rlc_cfg {
 	uint8_t initial_mcs;
 };
 
+/* 8 TC times the longest rotation of SI on TC=4: 4 SI types, one of them
+ * SI2quater with up to SI2Q_MAX_NUM instances */
+#define BTS_SI_BCCH_ROT_MAX	(8 * 4 * SI2Q_MAX_NUM)
+
+/* upper bound of 'smscb queue-max-length' */
+#define BTS_SMSCB_QUEUE_MAX	60
+#define BTS_SMSCB_INDEX_SIZE	32
+#define BTS_SMSCB_NUM_PRIO	2
+
 struct bts_smscb_state {
-	struct llist_head queue; /* list of struct smscb_msg */
-	int queue_len;
+	/* pending messages by message identifier, serial number and page */
+	struct llist_head index[BTS_SMSCB_INDEX_SIZE];
+	/* binary min-heaps of pending messages per priority, by due cycle */
+	struct {
+		struct smscb_msg *msg[BTS_SMSCB_QUEUE_MAX];
+		unsigned int len;
+	} heap[BTS_SMSCB_NUM_PRIO];
+	uint32_t cycle; /* number of CBCH cycles (8 multiframes) so far */
+	uint32_t seq; /* insertion counter, keeps FIFO order among equally due messages */
+	int queue_len; /* number of pending transmissions */
 	struct rate_ctr_group *ctrs;
 	struct smscb_msg *cur_msg; /* current SMS-CB */
 	struct smscb_msg *default_msg; /* default broadcast message; NULL if none */
@@ -226,9 +249,14 @@ struct gsm_bts {
 
 	/* AGCH queuing */
 	struct {
-		struct llist_head queue;
+		struct llist_head queue;	/* IMM ASS and others */
+		struct llist_head rej_queue;	/* IMM ASS REJ */
+		struct msgb *rej_partial;	/* IMM ASS REJ with room for more refs */
 		int length;
+		int imm_ass_length;		/* number of messages in queue (not rej_queue) */
 		int max_length;
+		int max_age;			/* in TDMA frames after the RACH */
+		int drop_credit;
 
 		int thresh_level;	/* Cleanup threshold in percent of max len */
 		int low_level;		/* Low water mark in percent of max len */
@@ -266,7 +294,10 @@ struct gsm_bts {
 		uint8_t ciphers;	/* flags A5/1==0x1, A5/2==0x2, A5/3==0x4 */
 	} support;
 	struct {
-		uint8_t tc4_ctr;
+		/* BCCH Norm rotation, indexed by (FN / 51) % bcch_len, see
+		 * bts_sysinfo_update_bcch() */
+		const uint8_t *bcch[BTS_SI_BCCH_ROT_MAX];
+		unsigned int bcch_len;
 	} si;
 	struct gsm_time gsm_time;
 	/* frame number statistics (FN in PH-RTS.ind vs. PH-DATA.ind */
@@ -301,6 +332,10 @@ struct gsm_bts {
 		char *sock_path;
 	} pcu;
 
+	/* maximum number of PDTCH blocks per TS the PCU may provide ahead of
+	 * the RTS, 0 if disabled */
+	unsigned int pdtch_prefetch;
+
 	struct osmo_fsm_inst *shutdown_fi; /* FSM instance to manage shutdown procedure during process exit */
 	struct osmo_tdef *T_defs; /* Timer defines */
 
@@ -328,9 +363,11 @@ int trx_set_available(struct gsm_bts_trx *trx, int avail);
 int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg);
 struct msgb *bts_agch_dequeue(struct gsm_bts *bts);
 int bts_agch_max_queue_length(int T, int bcch_conf);
+int bts_agch_max_age(int T, int bcch_conf);
 int bts_ccch_copy_msg(struct gsm_bts *bts, uint8_t *out_buf, struct gsm_time *gt,
 		      int is_ag_res);
 int bts_supports_cipher(struct gsm_bts *bts, int rsl_cipher);
+void bts_sysinfo_update_bcch(struct gsm_bts *bts);
 uint8_t *bts_sysinfo_get(struct gsm_bts *bts, const struct gsm_time *g_time);
 void regenerate_si3_restoctets(struct gsm_bts *bts);
 uint8_t *lchan_sacch_get(struct gsm_lchan *lchan);
@@ -14,6 +14,8 @@ enum {
 	CBCH_CTR_SENT_NULL,
 };
 
+void bts_smscb_state_init(struct bts_smscb_state *bts_ss);
+
 /* incoming SMS broadcast command from RSL */
 int bts_process_smscb_cmd(struct gsm_bts *bts, struct rsl_ie_cb_cmd_type cmd_type,
 			  bool extended_cbch, uint8_t msg_len, const uint8_t *msg);
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include <osmocom/core/fsm.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/logging.h>
@@ -42,3 +45,18 @@ enum dtx_dl_amr_fsm_events {
 
 extern const struct value_string dtx_dl_amr_fsm_event_names[];
 extern struct osmo_fsm dtx_dl_amr_fsm;
+
+/* Table driven DTX DL AMR state machine: same states and transitions as
+ * dtx_dl_amr_fsm, but embedded into struct gsm_lchan and without the
+ * osmo_fsm allocation, event dispatch and logging per voice frame. The
+ * osmo_fsm above is only kept as the reference for tests/misc. */
+struct dtx_dl_amr_sm {
+	/* set on channel activation if DTX DL is used on the lchan */
+	bool active;
+	/* enum dtx_dl_amr_fsm_states */
+	uint8_t state;
+};
+
+void dtx_dl_amr_sm_init(struct dtx_dl_amr_sm *sm);
+int dtx_dl_amr_sm_dispatch(struct dtx_dl_amr_sm *sm, enum dtx_dl_amr_fsm_events e);
+const char *dtx_dl_amr_sm_state_name(const struct dtx_dl_amr_sm *sm);
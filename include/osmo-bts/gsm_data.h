@@ -26,6 +26,7 @@
 
 #include <osmocom/abis/e1_input.h>
 
+#include <osmo-bts/dtx_dl_amr_fsm.h>
 #include <osmo-bts/paging.h>
 #include <osmo-bts/tx_power.h>
 #include <osmo-bts/oml.h>
@@ -41,6 +42,8 @@
 #define GSM_BTS_AGCH_QUEUE_THRESH_LEVEL_DISABLE 999999
 #define GSM_BTS_AGCH_QUEUE_LOW_LEVEL_DEFAULT 41
 #define GSM_BTS_AGCH_QUEUE_HIGH_LEVEL_DEFAULT 91
+/* upper limit of T3126 (5 seconds) in TDMA frames */
+#define GSM_BTS_AGCH_MAX_AGE_DEFAULT 1083
 
 #define LOGPLCHAN(lchan, ss, lvl, fmt, args...) LOGP(ss, lvl, "%s " fmt, gsm_lchan_name(lchan), ## args)
 #define LOGPTRX(trx, ss, lvl, fmt, args...) LOGP(ss, lvl, "%s " fmt, gsm_trx_name(trx), ## args)
@@ -97,10 +100,22 @@ enum gsm_lchan_state {
 };
 
 #define MAX_NUM_UL_MEAS	104
+/* largest number of measurements of one measurement period which take part
+ * in the computation (TCH/F, TCH/H: 24 + 1 SACCH) */
+#define UL_MEAS_WINDOW	25
 #define LC_UL_M_F_L1_VALID	(1 << 0)
 #define LC_UL_M_F_RES_VALID	(1 << 1)
 #define LC_UL_M_F_OSMO_EXT_VALID (1 << 2)
 
+/* compact copy of a struct bts_ul_meas, as far as it is needed for
+ * the computation at the end of the measurement period */
+struct bts_ul_meas_hist {
+	uint16_t ber10k;
+	int16_t ta_offs_256bits;
+	uint8_t inv_rssi;
+	uint8_t is_sub:1;
+};
+
 struct bts_ul_meas {
 	/* BER in units of 0.01%: 10.000 == 100% ber, 0 == 0% ber */
 	uint16_t ber10k;
@@ -207,9 +222,28 @@ struct gsm_lchan {
 		uint8_t flags;
 		/* RSL measurement result number, 0 at lchan_act */
 		uint8_t res_nr;
-		/* number of measurements stored in array below */
+		/* pre-built start of the RSL MEASurement RESult, see rsl_meas_res_enc() */
+		uint8_t res_tmpl[8];
+		/* number of measurements received in this measurement period */
 		uint8_t num_ul_meas;
-		struct bts_ul_meas uplink[MAX_NUM_UL_MEAS];
+		/* running sums over the measurements which take part in the
+		 * computation, i.e. the last lchan_meas_num_expected() ones */
+		struct {
+			uint32_t ber_full_sum;
+			uint32_t ber_sub_sum;
+			uint32_t irssi_full_sum;
+			uint32_t irssi_sub_sum;
+			int32_t ta256b_sum;
+			uint64_t ta256b_sq_sum;
+			int16_t ta256b_min;
+			int16_t ta256b_max;
+			uint8_t num_sub;
+			/* older measurements have left the window, min/max are stale */
+			bool window_moved;
+		} ul_acc;
+		/* the most recent measurements, indexed by num_ul_meas modulo
+		 * UL_MEAS_WINDOW, to take them out of the sums again */
+		struct bts_ul_meas_hist ul_hist[UL_MEAS_WINDOW];
 		/* last L1 header from the MS */
 		uint8_t l1_info[2];
 		struct gsm_meas_rep_unidir ul_res;
@@ -229,7 +263,7 @@ struct gsm_lchan {
 	struct {
 		struct amr_multirate_conf amr_mr;
 		struct {
-			struct osmo_fsm_inst *dl_amr_fsm;
+			struct dtx_dl_amr_sm dl_amr_sm;
 			/* TCH cache */
 			uint8_t cache[20];
 			/* FACCH cache */
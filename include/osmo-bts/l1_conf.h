@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+
+/* Tracking of the request primitives sent to a DSP that still wait for
+ * their confirmation, as used by the sysmoBTS, Litecell 1.5 and OC-2G.
+ * Pending requests are hashed by (confirmation primitive, hLayer3). */
+
+struct gsm_bts_trx;
+struct msgb;
+struct rate_ctr_group;
+
+enum l1_conf_class {
+	L1_CONF_C_SYS,		/* system primitives */
+	L1_CONF_C_PHY,		/* L1 primitives concerning the whole PHY */
+	L1_CONF_C_LCHAN,	/* L1 primitives concerning a logical channel */
+	_NUM_L1_CONF_C
+};
+
+extern const struct value_string l1_conf_class_names[];
+
+#define L1_CONF_TIMEOUT_MS_DEFAULT	30000
+#define L1_CONF_HASH_BITS		6
+
+typedef int l1_conf_cb(struct gsm_bts_trx *trx, struct msgb *l1_msg, void *data);
+
+struct l1_conf;
+
+struct l1_conf_wait {
+	struct llist_head list;		/* hash bucket, or free list of the pool */
+	struct osmo_timer_list timer;	/* timer for L1 timeout */
+	struct l1_conf *lc;
+	unsigned int conf_prim_id;	/* primitive we expect in response */
+	uint32_t conf_hLayer3;		/* layer 3 handle we expect in response */
+	bool is_sys_prim;		/* is this a system or L1 primitive */
+	enum l1_conf_class cls;
+	struct timespec tx_time;	/* when the request was sent */
+	l1_conf_cb *cb;
+	void *cb_data;
+};
+
+/* called when a confirmation did not arrive in time */
+typedef void l1_conf_timeout_cb(struct l1_conf_wait *wlc);
+
+struct l1_conf {
+	struct llist_head hash[1 << L1_CONF_HASH_BITS];
+	struct llist_head pool;
+	unsigned int timeout_ms[_NUM_L1_CONF_C];
+	l1_conf_timeout_cb *timeout_cb;
+	struct rate_ctr_group *ctrs;
+};
+
+struct l1_conf *l1_conf_alloc(void *ctx, unsigned int ctr_idx,
+			      l1_conf_timeout_cb *timeout_cb);
+void l1_conf_set_timeout(struct l1_conf *lc, enum l1_conf_class cls,
+			 unsigned int timeout_ms);
+struct l1_conf_wait *l1_conf_add(struct l1_conf *lc, enum l1_conf_class cls,
+				 bool is_sys_prim, unsigned int conf_prim_id,
+				 uint32_t conf_hLayer3, l1_conf_cb *cb, void *cb_data);
+struct l1_conf_wait *l1_conf_take(struct l1_conf *lc, bool is_sys_prim,
+				  unsigned int conf_prim_id, uint32_t conf_hLayer3);
+void l1_conf_release(struct l1_conf_wait *wlc);
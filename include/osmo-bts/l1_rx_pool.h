@@ -0,0 +1,22 @@
+#pragma once
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+
+/* Pool of receive buffers for a PHY read queue, as used by the sysmoBTS,
+ * Litecell 1.5 and OC-2G DSP transports and by the virtual Um socket.
+ * Buffers are talloc children of the pool. Whoever ends up owning a
+ * received message still calls msgb_free() on it, the buffer then goes
+ * back into the pool instead of being freed. */
+
+struct l1_rx_pool;
+
+struct l1_rx_pool *l1_rx_pool_alloc(void *ctx, unsigned int buf_size,
+				    unsigned int headroom, unsigned int max_free,
+				    unsigned int ctr_idx);
+void l1_rx_pool_release(struct l1_rx_pool *pool);
+
+struct msgb *l1_rx_pool_get(struct l1_rx_pool *pool);
+void l1_rx_pool_account(struct l1_rx_pool *pool, unsigned int count,
+			unsigned int batch);
+void l1_rx_pool_backoff(struct l1_rx_pool *pool, struct osmo_fd *ofd);
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <osmocom/core/write_queue.h>
+
+/* Vectored writer for the osmo_wqueue of a DSP message queue device, as
+ * used by the sysmoBTS, Litecell 1.5 and OC-2G transports. Every queued
+ * msgb carries one primitive between msg->l1h and msg->tail. */
+
+/* Depth of a DSP write queue, a full queue is passed to a single writev() */
+#define L1_WQUEUE_LEN	64
+
+int l1_wqueue_init(struct osmo_wqueue *wq, void *ctx, int max_length,
+		   unsigned int ctr_idx);
+void l1_wqueue_release(struct osmo_wqueue *wq);
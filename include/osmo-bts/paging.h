@@ -43,6 +43,9 @@ int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
 int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *gt,
 		   int *is_empty);
 
+/* must the paging block for given gsm time be used for paging? */
+int paging_group_urgent(struct paging_state *ps, struct gsm_time *gt);
+
 
 /* inspection methods below */
 int paging_group_queue_empty(struct paging_state *ps, uint8_t group);
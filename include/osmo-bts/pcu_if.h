@@ -24,4 +24,18 @@ void pcu_sock_exit(void);
 
 bool pcu_connected(void);
 
+/* shared memory PDTCH data plane, see pcuif_proto.h */
+struct pcu_shm;
+struct gsm_pcu_if_shm_rec;
+struct gsm_pcu_if_shm_cnf;
+typedef int pcu_shm_rx_cb(void *data, uint8_t trx_nr, uint8_t ts_nr,
+			  const struct gsm_pcu_if_shm_rec *rec);
+
+struct pcu_shm *pcu_shm_alloc(void *ctx, unsigned int num_trx, pcu_shm_rx_cb *rx_cb, void *rx_data);
+void pcu_shm_free(struct pcu_shm *shm);
+void pcu_shm_cnf(const struct pcu_shm *shm, struct gsm_pcu_if_shm_cnf *cnf, int fds[3]);
+int pcu_shm_tx(struct pcu_shm *shm, uint8_t trx_nr, uint8_t ts_nr,
+	       const struct gsm_pcu_if_shm_rec *rec);
+void pcu_shm_flush(struct pcu_shm *shm);
+
 #endif /* _PCU_IF_H */
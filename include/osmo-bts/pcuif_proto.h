@@ -5,7 +5,7 @@
 
 #define PCU_SOCK_DEFAULT	"/tmp/pcu_bts"
 
-#define PCU_IF_VERSION		0x09
+#define PCU_IF_VERSION		0x0a
 #define TXT_MAX_LEN	128
 
 /* msg_type */
@@ -16,12 +16,16 @@
 #define PCU_IF_MSG_APP_INFO_REQ	0x04	/* BTS asks PCU to tranmit APP INFO via PACCH */
 #define PCU_IF_MSG_RTS_REQ	0x10	/* ready to send request */
 #define PCU_IF_MSG_DATA_CNF_DT	0x11	/* confirm (with direct tlli) */
+#define PCU_IF_MSG_RTS_BATCH_REQ 0x12	/* ready to send request for several TS */
 #define PCU_IF_MSG_RACH_IND	0x22	/* receive RACH */
 #define PCU_IF_MSG_INFO_IND	0x32	/* retrieve BTS info */
 #define PCU_IF_MSG_ACT_REQ	0x40	/* activate/deactivate PDCH */
 #define PCU_IF_MSG_TIME_IND	0x52	/* GSM time indication */
 #define PCU_IF_MSG_PAG_REQ	0x60	/* paging request */
 #define PCU_IF_MSG_TXT_IND	0x70	/* Text indication for BTS */
+#define PCU_IF_MSG_SHM_REQ	0x80	/* PCU requests the shared memory data plane */
+#define PCU_IF_MSG_SHM_CNF	0x81	/* BTS provides the shared memory data plane */
+#define PCU_IF_MSG_FEAT_REQ	0x82	/* PCU enables optional features */
 
 /* sapi */
 #define PCU_IF_SAPI_RACH	0x01	/* channel request on CCCH */
@@ -36,6 +40,9 @@
 /* flags */
 #define PCU_IF_FLAG_ACTIVE	(1 << 0)/* BTS is active */
 #define PCU_IF_FLAG_SYSMO	(1 << 1)/* access PDCH of sysmoBTS directly */
+#define PCU_IF_FLAG_SHM		(1 << 2)/* BTS offers the shared memory data plane */
+#define PCU_IF_FLAG_SPARSE_TIME	(1 << 3)/* BTS may send TIME.IND once per 52-multiframe */
+#define PCU_IF_FLAG_RTS_BATCH	(1 << 4)/* BTS may aggregate RTS.req per TRX */
 #define PCU_IF_FLAG_CS1		(1 << 16)
 #define PCU_IF_FLAG_CS2		(1 << 17)
 #define PCU_IF_FLAG_CS3		(1 << 18)
@@ -100,6 +107,17 @@ struct gsm_pcu_if_rts_req {
 	uint8_t		block_nr;
 } __attribute__ ((packed));
 
+/* RTS for all PDCH timeslots of a TRX in one block period */
+struct gsm_pcu_if_rts_batch_req {
+	uint8_t		sapi;
+	uint8_t		ts_mask;	/* bit n set: RTS for ts_nr n */
+	uint8_t		spare[2];
+	uint32_t	fn;
+	uint16_t	arfcn;
+	uint8_t		trx_nr;
+	uint8_t		block_nr;
+} __attribute__ ((packed));
+
 struct gsm_pcu_if_rach_ind {
 	uint8_t		sapi;
 	uint16_t	ra;
@@ -189,6 +207,77 @@ struct gsm_pcu_if_susp_req {
 	uint8_t		cause;
 } __attribute__ ((packed));
 
+/* PCU enables a subset of the optional features offered in INFO.ind:
+ * PCU_IF_FLAG_SPARSE_TIME: TIME.IND is only sent on FN % 52 == 0, and when the
+ *	FN does not advance as expected; the PCU extrapolates in between.
+ * PCU_IF_FLAG_RTS_BATCH: RTS.req of a TRX for the same FN and SAPI are sent
+ *	as one RTS_BATCH.req. */
+struct gsm_pcu_if_feat_req {
+	uint32_t	flags;
+} __attribute__ ((packed));
+
+/* PCU asks the BTS to exchange PDTCH/PTCCH data via shared memory */
+struct gsm_pcu_if_shm_req {
+	uint8_t		if_version;	/* PCU_IF_VERSION of the PCU */
+	uint8_t		version;	/* PCU_IF_SHM_VERSION */
+} __attribute__ ((packed));
+
+/* BTS confirms the shared memory data plane.  The message carries three file
+ * descriptors (SCM_RIGHTS): the shared memory, the eventfd the BTS signals
+ * the PCU with, and the eventfd the PCU signals the BTS with. */
+struct gsm_pcu_if_shm_cnf {
+	uint8_t		version;	/* PCU_IF_SHM_VERSION */
+	uint8_t		num_trx;	/* number of TRX, with 8 TS each */
+	uint16_t	ring_len;	/* PCU_IF_SHM_RING_LEN */
+	uint32_t	size;		/* size of the shared memory */
+} __attribute__ ((packed));
+
+/*
+ * Shared memory data plane
+ *
+ * Once negotiated, DATA.req, DATA.ind and RTS.req for PDTCH and PTCCH are
+ * exchanged as compact records in single-producer/single-consumer rings, one
+ * pair per timeslot, instead of full gsm_pcu_if primitives on the socket.
+ * Everything else stays on the socket.  While the data plane is in use, its
+ * records are never sent on the socket: if a ring is full, the BTS holds the
+ * records back until the PCU has caught up, so they arrive in order.  The
+ * PCU maps the rings only after the SHM_CNF, which is queued behind all
+ * primitives sent before it.  A producer signals the consumer's
+ * eventfd only when it adds a record to an empty ring; the consumer drains
+ * all rings of its direction when signalled.
+ */
+#define PCU_IF_SHM_VERSION	1
+#define PCU_IF_SHM_MIN_IF_VERSION 0x0a	/* first PCU_IF_VERSION with SHM_REQ/CNF */
+#define PCU_IF_SHM_RING_LEN	64	/* records per ring, power of two */
+
+struct gsm_pcu_if_shm_rec {
+	uint8_t		msg_type;	/* PCU_IF_MSG_{DATA_REQ,DATA_IND,RTS_REQ} */
+	uint8_t		sapi;		/* PCU_IF_SAPI_{PDTCH,PTCCH} */
+	uint8_t		len;
+	uint8_t		block_nr;
+	uint32_t	fn;
+	int8_t		rssi;
+	uint8_t		spare;
+	uint16_t	ber10k;
+	int16_t		ta_offs_qbits;
+	int16_t		lqual_cb;
+	uint8_t		data[162];
+};
+
+struct gsm_pcu_if_shm_ring {
+	uint32_t	head;		/* next record to write, only written by the producer */
+	uint8_t		spare_head[60];	/* keep head and tail on separate cache lines */
+	uint32_t	tail;		/* next record to read, only written by the consumer */
+	uint8_t		spare_tail[60];
+	struct gsm_pcu_if_shm_rec rec[PCU_IF_SHM_RING_LEN];
+};
+
+/* The shared memory is an array of these, indexed by trx_nr * 8 + ts_nr */
+struct gsm_pcu_if_shm_ts {
+	struct gsm_pcu_if_shm_ring ul;	/* BTS -> PCU: DATA.ind, RTS.req */
+	struct gsm_pcu_if_shm_ring dl;	/* PCU -> BTS: DATA.req */
+};
+
 struct gsm_pcu_if {
 	/* context based information */
 	uint8_t		msg_type;	/* message type */
@@ -202,6 +291,7 @@ struct gsm_pcu_if {
 		struct gsm_pcu_if_data		data_ind;
 		struct gsm_pcu_if_susp_req	susp_req;
 		struct gsm_pcu_if_rts_req	rts_req;
+		struct gsm_pcu_if_rts_batch_req	rts_batch_req;
 		struct gsm_pcu_if_rach_ind	rach_ind;
 		struct gsm_pcu_if_txt_ind	txt_ind;
 		struct gsm_pcu_if_info_ind	info_ind;
@@ -209,6 +299,9 @@ struct gsm_pcu_if {
 		struct gsm_pcu_if_time_ind	time_ind;
 		struct gsm_pcu_if_pag_req	pag_req;
 		struct gsm_pcu_if_app_info_req	app_info_req;
+		struct gsm_pcu_if_shm_req	shm_req;
+		struct gsm_pcu_if_shm_cnf	shm_cnf;
+		struct gsm_pcu_if_feat_req	feat_req;
 	} u;
 } __attribute__ ((packed));
 
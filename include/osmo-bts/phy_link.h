@@ -5,12 +5,14 @@
 #include <osmocom/core/linuxlist.h>
 
 #include <osmo-bts/scheduler.h>
+#include <osmo-bts/l1_conf.h>
 
 #include <linux/if_packet.h>
 #include "btsconfig.h"
 
 struct gsm_bts_trx;
 struct virt_um_inst;
+struct vbts_loadgen;
 
 enum phy_link_type {
 	PHY_LINK_T_NONE,
@@ -58,7 +60,9 @@ struct phy_link {
 			uint16_t bts_mcast_port;
 			char *ms_mcast_group;		/* MS are listening to this group */
 			uint16_t ms_mcast_port;
+			unsigned int clock_speed;	/* multiple of real time, 0 for as fast as possible */
 			struct virt_um_inst *virt_um;
+			struct vbts_loadgen *loadgen;	/* synthetic uplink traffic */
 		} virt;
 		struct {
 			/* MAC address of the PHY */
@@ -76,6 +80,10 @@ struct phy_link {
 			bool tx_atten_flag;
 			uint32_t tx_atten_db;
 			bool over_sample_16x;
+			/* blocks of the TPACKET_V3 receive ring, 0 for none */
+			unsigned int rx_ring_blocks;
+			/* upper bound of the unacknowledged command window */
+			unsigned int cmd_window_max;
 #if OCTPHY_MULTI_TRX == 1
 			/* arfcn used by TRX with id 0 */
 			uint16_t center_arfcn;
@@ -106,6 +114,8 @@ struct phy_instance {
 			int clk_cal;
 			uint8_t clk_src;
 			char *calib_path;
+			uint8_t rx_batch;	/* prims read from a DSP queue per wakeup */
+			unsigned int conf_timeout_ms[_NUM_L1_CONF_C];	/* 0 for the default */
 
 			struct femtol1_hdl *hdl;
 		} sysmobts;
@@ -136,6 +146,8 @@ struct phy_instance {
 			uint8_t tx_pwr_adj_mode;	/* 0: no auto adjust power, 1: auto adjust power using RMS detector */
 			uint8_t tx_pwr_red_8psk;	/* 8-PSK maximum Tx power reduction level in dB */
 			uint8_t tx_c0_idle_pwr_red;	/* C0 idle slot Tx power reduction level in dB */
+			uint8_t rx_batch;		/* prims read from a DSP queue per wakeup */
+			unsigned int conf_timeout_ms[_NUM_L1_CONF_C];	/* 0 for the default */
 		} lc15;
                 struct {
                         /* configuration */
@@ -150,6 +162,8 @@ struct phy_instance {
                         uint8_t tx_pwr_adj_mode;        /* 0: no auto adjust power, 1: auto adjust power using RMS detector */
                         uint8_t tx_pwr_red_8psk;        /* 8-PSK maximum Tx power reduction level in dB */
                         uint8_t tx_c0_idle_pwr_red;     /* C0 idle slot Tx power reduction level in dB */
+                        uint8_t rx_batch;               /* prims read from a DSP queue per wakeup */
+                        unsigned int conf_timeout_ms[_NUM_L1_CONF_C];   /* 0 for the default */
                 } oc2g;
 	} u;
 };
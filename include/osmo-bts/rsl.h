@@ -45,6 +45,8 @@ void ipacc_dyn_pdch_complete(struct gsm_bts_trx_ts *ts, int rc);
 
 int rsl_tx_cbch_load_indication(struct gsm_bts *bts, bool ext_cbch, bool overflow, uint8_t amount);
 
+struct msgb *rsl_meas_res_enc(struct gsm_lchan *lchan, const uint8_t *l3, int l3_len,
+			      const struct lapdm_entity *le);
 int rsl_tx_meas_res(struct gsm_lchan *lchan, uint8_t *l3, int l3_len, const struct lapdm_entity *le);
 
 #endif // _RSL_H */
@@ -139,6 +139,8 @@ struct l1sched_ts {
 	const struct trx_sched_frame *mf_frames; /* pointer to frame layout */
 
 	struct llist_head	dl_prims;	/* Queue primitives for TX */
+	struct llist_head	pdtch_prefetch;	/* PDTCH blocks for TX, sorted by FN */
+	unsigned int		pdtch_prefetch_len;
 
 	struct rate_ctr_group	*ctrs;		/* rate counters */
 
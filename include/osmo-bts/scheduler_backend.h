@@ -39,6 +39,8 @@ extern const ubit_t _sched_tsc[8][26];
 extern const ubit_t _sched_egprs_tsc[8][78];
 extern const ubit_t _sched_sch_train[64];
 
+struct msgb *_sched_dequeue_pdtch(struct l1sched_trx *l1t, int8_t tn, uint32_t fn,
+				  enum trx_chan_type chan);
 struct msgb *_sched_dequeue_prim(struct l1sched_trx *l1t, int8_t tn, uint32_t fn,
 				 enum trx_chan_type chan);
 
@@ -36,6 +36,7 @@
 #include <osmocom/core/select.h>
 #include <osmocom/core/timer.h>
 #include <osmocom/core/msgb.h>
+#include <osmocom/core/talloc.h>
 #include <osmocom/core/signal.h>
 #include <osmocom/core/macaddr.h>
 #include <osmocom/abis/abis.h>
@@ -50,7 +51,19 @@
 #include <osmo-bts/oml.h>
 #include <osmo-bts/bts_model.h>
 
-static struct gsm_bts *g_bts;
+/* Per-BTS Abis state.  libosmo-abis only hands the e1inp_line to the
+ * callbacks, the line_ops it was bound to lead back to the BTS.  This way
+ * one process can run the Abis links of several BTS (osmo-bts-omldummy). */
+struct abis_link {
+	struct e1inp_line_ops line_ops;
+	struct ipaccess_unit dev_info;
+	struct gsm_bts *bts;
+};
+
+static struct gsm_bts *line_bts(const struct e1inp_line *line)
+{
+	return container_of(line->ops, struct abis_link, line_ops)->bts;
+}
 
 int abis_oml_sendmsg(struct msgb *msg)
 {
@@ -98,6 +111,7 @@ int abis_bts_rsl_sendmsg(struct msgb *msg)
 static struct e1inp_sign_link *sign_link_up(void *unit, struct e1inp_line *line,
 					    enum e1inp_sign_type type)
 {
+	struct gsm_bts *bts = line_bts(line);
 	struct e1inp_sign_link *sign_link = NULL;
 	struct gsm_bts_trx *trx;
 	int trx_nr;
@@ -106,20 +120,20 @@ static struct e1inp_sign_link *sign_link_up(void *unit, struct e1inp_line *line,
 	case E1INP_SIGN_OML:
 		LOGP(DABIS, LOGL_INFO, "OML Signalling link up\n");
 		e1inp_ts_config_sign(&line->ts[E1INP_SIGN_OML-1], line);
-		sign_link = g_bts->oml_link =
+		sign_link = bts->oml_link =
 			e1inp_sign_link_create(&line->ts[E1INP_SIGN_OML-1],
-						E1INP_SIGN_OML, g_bts->c0, 255, 0);
-		if (clock_gettime(CLOCK_MONOTONIC, &g_bts->oml_conn_established_timestamp) != 0)
-			memset(&g_bts->oml_conn_established_timestamp, 0,
-			       sizeof(g_bts->oml_conn_established_timestamp));
-		drain_oml_queue(g_bts);
-		bts_link_estab(g_bts);
+						E1INP_SIGN_OML, bts->c0, 255, 0);
+		if (clock_gettime(CLOCK_MONOTONIC, &bts->oml_conn_established_timestamp) != 0)
+			memset(&bts->oml_conn_established_timestamp, 0,
+			       sizeof(bts->oml_conn_established_timestamp));
+		drain_oml_queue(bts);
+		bts_link_estab(bts);
 		break;
 	default:
 		trx_nr = type - E1INP_SIGN_RSL;
 		LOGP(DABIS, LOGL_INFO, "RSL Signalling link for TRX%d up\n",
 			trx_nr);
-		trx = gsm_bts_trx_num(g_bts, trx_nr);
+		trx = gsm_bts_trx_num(bts, trx_nr);
 		if (!trx) {
 			LOGP(DABIS, LOGL_ERROR, "TRX%d does not exist!\n",
 				trx_nr);
@@ -139,36 +153,37 @@ static struct e1inp_sign_link *sign_link_up(void *unit, struct e1inp_line *line,
 
 static void sign_link_down(struct e1inp_line *line)
 {
+	struct gsm_bts *bts = line_bts(line);
 	struct gsm_bts_trx *trx;
 	LOGPIL(line, DABIS, LOGL_ERROR, "Signalling link down\n");
 
 	/* First remove the OML signalling link */
-	if (g_bts->oml_link) {
+	if (bts->oml_link) {
 		struct timespec now;
 
-		e1inp_sign_link_destroy(g_bts->oml_link);
+		e1inp_sign_link_destroy(bts->oml_link);
 
 		/* Log a special notice if the OML connection was dropped relatively quickly. */
-		if (g_bts->oml_conn_established_timestamp.tv_sec != 0 && clock_gettime(CLOCK_MONOTONIC, &now) == 0 &&
-		    g_bts->oml_conn_established_timestamp.tv_sec + OSMO_BTS_OML_CONN_EARLY_DISCONNECT >= now.tv_sec) {
+		if (bts->oml_conn_established_timestamp.tv_sec != 0 && clock_gettime(CLOCK_MONOTONIC, &now) == 0 &&
+		    bts->oml_conn_established_timestamp.tv_sec + OSMO_BTS_OML_CONN_EARLY_DISCONNECT >= now.tv_sec) {
 			LOGP(DABIS, LOGL_FATAL, "OML link was closed early within %" PRIu64 " seconds. "
 			"If this situation persists, please check your BTS and BSC configuration files for errors. "
 			"A common error is a mismatch between unit_id configuration parameters of BTS and BSC.\n",
-			(uint64_t)(now.tv_sec - g_bts->oml_conn_established_timestamp.tv_sec));
+			(uint64_t)(now.tv_sec - bts->oml_conn_established_timestamp.tv_sec));
 		}
 	}
-	g_bts->oml_link = NULL;
-	memset(&g_bts->oml_conn_established_timestamp, 0, sizeof(g_bts->oml_conn_established_timestamp));
+	bts->oml_link = NULL;
+	memset(&bts->oml_conn_established_timestamp, 0, sizeof(bts->oml_conn_established_timestamp));
 
 	/* Then iterate over the RSL signalling links */
-	llist_for_each_entry(trx, &g_bts->trx_list, list) {
+	llist_for_each_entry(trx, &bts->trx_list, list) {
 		if (trx->rsl_link) {
 			e1inp_sign_link_destroy(trx->rsl_link);
 			trx->rsl_link = NULL;
 		}
 	}
 
-	bts_model_abis_close(g_bts);
+	bts_model_abis_close(bts);
 }
 
 
@@ -233,60 +248,72 @@ static int inp_s_cbfn(unsigned int subsys, unsigned int signal,
 }
 
 
-static struct ipaccess_unit bts_dev_info = {
-	.unit_name	= "sysmoBTS",
-	.equipvers	= "",	/* FIXME: read this from hw */
-	.swversion	= PACKAGE_VERSION,
-	.location1	= "",
-	.location2	= "",
-	.serno		= "",
-};
-
-static struct e1inp_line_ops line_ops = {
-	.cfg = {
-		.ipa = {
-			.role	= E1INP_LINE_R_BTS,
-			.dev	= &bts_dev_info,
-		},
-	},
-	.sign_link_up	= sign_link_up,
-	.sign_link_down	= sign_link_down,
-	.sign_link	= sign_link_cb,
-};
-
 void abis_init(struct gsm_bts *bts)
 {
-	g_bts = bts;
+	static bool initialized = false;
+
+	/* with several BTS in one process, this is called once per BTS */
+	if (initialized)
+		return;
+	initialized = true;
 
 	oml_init(&bts->mo);
 	libosmo_abis_init(tall_bts_ctx);
 
-	osmo_signal_register_handler(SS_L_INPUT, &inp_s_cbfn, bts);
+	osmo_signal_register_handler(SS_L_INPUT, &inp_s_cbfn, NULL);
 }
 
 struct e1inp_line *abis_open(struct gsm_bts *bts, char *dst_host,
 			     char *model_name)
 {
+	/* the first BTS uses line 0, as it always did */
+	static unsigned int next_line_nr = 0;
+	struct abis_link *link;
+	struct ipaccess_unit *dev_info;
 	struct e1inp_line *line;
 
+	link = talloc_zero(bts, struct abis_link);
+	if (!link)
+		return NULL;
+	link->bts = bts;
+	dev_info = &link->dev_info;
+
 	/* patch in various data from VTY and other sources */
-	line_ops.cfg.ipa.addr = dst_host;
-	osmo_get_macaddr(bts_dev_info.mac_addr, "eth0");
-	bts_dev_info.site_id = bts->ip_access.site_id;
-	bts_dev_info.bts_id = bts->ip_access.bts_id;
-	bts_dev_info.unit_name = model_name;
+	link->line_ops = (struct e1inp_line_ops) {
+		.cfg = {
+			.ipa = {
+				.role	= E1INP_LINE_R_BTS,
+				.addr	= dst_host,
+				.dev	= dev_info,
+			},
+		},
+		.sign_link_up	= sign_link_up,
+		.sign_link_down	= sign_link_down,
+		.sign_link	= sign_link_cb,
+	};
+	dev_info->equipvers = "";	/* FIXME: read this from hw */
+	dev_info->swversion = PACKAGE_VERSION;
+	dev_info->location1 = "";
+	dev_info->serno = "";
+	osmo_get_macaddr(dev_info->mac_addr, "eth0");
+	dev_info->site_id = bts->ip_access.site_id;
+	dev_info->bts_id = bts->ip_access.bts_id;
+	dev_info->unit_name = model_name;
 	if (bts->description)
-		bts_dev_info.unit_name = bts->description;
-	bts_dev_info.location2 = model_name;
+		dev_info->unit_name = bts->description;
+	dev_info->location2 = model_name;
 
-	line = e1inp_line_find(0);
+	line = e1inp_line_find(next_line_nr);
 	if (line)
 		e1inp_line_get(line); /* We want a new reference for returned line */
 	else
-		line = e1inp_line_create(0, "ipa"); /* already comes with a reference */
-	if (!line)
+		line = e1inp_line_create(next_line_nr, "ipa"); /* already comes with a reference */
+	if (!line) {
+		talloc_free(link);
 		return NULL;
-	e1inp_line_bind_ops(line, &line_ops);
+	}
+	next_line_nr++;
+	e1inp_line_bind_ops(line, &link->line_ops);
 
 	/* This will open the OML connection now */
 	if (e1inp_line_update(line) < 0)
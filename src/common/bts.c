@@ -81,6 +81,7 @@ static int bts_signal_cbfn(unsigned int subsys, unsigned int signal,
 		struct gsm_bts *bts = signal_data;
 
 		bts_update_agch_max_queue_length(bts);
+		bts_sysinfo_update_bcch(bts);
 	}
 	return 0;
 }
@@ -99,6 +100,12 @@ static const struct rate_ctr_desc bts_ctr_desc[] = {
 	[BTS_CTR_AGCH_RCVD] =		{"agch:rcvd", "Received AGCH requests (Abis)"},
 	[BTS_CTR_AGCH_SENT] =		{"agch:sent", "Sent AGCH requests (Abis)"},
 	[BTS_CTR_AGCH_DELETED] =	{"agch:delete", "Sent AGCH DELETE IND (Abis)"},
+	[BTS_CTR_AGCH_DEL_EXPIRED] =	{"agch:delete:expired", "Deleted AGCH messages, MS stopped waiting (T3126)"},
+	[BTS_CTR_AGCH_DEL_CONGESTION] =	{"agch:delete:congestion", "Deleted AGCH messages, queue above high water mark"},
+	[BTS_CTR_AGCH_DEL_FULL] =	{"agch:delete:full", "Deleted AGCH messages, queue full"},
+	[BTS_CTR_AGCH_REFUSED_FULL] =	{"agch:refused:full", "Refused AGCH messages, queue full"},
+	[BTS_CTR_AGCH_PCH_PREEMPT] =	{"agch:pch_preempt", "Sent AGCH messages in place of pending paging (Um)"},
+	[BTS_CTR_PAGING_EXPIRED] =	{"paging:expired", "Expired paging requests before being sent (Um)"},
 };
 static const struct rate_ctr_group_desc bts_ctrg_desc = {
 	"bts",
@@ -276,6 +283,7 @@ int bts_init(struct gsm_bts *bts)
 {
 	int rc, i;
 	static int initialized = 0;
+	unsigned int ctr_idx;
 	void *tall_rtp_ctx;
 
 	/* add to list of BTSs */
@@ -284,9 +292,14 @@ int bts_init(struct gsm_bts *bts)
 	bts->band = GSM_BAND_1800;
 
 	INIT_LLIST_HEAD(&bts->agch_queue.queue);
+	INIT_LLIST_HEAD(&bts->agch_queue.rej_queue);
 	bts->agch_queue.length = 0;
+	bts->agch_queue.max_age = GSM_BTS_AGCH_MAX_AGE_DEFAULT;
 
-	bts->ctrs = rate_ctr_group_alloc(bts, &bts_ctrg_desc, bts->nr);
+	/* Several BTS in one process (osmo-bts-omldummy) may share the same
+	 * bts->nr, the counter groups are indexed in order of bts_init() */
+	ctr_idx = bts_gsmnet.num_bts;
+	bts->ctrs = rate_ctr_group_alloc(bts, &bts_ctrg_desc, ctr_idx);
 	if (!bts->ctrs) {
 		llist_del(&bts->list);
 		return -1;
@@ -336,11 +349,6 @@ int bts_init(struct gsm_bts *bts)
 	oml_mo_state_init(&bts->gprs.nsvc[0].mo, -1, NM_AVSTATE_DEPENDENCY);
 	oml_mo_state_init(&bts->gprs.nsvc[1].mo, NM_OPSTATE_DISABLED, NM_AVSTATE_OFF_LINE);
 
-	/* allocate a talloc pool for ORTP to ensure it doesn't have to go back
-	 * to the libc malloc all the time */
-	tall_rtp_ctx = talloc_pool(tall_bts_ctx, 262144);
-	osmo_rtp_init(tall_rtp_ctx);
-
 	/* features implemented in 'common', available for all models */
 	osmo_bts_set_feature(bts->features, BTS_FEAT_ETWS_PN);
 
@@ -356,14 +364,18 @@ int bts_init(struct gsm_bts *bts)
 
 	if (!initialized) {
 		osmo_signal_register_handler(SS_GLOBAL, bts_signal_cbfn, NULL);
+		/* allocate a talloc pool for ORTP to ensure it doesn't have to go back
+		 * to the libc malloc all the time */
+		tall_rtp_ctx = talloc_pool(tall_bts_ctx, 262144);
+		osmo_rtp_init(tall_rtp_ctx);
 		initialized = 1;
 	}
 
-	INIT_LLIST_HEAD(&bts->smscb_basic.queue);
-	bts->smscb_basic.ctrs = rate_ctr_group_alloc(bts, &cbch_ctrg_desc, 0);
+	bts_smscb_state_init(&bts->smscb_basic);
+	bts->smscb_basic.ctrs = rate_ctr_group_alloc(bts, &cbch_ctrg_desc, ctr_idx * 2);
 	OSMO_ASSERT(bts->smscb_basic.ctrs);
-	INIT_LLIST_HEAD(&bts->smscb_extended.queue);
-	bts->smscb_extended.ctrs = rate_ctr_group_alloc(bts, &cbch_ctrg_desc, 1);
+	bts_smscb_state_init(&bts->smscb_extended);
+	bts->smscb_extended.ctrs = rate_ctr_group_alloc(bts, &cbch_ctrg_desc, ctr_idx * 2 + 1);
 	OSMO_ASSERT(bts->smscb_extended.ctrs);
 	bts->smscb_queue_max_len = 15;
 	bts->smscb_queue_tgt_len = 2;
@@ -371,10 +383,6 @@ int bts_init(struct gsm_bts *bts)
 
 	INIT_LLIST_HEAD(&bts->oml_queue);
 
-	/* register DTX DL FSM */
-	rc = osmo_fsm_register(&dtx_dl_amr_fsm);
-	OSMO_ASSERT(rc == 0);
-
 	bts->fn_stats.min = INT32_MAX;
 	bts->fn_stats.max = INT32_MIN;
 	bts->fn_stats.avg_count = 0;
@@ -558,10 +566,23 @@ int lchan_init_lapdm(struct gsm_lchan *lchan)
 #define CCCH_RACH_RATIO_COMBINED256      (256*1/9)
 #define CCCH_RACH_RATIO_SEPARATE256      (256*10/55)
 
+/* look up S for a given Tx-integer T, see GSM 04.08, 3.3.1.1.2 */
+static int rach_s_value(int T, int is_ccch_comb)
+{
+	int i, T_group = 0;
+
+	for (i = 0; i < ARRAY_SIZE(tx_integer); i++) {
+		if (tx_integer[i] == T) {
+			T_group = i % 5;
+			break;
+		}
+	}
+	return s_values[T_group][is_ccch_comb];
+}
+
 int bts_agch_max_queue_length(int T, int bcch_conf)
 {
-	int S, ccch_rach_ratio256, i;
-	int T_group = 0;
+	int S, ccch_rach_ratio256;
 	int is_ccch_comb = 0;
 
 	if (bcch_conf == RSL_BCCH_CCCH_CONF_1_C)
@@ -586,17 +607,36 @@ int bts_agch_max_queue_length(int T, int bcch_conf)
 		CCCH_RACH_RATIO_COMBINED256 :
 		CCCH_RACH_RATIO_SEPARATE256;
 
-	for (i = 0; i < ARRAY_SIZE(tx_integer); i++) {
-		if (tx_integer[i] == T) {
-			T_group = i % 5;
-			break;
-		}
-	}
-	S = s_values[T_group][is_ccch_comb];
+	S = rach_s_value(T, is_ccch_comb);
 
 	return (T + 2 * S) * ccch_rach_ratio256 / 256;
 }
 
+/* RACH slots per 51-multiframe on a combined CCCH+SDCCH/4 */
+#define RACH_SLOTS_COMBINED	27
+
+int bts_agch_max_age(int T, int bcch_conf)
+{
+	int S, age;
+	int is_ccch_comb = 0;
+
+	if (bcch_conf == RSL_BCCH_CCCH_CONF_1_C)
+		is_ccch_comb = 1;
+
+	/*
+	 * An AGCH message is useless once the MS has given up waiting for it.
+	 * The MS starts T3126 after its last CHANNEL REQUEST, and
+	 *   T3126 = min((T + 2*S) RACH slots, 5 s), as defined in GSM 04.08, 11.1.1
+	 * A non-combined CCCH has a RACH slot in every TDMA frame.
+	 */
+	S = rach_s_value(T, is_ccch_comb);
+	age = T + 2 * S;
+	if (is_ccch_comb)
+		age = age * 51 / RACH_SLOTS_COMBINED;
+
+	return OSMO_MIN(age, GSM_BTS_AGCH_MAX_AGE_DEFAULT);
+}
+
 static void bts_update_agch_max_queue_length(struct gsm_bts *bts)
 {
 	struct gsm48_system_information_type_3 *si3;
@@ -610,6 +650,9 @@ static void bts_update_agch_max_queue_length(struct gsm_bts *bts)
 	bts->agch_queue.max_length =
 		bts_agch_max_queue_length(si3->rach_control.tx_integer,
 					  si3->control_channel_desc.ccch_conf);
+	bts->agch_queue.max_age =
+		bts_agch_max_age(si3->rach_control.tx_integer,
+				 si3->control_channel_desc.ccch_conf);
 
 	if (bts->agch_queue.max_length != old_max_length)
 		LOGP(DRSL, LOGL_INFO, "Updated AGCH max queue length to %d\n",
@@ -743,60 +786,147 @@ static int try_merge_imm_ass_rej(struct gsm48_imm_ass_rej *old_rej,
 	return 0;
 }
 
-int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg)
+static int count_imm_ass_rej_refs(struct gsm48_imm_ass_rej *rej)
 {
-	int hard_limit = 100;
-	struct gsm48_imm_ass_rej *imm_ass_cmd = msgb_l3(msg);
+	struct gsm48_req_ref req_refs[REQ_REFS_PER_IMM_ASS_REJ];
+	uint8_t wait_inds[REQ_REFS_PER_IMM_ASS_REJ];
+
+	return extract_imm_ass_rej_refs(rej, req_refs, wait_inds);
+}
 
-	if (bts->agch_queue.length > hard_limit) {
-		LOGP(DSUM, LOGL_ERROR,
-		     "AGCH: too many messages in queue, "
-		     "refusing message type %s, length = %d/%d\n",
-		     gsm48_rr_msg_name(((struct gsm48_imm_ass *)msgb_l3(msg))->msg_type),
-		     bts->agch_queue.length, bts->agch_queue.max_length);
+/* The AGCH queue consists of two priority classes: IMMEDIATE ASSIGNMENTs
+ * (and anything else that is not a reject) in agch_queue.queue, and IMMEDIATE
+ * ASSIGNMENT REJECTs in agch_queue.rej_queue.  Each message remembers the
+ * (reduced) frame number of the RACH it refers to, so that it can be
+ * dropped as soon as the MS has stopped waiting for it. */
+#define agchmsg_ref_fn(x)	((x)->cb[0])
+#define agchmsg_has_ref(x)	((x)->cb[1])
 
-		bts->agch_queue.rejected_msgs++;
-		return -ENOMEM;
-	}
+#define AGCH_QUEUE_HARD_LIMIT	100
+/* modulus of the frame number as encoded in the Request Reference */
+#define AGCH_RFN_MODULUS	(26 * 51 * 32)
 
-	if (bts->agch_queue.length > 0) {
-		struct msgb *last_msg =
-			llist_entry(bts->agch_queue.queue.prev, struct msgb, list);
-		struct gsm48_imm_ass_rej *last_imm_ass_rej = msgb_l3(last_msg);
+static bool agch_msg_is_rej(struct msgb *msg)
+{
+	struct gsm48_imm_ass_rej *rej = msgb_l3(msg);
 
-		if (try_merge_imm_ass_rej(last_imm_ass_rej, imm_ass_cmd)) {
-			bts->agch_queue.merged_msgs++;
-			msgb_free(msg);
-			return 0;
-		}
-	}
+	return rej->msg_type == GSM48_MT_RR_IMM_ASS_REJ;
+}
 
-	msgb_enqueue(&bts->agch_queue.queue, msg);
-	bts->agch_queue.length++;
+static void agch_msg_set_ref(struct msgb *msg)
+{
+	struct gsm48_imm_ass *imm_ass = msgb_l3(msg);
+	struct gsm48_imm_ass_rej *rej = msgb_l3(msg);
+	struct gsm48_req_ref *ref;
+	struct gsm_time gt;
+
+	switch (imm_ass->msg_type) {
+	case GSM48_MT_RR_IMM_ASS:
+		ref = &imm_ass->req_ref;
+		break;
+	case GSM48_MT_RR_IMM_ASS_REJ:
+		ref = &rej->req_ref1;
+		break;
+	default:
+		agchmsg_has_ref(msg) = 0;
+		return;
+	}
 
-	return 0;
+	gt.t1 = ref->t1;
+	gt.t2 = ref->t2;
+	gt.t3 = (ref->t3_high << 3) | ref->t3_low;
+	agchmsg_ref_fn(msg) = gsm_gsmtime2fn(&gt);
+	agchmsg_has_ref(msg) = 1;
 }
 
-struct msgb *bts_agch_dequeue(struct gsm_bts *bts)
+/* number of frames elapsed since the RACH burst the message refers to */
+static int agch_msg_age(struct gsm_bts *bts, struct msgb *msg)
 {
-	struct msgb *msg = msgb_dequeue(&bts->agch_queue.queue);
-	if (!msg)
-		return NULL;
+	int age;
+
+	if (!agchmsg_has_ref(msg))
+		return 0;
+
+	age = (int)(bts->gsm_time.fn % AGCH_RFN_MODULUS) - (int)agchmsg_ref_fn(msg);
+	if (age < 0)
+		age += AGCH_RFN_MODULUS;
+	/* a reference from the future means our clocks disagree, keep it */
+	if (age > AGCH_RFN_MODULUS / 2)
+		age -= AGCH_RFN_MODULUS;
+
+	return age;
+}
 
+/* Remove a message from the AGCH queue and inform the BSC about it,
+ * cause_ctr is the BTS_CTR_AGCH_DEL_* counter to increment */
+static void agch_drop_msg(struct gsm_bts *bts, struct msgb *msg, int cause_ctr)
+{
+	llist_del(&msg->list);
 	bts->agch_queue.length--;
-	return msg;
+	if (!agch_msg_is_rej(msg))
+		bts->agch_queue.imm_ass_length--;
+	if (msg == bts->agch_queue.rej_partial)
+		bts->agch_queue.rej_partial = NULL;
+
+	rsl_tx_delete_ind(bts, msgb_l3(msg), msgb_l3len(msg));
+	rate_ctr_inc2(bts->ctrs, BTS_CTR_AGCH_DELETED);
+	rate_ctr_inc2(bts->ctrs, cause_ctr);
+	msgb_free(msg);
+
+	bts->agch_queue.dropped_msgs++;
+}
+
+/* Drop expired messages from the head of both classes.  Messages are
+ * queued roughly in order of their RACH, so this is O(1) amortized. */
+static void agch_expire(struct gsm_bts *bts)
+{
+	struct llist_head *queues[] = {
+		&bts->agch_queue.queue,
+		&bts->agch_queue.rej_queue,
+	};
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(queues); i++) {
+		while (!llist_empty(queues[i])) {
+			struct msgb *msg = llist_first_entry(queues[i], struct msgb, list);
+
+			if (agch_msg_age(bts, msg) <= bts->agch_queue.max_age)
+				break;
+			LOGP(DSUM, LOGL_INFO, "AGCH: dropping expired %s\n",
+			     gsm48_rr_msg_name(((struct gsm48_imm_ass *)msgb_l3(msg))->msg_type));
+			agch_drop_msg(bts, msg, BTS_CTR_AGCH_DEL_EXPIRED);
+		}
+	}
+}
+
+/* Drop the message of least value: the oldest IMM ASS REJ, or if there is
+ * none, the oldest IMM ASS (which is the closest one to its deadline). */
+static bool agch_drop_lowest_prio(struct gsm_bts *bts, int cause_ctr)
+{
+	if (!llist_empty(&bts->agch_queue.rej_queue)) {
+		agch_drop_msg(bts, llist_first_entry(&bts->agch_queue.rej_queue, struct msgb, list),
+			      cause_ctr);
+		return true;
+	}
+	if (!llist_empty(&bts->agch_queue.queue)) {
+		agch_drop_msg(bts, llist_first_entry(&bts->agch_queue.queue, struct msgb, list),
+			      cause_ctr);
+		return true;
+	}
+	return false;
 }
 
 /*
  * Remove lower prio messages if the queue has grown too long.
  *
- * \return 0 if the number of messages in the queue would fit into the AGCH
- *         reserved part of the CCCH.
+ * This is called once per enqueued message.  Instead of throwing a dice for
+ * every queued message, the drop probability of the new queue length is
+ * accumulated in drop_credit, and one message is dropped for every full unit
+ * of credit.
  */
 static void compact_agch_queue(struct gsm_bts *bts)
 {
-	struct msgb *msg, *msg2;
-	int max_len, slope, offs;
+	int max_len, slope, offs, p_drop;
 	int level_low = bts->agch_queue.low_level;
 	int level_high = bts->agch_queue.high_level;
 	int level_thres = bts->agch_queue.thresh_level;
@@ -806,8 +936,10 @@ static void compact_agch_queue(struct gsm_bts *bts)
 	if (max_len == 0)
 		max_len = 1;
 
-	if (bts->agch_queue.length < max_len * level_thres / 100)
+	if (bts->agch_queue.length < max_len * level_thres / 100) {
+		bts->agch_queue.drop_credit = 0;
 		return;
+	}
 
 	/* p^
 	 * 1+      /'''''
@@ -823,43 +955,155 @@ static void compact_agch_queue(struct gsm_bts *bts)
 	else
 		slope = 0x10000 * max_len; /* p_drop >= 1 if len > offs */
 
-	llist_for_each_entry_safe(msg, msg2, &bts->agch_queue.queue, list) {
-		struct gsm48_imm_ass *imm_ass_cmd = msgb_l3(msg);
-		int p_drop;
+	p_drop = (bts->agch_queue.length - offs) * slope / max_len;
+	if (p_drop <= 0)
+		return;
+
+	bts->agch_queue.drop_credit += p_drop;
+	while (bts->agch_queue.drop_credit >= 0x10000 && bts->agch_queue.length > offs) {
+		if (!agch_drop_lowest_prio(bts, BTS_CTR_AGCH_DEL_CONGESTION))
+			break;
+		bts->agch_queue.drop_credit -= 0x10000;
+	}
+
+	if (bts->agch_queue.length <= offs)
+		bts->agch_queue.drop_credit = 0;
+}
+
+int bts_agch_enqueue(struct gsm_bts *bts, struct msgb *msg)
+{
+	struct gsm48_imm_ass_rej *imm_ass_cmd = msgb_l3(msg);
+	bool is_rej = agch_msg_is_rej(msg);
+
+	agch_msg_set_ref(msg);
+	agch_expire(bts);
+
+	/* there is at most one IMM ASS REJ with free room in the queue */
+	if (is_rej && bts->agch_queue.rej_partial) {
+		struct gsm48_imm_ass_rej *partial_rej = msgb_l3(bts->agch_queue.rej_partial);
+
+		if (try_merge_imm_ass_rej(partial_rej, imm_ass_cmd)) {
+			bts->agch_queue.merged_msgs++;
+			if (count_imm_ass_rej_refs(partial_rej) == REQ_REFS_PER_IMM_ASS_REJ)
+				bts->agch_queue.rej_partial = NULL;
+			msgb_free(msg);
+			return 0;
+		}
+		/* the partial message is full now */
+		bts->agch_queue.rej_partial = NULL;
+	}
+
+	if (bts->agch_queue.length >= AGCH_QUEUE_HARD_LIMIT) {
+		/* an assignment is always worth more than a reject */
+		if (is_rej || llist_empty(&bts->agch_queue.rej_queue)) {
+			LOGP(DSUM, LOGL_ERROR,
+			     "AGCH: too many messages in queue, "
+			     "refusing message type %s, length = %d/%d\n",
+			     gsm48_rr_msg_name(((struct gsm48_imm_ass *)msgb_l3(msg))->msg_type),
+			     bts->agch_queue.length, bts->agch_queue.max_length);
+
+			bts->agch_queue.rejected_msgs++;
+			rate_ctr_inc2(bts->ctrs, BTS_CTR_AGCH_REFUSED_FULL);
+			return -ENOMEM;
+		}
+		agch_drop_lowest_prio(bts, BTS_CTR_AGCH_DEL_FULL);
+	}
+
+	if (is_rej) {
+		msgb_enqueue(&bts->agch_queue.rej_queue, msg);
+		if (count_imm_ass_rej_refs(imm_ass_cmd) < REQ_REFS_PER_IMM_ASS_REJ)
+			bts->agch_queue.rej_partial = msg;
+	} else {
+		msgb_enqueue(&bts->agch_queue.queue, msg);
+		bts->agch_queue.imm_ass_length++;
+	}
+	bts->agch_queue.length++;
 
-		p_drop = (bts->agch_queue.length - offs) * slope / max_len;
+	compact_agch_queue(bts);
 
-		if ((random() & 0xffff) >= p_drop)
-			return;
+	return 0;
+}
+
+struct msgb *bts_agch_dequeue(struct gsm_bts *bts)
+{
+	struct msgb *msg;
 
-		llist_del(&msg->list);
-		bts->agch_queue.length--;
-		rsl_tx_delete_ind(bts, (uint8_t *)imm_ass_cmd, msgb_l3len(msg));
-		rate_ctr_inc2(bts->ctrs, BTS_CTR_AGCH_DELETED);
-		msgb_free(msg);
+	agch_expire(bts);
+
+	msg = msgb_dequeue(&bts->agch_queue.queue);
+	if (msg)
+		bts->agch_queue.imm_ass_length--;
+	else
+		msg = msgb_dequeue(&bts->agch_queue.rej_queue);
+	if (!msg)
+		return NULL;
+
+	if (msg == bts->agch_queue.rej_partial)
+		bts->agch_queue.rej_partial = NULL;
+	bts->agch_queue.length--;
+	return msg;
+}
 
-		bts->agch_queue.dropped_msgs++;
+/* Check whether the IMM ASS at the head of the AGCH queue would miss its
+ * deadline if it had to wait for the blocks the AGCH can count on.  All queued
+ * IMM ASS are assumed to need one of those blocks before the oldest one
+ * expires, which errs on the side of serving the AGCH early.
+ *
+ * Those blocks are the reserved AGCH blocks.  Without any (BS_AG_BLKS_RES 0),
+ * the AGCH shares all CCCH blocks with the PCH, and only is urgent if it would
+ * miss its deadline even with every one of them. */
+static bool agch_is_urgent(struct gsm_bts *bts)
+{
+	struct gsm48_system_information_type_3 *si3;
+	int agch_blks = 1;
+	int slack;
+
+	agch_expire(bts);
+
+	if (llist_empty(&bts->agch_queue.queue))
+		return false;
+
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_3)) {
+		si3 = GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+		agch_blks = si3->control_channel_desc.bs_ag_blks_res;
+		if (agch_blks == 0)
+			agch_blks = si3->control_channel_desc.ccch_conf == RSL_BCCH_CCCH_CONF_1_C ?
+				3 : 9;
 	}
-	return;
+
+	/* frames left until the oldest IMM ASS is useless */
+	slack = bts->agch_queue.max_age -
+		agch_msg_age(bts, llist_first_entry(&bts->agch_queue.queue, struct msgb, list));
+
+	/* AGCH blocks left until then (agch_blks per 51-multiframe) */
+	return bts->agch_queue.imm_ass_length > slack * agch_blks / 51;
 }
 
+/*
+ * Fill one CCCH block.  Reserved AGCH blocks only ever carry AGCH messages.
+ * On paging blocks, paging takes precedence, unless an IMM ASS would miss its
+ * deadline while none of the pending paging records would miss its last paging
+ * occasion; the paging records are then sent at the next occurrence of their
+ * paging group instead.
+ */
 int bts_ccch_copy_msg(struct gsm_bts *bts, uint8_t *out_buf, struct gsm_time *gt,
 		      int is_ag_res)
 {
 	struct msgb *msg = NULL;
 	int rc = 0;
 	int is_empty = 1;
-
-	/* Do queue house keeping.
-	 * This needs to be done every time a CCCH message is requested, since
-	 * the queue max length is calculated based on the CCCH block rate and
-	 * PCH messages also reduce the drain of the AGCH queue.
-	 */
-	compact_agch_queue(bts);
-
-	/* Check for paging messages first if this is PCH */
-	if (!is_ag_res)
-		rc = paging_gen_msg(bts->paging_state, out_buf, gt, &is_empty);
+	bool preempt = false;
+
+	if (!is_ag_res) {
+		if (agch_is_urgent(bts) && !paging_group_urgent(bts->paging_state, gt)) {
+			preempt = true;
+			bts->load.ccch.pch_total += 1;
+			bts->load.ccch.pch_used += 1;
+		} else {
+			/* Check for paging messages first if this is PCH */
+			rc = paging_gen_msg(bts->paging_state, out_buf, gt, &is_empty);
+		}
+	}
 
 	/* Check whether the block may be overwritten */
 	if (!is_empty)
@@ -870,6 +1114,8 @@ int bts_ccch_copy_msg(struct gsm_bts *bts, uint8_t *out_buf, struct gsm_time *gt
 		return rc;
 
 	rate_ctr_inc2(bts->ctrs, BTS_CTR_AGCH_SENT);
+	if (preempt)
+		rate_ctr_inc2(bts->ctrs, BTS_CTR_AGCH_PCH_PREEMPT);
 
 	/* Copy AGCH message */
 	memcpy(out_buf, msgb_l3(msg), msgb_l3len(msg));
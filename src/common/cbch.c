@@ -21,6 +21,7 @@
 #include <errno.h>
 
 #include <osmocom/core/utils.h>
+#include <osmocom/core/bits.h>
 #include <osmocom/core/linuxlist.h>
 #include <osmocom/gsm/protocol/gsm_04_12.h>
 
@@ -29,13 +30,35 @@
 #include <osmo-bts/rsl.h>
 #include <osmo-bts/logging.h>
 
+/* CBCH messages are sent by priority, and within the same priority in the
+ * order in which they become due.  Messages the BSC sends again while they are
+ * still pending are not stored twice, but get another transmission, spaced by
+ * the repetition period of their priority. */
+enum smscb_prio {
+	SMSCB_PRIO_EMERGENCY,	/* ETWS, CMAS, EU-Alert (3GPP TS 23.041) */
+	SMSCB_PRIO_NORMAL,
+};
+
+/* minimum distance between two transmissions of the same message, in CBCH
+ * cycles of 8 multiframes */
+static const uint8_t smscb_rep_period[BTS_SMSCB_NUM_PRIO] = {
+	[SMSCB_PRIO_EMERGENCY]	= 1,
+	[SMSCB_PRIO_NORMAL]	= 2,
+};
+
 /* internal representation of one SMS-CB message (e.g. in the pending queue */
 struct smscb_msg {
-	struct llist_head list;		/* list in smscb_state.queue */
+	struct llist_head list;		/* list in smscb_state.index */
 
 	bool is_schedule;		/* is this a schedule message? */
-	uint8_t msg[GSM412_MSG_LEN];	/* message buffer */
+	bool in_store;			/* pending, i.e. in the index and a heap */
+	enum smscb_prio prio;
+	uint64_t key;			/* serial number, message identifier and page */
+	uint32_t due;			/* CBCH cycle of the next transmission */
+	uint32_t seq;
+	unsigned int reps;		/* further transmissions after the next one */
 	uint8_t num_segs;		/* total number of segments */
+	uint8_t blocks[4][GSM_MACBLOCK_LEN]; /* segmented message, block type included */
 };
 
 /* determine if current queue length differs more than permitted hysteresis from target
@@ -97,8 +120,6 @@ static int get_smscb_null_block(uint8_t *out)
 static int get_smscb_block(struct bts_smscb_state *bts_ss, uint8_t *out, uint8_t tb,
 			   const struct gsm_time *g_time)
 {
-	int to_copy;
-	struct gsm412_block_type *block_type;
 	struct smscb_msg *msg = bts_ss->cur_msg;
 	uint8_t block_nr = tb % 4;
 	const char *chan_name = tb_to_chan_str(tb);
@@ -117,47 +138,115 @@ static int get_smscb_block(struct bts_smscb_state *bts_ss, uint8_t *out, uint8_t
 		return get_smscb_null_block(out);
 	}
 
-	block_type = (struct gsm412_block_type *) out++;
+	memcpy(out, msg->blocks[block_nr], GSM_MACBLOCK_LEN);
 
-	/* LPD is always 01 */
-	block_type->spare = 0;
-	block_type->lpd = 1;
+	return block_nr + 1 == msg->num_segs;
+}
 
-	/* determine how much data to copy */
-	to_copy = GSM412_MSG_LEN - (block_nr * GSM412_BLOCK_LEN);
-	if (to_copy > GSM412_BLOCK_LEN)
-	to_copy = GSM412_BLOCK_LEN;
-	OSMO_ASSERT(to_copy >= 0);
+/* split the message into its blocks once, so that repetitions are plain copies */
+static void smscb_segment(struct smscb_msg *scm, const uint8_t *msg, uint8_t msg_len)
+{
+	uint8_t buf[GSM412_MSG_LEN];
+	struct gsm412_block_type *block_type;
+	unsigned int block_nr;
 
-	/* copy data and increment index */
-	memcpy(out, &msg->msg[block_nr * GSM412_BLOCK_LEN], to_copy);
+	/* initialize entire message with default padding */
+	memset(buf, GSM_MACBLOCK_PADDING, sizeof(buf));
+	memcpy(buf, msg, msg_len);
 
-	/* set + increment sequence number */
-	if (block_nr == 0 && msg->is_schedule)
-		block_type->seq_nr = 8;	/* first schedule block */
-	else
-		block_type->seq_nr = block_nr;
+	for (block_nr = 0; block_nr < scm->num_segs; block_nr++) {
+		block_type = (struct gsm412_block_type *) scm->blocks[block_nr];
 
-	/* determine if this is the last block */
-	if (block_nr + 1 == msg->num_segs)
-		block_type->lb = 1;
-	else
-		block_type->lb = 0;
-
-	if (block_nr == 4) {
-		if (msg != bts_ss->default_msg) {
-			DEBUGPGT(DLSMS, g_time, "%s: deleting fully-transmitted message %p\n",
-				 chan_name, msg);
-			/* delete any fully-transmitted normal message (or superseded default) */
-			talloc_free(bts_ss->cur_msg);
-			bts_ss->cur_msg = NULL;
-		} else {
-			DEBUGPGT(DLSMS, g_time, "%s: keeping fully-transmitted default message %p\n",
-				 chan_name, msg);
-		}
+		/* LPD is always 01 */
+		block_type->spare = 0;
+		block_type->lpd = 1;
+
+		/* set sequence number */
+		if (block_nr == 0 && scm->is_schedule)
+			block_type->seq_nr = 8;	/* first schedule block */
+		else
+			block_type->seq_nr = block_nr;
+
+		/* determine if this is the last block */
+		block_type->lb = (block_nr + 1 == scm->num_segs);
+
+		memcpy(&scm->blocks[block_nr][1], &buf[block_nr * GSM412_BLOCK_LEN], GSM412_BLOCK_LEN);
+	}
+}
+
+/* 3GPP TS 23.041 Section 9.4.1.2: the message identifier ranges reserved for
+ * ETWS, CMAS and other public warning systems */
+static enum smscb_prio smscb_msg_prio(const uint8_t *msg, uint8_t msg_len)
+{
+	uint16_t msg_id;
+
+	if (msg_len < 4)
+		return SMSCB_PRIO_NORMAL;
+	msg_id = osmo_load16be(&msg[2]);
+	if (msg_id >= 0x1100 && msg_id <= 0x18ff)
+		return SMSCB_PRIO_EMERGENCY;
+	return SMSCB_PRIO_NORMAL;
+}
+
+/* Serial number, message identifier and page parameter identify a page */
+static uint64_t smscb_msg_key(const uint8_t *msg)
+{
+	return ((uint64_t) osmo_load32be(msg) << 8) | msg[5];
+}
+
+static struct llist_head *smscb_index_bucket(struct bts_smscb_state *bts_ss, uint64_t key)
+{
+	return &bts_ss->index[(key ^ (key >> 24)) % BTS_SMSCB_INDEX_SIZE];
+}
+
+static bool smscb_before(const struct smscb_msg *a, const struct smscb_msg *b)
+{
+	if (a->due != b->due)
+		return (int32_t)(a->due - b->due) < 0;
+	return (int32_t)(a->seq - b->seq) < 0;
+}
+
+static void smscb_heap_push(struct bts_smscb_state *bts_ss, struct smscb_msg *scm)
+{
+	struct smscb_msg **heap = bts_ss->heap[scm->prio].msg;
+	unsigned int i = bts_ss->heap[scm->prio].len++;
+
+	OSMO_ASSERT(i < BTS_SMSCB_QUEUE_MAX);
+	scm->seq = bts_ss->seq++;
+	while (i > 0 && smscb_before(scm, heap[(i - 1) / 2])) {
+		heap[i] = heap[(i - 1) / 2];
+		i = (i - 1) / 2;
+	}
+	heap[i] = scm;
+}
+
+static struct smscb_msg *smscb_heap_pop(struct bts_smscb_state *bts_ss, enum smscb_prio prio)
+{
+	struct smscb_msg **heap = bts_ss->heap[prio].msg;
+	unsigned int len = --bts_ss->heap[prio].len;
+	struct smscb_msg *top = heap[0];
+	struct smscb_msg *last = heap[len];
+	unsigned int i = 0, child;
+
+	while ((child = 2 * i + 1) < len) {
+		if (child + 1 < len && smscb_before(heap[child + 1], heap[child]))
+			child++;
+		if (!smscb_before(heap[child], last))
+			break;
+		heap[i] = heap[child];
+		i = child;
 	}
+	heap[i] = last;
 
-	return block_type->lb;
+	return top;
+}
+
+void bts_smscb_state_init(struct bts_smscb_state *bts_ss)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(bts_ss->index); i++)
+		INIT_LLIST_HEAD(&bts_ss->index[i]);
 }
 
 static const uint8_t last_block_rsl2um[4] = {
@@ -176,6 +265,18 @@ static const struct value_string rsl_cb_cmd_names[] = {
 };
 
 
+/* look up a pending message the BSC sends again */
+static struct smscb_msg *smscb_lookup(struct bts_smscb_state *bts_ss, uint64_t key)
+{
+	struct smscb_msg *scm;
+
+	llist_for_each_entry(scm, smscb_index_bucket(bts_ss, key), list) {
+		if (scm->key == key)
+			return scm;
+	}
+	return NULL;
+}
+
 /* incoming SMS broadcast command from RSL */
 int bts_process_smscb_cmd(struct gsm_bts *bts, struct rsl_ie_cb_cmd_type cmd_type,
 			  bool extended_cbch, uint8_t msg_len, const uint8_t *msg)
@@ -183,6 +284,8 @@ int bts_process_smscb_cmd(struct gsm_bts *bts, struct rsl_ie_cb_cmd_type cmd_typ
 	struct smscb_msg *scm;
 	struct bts_smscb_state *bts_ss;
 	const char *chan_name;
+	bool indexed;
+	uint64_t key = 0;
 
 	if (extended_cbch) {
 		chan_name = tb_to_chan_str(4);
@@ -192,27 +295,18 @@ int bts_process_smscb_cmd(struct gsm_bts *bts, struct rsl_ie_cb_cmd_type cmd_typ
 		bts_ss = &bts->smscb_basic;
 	}
 
-	if (msg_len > sizeof(scm->msg)) {
-		LOGP(DLSMS, LOGL_ERROR, "%s: Cannot process SMSCB of %u bytes (max %zu)\n",
-		     chan_name, msg_len, sizeof(scm->msg));
+	if (msg_len > GSM412_MSG_LEN) {
+		LOGP(DLSMS, LOGL_ERROR, "%s: Cannot process SMSCB of %u bytes (max %u)\n",
+		     chan_name, msg_len, GSM412_MSG_LEN);
 		return -EINVAL;
 	}
 
-	scm = talloc_zero_size(bts, sizeof(*scm));
-	if (!scm)
-		return -1;
-
-	/* initialize entire message with default padding */
-	memset(scm->msg, GSM_MACBLOCK_PADDING, sizeof(scm->msg));
-
-	if (cmd_type.command == RSL_CB_CMD_TYPE_SCHEDULE)
-		scm->is_schedule = true;
-
-	scm->num_segs = last_block_rsl2um[cmd_type.last_block&3];
-	memcpy(scm->msg, msg, msg_len);
-
 	LOGP(DLSMS, LOGL_INFO, "RSL SMSCB COMMAND (chan=%s, type=%s, num_blocks=%u)\n",
-		chan_name, get_value_string(rsl_cb_cmd_names, cmd_type.command), scm->num_segs);
+		chan_name, get_value_string(rsl_cb_cmd_names, cmd_type.command),
+		last_block_rsl2um[cmd_type.last_block&3]);
+
+	/* only normal messages carry the CBS page header identifying them */
+	indexed = cmd_type.command == RSL_CB_CMD_TYPE_NORMAL && msg_len >= 6;
 
 	switch (cmd_type.command) {
 	case RSL_CB_CMD_TYPE_NORMAL:
@@ -220,34 +314,63 @@ int bts_process_smscb_cmd(struct gsm_bts *bts, struct rsl_ie_cb_cmd_type cmd_typ
 	case RSL_CB_CMD_TYPE_NULL:
 		/* def_bcast is ignored as per Section 9.3.41 of 3GPP TS 48.058 */
 		/* limit queue size and optionally send CBCH LOAD Information (overflow) via RSL */
-		if (bts_ss->queue_len >= bts->smscb_queue_max_len) {
+		if (bts_ss->queue_len >= OSMO_MIN(bts->smscb_queue_max_len, BTS_SMSCB_QUEUE_MAX)) {
 			LOGP(DLSMS, LOGL_NOTICE, "RSL SMSCB COMMAND (chan=%s, type=%s): OVERFLOW\n",
 			     chan_name, get_value_string(rsl_cb_cmd_names, cmd_type.command));
 			rate_ctr_inc2(bts_ss->ctrs, CBCH_CTR_RCVD_DROPPED);
-			talloc_free(scm);
 			break;
 		}
-		llist_add_tail(&scm->list, &bts_ss->queue);
+		if (indexed) {
+			key = smscb_msg_key(msg);
+			scm = smscb_lookup(bts_ss, key);
+			if (scm) {
+				/* still pending: just transmit it once more */
+				DEBUGP(DLSMS, "%s: message already pending, %u repetitions\n",
+				       chan_name, scm->reps + 1);
+				scm->reps++;
+				goto queued;
+			}
+		}
+
+		scm = talloc_zero_size(bts, sizeof(*scm));
+		if (!scm)
+			return -1;
+		scm->is_schedule = cmd_type.command == RSL_CB_CMD_TYPE_SCHEDULE;
+		scm->num_segs = last_block_rsl2um[cmd_type.last_block&3];
+		scm->prio = smscb_msg_prio(msg, msg_len);
+		smscb_segment(scm, msg, msg_len);
+
+		scm->key = key;
+		INIT_LLIST_HEAD(&scm->list);
+		if (indexed)
+			llist_add_tail(&scm->list, smscb_index_bucket(bts_ss, key));
+		scm->in_store = true;
+		scm->due = bts_ss->cycle;
+		smscb_heap_push(bts_ss, scm);
+queued:
 		bts_ss->queue_len++;
 		check_and_send_cbch_load(bts, bts_ss);
 		rate_ctr_inc2(bts_ss->ctrs, CBCH_CTR_RCVD_QUEUED);
 		break;
 	case RSL_CB_CMD_TYPE_DEFAULT:
-		/* old default msg will be free'd in get_smscb_block() if it is currently in transit
-		 * and we set a new default_msg here */
-		if (bts_ss->cur_msg && bts_ss->cur_msg == bts_ss->default_msg)
-			talloc_free(bts_ss->cur_msg);
-		if (cmd_type.def_bcast == RSL_CB_CMD_DEFBCAST_NORMAL)
+		/* the default message currently in transit is released by
+		 * select_next_smscb(), which no longer finds it in default_msg */
+		if (bts_ss->default_msg && bts_ss->default_msg != bts_ss->cur_msg)
+			talloc_free(bts_ss->default_msg);
+		bts_ss->default_msg = NULL;
+		if (cmd_type.def_bcast == RSL_CB_CMD_DEFBCAST_NORMAL) {
 			/* def_bcast == 0: normal message */
+			scm = talloc_zero_size(bts, sizeof(*scm));
+			if (!scm)
+				return -1;
+			INIT_LLIST_HEAD(&scm->list);
+			scm->num_segs = last_block_rsl2um[cmd_type.last_block&3];
+			smscb_segment(scm, msg, msg_len);
 			bts_ss->default_msg = scm;
-		else {
-			/* def_bcast == 1: NULL message */
-			bts_ss->default_msg = NULL;
-			talloc_free(scm);
 		}
+		/* def_bcast == 1: NULL message */
 		break;
 	default:
-		talloc_free(scm);
 		return -EINVAL;
 	}
 
@@ -258,11 +381,32 @@ static struct smscb_msg *select_next_smscb(struct gsm_bts *bts, uint8_t tb)
 {
 	struct bts_smscb_state *bts_ss = bts_smscb_state(bts, tb);
 	const char *chan_name = tb_to_chan_str(tb);
-	struct smscb_msg *msg;
-
-	msg = llist_first_entry_or_null(&bts_ss->queue, struct smscb_msg, list);
-	if (msg) {
-		llist_del(&msg->list);
+	struct smscb_msg *msg, *prev = bts_ss->cur_msg;
+	unsigned int prio;
+
+	/* the previous message has been sent completely */
+	if (prev && !prev->in_store && prev != bts_ss->default_msg)
+		talloc_free(prev);
+	bts_ss->cur_msg = NULL;
+	bts_ss->cycle++;
+
+	for (prio = 0; prio < BTS_SMSCB_NUM_PRIO; prio++) {
+		if (!bts_ss->heap[prio].len)
+			continue;
+		msg = bts_ss->heap[prio].msg[0];
+		if ((int32_t)(msg->due - bts_ss->cycle) > 0)
+			continue;
+
+		smscb_heap_pop(bts_ss, prio);
+		if (msg->reps) {
+			/* keep it for the next repetition */
+			msg->reps--;
+			msg->due = bts_ss->cycle + smscb_rep_period[prio];
+			smscb_heap_push(bts_ss, msg);
+		} else {
+			llist_del(&msg->list);
+			msg->in_store = false;
+		}
 		bts_ss->queue_len--;
 		check_and_send_cbch_load(bts, bts_ss);
 		DEBUGP(DLSMS, "%s: %s: Dequeued msg\n", __func__, chan_name);
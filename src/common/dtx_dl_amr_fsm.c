@@ -19,6 +19,8 @@
  *
  */
 
+#include <errno.h>
+
 #include <osmo-bts/dtx_dl_amr_fsm.h>
 #include <osmo-bts/logging.h>
 
@@ -475,3 +477,124 @@ struct osmo_fsm dtx_dl_amr_fsm = {
 	.event_names = dtx_dl_amr_fsm_event_names,
 	.log_subsys = DL1C,
 };
+
+/* Transition table of the embedded state machine, the next state is stored
+ * incremented by one so that 0 marks the events not permitted in a state. */
+#define NEXT(s) ((s) + 1)
+
+static const uint8_t dtx_dl_amr_trans[ST_FACCH + 1][E_SID_U + 1] = {
+	[ST_VOICE] = {
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_FACCH]	= NEXT(ST_VOICE),
+		[E_SID_F]	= NEXT(ST_SID_F1),
+		[E_SID_U]	= NEXT(ST_U_NOINH),
+		[E_INHIB]	= NEXT(ST_F1_INH_V),
+	},
+	[ST_SID_F1] = {
+		[E_SID_F]	= NEXT(ST_SID_F1),
+		[E_SID_U]	= NEXT(ST_U_NOINH),
+		/* dtx_fsm_sid_f1() requests ST_F1_INH_F, which is not in
+		   the out_state_mask, so the FSM stays where it is */
+		[E_FACCH]	= NEXT(ST_SID_F1),
+		[E_FIRST]	= NEXT(ST_SID_F2),
+		[E_ONSET]	= NEXT(ST_ONSET_V),
+	},
+	[ST_SID_F2] = {
+		[E_COMPL]	= NEXT(ST_U_NOINH),
+		[E_FACCH]	= NEXT(ST_ONSET_F),
+		[E_ONSET]	= NEXT(ST_ONSET_V),
+	},
+	[ST_F1_INH_V] = {
+		[E_COMPL]	= NEXT(ST_F1_INH_V_REC),
+	},
+	[ST_F1_INH_F] = {
+		[E_COMPL]	= NEXT(ST_F1_INH_F_REC),
+	},
+	[ST_U_INH_V] = {
+		[E_COMPL]	= NEXT(ST_U_INH_V_REC),
+	},
+	[ST_U_INH_F] = {
+		[E_COMPL]	= NEXT(ST_U_INH_F_REC),
+	},
+	[ST_U_NOINH] = {
+		[E_FACCH]	= NEXT(ST_ONSET_F),
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_COMPL]	= NEXT(ST_SID_U),
+		[E_SID_U]	= NEXT(ST_U_NOINH),
+		[E_SID_F]	= NEXT(ST_U_NOINH),
+		[E_ONSET]	= NEXT(ST_ONSET_V),
+	},
+	[ST_F1_INH_V_REC] = {
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_COMPL]	= NEXT(ST_VOICE),
+	},
+	[ST_F1_INH_F_REC] = {
+		[E_FACCH]	= NEXT(ST_FACCH),
+		[E_COMPL]	= NEXT(ST_FACCH),
+	},
+	[ST_U_INH_V_REC] = {
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_COMPL]	= NEXT(ST_VOICE),
+	},
+	[ST_U_INH_F_REC] = {
+		[E_FACCH]	= NEXT(ST_FACCH),
+		[E_COMPL]	= NEXT(ST_FACCH),
+	},
+	[ST_SID_U] = {
+		[E_FACCH]	= NEXT(ST_U_INH_F),
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_INHIB]	= NEXT(ST_U_INH_V),
+		[E_SID_U]	= NEXT(ST_U_NOINH),
+		[E_SID_F]	= NEXT(ST_U_NOINH),
+	},
+	[ST_ONSET_V] = {
+		[E_COMPL]	= NEXT(ST_ONSET_V_REC),
+	},
+	[ST_ONSET_F] = {
+		[E_COMPL]	= NEXT(ST_ONSET_F_REC),
+	},
+	[ST_ONSET_V_REC] = {
+		[E_COMPL]	= NEXT(ST_VOICE),
+	},
+	[ST_ONSET_F_REC] = {
+		[E_COMPL]	= NEXT(ST_FACCH),
+	},
+	[ST_FACCH] = {
+		[E_SID_U]	= NEXT(ST_FACCH),
+		[E_SID_F]	= NEXT(ST_FACCH),
+		[E_FACCH]	= NEXT(ST_FACCH),
+		[E_VOICE]	= NEXT(ST_VOICE),
+		[E_COMPL]	= NEXT(ST_SID_F1),
+	},
+};
+
+void dtx_dl_amr_sm_init(struct dtx_dl_amr_sm *sm)
+{
+	sm->active = true;
+	sm->state = ST_VOICE;
+}
+
+/*! \brief Feed an event into the embedded DTX DL AMR state machine
+ *  \param[in] sm State machine of the lchan
+ *  \param[in] e Event to dispatch
+ *  \returns 0 in case of success; -EINVAL if the event is not permitted
+ */
+int dtx_dl_amr_sm_dispatch(struct dtx_dl_amr_sm *sm, enum dtx_dl_amr_fsm_events e)
+{
+	uint8_t next;
+
+	if (sm->state >= ARRAY_SIZE(dtx_dl_amr_trans) || e >= ARRAY_SIZE(dtx_dl_amr_trans[0]))
+		return -EINVAL;
+
+	next = dtx_dl_amr_trans[sm->state][e];
+	if (!next)
+		return -EINVAL;
+
+	sm->state = next - 1;
+	return 0;
+}
+
+const char *dtx_dl_amr_sm_state_name(const struct dtx_dl_amr_sm *sm)
+{
+	return osmo_fsm_state_name(&dtx_dl_amr_fsm, sm->state);
+}
@@ -0,0 +1,248 @@
+/* l1_conf.c: tracking of the DSP requests waiting for their confirmation */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1_conf.h>
+
+/* entries allocated up front, the pool grows beyond on demand */
+#define L1_CONF_POOL_INIT	32
+
+const struct value_string l1_conf_class_names[] = {
+	{ L1_CONF_C_SYS,	"sys" },
+	{ L1_CONF_C_PHY,	"phy" },
+	{ L1_CONF_C_LCHAN,	"lchan" },
+	{ 0, NULL }
+};
+
+/* upper bounds (exclusive) of the latency histogram buckets in ms, the
+ * last bucket takes everything above */
+static const unsigned int l1_conf_lat_bounds[] = { 1, 2, 5, 10, 20, 50, 100, 500 };
+#define L1_CONF_LAT_BUCKETS	(ARRAY_SIZE(l1_conf_lat_bounds) + 1)
+
+/* per class: the latency buckets followed by the timeout counter */
+#define L1_CONF_CTRS_PER_C	(L1_CONF_LAT_BUCKETS + 1)
+#define L1_CONF_CTR_LAT(cls, b)	((cls) * L1_CONF_CTRS_PER_C + (b))
+#define L1_CONF_CTR_TIMEOUT(cls) ((cls) * L1_CONF_CTRS_PER_C + L1_CONF_LAT_BUCKETS)
+#define L1_CONF_CTR_POOL_ALLOC	(_NUM_L1_CONF_C * L1_CONF_CTRS_PER_C)
+
+#define L1_CONF_CLASS_CTRS(cls, name) \
+	[L1_CONF_CTR_LAT(cls, 0)] = { name ":lat:1ms", "Confirmed within 1 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 1)] = { name ":lat:2ms", "Confirmed within 1-2 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 2)] = { name ":lat:5ms", "Confirmed within 2-5 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 3)] = { name ":lat:10ms", "Confirmed within 5-10 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 4)] = { name ":lat:20ms", "Confirmed within 10-20 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 5)] = { name ":lat:50ms", "Confirmed within 20-50 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 6)] = { name ":lat:100ms", "Confirmed within 50-100 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 7)] = { name ":lat:500ms", "Confirmed within 100-500 ms" }, \
+	[L1_CONF_CTR_LAT(cls, 8)] = { name ":lat:slow", "Confirmed after 500 ms or more" }, \
+	[L1_CONF_CTR_TIMEOUT(cls)] = { name ":timeout", "Confirmations timed out" }
+
+static const struct rate_ctr_desc l1_conf_ctr_desc[] = {
+	L1_CONF_CLASS_CTRS(L1_CONF_C_SYS, "sys"),
+	L1_CONF_CLASS_CTRS(L1_CONF_C_PHY, "phy"),
+	L1_CONF_CLASS_CTRS(L1_CONF_C_LCHAN, "lchan"),
+	[L1_CONF_CTR_POOL_ALLOC] = { "pool:alloc", "Pending requests allocated beyond the pool" },
+};
+static const struct rate_ctr_group_desc l1_conf_ctrg_desc = {
+	"l1_conf",
+	"DSP request to confirmation latency",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(l1_conf_ctr_desc),
+	l1_conf_ctr_desc
+};
+
+static unsigned int l1_conf_hash(bool is_sys_prim, unsigned int conf_prim_id,
+				 uint32_t conf_hLayer3)
+{
+	uint32_t key = conf_hLayer3 + ((conf_prim_id << 1) | is_sys_prim) * 0x10001;
+
+	return (key * 2654435761u) >> (32 - L1_CONF_HASH_BITS);
+}
+
+static void l1_conf_timeout(void *data)
+{
+	struct l1_conf_wait *wlc = data;
+	struct l1_conf *lc = wlc->lc;
+
+	llist_del(&wlc->list);
+	rate_ctr_inc2(lc->ctrs, L1_CONF_CTR_TIMEOUT(wlc->cls));
+	lc->timeout_cb(wlc);
+	l1_conf_release(wlc);
+}
+
+static int l1_conf_destructor(struct l1_conf *lc)
+{
+	struct l1_conf_wait *wlc;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(lc->hash); i++) {
+		llist_for_each_entry(wlc, &lc->hash[i], list)
+			osmo_timer_del(&wlc->timer);
+	}
+	rate_ctr_group_free(lc->ctrs);
+	return 0;
+}
+
+/*! \brief Allocate the confirmation tracking of one DSP
+ *  \param[in] ctx talloc context, also owning the pending requests
+ *  \param[in] ctr_idx Index of the counter group
+ *  \param[in] timeout_cb Call-back for a confirmation not received in time
+ *  \returns the tracker, NULL on error
+ */
+struct l1_conf *l1_conf_alloc(void *ctx, unsigned int ctr_idx,
+			      l1_conf_timeout_cb *timeout_cb)
+{
+	struct l1_conf *lc;
+	unsigned int i;
+
+	lc = talloc_zero(ctx, struct l1_conf);
+	if (!lc)
+		return NULL;
+
+	lc->ctrs = rate_ctr_group_alloc(lc, &l1_conf_ctrg_desc, ctr_idx);
+	if (!lc->ctrs) {
+		talloc_free(lc);
+		return NULL;
+	}
+	talloc_set_destructor(lc, l1_conf_destructor);
+
+	for (i = 0; i < ARRAY_SIZE(lc->hash); i++)
+		INIT_LLIST_HEAD(&lc->hash[i]);
+	INIT_LLIST_HEAD(&lc->pool);
+	for (i = 0; i < _NUM_L1_CONF_C; i++)
+		lc->timeout_ms[i] = L1_CONF_TIMEOUT_MS_DEFAULT;
+	lc->timeout_cb = timeout_cb;
+
+	for (i = 0; i < L1_CONF_POOL_INIT; i++) {
+		struct l1_conf_wait *wlc = talloc_zero(lc, struct l1_conf_wait);
+		if (!wlc)
+			break;
+		llist_add(&wlc->list, &lc->pool);
+	}
+
+	return lc;
+}
+
+/*! \brief Set the time to wait for the confirmations of a primitive class */
+void l1_conf_set_timeout(struct l1_conf *lc, enum l1_conf_class cls,
+			 unsigned int timeout_ms)
+{
+	OSMO_ASSERT(cls < _NUM_L1_CONF_C);
+	lc->timeout_ms[cls] = timeout_ms ? timeout_ms : L1_CONF_TIMEOUT_MS_DEFAULT;
+}
+
+/*! \brief Start waiting for the confirmation of a request just sent
+ *  \returns the pending request, NULL on error
+ */
+struct l1_conf_wait *l1_conf_add(struct l1_conf *lc, enum l1_conf_class cls,
+				 bool is_sys_prim, unsigned int conf_prim_id,
+				 uint32_t conf_hLayer3, l1_conf_cb *cb, void *cb_data)
+{
+	struct l1_conf_wait *wlc;
+	unsigned int timeout_ms = lc->timeout_ms[cls];
+
+	if (!llist_empty(&lc->pool)) {
+		wlc = llist_first_entry(&lc->pool, struct l1_conf_wait, list);
+		llist_del(&wlc->list);
+		memset(wlc, 0, sizeof(*wlc));
+	} else {
+		wlc = talloc_zero(lc, struct l1_conf_wait);
+		if (!wlc)
+			return NULL;
+		rate_ctr_inc2(lc->ctrs, L1_CONF_CTR_POOL_ALLOC);
+	}
+
+	wlc->lc = lc;
+	wlc->cls = cls;
+	wlc->is_sys_prim = is_sys_prim;
+	wlc->conf_prim_id = conf_prim_id;
+	/* system primitives are matched by their id only */
+	wlc->conf_hLayer3 = is_sys_prim ? 0 : conf_hLayer3;
+	wlc->cb = cb;
+	wlc->cb_data = cb_data;
+	osmo_clock_gettime(CLOCK_MONOTONIC, &wlc->tx_time);
+
+	/* confirmations of equal key are matched in the order of the requests */
+	llist_add_tail(&wlc->list,
+		       &lc->hash[l1_conf_hash(is_sys_prim, conf_prim_id, wlc->conf_hLayer3)]);
+
+	osmo_timer_setup(&wlc->timer, l1_conf_timeout, wlc);
+	osmo_timer_schedule(&wlc->timer, timeout_ms / 1000, (timeout_ms % 1000) * 1000);
+
+	return wlc;
+}
+
+/*! \brief Look up the pending request a confirmation belongs to
+ *
+ *  The request is no longer pending afterwards, the caller has to hand it
+ *  to l1_conf_release() once done with its call-back.
+ *  \returns the pending request, NULL if this was no expected confirmation
+ */
+struct l1_conf_wait *l1_conf_take(struct l1_conf *lc, bool is_sys_prim,
+				  unsigned int conf_prim_id, uint32_t conf_hLayer3)
+{
+	struct l1_conf_wait *wlc;
+	struct timespec now;
+	unsigned int i, lat_ms;
+
+	if (is_sys_prim)
+		conf_hLayer3 = 0;
+
+	llist_for_each_entry(wlc, &lc->hash[l1_conf_hash(is_sys_prim, conf_prim_id, conf_hLayer3)], list) {
+		if (wlc->is_sys_prim != is_sys_prim)
+			continue;
+		if (wlc->conf_prim_id != conf_prim_id)
+			continue;
+		if (wlc->conf_hLayer3 != conf_hLayer3)
+			continue;
+
+		llist_del(&wlc->list);
+		INIT_LLIST_HEAD(&wlc->list);
+		osmo_timer_del(&wlc->timer);
+
+		osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+		lat_ms = (now.tv_sec - wlc->tx_time.tv_sec) * 1000
+			+ (now.tv_nsec - wlc->tx_time.tv_nsec) / 1000000;
+		for (i = 0; i < ARRAY_SIZE(l1_conf_lat_bounds); i++) {
+			if (lat_ms < l1_conf_lat_bounds[i])
+				break;
+		}
+		rate_ctr_inc2(lc->ctrs, L1_CONF_CTR_LAT(wlc->cls, i));
+
+		return wlc;
+	}
+
+	return NULL;
+}
+
+/*! \brief Return a request taken by l1_conf_take() to the pool */
+void l1_conf_release(struct l1_conf_wait *wlc)
+{
+	struct l1_conf *lc = wlc->lc;
+
+	osmo_timer_del(&wlc->timer);
+	llist_add(&wlc->list, &lc->pool);
+}
@@ -0,0 +1,236 @@
+/* l1_rx_pool.c: recycled receive buffers for the PHY read queues */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <stdbool.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1_rx_pool.h>
+
+/* how long a read queue is left alone when no buffer could be allocated */
+#define L1_RX_POOL_BACKOFF_US	10000
+
+enum l1_rx_pool_ctr {
+	L1_RX_POOL_CTR_WAKEUP,
+	L1_RX_POOL_CTR_PRIM,
+	L1_RX_POOL_CTR_BATCH_FULL,
+	L1_RX_POOL_CTR_ALLOC,
+	L1_RX_POOL_CTR_BACKOFF,
+};
+
+static const struct rate_ctr_desc l1_rx_pool_ctr_desc[] = {
+	[L1_RX_POOL_CTR_WAKEUP] =	{"rx:wakeup", "Wakeups of the read queue"},
+	[L1_RX_POOL_CTR_PRIM] =		{"rx:prim", "Primitives read"},
+	[L1_RX_POOL_CTR_BATCH_FULL] =	{"rx:batch_full", "Wakeups filling the whole batch"},
+	[L1_RX_POOL_CTR_ALLOC] =	{"rx:pool_alloc", "Receive buffers allocated on an empty pool"},
+	[L1_RX_POOL_CTR_BACKOFF] =	{"rx:backoff", "Reads postponed for lack of receive buffers"},
+};
+static const struct rate_ctr_group_desc l1_rx_pool_ctrg_desc = {
+	"l1_rx_pool",
+	"PHY read queue",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(l1_rx_pool_ctr_desc),
+	l1_rx_pool_ctr_desc
+};
+
+struct l1_rx_pool {
+	struct llist_head free;
+	unsigned int free_len;
+	/* buffers handed out and not yet returned */
+	unsigned int in_use;
+	/* buffers returned beyond this are freed for real */
+	unsigned int max_free;
+	unsigned int buf_size;
+	unsigned int headroom;
+	/* buffers are freed for real when they come back */
+	bool closing;
+	/* l1_rx_pool_release() was called, free the pool with the last buffer */
+	bool released;
+	struct rate_ctr_group *ctrs;
+	/* read interest of this fd is restored when the timer expires */
+	struct osmo_fd *backoff_ofd;
+	struct osmo_timer_list backoff_timer;
+};
+
+static int l1_rx_pool_destructor(struct l1_rx_pool *pool)
+{
+	/* let the buffers go along with the pool */
+	pool->closing = true;
+	pool->released = false;
+	osmo_timer_del(&pool->backoff_timer);
+	if (pool->ctrs)
+		rate_ctr_group_free(pool->ctrs);
+	return 0;
+}
+
+static void l1_rx_pool_free_cb(void *data)
+{
+	talloc_free(data);
+}
+
+static int l1_rx_pool_msgb_destructor(struct msgb *msg)
+{
+	struct l1_rx_pool *pool;
+
+	pool = talloc_get_type(talloc_parent(msg), struct l1_rx_pool);
+	if (!pool)
+		return 0;
+	pool->in_use--;
+	if (pool->closing) {
+		/* the buffer is still being freed as a child of the pool,
+		 * so free the pool itself from the main loop */
+		if (pool->released && pool->in_use == 0) {
+			osmo_timer_setup(&pool->backoff_timer, l1_rx_pool_free_cb, pool);
+			osmo_timer_schedule(&pool->backoff_timer, 0, 0);
+		}
+		return 0;
+	}
+	if (pool->free_len >= pool->max_free)
+		return 0;
+
+	msgb_reset(msg);
+	msgb_reserve(msg, pool->headroom);
+	llist_add(&msg->list, &pool->free);
+	pool->free_len++;
+
+	/* keep the memory */
+	return -1;
+}
+
+static void l1_rx_pool_backoff_cb(void *data)
+{
+	struct l1_rx_pool *pool = data;
+
+	pool->backoff_ofd->when |= OSMO_FD_READ;
+	pool->backoff_ofd = NULL;
+}
+
+/*! \brief Allocate a pool of receive buffers
+ *  \param[in] ctx talloc context, the pool lives on it as long as buffers are held
+ *  \param[in] buf_size Size of a buffer after its headroom
+ *  \param[in] headroom Headroom reserved in front of every buffer
+ *  \param[in] max_free Maximum number of buffers kept in the pool
+ *  \param[in] ctr_idx Index of the counter group
+ *  \returns pool on success; NULL on error
+ */
+struct l1_rx_pool *l1_rx_pool_alloc(void *ctx, unsigned int buf_size,
+				    unsigned int headroom, unsigned int max_free,
+				    unsigned int ctr_idx)
+{
+	struct l1_rx_pool *pool;
+
+	pool = talloc_zero(ctx, struct l1_rx_pool);
+	if (!pool)
+		return NULL;
+
+	INIT_LLIST_HEAD(&pool->free);
+	pool->max_free = max_free;
+	pool->buf_size = buf_size;
+	pool->headroom = headroom;
+	osmo_timer_setup(&pool->backoff_timer, l1_rx_pool_backoff_cb, pool);
+
+	pool->ctrs = rate_ctr_group_alloc(pool, &l1_rx_pool_ctrg_desc, ctr_idx);
+	if (!pool->ctrs) {
+		talloc_free(pool);
+		return NULL;
+	}
+	talloc_set_destructor(pool, l1_rx_pool_destructor);
+
+	return pool;
+}
+
+/*! \brief Release a pool once its read queue is closed. Buffers still held
+ *  elsewhere are freed for real from now on, the pool itself is freed
+ *  along with the last of them. */
+void l1_rx_pool_release(struct l1_rx_pool *pool)
+{
+	struct msgb *msg, *tmp;
+
+	pool->closing = true;
+	pool->released = true;
+	osmo_timer_del(&pool->backoff_timer);
+	pool->backoff_ofd = NULL;
+	rate_ctr_group_free(pool->ctrs);
+	pool->ctrs = NULL;
+
+	llist_for_each_entry_safe(msg, tmp, &pool->free, list) {
+		llist_del(&msg->list);
+		/* not handed out, don't account it as returned */
+		talloc_set_destructor(msg, NULL);
+		msgb_free(msg);
+	}
+	pool->free_len = 0;
+
+	if (pool->in_use == 0)
+		talloc_free(pool);
+}
+
+/*! \brief Get a receive buffer, allocating one if the pool is empty
+ *  \returns buffer with the configured headroom reserved; NULL on error */
+struct msgb *l1_rx_pool_get(struct l1_rx_pool *pool)
+{
+	struct msgb *msg;
+
+	if (!llist_empty(&pool->free)) {
+		msg = llist_first_entry(&pool->free, struct msgb, list);
+		llist_del(&msg->list);
+		pool->free_len--;
+	} else {
+		msg = msgb_alloc_c(pool, pool->headroom + pool->buf_size, "l1_rx_pool");
+		if (!msg)
+			return NULL;
+		msgb_reserve(msg, pool->headroom);
+		talloc_set_destructor(msg, l1_rx_pool_msgb_destructor);
+		rate_ctr_inc2(pool->ctrs, L1_RX_POOL_CTR_ALLOC);
+	}
+
+	pool->in_use++;
+	return msg;
+}
+
+/*! \brief Account a wakeup of the read queue
+ *  \param[in] count Number of primitives read
+ *  \param[in] batch Number of buffers offered to the read */
+void l1_rx_pool_account(struct l1_rx_pool *pool, unsigned int count,
+			unsigned int batch)
+{
+	rate_ctr_inc2(pool->ctrs, L1_RX_POOL_CTR_WAKEUP);
+	rate_ctr_add2(pool->ctrs, L1_RX_POOL_CTR_PRIM, count);
+	if (count == batch)
+		rate_ctr_inc2(pool->ctrs, L1_RX_POOL_CTR_BATCH_FULL);
+}
+
+/*! \brief Stop reading from a queue for a while, as no receive buffer could
+ *  be allocated. The fd would otherwise stay readable and wake us up again
+ *  right away. */
+void l1_rx_pool_backoff(struct l1_rx_pool *pool, struct osmo_fd *ofd)
+{
+	LOGP(DL1C, LOGL_ERROR, "no receive buffer, postponing read from fd %d\n", ofd->fd);
+	rate_ctr_inc2(pool->ctrs, L1_RX_POOL_CTR_BACKOFF);
+
+	ofd->when &= ~OSMO_FD_READ;
+	pool->backoff_ofd = ofd;
+	osmo_timer_schedule(&pool->backoff_timer, 0, L1_RX_POOL_BACKOFF_US);
+}
@@ -0,0 +1,217 @@
+/* l1_wqueue.c: vectored writer for the DSP message queue devices */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stat_item.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/l1_wqueue.h>
+
+enum l1_wqueue_ctr {
+	L1_WQUEUE_CTR_WRITEV,
+	L1_WQUEUE_CTR_PRIM,
+	L1_WQUEUE_CTR_PARTIAL,
+	L1_WQUEUE_CTR_ERROR,
+	L1_WQUEUE_CTR_DEPTH_FULL,
+};
+
+static const struct rate_ctr_desc l1_wqueue_ctr_desc[] = {
+	[L1_WQUEUE_CTR_WRITEV] =	{"tx:writev", "writev() calls"},
+	[L1_WQUEUE_CTR_PRIM] =		{"tx:prim", "Primitives written"},
+	[L1_WQUEUE_CTR_PARTIAL] =	{"tx:partial", "Primitives written only partially"},
+	[L1_WQUEUE_CTR_ERROR] =		{"tx:error", "Failed writev() calls"},
+	[L1_WQUEUE_CTR_DEPTH_FULL] =	{"depth:full", "Writes finding the queue full"},
+};
+static const struct rate_ctr_group_desc l1_wqueue_ctrg_desc = {
+	"l1_wqueue",
+	"DSP message queue writer",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(l1_wqueue_ctr_desc),
+	l1_wqueue_ctr_desc
+};
+
+enum l1_wqueue_stat {
+	L1_WQUEUE_STAT_DEPTH,
+};
+
+static const struct osmo_stat_item_desc l1_wqueue_stat_desc[] = {
+	[L1_WQUEUE_STAT_DEPTH] = { "depth", "Primitives queued when the device became writable",
+				   "", 16, 0 },
+};
+static const struct osmo_stat_item_group_desc l1_wqueue_statg_desc = {
+	"l1_wqueue",
+	"DSP message queue writer",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(l1_wqueue_stat_desc),
+	l1_wqueue_stat_desc
+};
+
+/* hangs off the osmo_fd of the write queue */
+struct l1_wqueue_state {
+	struct rate_ctr_group *ctrs;
+	struct osmo_stat_item_group *stats;
+};
+
+static int l1_wqueue_state_destructor(struct l1_wqueue_state *st)
+{
+	rate_ctr_group_free(st->ctrs);
+	osmo_stat_item_group_free(st->stats);
+	return 0;
+}
+
+/* Account the queue depth each time the device became writable */
+static void l1_wqueue_depth(struct l1_wqueue_state *st, const struct osmo_wqueue *queue)
+{
+	osmo_stat_item_set(st->stats->items[L1_WQUEUE_STAT_DEPTH], queue->current_length);
+	if (queue->current_length >= queue->max_length)
+		rate_ctr_inc2(st->ctrs, L1_WQUEUE_CTR_DEPTH_FULL);
+}
+
+static int l1_wqueue_write(struct osmo_fd *fd, struct osmo_wqueue *queue)
+{
+	struct l1_wqueue_state *st = fd->data;
+	struct iovec iov[L1_WQUEUE_LEN];
+	struct msgb *msg, *tmp;
+	ssize_t rc;
+	size_t written;
+	int count = 0;
+
+	l1_wqueue_depth(st, queue);
+
+	llist_for_each_entry(msg, &queue->msg_queue, list) {
+		if (count >= ARRAY_SIZE(iov))
+			break;
+		iov[count].iov_base = msg->l1h;
+		iov[count].iov_len = msgb_l1len(msg);
+		count += 1;
+	}
+
+	/* Nothing scheduled? This should not happen. */
+	if (count == 0)
+		return 0;
+
+	rc = writev(fd->fd, iov, count);
+	rate_ctr_inc2(st->ctrs, L1_WQUEUE_CTR_WRITEV);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		rate_ctr_inc2(st->ctrs, L1_WQUEUE_CTR_ERROR);
+		LOGP(DL1C, LOGL_ERROR, "failed to write to L1 msg_queue: %s\n",
+		     strerror(errno));
+		return -errno;
+	}
+	written = rc;
+
+	/* now delete the entries written completely, each one may have its
+	 * own length. A partially written one stays at the head of the queue
+	 * with its remainder. */
+	llist_for_each_entry_safe(msg, tmp, &queue->msg_queue, list) {
+		size_t len = msgb_l1len(msg);
+
+		if (written < len) {
+			if (written > 0) {
+				msg->l1h += written;
+				rate_ctr_inc2(st->ctrs, L1_WQUEUE_CTR_PARTIAL);
+			}
+			break;
+		}
+
+		written -= len;
+		queue->current_length -= 1;
+		llist_del(&msg->list);
+		msgb_free(msg);
+		rate_ctr_inc2(st->ctrs, L1_WQUEUE_CTR_PRIM);
+	}
+
+	return 0;
+}
+
+static int l1_wqueue_vector_cb(struct osmo_fd *fd, unsigned int what)
+{
+	struct osmo_wqueue *queue;
+
+	queue = container_of(fd, struct osmo_wqueue, bfd);
+
+	if ((what & OSMO_FD_READ) && queue->read_cb)
+		queue->read_cb(fd);
+
+	if ((what & OSMO_FD_EXCEPT) && queue->except_cb)
+		queue->except_cb(fd);
+
+	if (what & OSMO_FD_WRITE) {
+		fd->when &= ~OSMO_FD_WRITE;
+
+		l1_wqueue_write(fd, queue);
+
+		if (!llist_empty(&queue->msg_queue))
+			fd->when |= OSMO_FD_WRITE;
+	}
+
+	return 0;
+}
+
+/*! \brief Set up the vectored writer on a write queue
+ *  \param[in] wq Write queue, its bfd.fd is filled in by the caller
+ *  \param[in] ctx talloc context for the writer state
+ *  \param[in] max_length Maximum number of queued primitives, usually L1_WQUEUE_LEN
+ *  \param[in] ctr_idx Index of the counter and stat item groups
+ *  \returns 0 in case of success; negative on error
+ */
+int l1_wqueue_init(struct osmo_wqueue *wq, void *ctx, int max_length,
+		   unsigned int ctr_idx)
+{
+	struct l1_wqueue_state *st;
+
+	st = talloc_zero(ctx, struct l1_wqueue_state);
+	if (!st)
+		return -ENOMEM;
+
+	st->ctrs = rate_ctr_group_alloc(st, &l1_wqueue_ctrg_desc, ctr_idx);
+	if (!st->ctrs) {
+		talloc_free(st);
+		return -ENOMEM;
+	}
+	st->stats = osmo_stat_item_group_alloc(st, &l1_wqueue_statg_desc, ctr_idx);
+	if (!st->stats) {
+		rate_ctr_group_free(st->ctrs);
+		talloc_free(st);
+		return -ENOMEM;
+	}
+	talloc_set_destructor(st, l1_wqueue_state_destructor);
+
+	osmo_wqueue_init(wq, max_length);
+	wq->bfd.cb = l1_wqueue_vector_cb;
+	wq->bfd.data = st;
+
+	return 0;
+}
+
+/*! \brief Release the writer state of a write queue set up by l1_wqueue_init() */
+void l1_wqueue_release(struct osmo_wqueue *wq)
+{
+	talloc_free(wq->bfd.data);
+	wq->bfd.data = NULL;
+}
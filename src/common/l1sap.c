@@ -1754,21 +1754,9 @@ int l1sap_chan_act(struct gsm_bts_trx *trx, uint8_t chan_nr, struct tlv_parsed *
 	if (rc)
 		return -RSL_ERR_EQUIPMENT_FAIL;
 
-	/* Init DTX DL FSM if necessary */
-	if (trx->bts->dtxd && lchan->type != GSM_LCHAN_SDCCH) {
-		char name[32];
-		snprintf(name, sizeof(name), "bts%u-trx%u-ts%u-ss%u", lchan->ts->trx->bts->nr,
-			 lchan->ts->trx->nr, lchan->ts->nr, lchan->nr);
-		lchan->tch.dtx.dl_amr_fsm = osmo_fsm_inst_alloc(&dtx_dl_amr_fsm,
-								tall_bts_ctx,
-								lchan,
-								LOGL_DEBUG,
-								name);
-		if (!lchan->tch.dtx.dl_amr_fsm) {
-			l1sap_chan_act_dact_modify(trx, chan_nr, PRIM_INFO_DEACTIVATE, 0);
-			return -RSL_ERR_EQUIPMENT_FAIL;
-		}
-	}
+	/* Init DTX DL state machine if necessary */
+	if (trx->bts->dtxd && lchan->type != GSM_LCHAN_SDCCH)
+		dtx_dl_amr_sm_init(&lchan->tch.dtx.dl_amr_sm);
 	return 0;
 }
 
@@ -1778,10 +1766,7 @@ int l1sap_chan_rel(struct gsm_bts_trx *trx, uint8_t chan_nr)
 	LOGPLCHAN(lchan, DL1C, LOGL_INFO, "deactivating channel chan_nr=%s trx=%d\n",
 		  rsl_chan_nr_str(chan_nr), trx->nr);
 
-	if (lchan->tch.dtx.dl_amr_fsm) {
-		osmo_fsm_inst_free(lchan->tch.dtx.dl_amr_fsm);
-		lchan->tch.dtx.dl_amr_fsm = NULL;
-	}
+	lchan->tch.dtx.dl_amr_sm.active = false;
 
 	return l1sap_chan_act_dact_modify(trx, chan_nr, PRIM_INFO_DEACTIVATE,
 		0);
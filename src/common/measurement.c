@@ -316,6 +316,83 @@ static uint8_t modulus_by_lchan(struct gsm_lchan *lchan)
 	}
 }
 
+/* Get the number of measurements that we expect for a specific pchan, or 0
+ * if the number is not defined by the slot layout of the channel */
+static unsigned int pchan_meas_num_expected(enum gsm_phys_chan_config pchan)
+{
+	switch (pchan) {
+	case GSM_PCHAN_TCH_F:
+		/* 24 for TCH + 1 for SACCH */
+		return 25;
+	case GSM_PCHAN_TCH_H:
+		/* 24 half-blocks for TCH + 1 for SACCH */
+		return 25;
+	case GSM_PCHAN_SDCCH8_SACCH8C:
+	case GSM_PCHAN_SDCCH8_SACCH8C_CBCH:
+		/* 2 for SDCCH + 1 for SACCH */
+		return 3;
+	case GSM_PCHAN_CCCH_SDCCH4:
+	case GSM_PCHAN_CCCH_SDCCH4_CBCH:
+		/* 2 for SDCCH + 1 for SACCH */
+		return 3;
+	default:
+		return 0;
+	}
+}
+
+/* Add a measurement to the running sums of the lchan. Only the last
+ * pchan_meas_num_expected() measurements of a period take part in the
+ * computation (excess measurements at the beginning are ignored), so the
+ * measurement which drops out of that window is taken out of the sums again.
+ * This way the computation at the end of the period does not have to walk
+ * over the individual measurements. */
+static void ul_meas_acc_add(struct gsm_lchan *lchan, const struct bts_ul_meas *ulm)
+{
+	unsigned int window = pchan_meas_num_expected(ts_pchan(lchan->ts));
+	unsigned int n = lchan->meas.num_ul_meas;
+	struct bts_ul_meas_hist *h;
+
+	OSMO_ASSERT(window <= UL_MEAS_WINDOW);
+
+	if (window && n >= window) {
+		/* with window == UL_MEAS_WINDOW, this is the slot we overwrite below */
+		h = &lchan->meas.ul_hist[(n - window) % UL_MEAS_WINDOW];
+		lchan->meas.ul_acc.ber_full_sum -= h->ber10k;
+		lchan->meas.ul_acc.irssi_full_sum -= h->inv_rssi;
+		lchan->meas.ul_acc.ta256b_sum -= h->ta_offs_256bits;
+		lchan->meas.ul_acc.ta256b_sq_sum -= (int32_t)h->ta_offs_256bits * h->ta_offs_256bits;
+		if (h->is_sub) {
+			lchan->meas.ul_acc.ber_sub_sum -= h->ber10k;
+			lchan->meas.ul_acc.irssi_sub_sum -= h->inv_rssi;
+			lchan->meas.ul_acc.num_sub--;
+		}
+		lchan->meas.ul_acc.window_moved = true;
+	}
+
+	h = &lchan->meas.ul_hist[n % UL_MEAS_WINDOW];
+	h->ber10k = ulm->ber10k;
+	h->ta_offs_256bits = ulm->ta_offs_256bits;
+	h->inv_rssi = ulm->inv_rssi;
+	h->is_sub = ulm->is_sub;
+
+	lchan->meas.ul_acc.ber_full_sum += ulm->ber10k;
+	lchan->meas.ul_acc.irssi_full_sum += ulm->inv_rssi;
+	lchan->meas.ul_acc.ta256b_sum += ulm->ta_offs_256bits;
+	lchan->meas.ul_acc.ta256b_sq_sum += (int32_t)ulm->ta_offs_256bits * ulm->ta_offs_256bits;
+	if (ulm->is_sub) {
+		lchan->meas.ul_acc.ber_sub_sum += ulm->ber10k;
+		lchan->meas.ul_acc.irssi_sub_sum += ulm->inv_rssi;
+		lchan->meas.ul_acc.num_sub++;
+	}
+
+	if (n == 0 || ulm->ta_offs_256bits < lchan->meas.ul_acc.ta256b_min)
+		lchan->meas.ul_acc.ta256b_min = ulm->ta_offs_256bits;
+	if (n == 0 || ulm->ta_offs_256bits > lchan->meas.ul_acc.ta256b_max)
+		lchan->meas.ul_acc.ta256b_max = ulm->ta_offs_256bits;
+
+	lchan->meas.num_ul_meas++;
+}
+
 /* receive a L1 uplink measurement from L1 (this function is only used
  * internally, it is public to call it from unit-tests)  */
 int lchan_new_ul_meas(struct gsm_lchan *lchan, struct bts_ul_meas *ulm, uint32_t fn)
@@ -329,7 +406,7 @@ int lchan_new_ul_meas(struct gsm_lchan *lchan, struct bts_ul_meas *ulm, uint32_t
 		       lchan->meas.num_ul_meas, fn_mod);
 	}
 
-	if (lchan->meas.num_ul_meas >= ARRAY_SIZE(lchan->meas.uplink)) {
+	if (lchan->meas.num_ul_meas >= MAX_NUM_UL_MEAS) {
 		LOGPFN(DMEAS, LOGL_NOTICE, fn,
 		       "%s no space for uplink measurement, num_ul_meas=%d, fn_mod=%u\n",
 		       gsm_lchan_name(lchan), lchan->meas.num_ul_meas, fn_mod);
@@ -346,8 +423,7 @@ int lchan_new_ul_meas(struct gsm_lchan *lchan, struct bts_ul_meas *ulm, uint32_t
 		 ulm->c_i, ulm->is_sub, ulm->inv_rssi, lchan->meas.num_ul_meas,
 		 fn_mod);
 
-	memcpy(&lchan->meas.uplink[lchan->meas.num_ul_meas++], ulm,
-		sizeof(*ulm));
+	ul_meas_acc_add(lchan, ulm);
 
 	lchan->meas.last_fn = fn;
 
@@ -393,26 +469,11 @@ static uint8_t ber10k_to_rxqual(uint32_t ber10k)
  * the channel) */
 static unsigned int lchan_meas_num_expected(const struct gsm_lchan *lchan)
 {
-	enum gsm_phys_chan_config pchan = ts_pchan(lchan->ts);
+	unsigned int num_expect = pchan_meas_num_expected(ts_pchan(lchan->ts));
 
-	switch (pchan) {
-	case GSM_PCHAN_TCH_F:
-		/* 24 for TCH + 1 for SACCH */
-		return 25;
-	case GSM_PCHAN_TCH_H:
-		/* 24 half-blocks for TCH + 1 for SACCH */
-		return 25;
-	case GSM_PCHAN_SDCCH8_SACCH8C:
-	case GSM_PCHAN_SDCCH8_SACCH8C_CBCH:
-		/* 2 for SDCCH + 1 for SACCH */
-		return 3;
-	case GSM_PCHAN_CCCH_SDCCH4:
-	case GSM_PCHAN_CCCH_SDCCH4_CBCH:
-		/* 2 for SDCCH + 1 for SACCH */
-		return 3;
-	default:
+	if (!num_expect)
 		return lchan->meas.num_ul_meas;
-	}
+	return num_expect;
 }
 
 /* In DTX a subset of blocks must always be transmitted
@@ -463,13 +524,13 @@ static void lchan_meas_compute_extended(struct gsm_lchan *lchan)
 	unsigned int num_ul_meas;
 	unsigned int num_ul_meas_excess = 0;
         unsigned int num_ul_meas_expect;
+	int64_t mean;
 
 	/* we assume that lchan_meas_check_compute() has already computed the mean value
 	 * and we can compute the min/max/variance/stddev from this */
-	int i;
+	unsigned int i;
 
-	/* each measurement is an int32_t, so the squared difference value must fit in 32bits */
-	/* the sum of the squared values (each up to 32bit) can very easily exceed 32 bits */
+	/* each squared difference fits in 32bits, but their sum can very easily exceed 32 bits */
 	u_int64_t sq_diff_sum = 0;
 
 	/* In case we do not have any measurement values collected there is no
@@ -482,10 +543,6 @@ static void lchan_meas_compute_extended(struct gsm_lchan *lchan)
 	if (!lchan->meas.num_ul_meas)
 		return;
 
-	/* initialize min/max values with their counterpart */
-	lchan->meas.ext.toa256_min = INT16_MAX;
-	lchan->meas.ext.toa256_max = INT16_MIN;
-
 	/* Determine the number of measurement values we need to take into the
 	 * computation. In this case we only compute over the measurements we
 	 * have indeed received. Since this computation is about timing
@@ -505,26 +562,31 @@ static void lchan_meas_compute_extended(struct gsm_lchan *lchan)
 	 * beginning of its slot. This is of course excluding the TA value that the MS has already
 	 * compensated/pre-empted its transmission */
 
-	/* step 1: compute the sum of the squared difference of each value to mean */
-	for (i = 0; i < num_ul_meas; i++) {
-		const struct bts_ul_meas *m;
-
-		OSMO_ASSERT(i < lchan->meas.num_ul_meas);
-		m = &lchan->meas.uplink[i+num_ul_meas_excess];
-
-		int32_t diff = (int32_t)m->ta_offs_256bits - (int32_t)lchan->meas.ms_toa256;
-		/* diff can now be any value of +65535 to -65535, so we can safely square it,
-		 * but only in unsigned math.  As squaring looses the sign, we can simply drop
-		 * it before squaring, too. */
-		uint32_t diff_abs = labs(diff);
-		uint32_t diff_squared = diff_abs * diff_abs;
-		sq_diff_sum += diff_squared;
-
-		/* also use this loop iteration to compute min/max values */
-		if (m->ta_offs_256bits > lchan->meas.ext.toa256_max)
-			lchan->meas.ext.toa256_max = m->ta_offs_256bits;
-		if (m->ta_offs_256bits < lchan->meas.ext.toa256_min)
-			lchan->meas.ext.toa256_min = m->ta_offs_256bits;
+	/* step 1: compute the sum of the squared difference of each value to mean,
+	 * sum((x - mean)^2) = sum(x^2) - 2 * mean * sum(x) + n * mean^2, which is
+	 * exact in 64 bit integer math */
+	mean = lchan->meas.ms_toa256;
+	sq_diff_sum = (int64_t)lchan->meas.ul_acc.ta256b_sq_sum
+		      - 2 * mean * lchan->meas.ul_acc.ta256b_sum
+		      + (int64_t)num_ul_meas * mean * mean;
+
+	/* min/max are tracked while adding the measurements; only if older
+	 * measurements have left the window again, we need to look at the
+	 * (at most UL_MEAS_WINDOW) ones which are still in it */
+	if (!lchan->meas.ul_acc.window_moved) {
+		lchan->meas.ext.toa256_min = lchan->meas.ul_acc.ta256b_min;
+		lchan->meas.ext.toa256_max = lchan->meas.ul_acc.ta256b_max;
+	} else {
+		lchan->meas.ext.toa256_min = INT16_MAX;
+		lchan->meas.ext.toa256_max = INT16_MIN;
+		for (i = num_ul_meas_excess; i < lchan->meas.num_ul_meas; i++) {
+			const struct bts_ul_meas_hist *h = &lchan->meas.ul_hist[i % UL_MEAS_WINDOW];
+
+			if (h->ta_offs_256bits > lchan->meas.ext.toa256_max)
+				lchan->meas.ext.toa256_max = h->ta_offs_256bits;
+			if (h->ta_offs_256bits < lchan->meas.ext.toa256_min)
+				lchan->meas.ext.toa256_min = h->ta_offs_256bits;
+		}
 	}
 	/* step 2: compute the variance (mean of sum of squared differences) */
 	sq_diff_sum = sq_diff_sum / num_ul_meas;
@@ -539,21 +601,21 @@ static void lchan_meas_compute_extended(struct gsm_lchan *lchan)
 int lchan_meas_check_compute(struct gsm_lchan *lchan, uint32_t fn)
 {
 	struct gsm_meas_rep_unidir *mru;
-	uint32_t ber_full_sum = 0;
-	uint32_t irssi_full_sum = 0;
-	uint32_t ber_sub_sum = 0;
-	uint32_t irssi_sub_sum = 0;
-	int32_t ta256b_sum = 0;
-	unsigned int num_meas_sub = 0;
-	unsigned int num_meas_sub_actual = 0;
+	uint32_t ber_full_sum;
+	uint32_t irssi_full_sum;
+	uint32_t ber_sub_sum;
+	uint32_t irssi_sub_sum;
+	int32_t ta256b_sum;
+	unsigned int num_meas_sub;
+	unsigned int num_meas_sub_actual;
 	unsigned int num_meas_sub_subst = 0;
 	unsigned int num_meas_sub_expect;
 	unsigned int num_ul_meas;
-	unsigned int num_ul_meas_actual = 0;
+	unsigned int num_ul_meas_actual;
 	unsigned int num_ul_meas_subst = 0;
 	unsigned int num_ul_meas_expect;
 	unsigned int num_ul_meas_excess = 0;
-	int i;
+	unsigned int i;
 
 	/* if measurement period is not complete, abort */
 	if (!is_meas_complete(lchan, fn))
@@ -588,57 +650,45 @@ int lchan_meas_check_compute(struct gsm_lchan *lchan, uint32_t fn)
 		LOGP(DMEAS, LOGL_DEBUG, "%s received %u excess UL measurements\n", gsm_lchan_name(lchan),
 		     num_ul_meas_excess);
 
-	/* Measurement computation step 1: add up */
-	for (i = 0; i < num_ul_meas; i++) {
-		const struct bts_ul_meas *m;
-		bool is_sub = false;
-
-		/* Note: We will always compute over a full measurement,
-		 * interval even when not enough measurement samples are in
-		 * the buffer. As soon as we run out of measurement values
-		 * we continue the calculation using dummy values. This works
-		 * well for the BER, since there we can safely assume 100%
-		 * since a missing measurement means that the data (block)
-		 * is lost as well (some phys do not give us measurement
-		 * reports for lost blocks or blocks that are spaced out for
-		 * DTX). However, for RSSI and TA this does not work since
-		 * there we would distort the calculation if we would replace
-		 * them with a made up number. This means for those values we
-		 * only compute over the data we have actually received. */
-
-		if (i < lchan->meas.num_ul_meas) {
-			m = &lchan->meas.uplink[i + num_ul_meas_excess];
-			if (m->is_sub) {
-				irssi_sub_sum += m->inv_rssi;
-				num_meas_sub_actual++;
-				is_sub = true;
+	/* Measurement computation step 1: add up. The received measurements
+	 * have already been added up in lchan_new_ul_meas(). */
+	num_ul_meas_actual = lchan->meas.num_ul_meas - num_ul_meas_excess;
+	ber_full_sum = lchan->meas.ul_acc.ber_full_sum;
+	ber_sub_sum = lchan->meas.ul_acc.ber_sub_sum;
+	irssi_full_sum = lchan->meas.ul_acc.irssi_full_sum;
+	irssi_sub_sum = lchan->meas.ul_acc.irssi_sub_sum;
+	ta256b_sum = lchan->meas.ul_acc.ta256b_sum;
+	num_meas_sub_actual = lchan->meas.ul_acc.num_sub;
+	num_meas_sub = num_meas_sub_actual;
+
+	/* Note: We will always compute over a full measurement,
+	 * interval even when not enough measurement samples are in
+	 * the buffer. As soon as we run out of measurement values
+	 * we continue the calculation using dummy values. This works
+	 * well for the BER, since there we can safely assume 100%
+	 * since a missing measurement means that the data (block)
+	 * is lost as well (some phys do not give us measurement
+	 * reports for lost blocks or blocks that are spaced out for
+	 * DTX). However, for RSSI and TA this does not work since
+	 * there we would distort the calculation if we would replace
+	 * them with a made up number. This means for those values we
+	 * only compute over the data we have actually received. */
+	for (i = num_ul_meas_actual; i < num_ul_meas; i++) {
+		ber_full_sum += measurement_dummy.ber10k;
+
+		/* For AMR the amount of SUB frames is defined by the
+		 * the occurrence of DTX periods, which are dynamically
+		 * negotiated in AMR, so we can not know if and how many
+		 * SUB frames are missing. */
+		if (lchan->tch_mode != GSM48_CMODE_SPEECH_AMR) {
+			if (num_ul_meas_expect - i <= num_meas_sub_expect - num_meas_sub) {
+				num_meas_sub_subst++;
+				num_meas_sub++;
+				ber_sub_sum += measurement_dummy.ber10k;
 			}
-			irssi_full_sum += m->inv_rssi;
-			ta256b_sum += m->ta_offs_256bits;
-
-			num_ul_meas_actual++;
-		} else {
-			m = &measurement_dummy;
-
-			/* For AMR the amount of SUB frames is defined by the
-			 * the occurrence of DTX periods, which are dynamically
-			 * negotiated in AMR, so we can not know if and how many
-			 * SUB frames are missing. */
-			if (lchan->tch_mode != GSM48_CMODE_SPEECH_AMR) {
-				if (num_ul_meas_expect - i <= num_meas_sub_expect - num_meas_sub) {
-					num_meas_sub_subst++;
-					is_sub = true;
-				}
-			}
-
-			num_ul_meas_subst++;
 		}
 
-		ber_full_sum += m->ber10k;
-		if (is_sub) {
-			num_meas_sub++;
-			ber_sub_sum += m->ber10k;
-		}
+		num_ul_meas_subst++;
 	}
 
 	if (lchan->tch_mode != GSM48_CMODE_SPEECH_AMR) {
@@ -730,6 +780,7 @@ int lchan_meas_check_compute(struct gsm_lchan *lchan, uint32_t fn)
 	lchan_ms_ta_ctrl(lchan);
 
 	lchan->meas.num_ul_meas = 0;
+	memset(&lchan->meas.ul_acc, 0, sizeof(lchan->meas.ul_acc));
 
 	/* return 1 to indicate that the computation has been done and the next
 	 * interval begins. */
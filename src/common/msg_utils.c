@@ -94,13 +94,25 @@ static int check_manuf(struct msgb *msg, struct abis_om_hdr *omh, size_t msg_siz
 	return type;
 }
 
+/* feed an event into the DTX DL AMR state machine of the lchan */
+static int dtx_sm_dispatch(struct gsm_lchan *lchan, enum dtx_dl_amr_fsm_events e)
+{
+	int rc = dtx_dl_amr_sm_dispatch(&lchan->tch.dtx.dl_amr_sm, e);
+
+	if (rc < 0)
+		LOGPLCHAN(lchan, DL1P, LOGL_ERROR, "DTX DL: event %s not permitted in state %s\n",
+			  get_value_string(dtx_dl_amr_fsm_event_names, e),
+			  dtx_dl_amr_sm_state_name(&lchan->tch.dtx.dl_amr_sm));
+	return rc;
+}
+
 /* check that DTX is in the middle of silence */
 static inline bool dtx_is_update(const struct gsm_lchan *lchan)
 {
 	if (!dtx_dl_amr_enabled(lchan))
 		return false;
-	if (lchan->tch.dtx.dl_amr_fsm->state == ST_SID_U ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_U_NOINH)
+	if (lchan->tch.dtx.dl_amr_sm.state == ST_SID_U ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_U_NOINH)
 		return true;
 	return false;
 }
@@ -111,7 +123,7 @@ bool dtx_is_first_p1(const struct gsm_lchan *lchan)
 	if (!dtx_dl_amr_enabled(lchan))
 		return false;
 	if ((lchan->type == GSM_LCHAN_TCH_H &&
-	     lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F1))
+	     lchan->tch.dtx.dl_amr_sm.state == ST_SID_F1))
 		return true;
 	return false;
 }
@@ -181,7 +193,7 @@ int dtx_dl_amr_fsm_step(struct gsm_lchan *lchan, const uint8_t *rtp_pl,
 		if (lchan->type == GSM_LCHAN_TCH_H && !rtp_pl) {
 			/* we're called by gen_empty_tch_msg() to handle states
 			   specific to AMR HR DTX */
-			switch (lchan->tch.dtx.dl_amr_fsm->state) {
+			switch (lchan->tch.dtx.dl_amr_sm.state) {
 			case ST_SID_F2:
 				*len = 3; /* SID-FIRST P1 -> P2 completion */
 				memcpy(l1_payload, lchan->tch.dtx.cache, 2);
@@ -231,47 +243,38 @@ int dtx_dl_amr_fsm_step(struct gsm_lchan *lchan, const uint8_t *rtp_pl,
 
 	if (osmo_amr_is_speech(ft)) {
 		/* AMR HR - SID-FIRST_P1 Inhibition */
-		if (marker && lchan->tch.dtx.dl_amr_fsm->state == ST_VOICE)
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      E_INHIB, (void *)lchan);
+		if (marker && lchan->tch.dtx.dl_amr_sm.state == ST_VOICE)
+			return dtx_sm_dispatch(lchan, E_INHIB);
 
 		/* AMR HR - SID-UPDATE Inhibition */
 		if (marker && lchan->type == GSM_LCHAN_TCH_H &&
-		    lchan->tch.dtx.dl_amr_fsm->state == ST_SID_U)
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      E_INHIB, (void *)lchan);
+		    lchan->tch.dtx.dl_amr_sm.state == ST_SID_U)
+			return dtx_sm_dispatch(lchan, E_INHIB);
 
 		/* AMR FR & HR - generic */
-		if (marker && (lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F1 ||
-			       lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F2 ||
-			       lchan->tch.dtx.dl_amr_fsm->state == ST_U_NOINH))
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      E_ONSET, (void *)lchan);
+		if (marker && (lchan->tch.dtx.dl_amr_sm.state == ST_SID_F1 ||
+			       lchan->tch.dtx.dl_amr_sm.state == ST_SID_F2 ||
+			       lchan->tch.dtx.dl_amr_sm.state == ST_U_NOINH))
+			return dtx_sm_dispatch(lchan, E_ONSET);
 
-		if (lchan->tch.dtx.dl_amr_fsm->state != ST_VOICE)
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      E_VOICE, (void *)lchan);
+		if (lchan->tch.dtx.dl_amr_sm.state != ST_VOICE)
+			return dtx_sm_dispatch(lchan, E_VOICE);
 
 		return 0;
 	}
 
 	if (ft == AMR_SID) {
-		if (lchan->tch.dtx.dl_amr_fsm->state == ST_VOICE) {
+		if (lchan->tch.dtx.dl_amr_sm.state == ST_VOICE) {
 			/* SID FIRST/UPDATE scheduling logic relies on SID FIRST
 			   being sent first hence we have to force caching of SID
 			   as FIRST regardless of actually decoded type */
 			dtx_cache_payload(lchan, rtp_pl, rtp_pl_len, fn, false);
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      sti ? E_SID_U : E_SID_F,
-						      (void *)lchan);
-		} else if (lchan->tch.dtx.dl_amr_fsm->state != ST_FACCH)
+			return dtx_sm_dispatch(lchan, sti ? E_SID_U : E_SID_F);
+		} else if (lchan->tch.dtx.dl_amr_sm.state != ST_FACCH)
 			dtx_cache_payload(lchan, rtp_pl, rtp_pl_len, fn, sti);
-		if (lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F2)
-			return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						      E_COMPL, (void *)lchan);
-		return osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-					      sti ? E_SID_U : E_SID_F,
-					      (void *)lchan);
+		if (lchan->tch.dtx.dl_amr_sm.state == ST_SID_F2)
+			return dtx_sm_dispatch(lchan, E_COMPL);
+		return dtx_sm_dispatch(lchan, sti ? E_SID_U : E_SID_F);
 	}
 
 	if (ft != AMR_NO_DATA) {
@@ -280,8 +283,7 @@ int dtx_dl_amr_fsm_step(struct gsm_lchan *lchan, const uint8_t *rtp_pl,
 	}
 
 	if (marker)
-		osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm, E_VOICE,
-				       (void *)lchan);
+		dtx_sm_dispatch(lchan, E_VOICE);
 	*len = 0;
 	return 0;
 }
@@ -313,7 +315,7 @@ static inline bool dtx_amr_sid_optional(struct gsm_lchan *lchan, uint32_t fn)
 	uint32_t dx26 = 120 * (fn - lchan->tch.dtx.fn);
 
 	/* We're resuming after FACCH interruption */
-	if (lchan->tch.dtx.dl_amr_fsm->state == ST_FACCH) {
+	if (lchan->tch.dtx.dl_amr_sm.state == ST_FACCH) {
 		/* force STI bit to 0 so cache is treated as SID FIRST */
 		dtx_sti_unset(lchan);
 		lchan->tch.dtx.is_update = false;
@@ -344,7 +346,7 @@ static inline bool dtx_amr_sid_optional(struct gsm_lchan *lchan, uint32_t fn)
 		return true;
 	}
 
-	if (lchan->tch.dtx.dl_amr_fsm->state == ST_VOICE)
+	if (lchan->tch.dtx.dl_amr_sm.state == ST_VOICE)
 		return true;
 
 	/* according to 3GPP TS 26.093 A.5.1.1:
@@ -392,14 +394,14 @@ static inline bool dtx_sched_optional(struct gsm_lchan *lchan, uint32_t fn)
 }
 
 /*! \brief Check if DTX DL AMR is enabled for a given lchan (it have proper type,
- *         FSM is allocated etc.)
+ *         state machine is active etc.)
  *  \param[in] lchan Logical channel on which we check scheduling
  *  \returns true if DTX DL AMR is enabled, false otherwise
  */
 bool dtx_dl_amr_enabled(const struct gsm_lchan *lchan)
 {
 	if (lchan->ts->trx->bts->dtxd &&
-	    lchan->tch.dtx.dl_amr_fsm &&
+	    lchan->tch.dtx.dl_amr_sm.active &&
 	    lchan->tch_mode == GSM48_CMODE_SPEECH_AMR)
 		return true;
 	return false;
@@ -415,18 +417,18 @@ bool dtx_recursion(const struct gsm_lchan *lchan)
 	if (!dtx_dl_amr_enabled(lchan))
 		return false;
 
-	if (lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_V ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_F ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_V_REC ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_F_REC ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_V ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_F ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_V_REC ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_F_REC ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_F ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_V ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_F_REC ||
-	    lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_V_REC)
+	if (lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_V ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_F ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_V_REC ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_F_REC ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_V ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_F ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_V_REC ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_F_REC ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_F ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_V ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_F_REC ||
+	    lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_V_REC)
 		return true;
 
 	return false;
@@ -439,8 +441,7 @@ bool dtx_recursion(const struct gsm_lchan *lchan)
 void dtx_dispatch(struct gsm_lchan *lchan, enum dtx_dl_amr_fsm_events e)
 {
 	if (dtx_dl_amr_enabled(lchan))
-		osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm, e,
-				       (void *)lchan);
+		dtx_sm_dispatch(lchan, e);
 }
 
 /*! \brief Send internal signal to FSM: check that DTX is enabled for this chan,
@@ -480,24 +481,21 @@ uint8_t repeat_last_sid(struct gsm_lchan *lchan, uint8_t *dst, uint32_t fn)
 	if (lchan->tch.dtx.len) {
 		if (dtx_dl_amr_enabled(lchan)) {
 			if ((lchan->type == GSM_LCHAN_TCH_H &&
-			     lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F2) ||
+			     lchan->tch.dtx.dl_amr_sm.state == ST_SID_F2) ||
 			    (lchan->type == GSM_LCHAN_TCH_F &&
-			     lchan->tch.dtx.dl_amr_fsm->state == ST_SID_F1)) {
+			     lchan->tch.dtx.dl_amr_sm.state == ST_SID_F1)) {
 				/* advance FSM in case we've just sent SID FIRST
 				   to restore silence after FACCH interruption */
-				osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-						       E_SID_U, (void *)lchan);
+				dtx_sm_dispatch(lchan, E_SID_U);
 				dtx_sti_unset(lchan);
 			} else if (dtx_is_update(lchan)) {
 				/* enforce SID UPDATE for next repetition: it
 				   might have been altered by FACCH handling */
 				dtx_sti_set(lchan);
 				if (lchan->type == GSM_LCHAN_TCH_H &&
-				    lchan->tch.dtx.dl_amr_fsm->state ==
+				    lchan->tch.dtx.dl_amr_sm.state ==
 				    ST_U_NOINH)
-					osmo_fsm_inst_dispatch(lchan->tch.dtx.dl_amr_fsm,
-							       E_COMPL,
-							       (void *)lchan);
+					dtx_sm_dispatch(lchan, E_COMPL);
 				lchan->tch.dtx.is_update = true;
 			}
 		}
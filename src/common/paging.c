@@ -32,6 +32,7 @@
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/linuxlist.h>
+#include <osmocom/core/timer.h>
 
 #include <osmocom/gsm/protocol/gsm_04_08.h>
 #include <osmocom/gsm/gsm0502.h>
@@ -47,16 +48,35 @@
 #define MAX_PAGING_BLOCKS_CCCH	9
 #define MAX_BS_PA_MFRMS		9
 
+/* number of one-second slots in the expiry timing wheel; must be a power of
+ * two and should exceed the maximum lifetime (60s) */
+#define PAGING_WHEEL_SLOTS	64
+/* slab records reserved for IMM.ASS from the PCU on top of num_paging_max */
+#define PAGING_IMM_ASS_RESERVE	16
+/* number of records at the head of a group queue considered for packing */
+#define PAGING_PACK_WINDOW	8
+/* a record passed over this many times is always part of the next block */
+#define PAGING_PACK_MAX_SKIP	4
+
 enum paging_record_type {
 	PAGING_RECORD_PAGING,
 	PAGING_RECORD_IMM_ASS
 };
 
 struct paging_record {
+	/* entry in group queue (when in use) or slab free list */
 	struct llist_head list;
 	enum paging_record_type type;
 	union {
 		struct {
+			/* entry in expiry timing wheel slot, once sent */
+			struct llist_head exp_list;
+			/* time at which the timing wheel will drop this record */
+			time_t deadline;
+			/* has this record been transmitted at least once? */
+			bool sent;
+			/* how often was this record passed over by paging_pack() */
+			uint8_t skipped;
 			time_t expiration_time;
 			uint8_t chan_needed;
 			uint8_t identity_lv[9];
@@ -80,8 +100,29 @@ struct paging_state {
 	/* total number of currently active paging records in queue */
 	unsigned int num_paging;
 	struct llist_head paging_queue[MAX_PAGING_BLOCKS_CCCH*MAX_BS_PA_MFRMS];
+
+	/* fixed-capacity slab from which all paging records are taken */
+	struct paging_record *slab;
+	unsigned int slab_size;
+	struct llist_head free_list;
+
+	/* timing wheel for proactive expiry of paging records (1s per slot) */
+	struct llist_head exp_wheel[PAGING_WHEEL_SLOTS];
+	time_t wheel_time;
 };
 
+static int paging_slab_resize(struct paging_state *ps, unsigned int num_paging_max);
+
+/* Current time in seconds, through osmo_gettimeofday() so that the paging
+ * lifetime follows a virtual clock where one is used */
+static time_t paging_now(void)
+{
+	struct timeval tv;
+
+	osmo_gettimeofday(&tv, NULL);
+	return tv.tv_sec;
+}
+
 unsigned int paging_get_lifetime(struct paging_state *ps)
 {
 	return ps->paging_lifetime;
@@ -99,9 +140,145 @@ void paging_set_lifetime(struct paging_state *ps, unsigned int lifetime)
 
 void paging_set_queue_max(struct paging_state *ps, unsigned int queue_max)
 {
+	if (paging_slab_resize(ps, queue_max) < 0) {
+		LOGP(DPAG, LOGL_ERROR, "Unable to resize paging queue to %u records\n",
+			queue_max);
+		return;
+	}
 	ps->num_paging_max = queue_max;
 }
 
+/* Take a record from the slab, NULL if all records are in use */
+static struct paging_record *pr_alloc(struct paging_state *ps)
+{
+	struct paging_record *pr;
+
+	if (llist_empty(&ps->free_list))
+		return NULL;
+
+	pr = llist_entry(ps->free_list.next, struct paging_record, list);
+	llist_del(&pr->list);
+	memset(pr, 0, sizeof(*pr));
+	INIT_LLIST_HEAD(&pr->list);
+
+	return pr;
+}
+
+/* Return a record (which must not be part of any group queue) to the slab */
+static void pr_free(struct paging_state *ps, struct paging_record *pr)
+{
+	if (pr->type == PAGING_RECORD_PAGING)
+		llist_del_init(&pr->u.paging.exp_list);
+	llist_add(&pr->list, &ps->free_list);
+}
+
+/* (Re-)insert a paging record into the slot of the timing wheel which
+ * corresponds to its (current) deadline.  A record which has never been
+ * transmitted stays out of the wheel, every identity is paged at least once. */
+static void pr_wheel_update(struct paging_state *ps, struct paging_record *pr)
+{
+	llist_del_init(&pr->u.paging.exp_list);
+	if (!pr->u.paging.sent)
+		return;
+
+	pr->u.paging.deadline = pr->u.paging.expiration_time;
+	llist_add_tail(&pr->u.paging.exp_list,
+		       &ps->exp_wheel[pr->u.paging.deadline % PAGING_WHEEL_SLOTS]);
+}
+
+/* Expire all paging records whose deadline has passed.  Each wheel slot is
+ * visited once per second, so this is cheap enough to be called for every
+ * PCH block. */
+static void paging_wheel_advance(struct paging_state *ps, time_t now)
+{
+	unsigned int n_slots;
+
+	if (now <= ps->wheel_time)
+		return;
+
+	if (now - ps->wheel_time >= PAGING_WHEEL_SLOTS)
+		n_slots = PAGING_WHEEL_SLOTS;
+	else
+		n_slots = now - ps->wheel_time;
+
+	while (n_slots--) {
+		struct llist_head *slot = &ps->exp_wheel[(now - n_slots) % PAGING_WHEEL_SLOTS];
+		struct paging_record *pr, *pr2;
+
+		llist_for_each_entry_safe(pr, pr2, slot, u.paging.exp_list) {
+			if (pr->u.paging.deadline > now)
+				continue;
+			ps->num_paging--;
+			LOGP(DPAG, LOGL_INFO, "Expired paging record, queue_len=%u\n",
+			     ps->num_paging);
+			llist_del(&pr->list);
+			pr_free(ps, pr);
+		}
+	}
+
+	ps->wheel_time = now;
+}
+
+/* Re-allocate the slab for a new queue size, migrating all queued records.
+ * Records that do not fit into a smaller slab are dropped. */
+static int paging_slab_resize(struct paging_state *ps, unsigned int num_paging_max)
+{
+	struct paging_record *old_slab = ps->slab;
+	struct paging_record *new_slab;
+	unsigned int i, new_size = num_paging_max + PAGING_IMM_ASS_RESERVE;
+
+	if (old_slab && new_size == ps->slab_size)
+		return 0;
+
+	new_slab = talloc_zero_array(ps, struct paging_record, new_size);
+	if (!new_slab)
+		return -ENOMEM;
+
+	ps->slab = new_slab;
+	ps->slab_size = new_size;
+	INIT_LLIST_HEAD(&ps->free_list);
+	for (i = 0; i < new_size; i++)
+		llist_add_tail(&new_slab[i].list, &ps->free_list);
+	for (i = 0; i < ARRAY_SIZE(ps->exp_wheel); i++)
+		INIT_LLIST_HEAD(&ps->exp_wheel[i]);
+
+	if (!old_slab)
+		return 0;
+
+	ps->num_paging = 0;
+	for (i = 0; i < ARRAY_SIZE(ps->paging_queue); i++) {
+		struct llist_head *group_q = &ps->paging_queue[i];
+		struct paging_record *pr, *pr2, *npr;
+		LLIST_HEAD(old_q);
+
+		llist_splice_init(group_q, &old_q);
+		llist_for_each_entry_safe(pr, pr2, &old_q, list) {
+			if (pr->type == PAGING_RECORD_PAGING && ps->num_paging >= num_paging_max)
+				npr = NULL;
+			else
+				npr = pr_alloc(ps);
+			if (!npr) {
+				LOGP(DPAG, LOGL_NOTICE, "Dropping paging record, queue shrunk to %u\n",
+				     num_paging_max);
+				if (pr->type == PAGING_RECORD_PAGING)
+					rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP);
+				continue;
+			}
+			npr->type = pr->type;
+			npr->u = pr->u;
+			llist_add_tail(&npr->list, group_q);
+			if (npr->type == PAGING_RECORD_PAGING) {
+				INIT_LLIST_HEAD(&npr->u.paging.exp_list);
+				pr_wheel_update(ps, npr);
+				ps->num_paging++;
+			}
+		}
+	}
+
+	talloc_free(old_slab);
+	return 0;
+}
+
 static int tmsi_mi_to_uint(uint32_t *out, const uint8_t *tmsi_lv)
 {
 	if (tmsi_lv[0] < 5)
@@ -165,6 +342,48 @@ static int get_pag_subch_nr(struct paging_state *ps, struct gsm_time *gt)
 	return pag_idx + mfrm_part;
 }
 
+/* duration of one paging cycle (until a paging group recurs) in seconds,
+ * rounded up */
+static unsigned int paging_cycle_secs(struct paging_state *ps)
+{
+	unsigned int cycle_us = (ps->chan_desc.bs_pa_mfrms + 2) * 51 * 4615;
+
+	return (cycle_us + 999999) / 1000000;
+}
+
+/* Check whether the paging block at the given time must carry paging, i.e.
+ * whether any of the records it would carry has its last chance of being
+ * sent before the next occurrence of its paging group. */
+int paging_group_urgent(struct paging_state *ps, struct gsm_time *gt)
+{
+	struct llist_head *group_q;
+	struct paging_record *pr;
+	unsigned int i = 0;
+	time_t now = paging_now();
+	int group;
+
+	/* ETWS primary notifications are sent continuously */
+	if (ps->bts->etws.prim_notif)
+		return 1;
+
+	group = get_pag_subch_nr(ps, gt);
+	if (group < 0)
+		return 0;
+	group_q = &ps->paging_queue[group];
+
+	llist_for_each_entry(pr, group_q, list) {
+		if (i++ >= PAGING_PACK_WINDOW)
+			break;
+		/* IMM.ASS from the PCU have their own deadline */
+		if (pr->type == PAGING_RECORD_IMM_ASS)
+			return 1;
+		if (pr->u.paging.deadline < now + paging_cycle_secs(ps))
+			return 1;
+	}
+
+	return 0;
+}
+
 int paging_buffer_space(struct paging_state *ps)
 {
 	if (ps->num_paging >= ps->num_paging_max)
@@ -190,6 +409,9 @@ int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
 		return -EINVAL;
 	}
 
+	/* make sure stale records don't occupy the queue */
+	paging_wheel_advance(ps, paging_now());
+
 	if (ps->num_paging >= ps->num_paging_max) {
 		LOGP(DPAG, LOGL_NOTICE, "Dropping paging, queue full (%u)\n",
 			ps->num_paging);
@@ -206,27 +428,31 @@ int paging_add_identity(struct paging_state *ps, uint8_t paging_group,
 							identity_lv[0])) {
 			LOGP(DPAG, LOGL_INFO, "Ignoring duplicate paging\n");
 			pr->u.paging.expiration_time =
-					time(NULL) + ps->paging_lifetime;
+					paging_now() + ps->paging_lifetime;
+			pr_wheel_update(ps, pr);
 			return -EEXIST;
 		}
 	}
 
-	pr = talloc_zero(ps, struct paging_record);
-	if (!pr)
-		return -ENOMEM;
-	pr->type = PAGING_RECORD_PAGING;
-
-	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv)) {
-		talloc_free(pr);
+	if (*identity_lv + 1 > sizeof(pr->u.paging.identity_lv))
 		return -E2BIG;
+
+	pr = pr_alloc(ps);
+	if (!pr) {
+		LOGP(DPAG, LOGL_NOTICE, "Dropping paging, no free record\n");
+		rate_ctr_inc2(ps->bts->ctrs, BTS_CTR_PAGING_DROP);
+		return -ENOSPC;
 	}
+	pr->type = PAGING_RECORD_PAGING;
+	INIT_LLIST_HEAD(&pr->u.paging.exp_list);
 
 	LOGP(DPAG, LOGL_INFO, "Add paging to queue (group=%u, queue_len=%u)\n",
 		paging_group, ps->num_paging+1);
 
-	pr->u.paging.expiration_time = time(NULL) + ps->paging_lifetime;
+	pr->u.paging.expiration_time = paging_now() + ps->paging_lifetime;
 	pr->u.paging.chan_needed = chan_needed;
 	memcpy(&pr->u.paging.identity_lv, identity_lv, identity_lv[0]+1);
+	pr_wheel_update(ps, pr);
 
 	/* enqueue the new identity to the HEAD of the queue,
 	 * to ensure it will be paged quickly at least once.  */
@@ -257,9 +483,11 @@ int paging_add_imm_ass(struct paging_state *ps, const uint8_t *data,
 
 	group_q = &ps->paging_queue[paging_group];
 
-	pr = talloc_zero(ps, struct paging_record);
-	if (!pr)
-		return -ENOMEM;
+	pr = pr_alloc(ps);
+	if (!pr) {
+		LOGP(DPAG, LOGL_NOTICE, "Dropping IMM.ASS, no free record\n");
+		return -ENOSPC;
+	}
 	pr->type = PAGING_RECORD_IMM_ASS;
 
 	LOGP(DPAG, LOGL_INFO, "Add IMM.ASS to queue (group=%u)\n",
@@ -455,16 +683,6 @@ static int fill_paging_type_3(uint8_t *out_buf, const uint8_t *tmsi1_lv, uint8_t
 
 static const uint8_t empty_id_lv[] = { 0x01, 0xF0 };
 
-static struct paging_record *dequeue_pr(struct llist_head *group_q)
-{
-	struct paging_record *pr;
-
-	pr = llist_entry(group_q->next, struct paging_record, list);
-	llist_del(&pr->list);
-
-	return pr;
-}
-
 static int pr_is_imsi(struct paging_record *pr)
 {
 	if ((pr->u.paging.identity_lv[1] & 7) == GSM_MI_TYPE_IMSI)
@@ -493,6 +711,116 @@ static void sort_pr_tmsi_imsi(struct paging_record *pr[], unsigned int n)
 	}
 }
 
+/* Try to select 'total' records out of the ordered candidate array, of which
+ * the first 'n_must' are mandatory, with at least 'min_tmsi' TMSIs and at most
+ * 'max_imsi' IMSIs. Returns the number of selected records or 0 on failure. */
+static unsigned int pack_select(struct paging_record *sel[4], struct paging_record *cand[],
+				unsigned int n_cand, unsigned int n_must, unsigned int total,
+				unsigned int min_tmsi, unsigned int max_imsi)
+{
+	bool used[PAGING_PACK_WINDOW] = { false };
+	unsigned int i, n_sel = 0, n_tmsi = 0, n_imsi = 0;
+
+	if (n_must > total)
+		return 0;
+
+	for (i = 0; i < n_must; i++) {
+		if (pr_is_imsi(cand[i]))
+			n_imsi++;
+		else
+			n_tmsi++;
+		used[i] = true;
+		sel[n_sel++] = cand[i];
+	}
+	if (n_imsi > max_imsi)
+		return 0;
+
+	/* first fill the slots which can only carry a TMSI */
+	for (i = n_must; i < n_cand && n_tmsi < min_tmsi && n_sel < total; i++) {
+		if (pr_is_imsi(cand[i]))
+			continue;
+		used[i] = true;
+		sel[n_sel++] = cand[i];
+		n_tmsi++;
+	}
+	if (n_tmsi < min_tmsi)
+		return 0;
+
+	/* then the remaining slots with any identity */
+	for (i = n_must; i < n_cand && n_sel < total; i++) {
+		if (used[i])
+			continue;
+		if (pr_is_imsi(cand[i])) {
+			if (n_imsi >= max_imsi)
+				continue;
+			n_imsi++;
+		}
+		used[i] = true;
+		sel[n_sel++] = cand[i];
+	}
+	if (n_sel < total)
+		return 0;
+
+	return n_sel;
+}
+
+/* Select up to four paging records from the first PAGING_PACK_WINDOW records
+ * of a group queue, so that the resulting PAGING REQUEST carries as many
+ * identities as possible.  The head of the queue as well as any record that
+ * was passed over PAGING_PACK_MAX_SKIP times is always part of the selection.
+ * The selected records are removed from the queue. */
+static unsigned int paging_pack(struct llist_head *group_q, struct paging_record *sel[4])
+{
+	struct paging_record *win[PAGING_PACK_WINDOW];
+	struct paging_record *cand[PAGING_PACK_WINDOW];
+	struct paging_record *pr;
+	unsigned int i, j, n_win = 0, n_cand = 0, n_must, n_sel;
+
+	llist_for_each_entry(pr, group_q, list) {
+		if (pr->type != PAGING_RECORD_PAGING)
+			break;
+		win[n_win++] = pr;
+		if (n_win >= ARRAY_SIZE(win))
+			break;
+	}
+	if (n_win == 0)
+		return 0;
+
+	/* order candidates: head of queue, aged records, all others */
+	cand[n_cand++] = win[0];
+	for (i = 1; i < n_win; i++) {
+		if (win[i]->u.paging.skipped >= PAGING_PACK_MAX_SKIP)
+			cand[n_cand++] = win[i];
+	}
+	n_must = n_cand;
+	for (i = 1; i < n_win; i++) {
+		if (win[i]->u.paging.skipped < PAGING_PACK_MAX_SKIP)
+			cand[n_cand++] = win[i];
+	}
+
+	/* Type 3 (4 TMSI), Type 2 (2 TMSI + 1 xMSI), Type 1 (2 xMSI) */
+	n_sel = pack_select(sel, cand, n_cand, n_must, 4, 4, 0);
+	if (!n_sel)
+		n_sel = pack_select(sel, cand, n_cand, n_must, 3, 2, 1);
+	if (!n_sel)
+		n_sel = pack_select(sel, cand, n_cand, OSMO_MIN(n_must, 2),
+				    OSMO_MIN(n_cand, 2), 0, 2);
+
+	/* dequeue selected records, age the ones we passed over */
+	for (i = 0; i < n_win; i++) {
+		for (j = 0; j < n_sel; j++) {
+			if (win[i] == sel[j])
+				break;
+		}
+		if (j < n_sel)
+			llist_del(&win[i]->list);
+		else if (win[i]->u.paging.skipped < UINT8_MAX)
+			win[i]->u.paging.skipped++;
+	}
+
+	return n_sel;
+}
+
 static void build_p1_rest_octets(struct p1_rest_octets *p1ro, struct gsm_bts *bts)
 {
 	memset(p1ro, 0, sizeof(*p1ro));
@@ -531,6 +859,8 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 	*is_empty = 0;
 	bts->load.ccch.pch_total += 1;
 
+	paging_wheel_advance(ps, paging_now());
+
 	group = get_pag_subch_nr(ps, gt);
 	if (group < 0) {
 		LOGP(DPAG, LOGL_ERROR,
@@ -552,47 +882,41 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 					 NULL, 0, NULL);
 		*is_empty = 1;
 	} else {
-		struct paging_record *pr[4];
-		unsigned int num_pr = 0, imm_ass = 0;
-		time_t now = time(NULL);
+		struct paging_record *pr[4], *ia;
+		unsigned int num_pr;
+		time_t now = paging_now();
 		unsigned int i, num_imsi = 0;
 
 		bts->load.ccch.pch_used += 1;
 
-		/* get (if we have) up to four paging records */
-		for (i = 0; i < ARRAY_SIZE(pr); i++) {
-			if (llist_empty(group_q))
+		/* an IMMEDIATE ASSIGNMENT among the first four records
+		 * takes precedence over paging */
+		i = 0;
+		llist_for_each_entry(ia, group_q, list) {
+			if (i++ >= ARRAY_SIZE(pr))
 				break;
-			pr[i] = dequeue_pr(group_q);
+			if (ia->type != PAGING_RECORD_IMM_ASS)
+				continue;
 
-			/* check for IMM.ASS */
-			if (pr[i]->type == PAGING_RECORD_IMM_ASS) {
-				imm_ass = 1;
-				break;
-			}
+			/* get message and free record */
+			llist_del(&ia->list);
+			memcpy(out_buf, ia->u.imm_ass.msg, GSM_MACBLOCK_LEN);
+			pcu_tx_pch_data_cnf(gt->fn, ia->u.imm_ass.msg,
+							GSM_MACBLOCK_LEN);
+			pr_free(ps, ia);
+			return GSM_MACBLOCK_LEN;
+		}
 
-			num_pr++;
+		/* pick the records which fill the block best */
+		num_pr = paging_pack(group_q, pr);
+		OSMO_ASSERT(num_pr > 0);
 
-			/* count how many IMSIs are among them */
+		/* count how many IMSIs are among them */
+		for (i = 0; i < num_pr; i++) {
 			if (pr_is_imsi(pr[i]))
 				num_imsi++;
 		}
 
-		/* if we have an IMMEDIATE ASSIGNMENT */
-		if (imm_ass) {
-			/* re-add paging records */
-			for (i = 0; i < num_pr; i++)
-				llist_add(&pr[i]->list, group_q);
-
-			/* get message and free record */
-			memcpy(out_buf, pr[num_pr]->u.imm_ass.msg,
-							GSM_MACBLOCK_LEN);
-			pcu_tx_pch_data_cnf(gt->fn, pr[num_pr]->u.imm_ass.msg,
-							GSM_MACBLOCK_LEN);
-			talloc_free(pr[num_pr]);
-			return GSM_MACBLOCK_LEN;
-		}
-
 		/* make sure the TMSIs are ahead of the IMSIs in the array */
 		sort_pr_tmsi_imsi(pr, num_pr);
 
@@ -608,8 +932,8 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[2]->u.paging.chan_needed,
 						 pr[3]->u.paging.identity_lv,
 						 pr[3]->u.paging.chan_needed);
-		} else if (num_pr >= 3 && num_imsi <= 1) {
-			/* 3 or 4, of which only up to 1 is IMSI */
+		} else if (num_pr == 3) {
+			/* 3, of which only up to 1 is IMSI */
 			DEBUGP(DPAG, "Tx PAGING TYPE 2 (2 TMSI,1 xMSI)\n");
 			len = fill_paging_type_2(out_buf,
 						 pr[0]->u.paging.identity_lv,
@@ -617,11 +941,6 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[1]->u.paging.identity_lv,
 						 pr[1]->u.paging.chan_needed,
 						 pr[2]->u.paging.identity_lv);
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
 		} else if (num_pr == 1) {
 			DEBUGP(DPAG, "Tx PAGING TYPE 1 (1 xMSI,1 empty)\n");
 			len = fill_paging_type_1(out_buf,
@@ -629,40 +948,33 @@ int paging_gen_msg(struct paging_state *ps, uint8_t *out_buf, struct gsm_time *g
 						 pr[0]->u.paging.chan_needed,
 						 NULL, 0, NULL);
 		} else {
-			/* 2 (any type) or
-			 * 3 or 4, of which only 2 will be sent */
+			/* 2 (any type) */
 			DEBUGP(DPAG, "Tx PAGING TYPE 1 (2 xMSI)\n");
 			len = fill_paging_type_1(out_buf,
 						 pr[0]->u.paging.identity_lv,
 						 pr[0]->u.paging.chan_needed,
 						 pr[1]->u.paging.identity_lv,
 						 pr[1]->u.paging.chan_needed, NULL);
-			if (num_pr >= 3) {
-				/* re-add #4 for next time */
-				llist_add(&pr[2]->list, group_q);
-				pr[2] = NULL;
-			}
-			if (num_pr == 4) {
-				/* re-add #4 for next time */
-				llist_add(&pr[3]->list, group_q);
-				pr[3] = NULL;
-			}
 		}
 
 		for (i = 0; i < num_pr; i++) {
-			/* skip those that we might have re-added above */
-			if (pr[i] == NULL)
-				continue;
 			rate_ctr_inc2(bts->ctrs, BTS_CTR_PAGING_SENT);
+			pr[i]->u.paging.skipped = 0;
 			/* check if we can expire the paging record,
 			 * or if we need to re-queue it */
 			if (pr[i]->u.paging.expiration_time <= now) {
-				talloc_free(pr[i]);
+				pr_free(ps, pr[i]);
 				ps->num_paging--;
 				LOGP(DPAG, LOGL_INFO, "Removed paging record, queue_len=%u\n",
 					ps->num_paging);
-			} else
+			} else {
+				if (!pr[i]->u.paging.sent) {
+					/* from now on the wheel may expire it */
+					pr[i]->u.paging.sent = true;
+					pr_wheel_update(ps, pr[i]);
+				}
 				llist_add_tail(&pr[i]->list, group_q);
+			}
 		}
 	}
 	memset(out_buf+len, 0x2B, GSM_MACBLOCK_LEN-len);
@@ -709,10 +1021,16 @@ struct paging_state *paging_init(struct gsm_bts *bts,
 	ps->bts = bts;
 	ps->paging_lifetime = paging_lifetime;
 	ps->num_paging_max = num_paging_max;
+	ps->wheel_time = paging_now();
 
 	for (i = 0; i < ARRAY_SIZE(ps->paging_queue); i++)
 		INIT_LLIST_HEAD(&ps->paging_queue[i]);
 
+	if (paging_slab_resize(ps, num_paging_max) < 0) {
+		talloc_free(ps);
+		return NULL;
+	}
+
 	if (!initialized) {
 		osmo_signal_register_handler(SS_GLOBAL, paging_signal_cbfn, NULL);
 		initialized = 1;
@@ -724,7 +1042,7 @@ void paging_config(struct paging_state *ps,
 		  unsigned int num_paging_max,
 		  unsigned int paging_lifetime)
 {
-	ps->num_paging_max = num_paging_max;
+	paging_set_queue_max(ps, num_paging_max);
 	ps->paging_lifetime = paging_lifetime;
 }
 
@@ -737,8 +1055,9 @@ void paging_reset(struct paging_state *ps)
 		struct paging_record *pr, *pr2;
 		llist_for_each_entry_safe(pr, pr2, queue, list) {
 			llist_del(&pr->list);
-			talloc_free(pr);
-			ps->num_paging--;
+			if (pr->type == PAGING_RECORD_PAGING)
+				ps->num_paging--;
+			pr_free(ps, pr);
 		}
 	}
 
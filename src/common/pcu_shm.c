@@ -0,0 +1,300 @@
+/* pcu_shm.c: shared memory PDTCH data plane towards the PCU */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc.,
+ * 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/utils.h>
+
+#include <osmo-bts/logging.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/pcu_if.h>
+#include <osmo-bts/pcuif_proto.h>
+
+/* records which did not fit into the ring of their timeslot yet */
+#define PCU_SHM_BACKLOG_MAX	PCU_IF_SHM_RING_LEN
+
+struct pcu_shm_pending {
+	struct llist_head list;
+	struct gsm_pcu_if_shm_rec rec;
+};
+
+struct pcu_shm_backlog {
+	struct llist_head list;		/* of struct pcu_shm_pending */
+	unsigned int len;
+};
+
+struct pcu_shm {
+	/* the shared memory, one gsm_pcu_if_shm_ts per timeslot */
+	struct gsm_pcu_if_shm_ts *ts;
+	/* per timeslot, records waiting for room in the ul ring; nothing
+	 * overtakes them, so the PCU sees the records in order */
+	struct pcu_shm_backlog *backlog;
+	unsigned int backlog_len;
+	size_t size;
+	unsigned int num_trx;
+	int mem_fd;
+	/* eventfd to signal the PCU that an ul ring became non-empty */
+	int ul_fd;
+	/* eventfd the PCU signals us with, for the dl rings */
+	struct osmo_fd dl_ofd;
+	pcu_shm_rx_cb *rx_cb;
+	void *rx_data;
+};
+
+/* Add a record, return 1 if the consumer has to be signalled */
+static int ring_put(struct gsm_pcu_if_shm_ring *ring, const struct gsm_pcu_if_shm_rec *rec)
+{
+	uint32_t head = ring->head;
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= PCU_IF_SHM_RING_LEN)
+		return -ENOSPC;
+
+	memcpy(&ring->rec[head % PCU_IF_SHM_RING_LEN], rec, sizeof(*rec));
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+
+	/* Pairs with the fence in ring_drain(): either the consumer sees the
+	 * new head before it goes to sleep, or we see that it has consumed
+	 * everything up to the previous head and wake it up. */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return __atomic_load_n(&ring->tail, __ATOMIC_RELAXED) == head;
+}
+
+static void ring_drain(struct pcu_shm *shm, struct gsm_pcu_if_shm_ring *ring,
+		       uint8_t trx_nr, uint8_t ts_nr)
+{
+	uint32_t tail = ring->tail;
+	uint32_t head;
+
+	while (1) {
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		if (head == tail) {
+			__atomic_thread_fence(__ATOMIC_SEQ_CST);
+			if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == tail)
+				break;
+			continue;
+		}
+		shm->rx_cb(shm->rx_data, trx_nr, ts_nr, &ring->rec[tail % PCU_IF_SHM_RING_LEN]);
+		__atomic_store_n(&ring->tail, ++tail, __ATOMIC_RELEASE);
+	}
+}
+
+static int pcu_shm_dl_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct pcu_shm *shm = ofd->data;
+	uint64_t val;
+	unsigned int i;
+
+	/* reset the doorbell before looking at the rings, so that a record
+	 * added after we drained a ring signals us again */
+	if (read(ofd->fd, &val, sizeof(val)) < 0 && errno != EAGAIN)
+		return -errno;
+
+	for (i = 0; i < shm->num_trx * 8; i++)
+		ring_drain(shm, &shm->ts[i].dl, i / 8, i % 8);
+
+	return 0;
+}
+
+static int pcu_shm_destructor(struct pcu_shm *shm)
+{
+	if (shm->dl_ofd.fd >= 0) {
+		osmo_fd_unregister(&shm->dl_ofd);
+		close(shm->dl_ofd.fd);
+	}
+	if (shm->ul_fd >= 0)
+		close(shm->ul_fd);
+	if (shm->ts)
+		munmap(shm->ts, shm->size);
+	if (shm->mem_fd >= 0)
+		close(shm->mem_fd);
+	return 0;
+}
+
+struct pcu_shm *pcu_shm_alloc(void *ctx, unsigned int num_trx, pcu_shm_rx_cb *rx_cb, void *rx_data)
+{
+	struct pcu_shm *shm;
+	unsigned int i;
+	void *mem;
+
+	shm = talloc_zero(ctx, struct pcu_shm);
+	if (!shm)
+		return NULL;
+	shm->mem_fd = shm->ul_fd = shm->dl_ofd.fd = -1;
+	talloc_set_destructor(shm, pcu_shm_destructor);
+
+	shm->num_trx = num_trx;
+	shm->size = num_trx * 8 * sizeof(struct gsm_pcu_if_shm_ts);
+	shm->rx_cb = rx_cb;
+	shm->rx_data = rx_data;
+
+	shm->backlog = talloc_zero_array(shm, struct pcu_shm_backlog, num_trx * 8);
+	if (!shm->backlog)
+		goto err;
+	for (i = 0; i < num_trx * 8; i++)
+		INIT_LLIST_HEAD(&shm->backlog[i].list);
+
+	shm->mem_fd = memfd_create("osmo-bts-pcu", MFD_CLOEXEC);
+	if (shm->mem_fd < 0 || ftruncate(shm->mem_fd, shm->size) < 0)
+		goto err;
+	mem = mmap(NULL, shm->size, PROT_READ | PROT_WRITE, MAP_SHARED, shm->mem_fd, 0);
+	if (mem == MAP_FAILED)
+		goto err;
+	shm->ts = mem;
+
+	shm->ul_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shm->ul_fd < 0)
+		goto err;
+	shm->dl_ofd.fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (shm->dl_ofd.fd < 0)
+		goto err;
+	shm->dl_ofd.when = OSMO_FD_READ;
+	shm->dl_ofd.cb = pcu_shm_dl_cb;
+	shm->dl_ofd.data = shm;
+	if (osmo_fd_register(&shm->dl_ofd) < 0) {
+		close(shm->dl_ofd.fd);
+		shm->dl_ofd.fd = -1;
+		goto err;
+	}
+
+	LOGP(DPCU, LOGL_INFO, "Allocated %zu bytes of shared memory for %u TRX\n",
+	     shm->size, num_trx);
+	return shm;
+
+err:
+	LOGP(DPCU, LOGL_ERROR, "Failed to set up the shared memory data plane: %s\n",
+	     strerror(errno));
+	talloc_free(shm);
+	return NULL;
+}
+
+void pcu_shm_free(struct pcu_shm *shm)
+{
+	talloc_free(shm);
+}
+
+/* Fill the SHM_CNF for the PCU and the fds to pass along with it */
+void pcu_shm_cnf(const struct pcu_shm *shm, struct gsm_pcu_if_shm_cnf *cnf, int fds[3])
+{
+	cnf->version = PCU_IF_SHM_VERSION;
+	cnf->num_trx = shm->num_trx;
+	cnf->ring_len = PCU_IF_SHM_RING_LEN;
+	cnf->size = shm->size;
+
+	fds[0] = shm->mem_fd;
+	fds[1] = shm->ul_fd;
+	fds[2] = shm->dl_ofd.fd;
+}
+
+/* Move records of a timeslot from the backlog into its ring, as far as
+ * there is room.  Return 1 if the consumer has to be signalled. */
+static int backlog_flush(struct pcu_shm *shm, unsigned int idx)
+{
+	struct pcu_shm_backlog *bl = &shm->backlog[idx];
+	struct pcu_shm_pending *p, *p2;
+	int rc, signal = 0;
+
+	llist_for_each_entry_safe(p, p2, &bl->list, list) {
+		rc = ring_put(&shm->ts[idx].ul, &p->rec);
+		if (rc < 0)
+			break;
+		signal |= rc;
+		llist_del(&p->list);
+		talloc_free(p);
+		bl->len--;
+		shm->backlog_len--;
+	}
+	return signal;
+}
+
+static int pcu_shm_signal(struct pcu_shm *shm)
+{
+	const uint64_t one = 1;
+
+	if (write(shm->ul_fd, &one, sizeof(one)) < 0 && errno != EAGAIN)
+		return -errno;
+	return 0;
+}
+
+/* Pass a record to the PCU.  If the ring of the timeslot is full, the record
+ * waits in the backlog until the PCU catches up (see pcu_shm_flush()), the
+ * records of a timeslot are never reordered.  Return -ENOSPC if the backlog
+ * is full as well and the record was dropped. */
+int pcu_shm_tx(struct pcu_shm *shm, uint8_t trx_nr, uint8_t ts_nr,
+	       const struct gsm_pcu_if_shm_rec *rec)
+{
+	struct pcu_shm_backlog *bl;
+	struct pcu_shm_pending *p;
+	unsigned int idx;
+	int rc, signal = 0;
+
+	if (trx_nr >= shm->num_trx || ts_nr >= 8)
+		return -EINVAL;
+	idx = trx_nr * 8 + ts_nr;
+	bl = &shm->backlog[idx];
+
+	if (bl->len)
+		signal = backlog_flush(shm, idx);
+
+	if (!bl->len && (rc = ring_put(&shm->ts[idx].ul, rec)) >= 0) {
+		signal |= rc;
+		rc = 0;
+	} else if (bl->len >= PCU_SHM_BACKLOG_MAX) {
+		LOGP(DPCU, LOGL_ERROR, "PCU is lagging behind on TRX%u TS%u, dropping record "
+		     "type %u fn %u\n", trx_nr, ts_nr, rec->msg_type, rec->fn);
+		rc = -ENOSPC;
+	} else if (!(p = talloc(shm, struct pcu_shm_pending))) {
+		rc = -ENOMEM;
+	} else {
+		memcpy(&p->rec, rec, sizeof(*rec));
+		llist_add_tail(&p->list, &bl->list);
+		bl->len++;
+		shm->backlog_len++;
+		rc = 0;
+	}
+
+	if (signal && pcu_shm_signal(shm) < 0 && rc == 0)
+		rc = -EIO;
+	return rc;
+}
+
+/* Retry the records waiting in the backlog, called once per TDMA frame */
+void pcu_shm_flush(struct pcu_shm *shm)
+{
+	unsigned int i;
+	int signal = 0;
+
+	if (!shm->backlog_len)
+		return;
+
+	for (i = 0; i < shm->num_trx * 8; i++) {
+		if (shm->backlog[i].len)
+			signal |= backlog_flush(shm, i);
+	}
+	if (signal)
+		pcu_shm_signal(shm);
+}
@@ -21,6 +21,7 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
@@ -63,6 +64,10 @@ static const char *sapi_string[] = {
 };
 
 static int pcu_sock_send(struct gsm_network *net, struct msgb *msg);
+static struct pcu_shm *pcu_sock_shm(void);
+static bool pcu_sock_sparse_time(uint32_t fn);
+static int pcu_sock_rts_batch(const struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
+			      uint16_t arfcn, uint8_t block_nr);
 
 /*
  * PCU messages
@@ -144,6 +149,9 @@ int pcu_tx_info_ind(void)
 
 	if (pcu_direct)
 		info_ind->flags |= PCU_IF_FLAG_SYSMO;
+	else
+		info_ind->flags |= PCU_IF_FLAG_SHM;
+	info_ind->flags |= PCU_IF_FLAG_SPARSE_TIME | PCU_IF_FLAG_RTS_BATCH;
 
 	/* RAI */
 	info_ind->mcc = net->plmn.mcc;
@@ -327,10 +335,30 @@ int pcu_tx_rts_req(struct gsm_bts_trx_ts *ts, uint8_t is_ptcch, uint32_t fn,
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_rts_req *rts_req;
 	struct gsm_bts *bts = ts->trx->bts;
+	struct pcu_shm *shm = pcu_sock_shm();
+	int rc;
 
 	LOGP(DPCU, LOGL_DEBUG, "Sending rts request: is_ptcch=%d arfcn=%d "
 		"block=%d\n", is_ptcch, arfcn, block_nr);
 
+	if (shm) {
+		struct gsm_pcu_if_shm_rec rec = {
+			.msg_type = PCU_IF_MSG_RTS_REQ,
+			.sapi = is_ptcch ? PCU_IF_SAPI_PTCCH : PCU_IF_SAPI_PDTCH,
+			.fn = fn,
+			.block_nr = block_nr,
+		};
+		/* no fallback to the socket, the PCU would see the RTS out
+		 * of order with the ones still in the ring */
+		rc = pcu_shm_tx(shm, ts->trx->nr, ts->nr, &rec);
+		if (rc != -EINVAL)
+			return rc;
+	}
+
+	if (pcu_sock_rts_batch(ts, is_ptcch ? PCU_IF_SAPI_PTCCH : PCU_IF_SAPI_PDTCH,
+			       fn, arfcn, block_nr) == 0)
+		return 0;
+
 	msg = pcu_msgb_alloc(PCU_IF_MSG_RTS_REQ, bts->nr);
 	if (!msg)
 		return -ENOMEM;
@@ -355,6 +383,9 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_data *data_ind;
 	struct gsm_bts *bts = ts->trx->bts;
+	struct pcu_shm *shm = pcu_sock_shm();
+	struct gsm_pcu_if_shm_rec rec;
+	int rc;
 
 	LOGP(DPCU, LOGL_DEBUG, "Sending data indication: sapi=%s arfcn=%d block=%d data=%s\n",
 	     sapi_string[sapi], arfcn, block_nr, osmo_hexdump(data, len));
@@ -365,6 +396,25 @@ int pcu_tx_data_ind(struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
 		return 0;
 	}
 
+	if (shm && (sapi == PCU_IF_SAPI_PDTCH || sapi == PCU_IF_SAPI_PTCCH)
+	    && len <= sizeof(rec.data)) {
+		rec = (struct gsm_pcu_if_shm_rec) {
+			.msg_type = PCU_IF_MSG_DATA_IND,
+			.sapi = sapi,
+			.len = len,
+			.block_nr = block_nr,
+			.fn = fn,
+			.rssi = rssi,
+			.ber10k = ber10k,
+			.ta_offs_qbits = bto,
+			.lqual_cb = lqual,
+		};
+		memcpy(rec.data, data, len);
+		rc = pcu_shm_tx(shm, ts->trx->nr, ts->nr, &rec);
+		if (rc != -EINVAL)
+			return rc;
+	}
+
 	msg = pcu_msgb_alloc(PCU_IF_MSG_DATA_IND, bts->nr);
 	if (!msg)
 		return -ENOMEM;
@@ -421,12 +471,19 @@ int pcu_tx_time_ind(uint32_t fn)
 	struct msgb *msg;
 	struct gsm_pcu_if *pcu_prim;
 	struct gsm_pcu_if_time_ind *time_ind;
+	struct pcu_shm *shm = pcu_sock_shm();
 	uint8_t fn13 = fn % 13;
 
+	if (shm)
+		pcu_shm_flush(shm);
+
 	/* omit frame numbers not starting at a MAC block */
 	if (fn13 != 0 && fn13 != 4 && fn13 != 8)
 		return 0;
 
+	if (pcu_sock_sparse_time(fn))
+		return 0;
+
 	msg = pcu_msgb_alloc(PCU_IF_MSG_TIME_IND, 0);
 	if (!msg)
 		return -ENOMEM;
@@ -682,6 +739,9 @@ static int pcu_rx_act_req(struct gsm_bts *bts,
 	return 0;
 }
 
+static int pcu_rx_shm_req(struct gsm_bts *bts, const struct gsm_pcu_if_shm_req *shm_req);
+static int pcu_rx_feat_req(struct gsm_bts *bts, const struct gsm_pcu_if_feat_req *feat_req);
+
 static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
 	struct gsm_pcu_if *pcu_prim)
 {
@@ -708,6 +768,12 @@ static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
 	case PCU_IF_MSG_TXT_IND:
 		rc = pcu_rx_txt_ind(bts, &pcu_prim->u.txt_ind);
 		break;
+	case PCU_IF_MSG_SHM_REQ:
+		rc = pcu_rx_shm_req(bts, &pcu_prim->u.shm_req);
+		break;
+	case PCU_IF_MSG_FEAT_REQ:
+		rc = pcu_rx_feat_req(bts, &pcu_prim->u.feat_req);
+		break;
 	default:
 		LOGP(DPCU, LOGL_ERROR, "Received unknown PCU msg type %d\n",
 			msg_type);
@@ -721,13 +787,50 @@ static int pcu_rx(struct gsm_network *net, uint8_t msg_type,
  * PCU socket interface
  */
 
+/* maximum number of primitives sent/received with one sendmmsg()/recvmmsg() */
+#define PCU_SOCK_BATCH	32
+
 struct pcu_sock_state {
 	struct gsm_network *net;
 	struct osmo_fd listen_bfd;	/* fd for listen socket */
 	struct osmo_fd conn_bfd;	/* fd for connection to lcr */
 	struct llist_head upqueue;	/* queue for sending messages */
+	struct pcu_shm *shm;		/* shared memory data plane, if negotiated */
+	/* SHM_CNF waiting in upqueue, and the fds to pass along with it */
+	struct msgb *shm_cnf;
+	union {
+		char buf[CMSG_SPACE(3 * sizeof(int))];
+		struct cmsghdr align;
+	} shm_cnf_cmsg;
+	uint32_t features;		/* PCU_IF_FLAG_* enabled by the PCU */
+
+	/* next FN at which TIME.IND is expected, with PCU_IF_FLAG_SPARSE_TIME */
+	uint32_t time_ind_next_fn;
+	/* RTS being aggregated per TRX, with PCU_IF_FLAG_RTS_BATCH */
+	struct {
+		struct msgb *msg;
+	} rts_batch[8];
+
+	/* primitives received with one recvmmsg(), processed synchronously */
+	struct gsm_pcu_if rx_prim[PCU_SOCK_BATCH];
+	struct iovec rx_iov[PCU_SOCK_BATCH];
+	struct mmsghdr rx_hdr[PCU_SOCK_BATCH];
 };
 
+/* Queue the RTS being aggregated, before any other primitive is queued:
+ * nothing may overtake them */
+static void pcu_sock_rts_batch_flush(struct pcu_sock_state *state)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(state->rts_batch); i++) {
+		if (!state->rts_batch[i].msg)
+			continue;
+		msgb_enqueue(&state->upqueue, state->rts_batch[i].msg);
+		state->rts_batch[i].msg = NULL;
+	}
+}
+
 static int pcu_sock_send(struct gsm_network *net, struct msgb *msg)
 {
 	struct pcu_sock_state *state = net->pcu_state;
@@ -749,12 +852,187 @@ static int pcu_sock_send(struct gsm_network *net, struct msgb *msg)
 		msgb_free(msg);
 		return -EIO;
 	}
+	pcu_sock_rts_batch_flush(state);
 	msgb_enqueue(&state->upqueue, msg);
 	conn_bfd->when |= OSMO_FD_WRITE;
 
 	return 0;
 }
 
+static struct pcu_shm *pcu_sock_shm(void)
+{
+	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+
+	return state ? state->shm : NULL;
+}
+
+/* DATA.req for PDTCH/PTCCH received via the shared memory data plane */
+static int pcu_shm_rx(void *data, uint8_t trx_nr, uint8_t ts_nr,
+		      const struct gsm_pcu_if_shm_rec *rec)
+{
+	struct gsm_bts *bts = data;
+	struct gsm_bts_trx *trx;
+	struct gsm_pcu_if_data data_req;
+
+	if (rec->msg_type != PCU_IF_MSG_DATA_REQ
+	    || (rec->sapi != PCU_IF_SAPI_PDTCH && rec->sapi != PCU_IF_SAPI_PTCCH)
+	    || rec->len > sizeof(data_req.data)) {
+		LOGP(DPCU, LOGL_ERROR, "Received invalid record type %u sapi %u "
+		     "via shared memory\n", rec->msg_type, rec->sapi);
+		return -EINVAL;
+	}
+
+	trx = gsm_bts_trx_num(bts, trx_nr);
+	if (!trx)
+		return -EINVAL;
+
+	data_req = (struct gsm_pcu_if_data) {
+		.sapi = rec->sapi,
+		.len = rec->len,
+		.fn = rec->fn,
+		.arfcn = trx->arfcn,
+		.trx_nr = trx_nr,
+		.ts_nr = ts_nr,
+		.block_nr = rec->block_nr,
+	};
+	memcpy(data_req.data, rec->data, rec->len);
+
+	return pcu_rx_data_req(bts, PCU_IF_MSG_DATA_REQ, &data_req);
+}
+
+static int pcu_rx_feat_req(struct gsm_bts *bts, const struct gsm_pcu_if_feat_req *feat_req)
+{
+	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	uint32_t supported = PCU_IF_FLAG_SPARSE_TIME | PCU_IF_FLAG_RTS_BATCH;
+
+	state->features = feat_req->flags & supported;
+	/* send the next TIME.IND in any case, as a reference to extrapolate from */
+	state->time_ind_next_fn = GSM_TDMA_HYPERFRAME;
+
+	LOGP(DPCU, LOGL_NOTICE, "PCU enabled features 0x%08x (requested 0x%08x)\n",
+	     state->features, feat_req->flags);
+	return 0;
+}
+
+/* Return true if the TIME.IND for the given FN can be omitted */
+static bool pcu_sock_sparse_time(uint32_t fn)
+{
+	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	bool omit;
+
+	if (!state || !(state->features & PCU_IF_FLAG_SPARSE_TIME))
+		return false;
+
+	/* the PCU can extrapolate as long as the FN advances block by block;
+	 * a jump (e.g. PHY restart) needs an explicit TIME.IND */
+	omit = fn % 52 != 0 && fn == state->time_ind_next_fn;
+	state->time_ind_next_fn = GSM_TDMA_FN_SUM(fn, fn % 13 == 8 ? 5 : 4);
+	return omit;
+}
+
+/* Add an RTS to the aggregated RTS of its TRX.  The batch is sent once all
+ * timeslots had their turn in this select iteration, when the FN/SAPI
+ * changes, or before any other primitive is queued. */
+static int pcu_sock_rts_batch(const struct gsm_bts_trx_ts *ts, uint8_t sapi, uint32_t fn,
+			      uint16_t arfcn, uint8_t block_nr)
+{
+	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	struct gsm_pcu_if_rts_batch_req *req;
+	struct msgb **msg;
+
+	if (!state || !(state->features & PCU_IF_FLAG_RTS_BATCH) || state->conn_bfd.fd <= 0)
+		return -ENOTSUP;
+	if (ts->trx->nr >= ARRAY_SIZE(state->rts_batch))
+		return -EINVAL;
+
+	msg = &state->rts_batch[ts->trx->nr].msg;
+	if (*msg) {
+		req = &((struct gsm_pcu_if *) (*msg)->data)->u.rts_batch_req;
+		if (req->fn == fn && req->sapi == sapi) {
+			req->ts_mask |= (1 << ts->nr);
+			return 0;
+		}
+		pcu_sock_rts_batch_flush(state);
+	}
+
+	*msg = pcu_msgb_alloc(PCU_IF_MSG_RTS_BATCH_REQ, ts->trx->bts->nr);
+	if (!*msg)
+		return -ENOMEM;
+	req = &((struct gsm_pcu_if *) (*msg)->data)->u.rts_batch_req;
+	req->sapi = sapi;
+	req->ts_mask = (1 << ts->nr);
+	req->fn = fn;
+	req->arfcn = arfcn;
+	req->trx_nr = ts->trx->nr;
+	req->block_nr = block_nr;
+
+	state->conn_bfd.when |= OSMO_FD_WRITE;
+	return 0;
+}
+
+/* The PCU wants to use the shared memory data plane: set it up and pass the
+ * memory and the eventfds along with the confirmation.  The SHM_CNF is queued
+ * behind everything sent so far, see pcu_sock_write(). */
+static int pcu_rx_shm_req(struct gsm_bts *bts, const struct gsm_pcu_if_shm_req *shm_req)
+{
+	struct pcu_sock_state *state = bts_gsmnet.pcu_state;
+	struct gsm_pcu_if *pcu_prim;
+	struct cmsghdr *cmsg;
+	struct msgb *msg;
+	int fds[3];
+
+	if (shm_req->if_version < PCU_IF_SHM_MIN_IF_VERSION) {
+		LOGP(DPCU, LOGL_NOTICE, "PCU speaks interface version %u, the shared memory "
+		     "data plane needs %u, staying on the socket\n", shm_req->if_version,
+		     PCU_IF_SHM_MIN_IF_VERSION);
+		return 0;
+	}
+	if (shm_req->version != PCU_IF_SHM_VERSION) {
+		LOGP(DPCU, LOGL_NOTICE, "PCU requests shared memory version %u, but we "
+		     "support %u, staying on the socket\n", shm_req->version, PCU_IF_SHM_VERSION);
+		return 0;
+	}
+
+	msg = pcu_msgb_alloc(PCU_IF_MSG_SHM_CNF, bts->nr);
+	if (!msg)
+		return -ENOMEM;
+
+	/* a previous SHM_CNF not sent yet refers to the fds we are about to close */
+	if (state->shm_cnf) {
+		llist_del(&state->shm_cnf->list);
+		msgb_free(state->shm_cnf);
+		state->shm_cnf = NULL;
+	}
+	pcu_shm_free(state->shm);
+	state->shm = pcu_shm_alloc(state, bts->num_trx, pcu_shm_rx, bts);
+	if (!state->shm) {
+		msgb_free(msg);
+		return -ENOMEM;
+	}
+	pcu_prim = (struct gsm_pcu_if *) msg->data;
+	pcu_shm_cnf(state->shm, &pcu_prim->u.shm_cnf, fds);
+
+	cmsg = &state->shm_cnf_cmsg.align;
+	cmsg->cmsg_level = SOL_SOCKET;
+	cmsg->cmsg_type = SCM_RIGHTS;
+	cmsg->cmsg_len = CMSG_LEN(sizeof(fds));
+	memcpy(CMSG_DATA(cmsg), fds, sizeof(fds));
+
+	/* From now on the data plane records go to the rings, which the PCU
+	 * only looks at after it has read the SHM_CNF, i.e. after everything
+	 * queued before it. */
+	state->shm_cnf = msg;
+	if (pcu_sock_send(&bts_gsmnet, msg) < 0) {
+		state->shm_cnf = NULL;
+		pcu_shm_free(state->shm);
+		state->shm = NULL;
+		return -EIO;
+	}
+
+	LOGP(DPCU, LOGL_NOTICE, "PCU uses the shared memory data plane\n");
+	return 0;
+}
+
 static void pcu_sock_close(struct pcu_sock_state *state)
 {
 	struct osmo_fd *bfd = &state->conn_bfd;
@@ -772,6 +1050,17 @@ static void pcu_sock_close(struct pcu_sock_state *state)
 
 	bts->pcu_version[0] = '\0';
 
+	pcu_shm_free(state->shm);
+	state->shm = NULL;
+	state->shm_cnf = NULL;	/* freed along with upqueue below */
+	state->features = 0;
+	for (i = 0; i < ARRAY_SIZE(state->rts_batch); i++) {
+		if (!state->rts_batch[i].msg)
+			continue;
+		msgb_free(state->rts_batch[i].msg);
+		state->rts_batch[i].msg = NULL;
+	}
+
 	close(bfd->fd);
 	bfd->fd = -1;
 	osmo_fd_unregister(bfd);
@@ -815,44 +1104,48 @@ static int pcu_sock_read(struct osmo_fd *bfd)
 {
 	struct pcu_sock_state *state = (struct pcu_sock_state *)bfd->data;
 	struct gsm_pcu_if *pcu_prim;
-	struct msgb *msg;
-	int rc;
-
-	msg = msgb_alloc(sizeof(*pcu_prim), "pcu_sock_rx");
-	if (!msg)
-		return -ENOMEM;
-
-	pcu_prim = (struct gsm_pcu_if *) msg->tail;
-
-	rc = recv(bfd->fd, msg->tail, msgb_tailroom(msg), 0);
-	if (rc == 0)
-		goto close;
+	int i, n, rc = 0;
+
+	for (i = 0; i < PCU_SOCK_BATCH; i++) {
+		state->rx_iov[i].iov_base = &state->rx_prim[i];
+		state->rx_iov[i].iov_len = sizeof(state->rx_prim[i]);
+		state->rx_hdr[i].msg_hdr = (struct msghdr) {
+			.msg_iov = &state->rx_iov[i],
+			.msg_iovlen = 1,
+		};
+	}
 
-	if (rc < 0) {
-		if (errno == EAGAIN) {
-			msgb_free(msg);
+	/* fetch all primitives the PCU has queued so far at once */
+	n = recvmmsg(bfd->fd, state->rx_hdr, PCU_SOCK_BATCH, MSG_DONTWAIT, NULL);
+	if (n < 0) {
+		if (errno == EAGAIN)
 			return 0;
-		}
 		goto close;
 	}
+	if (n == 0)
+		goto close;
 
-	if (rc < sizeof(*pcu_prim)) {
-		LOGP(DPCU, LOGL_ERROR, "Received %d bytes on PCU Socket, but primitive size "
-		     "is %zu, discarding\n", rc, sizeof(*pcu_prim));
-		msgb_free(msg);
-		return 0;
-	}
+	for (i = 0; i < n; i++) {
+		/* a zero length message means the PCU has closed the connection */
+		if (state->rx_hdr[i].msg_len == 0)
+			goto close;
 
-	rc = pcu_rx(state->net, pcu_prim->msg_type, pcu_prim);
+		pcu_prim = &state->rx_prim[i];
+		if (state->rx_hdr[i].msg_len < sizeof(*pcu_prim)) {
+			LOGP(DPCU, LOGL_ERROR, "Received %u bytes on PCU Socket, but primitive size "
+			     "is %zu, discarding\n", state->rx_hdr[i].msg_len, sizeof(*pcu_prim));
+			continue;
+		}
 
-	/* as we always synchronously process the message in pcu_rx() and
-	 * its callbacks, we can free the message here. */
-	msgb_free(msg);
+		/* as we always synchronously process the primitive in
+		 * pcu_rx() and its callbacks, the ring can be reused on the
+		 * next call */
+		rc = pcu_rx(state->net, pcu_prim->msg_type, pcu_prim);
+	}
 
 	return rc;
 
 close:
-	msgb_free(msg);
 	pcu_sock_close(state);
 	return -1;
 }
@@ -860,27 +1153,48 @@ close:
 static int pcu_sock_write(struct osmo_fd *bfd)
 {
 	struct pcu_sock_state *state = bfd->data;
-	int rc;
+	struct mmsghdr hdr[PCU_SOCK_BATCH];
+	struct iovec iov[PCU_SOCK_BATCH];
+	struct msgb *msg, *msg2;
+	int i, n, rc;
 
-	while (!llist_empty(&state->upqueue)) {
-		struct msgb *msg, *msg2;
-		struct gsm_pcu_if *pcu_prim;
+	bfd->when &= ~OSMO_FD_WRITE;
+
+	pcu_sock_rts_batch_flush(state);
 
-		/* peek at the beginning of the queue */
-		msg = llist_entry(state->upqueue.next, struct msgb, list);
-		pcu_prim = (struct gsm_pcu_if *)msg->data;
+	while (!llist_empty(&state->upqueue)) {
+		/* gather the beginning of the queue, one datagram per primitive */
+		n = 0;
+		llist_for_each_entry_safe(msg, msg2, &state->upqueue, list) {
+			if (n == PCU_SOCK_BATCH)
+				break;
 
-		bfd->when &= ~OSMO_FD_WRITE;
+			/* bug hunter 8-): maybe someone forgot msgb_put(...) ? */
+			if (!msgb_length(msg)) {
+				LOGP(DPCU, LOGL_ERROR, "message type (%d) with ZERO "
+					"bytes!\n", ((struct gsm_pcu_if *)msg->data)->msg_type);
+				llist_del(&msg->list);
+				msgb_free(msg);
+				continue;
+			}
 
-		/* bug hunter 8-): maybe someone forgot msgb_put(...) ? */
-		if (!msgb_length(msg)) {
-			LOGP(DPCU, LOGL_ERROR, "message type (%d) with ZERO "
-				"bytes!\n", pcu_prim->msg_type);
-			goto dontsend;
+			iov[n].iov_base = msgb_data(msg);
+			iov[n].iov_len = msgb_length(msg);
+			hdr[n].msg_hdr = (struct msghdr) {
+				.msg_iov = &iov[n],
+				.msg_iovlen = 1,
+			};
+			if (msg == state->shm_cnf) {
+				hdr[n].msg_hdr.msg_control = state->shm_cnf_cmsg.buf;
+				hdr[n].msg_hdr.msg_controllen = sizeof(state->shm_cnf_cmsg.buf);
+			}
+			n++;
 		}
+		if (n == 0)
+			break;
 
-		/* try to send it over the socket */
-		rc = write(bfd->fd, msgb_data(msg), msgb_length(msg));
+		/* try to send them over the socket */
+		rc = sendmmsg(bfd->fd, hdr, n, MSG_DONTWAIT);
 		if (rc == 0)
 			goto close;
 		if (rc < 0) {
@@ -891,11 +1205,19 @@ static int pcu_sock_write(struct osmo_fd *bfd)
 			goto close;
 		}
 
-dontsend:
-		/* _after_ we send it, we can deueue */
-		msg2 = msgb_dequeue(&state->upqueue);
-		assert(msg == msg2);
-		msgb_free(msg);
+		/* _after_ we send them, we can dequeue */
+		for (i = 0; i < rc; i++) {
+			msg = msgb_dequeue(&state->upqueue);
+			if (msg == state->shm_cnf)
+				state->shm_cnf = NULL;
+			msgb_free(msg);
+		}
+
+		/* the socket buffer is full, wait until it can take the rest */
+		if (rc < n) {
+			bfd->when |= OSMO_FD_WRITE;
+			break;
+		}
 	}
 	return 0;
 
@@ -2849,80 +2849,132 @@ struct osmo_bts_supp_meas_info {
 	uint16_t toa256_std_dev;
 } __attribute__((packed));
 
-/* Compose and send 8.4.8 MEASUREMENT RESult via RSL */
-int rsl_tx_meas_res(struct gsm_lchan *lchan, uint8_t *l3, int l3_len, const struct lapdm_entity *le)
+/* The MEASUREMENT RESult always starts with the same IEs, which only differ in
+ * the result number and the length of the uplink measurements */
+static void meas_res_tmpl_init(struct gsm_lchan *lchan, uint8_t chan_nr)
 {
-	struct msgb *msg;
-	uint8_t meas_res[16];
-	uint8_t chan_nr = gsm_lchan2chan_nr(lchan);
-	int res_valid = lchan->meas.flags & LC_UL_M_F_RES_VALID;
-	struct gsm_bts *bts = lchan->ts->trx->bts;
-
-	LOGPLCHAN(lchan, DRSL, LOGL_DEBUG, "chan_num:%u Tx MEAS RES valid(%d), flags(%02x)\n",
-		  chan_nr, res_valid, lchan->meas.flags);
+	uint8_t *tmpl = lchan->meas.res_tmpl;
 
-	if (!res_valid)
-		return -EINPROGRESS;
+	tmpl[0] = ABIS_RSL_MDISC_DED_CHAN;
+	tmpl[1] = RSL_MT_MEAS_RES;
+	tmpl[2] = RSL_IE_CHAN_NR;
+	tmpl[3] = chan_nr;
+	tmpl[4] = RSL_IE_MEAS_RES_NR;
+	tmpl[5] = 0;			/* patched: result number */
+	tmpl[6] = RSL_IE_UPLINK_MEAS;
+	tmpl[7] = 0;			/* patched: length of uplink measurements */
+}
 
-	msg = rsl_msgb_alloc(sizeof(struct abis_rsl_dchan_hdr));
+/* Compose 8.4.8 MEASUREMENT RESult from the per-lchan template (this function
+ * is only used internally, it is public to call it from unit-tests) */
+struct msgb *rsl_meas_res_enc(struct gsm_lchan *lchan, const uint8_t *l3, int l3_len,
+			      const struct lapdm_entity *le)
+{
+	struct gsm_bts *bts = lchan->ts->trx->bts;
+	uint8_t chan_nr = gsm_lchan2chan_nr(lchan);
+	bool with_l3 = l3 && l3_len > 0;
+	struct msgb *msg;
+	uint8_t *ul_meas_len;
+	uint8_t *p;
+
+	/* template, 3 octets uplink measurements plus supplementary
+	 * information, BS power, L1 info, L3 info, MS timing offset */
+	msg = msgb_alloc_headroom(sizeof(struct ipaccess_head) + sizeof(lchan->meas.res_tmpl)
+				  + 3 + sizeof(struct osmo_bts_supp_meas_info) + 2 + 3
+				  + (with_l3 ? 3 + l3_len + 2 : 0),
+				  sizeof(struct ipaccess_head), "RSL MEAS RES");
 	if (!msg)
-		return -ENOMEM;
+		return NULL;
 
-	LOGPLCHAN(lchan, DRSL, LOGL_DEBUG,
-	     "Send Meas RES: NUM:%u, RXLEV_FULL:%u, RXLEV_SUB:%u, RXQUAL_FULL:%u, RXQUAL_SUB:%u, MS_PWR:%u, UL_TA:%u, L3_LEN:%d, TimingOff:%u\n",
-	     lchan->meas.res_nr,
-	     lchan->meas.ul_res.full.rx_lev,
-	     lchan->meas.ul_res.sub.rx_lev,
-	     lchan->meas.ul_res.full.rx_qual,
-	     lchan->meas.ul_res.sub.rx_qual,
-	     lchan->meas.l1_info[0],
-	     lchan->meas.l1_info[1], l3_len, ms_to2rsl(lchan, le) - MEAS_MAX_TIMING_ADVANCE);
+	if (lchan->meas.res_tmpl[0] != ABIS_RSL_MDISC_DED_CHAN || lchan->meas.res_tmpl[3] != chan_nr)
+		meas_res_tmpl_init(lchan, chan_nr);
+
+	p = msg->tail;
+	memcpy(p, lchan->meas.res_tmpl, sizeof(lchan->meas.res_tmpl));
+	msg->l3h = p + sizeof(struct abis_rsl_dchan_hdr);
+	p[5] = lchan->meas.res_nr++;
+	ul_meas_len = &p[7];
+	p += sizeof(lchan->meas.res_tmpl);
 
-	msgb_tv_put(msg, RSL_IE_MEAS_RES_NR, lchan->meas.res_nr++);
-	size_t ie_len = gsm0858_rsl_ul_meas_enc(&lchan->meas.ul_res,
-						lchan->tch.dtx.dl_active,
-						meas_res);
+	*ul_meas_len = gsm0858_rsl_ul_meas_enc(&lchan->meas.ul_res, lchan->tch.dtx.dl_active, p);
+	p += *ul_meas_len;
 	lchan->tch.dtx.dl_active = false;
-	if (ie_len >= 3) {
-		if (bts->supp_meas_toa256 && lchan->meas.flags & LC_UL_M_F_OSMO_EXT_VALID) {
-			struct osmo_bts_supp_meas_info *smi;
-			smi = (struct osmo_bts_supp_meas_info *) &meas_res[ie_len];
-			ie_len += sizeof(struct osmo_bts_supp_meas_info);
-			/* append signed 16bit value containing MS timing offset in 1/256th symbols
-			 * in the vendor-specific "Supplementary Measurement Information" part of
-			 * the uplink measurements IE.  The lchan->meas.ext members are the current
-			 * offset *relative* to the TA which the MS has already applied.  As we want
-			 * to know the total propagation time between MS and BTS, we need to add
-			 * the actual TA value applied by the MS plus the respective toa256 value in
-			 * 1/256 symbol periods. */
-			int16_t ta256 = lchan_get_ta(lchan) * 256;
-			smi->toa256_mean = htons(ta256 + lchan->meas.ms_toa256);
-			smi->toa256_min = htons(ta256 + lchan->meas.ext.toa256_min);
-			smi->toa256_max = htons(ta256 + lchan->meas.ext.toa256_max);
-			smi->toa256_std_dev = htons(lchan->meas.ext.toa256_std_dev);
-			lchan->meas.flags &= ~LC_UL_M_F_OSMO_EXT_VALID;
-		}
-		msgb_tlv_put(msg, RSL_IE_UPLINK_MEAS, ie_len, meas_res);
-		lchan->meas.flags &= ~LC_UL_M_F_RES_VALID;
-	}
-	msgb_tv_put(msg, RSL_IE_BS_POWER, lchan->bs_power_red / 2);
+	if (bts->supp_meas_toa256 && lchan->meas.flags & LC_UL_M_F_OSMO_EXT_VALID) {
+		struct osmo_bts_supp_meas_info *smi = (struct osmo_bts_supp_meas_info *) p;
+		/* append signed 16bit value containing MS timing offset in 1/256th symbols
+		 * in the vendor-specific "Supplementary Measurement Information" part of
+		 * the uplink measurements IE.  The lchan->meas.ext members are the current
+		 * offset *relative* to the TA which the MS has already applied.  As we want
+		 * to know the total propagation time between MS and BTS, we need to add
+		 * the actual TA value applied by the MS plus the respective toa256 value in
+		 * 1/256 symbol periods. */
+		int16_t ta256 = lchan_get_ta(lchan) * 256;
+		smi->toa256_mean = htons(ta256 + lchan->meas.ms_toa256);
+		smi->toa256_min = htons(ta256 + lchan->meas.ext.toa256_min);
+		smi->toa256_max = htons(ta256 + lchan->meas.ext.toa256_max);
+		smi->toa256_std_dev = htons(lchan->meas.ext.toa256_std_dev);
+		lchan->meas.flags &= ~LC_UL_M_F_OSMO_EXT_VALID;
+		*ul_meas_len += sizeof(*smi);
+		p += sizeof(*smi);
+	}
+	lchan->meas.flags &= ~LC_UL_M_F_RES_VALID;
+
+	*p++ = RSL_IE_BS_POWER;
+	*p++ = lchan->bs_power_red / 2;
 	if (lchan->meas.flags & LC_UL_M_F_L1_VALID) {
-		msgb_tv_fixed_put(msg, RSL_IE_L1_INFO, 2, lchan->meas.l1_info);
+		*p++ = RSL_IE_L1_INFO;
+		*p++ = lchan->meas.l1_info[0];
+		*p++ = lchan->meas.l1_info[1];
 		lchan->meas.flags &= ~LC_UL_M_F_L1_VALID;
 	}
 
-	if (l3 && l3_len > 0)
-		msgb_tl16v_put(msg, RSL_IE_L3_INFO, l3_len, l3);
+	if (with_l3) {
+		*p++ = RSL_IE_L3_INFO;
+		*p++ = l3_len >> 8;
+		*p++ = l3_len & 0xff;
+		memcpy(p, l3, l3_len);
+		p += l3_len;
+	}
 	if (ms_to_valid(lchan)) {
-		if (l3 && l3_len > 0)
-			msgb_tv_put(msg, RSL_IE_MS_TIMING_OFFSET, ms_to2rsl(lchan, le));
+		if (with_l3) {
+			*p++ = RSL_IE_MS_TIMING_OFFSET;
+			*p++ = ms_to2rsl(lchan, le);
+		}
 		lchan->ms_t_offs = -1;
 		lchan->p_offs = -1;
 	}
 
-	rsl_dch_push_hdr(msg, RSL_MT_MEAS_RES, chan_nr);
+	msgb_put(msg, p - msg->tail);
 	msg->trx = lchan->ts->trx;
 
+	return msg;
+}
+
+/* Compose and send 8.4.8 MEASUREMENT RESult via RSL */
+int rsl_tx_meas_res(struct gsm_lchan *lchan, uint8_t *l3, int l3_len, const struct lapdm_entity *le)
+{
+	struct msgb *msg;
+
+	if (!(lchan->meas.flags & LC_UL_M_F_RES_VALID)) {
+		LOGPLCHAN(lchan, DRSL, LOGL_DEBUG, "Tx MEAS RES: no valid results, flags(%02x)\n",
+			  lchan->meas.flags);
+		return -EINPROGRESS;
+	}
+
+	LOGPLCHAN(lchan, DRSL, LOGL_DEBUG,
+	     "Send Meas RES: NUM:%u, RXLEV_FULL:%u, RXLEV_SUB:%u, RXQUAL_FULL:%u, RXQUAL_SUB:%u, MS_PWR:%u, UL_TA:%u, L3_LEN:%d, TimingOff:%u\n",
+	     lchan->meas.res_nr,
+	     lchan->meas.ul_res.full.rx_lev,
+	     lchan->meas.ul_res.sub.rx_lev,
+	     lchan->meas.ul_res.full.rx_qual,
+	     lchan->meas.ul_res.sub.rx_qual,
+	     lchan->meas.l1_info[0],
+	     lchan->meas.l1_info[1], l3_len, ms_to2rsl(lchan, le) - MEAS_MAX_TIMING_ADVANCE);
+
+	msg = rsl_meas_res_enc(lchan, l3, l3_len, le);
+	if (!msg)
+		return -ENOMEM;
+
 	return abis_bts_rsl_sendmsg(msg);
 }
 
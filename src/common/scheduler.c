@@ -559,11 +559,17 @@ const struct trx_chan_desc trx_chan_desc[_TRX_CHAN_MAX] = {
 enum {
 	L1SCHED_TS_CTR_DL_LATE,
 	L1SCHED_TS_CTR_DL_NOT_FOUND,
+	L1SCHED_TS_CTR_PDTCH_PREFETCH_LATE,
+	L1SCHED_TS_CTR_PDTCH_PREFETCH_EARLY,
+	L1SCHED_TS_CTR_PDTCH_PREFETCH_UNDERRUN,
 };
 
 static const struct rate_ctr_desc l1sched_ts_ctr_desc[] = {
 	[L1SCHED_TS_CTR_DL_LATE] =	{"l1sched_ts:dl_late", "Downlink frames arrived too late to submit to lower layers"},
 	[L1SCHED_TS_CTR_DL_NOT_FOUND] =	{"l1sched_ts:dl_not_found", "Downlink frames not found while scheduling"},
+	[L1SCHED_TS_CTR_PDTCH_PREFETCH_LATE] =	{"l1sched_ts:pdtch_prefetch_late", "Prefetched PDTCH blocks whose FN had already passed"},
+	[L1SCHED_TS_CTR_PDTCH_PREFETCH_EARLY] =	{"l1sched_ts:pdtch_prefetch_early", "PDTCH blocks dropped for being too far ahead of the prefetch queue"},
+	[L1SCHED_TS_CTR_PDTCH_PREFETCH_UNDERRUN] = {"l1sched_ts:pdtch_prefetch_underrun", "PDTCH blocks not prefetched in time for their FN"},
 };
 static const struct rate_ctr_group_desc l1sched_ts_ctrg_desc = {
 	"l1sched_ts",
@@ -595,6 +601,8 @@ int trx_sched_init(struct l1sched_trx *l1t, struct gsm_bts_trx *trx)
 		l1ts->mf_index = 0;
 		l1ts->ctrs = rate_ctr_group_alloc(trx, &l1sched_ts_ctrg_desc, (trx->nr + 1) * 10 + tn);
 		INIT_LLIST_HEAD(&l1ts->dl_prims);
+		INIT_LLIST_HEAD(&l1ts->pdtch_prefetch);
+		l1ts->pdtch_prefetch_len = 0;
 
 		for (i = 0; i < ARRAY_SIZE(l1ts->chan_state); i++) {
 			struct l1sched_chan_state *chan_state;
@@ -617,6 +625,8 @@ void trx_sched_exit(struct l1sched_trx *l1t)
 	for (tn = 0; tn < ARRAY_SIZE(l1t->ts); tn++) {
 		struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
 		msgb_queue_flush(&l1ts->dl_prims);
+		msgb_queue_flush(&l1ts->pdtch_prefetch);
+		l1ts->pdtch_prefetch_len = 0;
 		rate_ctr_group_free(l1ts->ctrs);
 		l1ts->ctrs = NULL;
 		for (i = 0; i < _TRX_CHAN_MAX; i++) {
@@ -798,6 +808,87 @@ int _sched_compose_tch_ind(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 }
 
 
+/* PDTCH prefetch: blocks from the PCU are kept sorted by FN in a bounded
+ * queue per timeslot, so that the PCU can provide them well ahead of the
+ * RTS and its scheduling jitter does not result in idle blocks. */
+
+/* how far ahead of the current FN the PCU may prefetch */
+#define PDTCH_PREFETCH_MAX_FN	(2 * 52)
+
+static uint32_t pdch_prim_fn(struct msgb *msg)
+{
+	return msgb_l1sap_prim(msg)->u.data.fn;
+}
+
+static void pdtch_prefetch_enqueue(struct l1sched_trx *l1t, struct l1sched_ts *l1ts,
+				   uint8_t tn, struct msgb *msg)
+{
+	const struct gsm_bts *bts = l1t->trx->bts;
+	uint32_t fn = pdch_prim_fn(msg);
+	uint32_t ahead = GSM_TDMA_FN_SUB(fn, bts->gsm_time.fn);
+	struct msgb *pos;
+
+	/* anything more than half the hyperframe ahead is in the past */
+	if (ahead > GSM_TDMA_HYPERFRAME / 2) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn, "PDTCH block arrived late\n");
+		rate_ctr_inc2(l1ts->ctrs, L1SCHED_TS_CTR_PDTCH_PREFETCH_LATE);
+		msgb_free(msg);
+		return;
+	}
+	if (ahead > PDTCH_PREFETCH_MAX_FN || l1ts->pdtch_prefetch_len >= bts->pdtch_prefetch) {
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, -1, fn, "PDTCH block too early for "
+		       "the prefetch queue (%u frames ahead, %u queued)\n", ahead,
+		       l1ts->pdtch_prefetch_len);
+		rate_ctr_inc2(l1ts->ctrs, L1SCHED_TS_CTR_PDTCH_PREFETCH_EARLY);
+		msgb_free(msg);
+		return;
+	}
+
+	/* the PCU provides blocks in order, so search from the back */
+	llist_for_each_entry_reverse(pos, &l1ts->pdtch_prefetch, list) {
+		if (GSM_TDMA_FN_SUB(fn, pdch_prim_fn(pos)) < GSM_TDMA_HYPERFRAME / 2)
+			break;
+	}
+	llist_add(&msg->list, &pos->list);
+	l1ts->pdtch_prefetch_len++;
+}
+
+/* obtain the PDTCH/PTCCH block for the given FN, from the prefetch queue if
+ * enabled, otherwise from the regular queue */
+struct msgb *_sched_dequeue_pdtch(struct l1sched_trx *l1t, int8_t tn, uint32_t fn,
+				  enum trx_chan_type chan)
+{
+	struct l1sched_ts *l1ts = l1sched_trx_get_ts(l1t, tn);
+	struct msgb *msg;
+	uint32_t prim_fn;
+
+	if (!l1t->trx->bts->pdtch_prefetch && llist_empty(&l1ts->pdtch_prefetch))
+		return _sched_dequeue_prim(l1t, tn, fn, chan);
+
+	while (!llist_empty(&l1ts->pdtch_prefetch)) {
+		msg = llist_first_entry(&l1ts->pdtch_prefetch, struct msgb, list);
+		prim_fn = GSM_TDMA_FN_SUB(pdch_prim_fn(msg), fn);
+		if (prim_fn == 0) {
+			llist_del(&msg->list);
+			l1ts->pdtch_prefetch_len--;
+			return msg;
+		}
+		if (prim_fn < GSM_TDMA_HYPERFRAME / 2) /* l1sap_fn > fn */
+			break;
+
+		/* l1sap_fn < fn */
+		LOGL1S(DL1P, LOGL_NOTICE, l1t, tn, chan, fn, "Prefetched PDTCH block for "
+		       "fn=%u is late\n", pdch_prim_fn(msg));
+		rate_ctr_inc2(l1ts->ctrs, L1SCHED_TS_CTR_PDTCH_PREFETCH_LATE);
+		llist_del(&msg->list);
+		l1ts->pdtch_prefetch_len--;
+		msgb_free(msg);
+	}
+
+	rate_ctr_inc2(l1ts->ctrs, L1SCHED_TS_CTR_PDTCH_PREFETCH_UNDERRUN);
+	return NULL;
+}
+
 
 /*
  * data request (from upper layer)
@@ -820,6 +911,12 @@ int trx_sched_ph_data_req(struct l1sched_trx *l1t, struct osmo_phsap_prim *l1sap
 		return 0;
 	}
 
+	if (l1t->trx->bts->pdtch_prefetch
+	    && (l1sap->u.data.chan_nr & ~7) == RSL_CHAN_OSMO_PDCH) {
+		pdtch_prefetch_enqueue(l1t, l1ts, tn, l1sap->oph.msg);
+		return 0;
+	}
+
 	msgb_enqueue(&l1ts->dl_prims, l1sap->oph.msg);
 
 	return 0;
@@ -27,21 +27,29 @@
 #include <osmo-bts/pcu_if.h>
 #include <osmo-bts/bts.h>
 
-/* properly increment SI2q index and return SI2q data for scheduling */
-static inline uint8_t *get_si2q_inc_index(struct gsm_bts *bts)
+static unsigned int gcd(unsigned int a, unsigned int b)
 {
-	uint8_t i = bts->si2q_index;
-	/* si2q_count is the max si2q_index value, not the number of messages */
-	bts->si2q_index = (bts->si2q_index + 1) % (bts->si2q_count + 1);
-
-	return (uint8_t *)GSM_BTS_SI2Q(bts, i);
+	while (b) {
+		unsigned int t = a % b;
+		a = b;
+		b = t;
+	}
+	return a;
 }
 
-/* Apply the rules from 05.02 6.3.1.3 Mapping of BCCH Data */
-uint8_t *bts_sysinfo_get(struct gsm_bts *bts, const struct gsm_time *g_time)
+/* Apply the rules from 05.02 6.3.1.3 Mapping of BCCH Data, and compile the
+ * resulting rotation into bts->si.bcch.  To be called whenever the set of
+ * SI changes (S_NEW_SYSINFO). */
+void bts_sysinfo_update_bcch(struct gsm_bts *bts)
 {
+	const uint8_t *tc4[4 * SI2Q_MAX_NUM];
+	const uint8_t *tc5[SI2Q_MAX_NUM];
+	const uint8_t *tc_fixed[8];
 	unsigned int tc4_cnt = 0;
 	unsigned int tc4_sub[4];
+	unsigned int tc4_len = 0, tc5_len = 0;
+	unsigned int num_si2q = bts->si2q_count + 1;
+	unsigned int i, j, k, tc, rounds;
 
 	/* System information type 2 bis or 2 ter messages are sent if
 	 * needed, as determined by the system operator.  If only one of
@@ -67,86 +75,91 @@ uint8_t *bts_sysinfo_get(struct gsm_bts *bts, const struct gsm_time *g_time)
 	 * 4 consecutive occurrences of TC = 4. */
 
 	/* We only implement BCCH Norm at this time */
-	switch (g_time->tc) {
-	case 0:
-		/* System Information Type 1 need only be sent if
-		 * frequency hopping is in use or when the NCH is
-		 * present in a cell. If the MS finds another message
-		 * when TC = 0, it can assume that System Information
-		 * Type 1 is not in use.  */
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_1))
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_1);
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
-	case 1:
-		/* A SI 2 message will be sent at least every time TC = 1. */
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
-	case 2:
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_3);
-	case 3:
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_4);
-	case 4:
-		/* iterate over 2ter, 2quater, 9, 13 */
-		/* determine how many SI we need to send on TC=4,
-		 * and which of them we send when */
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter) && GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis)) {
-			tc4_sub[tc4_cnt] = SYSINFO_TYPE_2ter;
-			tc4_cnt += 1;
-		}
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) &&
-		    (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) || GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))) {
-			tc4_sub[tc4_cnt] = SYSINFO_TYPE_2quater;
-			tc4_cnt += 1;
-		}
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_13)) {
-			tc4_sub[tc4_cnt] = SYSINFO_TYPE_13;
-			tc4_cnt += 1;
-		}
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_9)) {
-			/* FIXME: check SI3 scheduling info! */
-			tc4_sub[tc4_cnt] = SYSINFO_TYPE_9;
-			tc4_cnt += 1;
-		}
+
+	/* System Information Type 1 need only be sent if
+	 * frequency hopping is in use or when the NCH is
+	 * present in a cell. If the MS finds another message
+	 * when TC = 0, it can assume that System Information
+	 * Type 1 is not in use.  */
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_1))
+		tc_fixed[0] = GSM_BTS_SI(bts, SYSINFO_TYPE_1);
+	else
+		tc_fixed[0] = GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	/* A SI 2 message will be sent at least every time TC = 1. */
+	tc_fixed[1] = GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	tc_fixed[2] = GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+	tc_fixed[3] = GSM_BTS_SI(bts, SYSINFO_TYPE_4);
+	tc_fixed[6] = GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+	tc_fixed[7] = GSM_BTS_SI(bts, SYSINFO_TYPE_4);
+
+	/* TC = 4: iterate over 2ter, 2quater, 9, 13 */
+	/* determine how many SI we need to send on TC=4,
+	 * and which of them we send when */
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter) && GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis))
+		tc4_sub[tc4_cnt++] = SYSINFO_TYPE_2ter;
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) &&
+	    (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) || GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter)))
+		tc4_sub[tc4_cnt++] = SYSINFO_TYPE_2quater;
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_13))
+		tc4_sub[tc4_cnt++] = SYSINFO_TYPE_13;
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_9)) {
+		/* FIXME: check SI3 scheduling info! */
+		tc4_sub[tc4_cnt++] = SYSINFO_TYPE_9;
+	}
+
+	if (tc4_cnt == 0) {
 		/* simply send SI2 if we have nothing else to send */
-		if (tc4_cnt == 0)
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
-		else {
-			/* increment static counter by one, modulo count */
-			bts->si.tc4_ctr = (bts->si.tc4_ctr + 1) % tc4_cnt;
+		tc4[tc4_len++] = GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	} else {
+		/* each round of the rotation sends the next SI2quater */
+		rounds = GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) ? num_si2q : 1;
+		for (i = 0; i < rounds; i++) {
+			for (j = 0; j < tc4_cnt; j++) {
+				if (tc4_sub[j] == SYSINFO_TYPE_2quater)
+					tc4[tc4_len++] = (const uint8_t *) GSM_BTS_SI2Q(bts, i);
+				else
+					tc4[tc4_len++] = GSM_BTS_SI(bts, tc4_sub[j]);
+			}
+		}
+	}
 
-			if (tc4_sub[bts->si.tc4_ctr] == SYSINFO_TYPE_2quater)
-				return get_si2q_inc_index(bts);
+	/* TC = 5: 2bis, 2ter, 2quater */
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis))
+		tc5[tc5_len++] = GSM_BTS_SI(bts, SYSINFO_TYPE_2bis);
+	else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
+		tc5[tc5_len++] = GSM_BTS_SI(bts, SYSINFO_TYPE_2ter);
+	else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater)) {
+		for (i = 0; i < num_si2q; i++)
+			tc5[tc5_len++] = (const uint8_t *) GSM_BTS_SI2Q(bts, i);
+	} else {
+		/* simply send SI2 if we have nothing else to send */
+		tc5[tc5_len++] = GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	}
 
-			return GSM_BTS_SI(bts, tc4_sub[bts->si.tc4_ctr]);
+	/* one table entry per TC, for as many 8-TC cycles as it takes
+	 * for both rotations to line up again */
+	k = tc4_len / gcd(tc4_len, tc5_len) * tc5_len;
+	OSMO_ASSERT(8 * k <= ARRAY_SIZE(bts->si.bcch));
+	for (i = 0; i < k; i++) {
+		for (tc = 0; tc < 8; tc++) {
+			if (tc == 4)
+				bts->si.bcch[i * 8 + tc] = tc4[i % tc4_len];
+			else if (tc == 5)
+				bts->si.bcch[i * 8 + tc] = tc5[i % tc5_len];
+			else
+				bts->si.bcch[i * 8 + tc] = tc_fixed[tc];
 		}
-	case 5:
-		/* 2bis, 2ter, 2quater */
-		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_2bis);
-
-		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis))
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_2ter);
-
-		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_2bis);
-
-		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) &&
-			 !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
-			return get_si2q_inc_index(bts);
-
-			/* simply send SI2 if we have nothing else to send */
-		else
-			return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
-		break;
-	case 6:
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_3);
-	case 7:
-		return GSM_BTS_SI(bts, SYSINFO_TYPE_4);
 	}
+	bts->si.bcch_len = 8 * k;
+}
+
+/* Return the SI to be sent on BCCH Norm at the given time */
+uint8_t *bts_sysinfo_get(struct gsm_bts *bts, const struct gsm_time *g_time)
+{
+	if (!bts->si.bcch_len)
+		bts_sysinfo_update_bcch(bts);
 
-	/* this should never bve reached. We must transmit a BCCH
-	 * message on the normal BCCH in all cases. */
-	OSMO_ASSERT(0);
-	return 0;
+	return (uint8_t *) bts->si.bcch[(g_time->fn / 51) % bts->si.bcch_len];
 }
 
 uint8_t num_agch(struct gsm_bts_trx *trx, const char * arg)
@@ -269,6 +269,8 @@ static void config_write_bts_single(struct vty *vty, struct gsm_bts *bts)
 		VTY_NEWLINE);
 	if (strcmp(bts->pcu.sock_path, PCU_SOCK_DEFAULT))
 		vty_out(vty, " pcu-socket %s%s", bts->pcu.sock_path, VTY_NEWLINE);
+	if (bts->pdtch_prefetch)
+		vty_out(vty, " pdtch-prefetch %u%s", bts->pdtch_prefetch, VTY_NEWLINE);
 	if (bts->supp_meas_toa256)
 		vty_out(vty, " supp-meas-info toa256%s", VTY_NEWLINE);
 	vty_out(vty, " smscb queue-max-length %d%s", bts->smscb_queue_max_len, VTY_NEWLINE);
@@ -644,6 +646,18 @@ DEFUN(cfg_bts_pcu_sock, cfg_bts_pcu_sock_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_bts_pdtch_prefetch, cfg_bts_pdtch_prefetch_cmd,
+	"pdtch-prefetch <0-32>",
+	"Let the PCU provide PDTCH blocks ahead of the RTS (osmo-bts-trx/virtual)\n"
+	"Maximum number of queued blocks per timeslot (0 = disabled)\n")
+{
+	struct gsm_bts *bts = vty->index;
+
+	bts->pdtch_prefetch = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_bts_supp_meas_toa256, cfg_bts_supp_meas_toa256_cmd,
 	"supp-meas-info toa256",
 	"Configure the RSL Supplementary Measurement Info\n"
@@ -1715,6 +1729,7 @@ int bts_vty_init(struct gsm_bts *bts)
 	install_element(BTS_NODE, &cfg_bts_min_qual_norm_cmd);
 	install_element(BTS_NODE, &cfg_bts_max_ber_rach_cmd);
 	install_element(BTS_NODE, &cfg_bts_pcu_sock_cmd);
+	install_element(BTS_NODE, &cfg_bts_pdtch_prefetch_cmd);
 	install_element(BTS_NODE, &cfg_bts_supp_meas_toa256_cmd);
 	install_element(BTS_NODE, &cfg_bts_no_supp_meas_toa256_cmd);
 	install_element(BTS_NODE, &cfg_bts_smscb_max_qlen_cmd);
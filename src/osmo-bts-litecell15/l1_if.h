@@ -8,6 +8,7 @@
 #include <osmocom/gsm/gsm_utils.h>
 
 #include <osmo-bts/phy_link.h>
+#include <osmo-bts/l1_conf.h>
 
 #include <nrw/litecell15/gsml1prim.h>
 #include <nrw/litecell15/gsml1types.h>
@@ -42,11 +43,17 @@ struct calib_send_state {
 	int last_file_idx;
 };
 
+/* number of primitives read from a DSP queue per wakeup */
+#define L1IF_RX_BATCH_DEFAULT	16
+#define L1IF_RX_BATCH_MAX	32
+
+struct l1_rx_pool;
+
 struct lc15l1_hdl {
 	struct gsm_time gsm_time;
 	HANDLE hLayer1;				/* handle to the L1 instance in the DSP */
 	uint32_t dsp_trace_f;			/* currently operational DSP trace flags */
-	struct llist_head wlc_list;
+	struct l1_conf *l1_conf;		/* requests waiting for their confirmation */
 
 	struct phy_instance *phy_inst;
 
@@ -55,6 +62,8 @@ struct lc15l1_hdl {
 
 	struct osmo_fd read_ofd[_NUM_MQ_READ];	/* osmo file descriptors */
 	struct osmo_wqueue write_q[_NUM_MQ_WRITE];
+	struct l1_rx_pool *rx_pool[_NUM_MQ_READ];	/* recycled receive buffers */
+	unsigned int rx_batch;			/* readv() depth, 0 for the default */
 
 	struct {
 		/* from DSP/FPGA after L1 Init */
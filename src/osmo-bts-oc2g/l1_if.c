@@ -71,26 +71,8 @@
 
 extern unsigned int dsp_trace;
 
-struct wait_l1_conf {
-	struct llist_head list;		/* internal linked list */
-	struct osmo_timer_list timer;	/* timer for L1 timeout */
-	unsigned int conf_prim_id;	/* primitive we expect in response */
-	HANDLE conf_hLayer3;		/* layer 3 handle we expect in response */
-	unsigned int is_sys_prim;	/* is this a system (1) or L1 (0) primitive */
-	l1if_compl_cb *cb;
-	void *cb_data;
-};
-
-static void release_wlc(struct wait_l1_conf *wlc)
-{
-	osmo_timer_del(&wlc->timer);
-	talloc_free(wlc);
-}
-
-static void l1if_req_timeout(void *data)
+static void l1if_req_timeout(struct l1_conf_wait *wlc)
 {
-	struct wait_l1_conf *wlc = data;
-
 	if (wlc->is_sys_prim)
 		LOGP(DL1C, LOGL_FATAL, "Timeout waiting for SYS primitive %s\n",
 			get_value_string(oc2gbts_sysprim_names, wlc->conf_prim_id));
@@ -151,17 +133,27 @@ static HANDLE l1p_get_hLayer3(GsmL1_Prim_t *prim)
 	return 0;
 }
 
+/* Class of an L1 request, for the timeout of its confirmation */
+static enum l1_conf_class l1p_conf_class(GsmL1_Prim_t *prim)
+{
+	switch (prim->id) {
+	case GsmL1_PrimId_MphActivateReq:
+	case GsmL1_PrimId_MphDeactivateReq:
+	case GsmL1_PrimId_MphConfigReq:
+	case GsmL1_PrimId_MphMeasureReq:
+		return L1_CONF_C_LCHAN;
+	default:
+		return L1_CONF_C_PHY;
+	}
+}
+
 static int _l1if_req_compl(struct oc2gl1_hdl *fl1h, struct msgb *msg,
 		   int is_system_prim, l1if_compl_cb *cb, void *data)
 {
-	struct wait_l1_conf *wlc;
 	struct osmo_wqueue *wqueue;
-	unsigned int timeout_secs;
-
-	/* allocate new wsc and store reference to mutex and conf_id */
-	wlc = talloc_zero(fl1h, struct wait_l1_conf);
-	wlc->cb = cb;
-	wlc->cb_data = data;
+	enum l1_conf_class cls;
+	unsigned int conf_prim_id;
+	HANDLE conf_hLayer3 = 0;
 
 	/* Make sure we actually have received a REQUEST type primitive */
 	if (is_system_prim == 0) {
@@ -173,14 +165,12 @@ static int _l1if_req_compl(struct oc2gl1_hdl *fl1h, struct msgb *msg,
 		if (oc2gbts_get_l1prim_type(l1p->id) != L1P_T_REQ) {
 			LOGP(DL1C, LOGL_ERROR, "L1 Prim %s is not a Request!\n",
 				get_value_string(oc2gbts_l1prim_names, l1p->id));
-			talloc_free(wlc);
 			return -EINVAL;
 		}
-		wlc->is_sys_prim = 0;
-		wlc->conf_prim_id = oc2gbts_get_l1prim_conf(l1p->id);
-		wlc->conf_hLayer3 = l1p_get_hLayer3(l1p);
+		conf_prim_id = oc2gbts_get_l1prim_conf(l1p->id);
+		conf_hLayer3 = l1p_get_hLayer3(l1p);
+		cls = l1p_conf_class(l1p);
 		wqueue = &fl1h->write_q[MQ_L1_WRITE];
-		timeout_secs = 30;
 	} else {
 		Oc2g_Prim_t *sysp = msgb_sysprim(msg);
 
@@ -190,28 +180,28 @@ static int _l1if_req_compl(struct oc2gl1_hdl *fl1h, struct msgb *msg,
 		if (oc2gbts_get_sysprim_type(sysp->id) != L1P_T_REQ) {
 			LOGP(DL1C, LOGL_ERROR, "SYS Prim %s is not a Request!\n",
 				get_value_string(oc2gbts_sysprim_names, sysp->id));
-			talloc_free(wlc);
 			return -EINVAL;
 		}
-		wlc->is_sys_prim = 1;
-		wlc->conf_prim_id = oc2gbts_get_sysprim_conf(sysp->id);
+		conf_prim_id = oc2gbts_get_sysprim_conf(sysp->id);
+		cls = L1_CONF_C_SYS;
 		wqueue = &fl1h->write_q[MQ_SYS_WRITE];
-		timeout_secs = 30;
 	}
 
-	/* enqueue the message in the queue and add wsc to list */
+	/* start waiting for the confirmation, if the DSP fails to respond in
+	 * time we terminate */
+	if (!l1_conf_add(fl1h->l1_conf, cls, is_system_prim, conf_prim_id,
+			 conf_hLayer3, cb, data)) {
+		msgb_free(msg);
+		return -ENOMEM;
+	}
+
+	/* enqueue the message in the queue */
 	if (osmo_wqueue_enqueue(wqueue, msg) != 0) {
 		/* So we will get a timeout but the log message might help */
 		LOGP(DL1C, LOGL_ERROR, "Write queue for %s full. dropping msg.\n",
 			is_system_prim ? "system primitive" : "gsm");
 		msgb_free(msg);
 	}
-	llist_add(&wlc->list, &fl1h->wlc_list);
-
-	/* schedule a timer for timeout_secs seconds. If DSP fails to respond, we terminate */
-	wlc->timer.data = wlc;
-	wlc->timer.cb = l1if_req_timeout;
-	osmo_timer_schedule(&wlc->timer, timeout_secs, 0);
 
 	return 0;
 }
@@ -454,9 +444,9 @@ static int ph_data_req(struct gsm_bts_trx *trx, struct msgb *msg,
 			memcpy(l1p->u.phDataReq.msgUnitParam.u8Buffer,
 			       lchan->tch.dtx.facch, msgb_l2len(msg));
 		else if (dtx_dl_amr_enabled(lchan) &&
-			 ((lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_F) ||
-			 (lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_F) ||
-			 (lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_F))) {
+			 ((lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_F) ||
+			 (lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_F) ||
+			 (lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_F))) {
 			if (sapi == GsmL1_Sapi_FacchF) {
 				sapi = GsmL1_Sapi_TchF;
 			}
@@ -471,13 +461,13 @@ static int ph_data_req(struct gsm_bts_trx *trx, struct msgb *msg,
 				memcpy(lchan->tch.dtx.facch, msg->l2h,
 				       msgb_l2len(msg));
 				/* prepare ONSET or INH message */
-				if(lchan->tch.dtx.dl_amr_fsm->state == ST_ONSET_F)
+				if(lchan->tch.dtx.dl_amr_sm.state == ST_ONSET_F)
 					l1p->u.phDataReq.msgUnitParam.u8Buffer[0] =
 								GsmL1_TchPlType_Amr_Onset;
-				else if(lchan->tch.dtx.dl_amr_fsm->state == ST_U_INH_F)
+				else if(lchan->tch.dtx.dl_amr_sm.state == ST_U_INH_F)
 					l1p->u.phDataReq.msgUnitParam.u8Buffer[0] =
 								GsmL1_TchPlType_Amr_SidUpdateInH;
-				else if(lchan->tch.dtx.dl_amr_fsm->state == ST_F1_INH_F)
+				else if(lchan->tch.dtx.dl_amr_sm.state == ST_F1_INH_F)
 					l1p->u.phDataReq.msgUnitParam.u8Buffer[0] =
 								GsmL1_TchPlType_Amr_SidFirstInH;
 				/* ignored CMR/CMI pair */
@@ -491,7 +481,7 @@ static int ph_data_req(struct gsm_bts_trx *trx, struct msgb *msg,
 				lchan->tch.dtx.fn = LCHAN_FN_DUMMY;
 			}
 		} else if (dtx_dl_amr_enabled(lchan) &&
-			   lchan->tch.dtx.dl_amr_fsm->state == ST_FACCH) {
+			   lchan->tch.dtx.dl_amr_sm.state == ST_FACCH) {
 			/* update FN so it can be checked by TCH silence
 			   resume handler */
 			lchan->tch.dtx.fn = LCHAN_FN_DUMMY;
@@ -1215,21 +1205,10 @@ static int l1if_handle_ind(struct oc2gl1_hdl *fl1, struct msgb *msg)
 	return rc;
 }
 
-static inline int is_prim_compat(GsmL1_Prim_t *l1p, struct wait_l1_conf *wlc)
-{
-	if (wlc->is_sys_prim != 0)
-		return 0;
-	if (l1p->id != wlc->conf_prim_id)
-		return 0;
-	if (l1p_get_hLayer3(l1p) != wlc->conf_hLayer3)
-		return 0;
-	return 1;
-}
-
 int l1if_handle_l1prim(int wq, struct oc2gl1_hdl *fl1h, struct msgb *msg)
 {
 	GsmL1_Prim_t *l1p = msgb_l1prim(msg);
-	struct wait_l1_conf *wlc;
+	struct l1_conf_wait *wlc;
 	int rc;
 
 	switch (l1p->id) {
@@ -1241,22 +1220,23 @@ int l1if_handle_l1prim(int wq, struct oc2gl1_hdl *fl1h, struct msgb *msg)
 			get_value_string(oc2gbts_l1prim_names, l1p->id), wq);
 	}
 
-	/* check if this is a resposne to a sync-waiting request */
-	llist_for_each_entry(wlc, &fl1h->wlc_list, list) {
-		if (is_prim_compat(l1p, wlc)) {
-			llist_del(&wlc->list);
-			if (wlc->cb) {
-				/* call-back function must take
-				 * ownership of msgb */
-				rc = wlc->cb(oc2gl1_hdl_trx(fl1h), msg,
-					     wlc->cb_data);
-			} else {
-				rc = 0;
-				msgb_free(msg);
-			}
-			release_wlc(wlc);
-			return rc;
+	/* check if this is a response to a sync-waiting request */
+	if (oc2gbts_get_l1prim_type(l1p->id) == L1P_T_CONF)
+		wlc = l1_conf_take(fl1h->l1_conf, false, l1p->id, l1p_get_hLayer3(l1p));
+	else
+		wlc = NULL;
+	if (wlc) {
+		if (wlc->cb) {
+			/* call-back function must take
+			 * ownership of msgb */
+			rc = wlc->cb(oc2gl1_hdl_trx(fl1h), msg,
+				     wlc->cb_data);
+		} else {
+			rc = 0;
+			msgb_free(msg);
 		}
+		l1_conf_release(wlc);
+		return rc;
 	}
 
 	/* if we reach here, it is not a Conf for a pending Req */
@@ -1266,30 +1246,27 @@ int l1if_handle_l1prim(int wq, struct oc2gl1_hdl *fl1h, struct msgb *msg)
 int l1if_handle_sysprim(struct oc2gl1_hdl *fl1h, struct msgb *msg)
 {
 	Oc2g_Prim_t *sysp = msgb_sysprim(msg);
-	struct wait_l1_conf *wlc;
+	struct l1_conf_wait *wlc;
 	int rc;
 
 	LOGP(DL1P, LOGL_DEBUG, "Rx SYS prim %s\n",
 		get_value_string(oc2gbts_sysprim_names, sysp->id));
 
-	/* check if this is a resposne to a sync-waiting request */
-	llist_for_each_entry(wlc, &fl1h->wlc_list, list) {
-		/* the limitation here is that we cannot have multiple callers
-		 * sending the same primitive */
-		if (wlc->is_sys_prim && sysp->id == wlc->conf_prim_id) {
-			llist_del(&wlc->list);
-			if (wlc->cb) {
-				/* call-back function must take
-				 * ownership of msgb */
-				rc = wlc->cb(oc2gl1_hdl_trx(fl1h), msg,
-					     wlc->cb_data);
-			} else {
-				rc = 0;
-				msgb_free(msg);
-			}
-			release_wlc(wlc);
-			return rc;
+	/* check if this is a response to a sync-waiting request, system
+	 * primitives are matched by their id only */
+	wlc = l1_conf_take(fl1h->l1_conf, true, sysp->id, 0);
+	if (wlc) {
+		if (wlc->cb) {
+			/* call-back function must take
+			 * ownership of msgb */
+			rc = wlc->cb(oc2gl1_hdl_trx(fl1h), msg,
+				     wlc->cb_data);
+		} else {
+			rc = 0;
+			msgb_free(msg);
 		}
+		l1_conf_release(wlc);
+		return rc;
 	}
 	/* if we reach here, it is not a Conf for a pending Req */
 	return l1if_handle_ind(fl1h, msg);
@@ -1616,7 +1593,7 @@ static int get_hwinfo(struct oc2gl1_hdl *fl1h)
 struct oc2gl1_hdl *l1if_open(struct phy_instance *pinst)
 {
 	struct oc2gl1_hdl *fl1h;
-	int rc;
+	int rc, i;
 
 	LOGP(DL1C, LOGL_INFO, "OC-2G BTS L1IF compiled against API headers "
 			"v%u.%u.%u\n", OC2G_API_VERSION >> 16,
@@ -1626,10 +1603,17 @@ struct oc2gl1_hdl *l1if_open(struct phy_instance *pinst)
 	fl1h = talloc_zero(pinst, struct oc2gl1_hdl);
 	if (!fl1h)
 		return NULL;
-	INIT_LLIST_HEAD(&fl1h->wlc_list);
 
 	fl1h->phy_inst = pinst;
+	fl1h->l1_conf = l1_conf_alloc(fl1h, pinst->num, l1if_req_timeout);
+	if (!fl1h->l1_conf) {
+		talloc_free(fl1h);
+		return NULL;
+	}
+	for (i = 0; i < _NUM_L1_CONF_C; i++)
+		l1_conf_set_timeout(fl1h->l1_conf, i, pinst->u.oc2g.conf_timeout_ms[i]);
 	fl1h->dsp_trace_f = pinst->u.oc2g.dsp_trace_f;
+	fl1h->rx_batch = pinst->u.oc2g.rx_batch;
 
 	get_hwinfo(fl1h);
 
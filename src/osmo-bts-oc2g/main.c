@@ -141,6 +141,7 @@ void bts_model_phy_link_set_defaults(struct phy_link *plink)
 
 void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
 {
+	pinst->u.oc2g.rx_batch = L1IF_RX_BATCH_DEFAULT;
 }
 
 int bts_model_oml_estab(struct gsm_bts *bts)
@@ -381,6 +381,34 @@ DEFUN(cfg_phy_pedestal_mode, cfg_phy_pedestal_mode_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_rx_batch, cfg_phy_rx_batch_cmd,
+	"dsp-rx-batch <1-32>",
+	"Set the number of primitives read from a DSP queue per wakeup\n"
+	"Number of primitives\n")
+{
+	struct phy_instance *pinst = vty->index;
+
+	pinst->u.oc2g.rx_batch = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_conf_timeout, cfg_phy_conf_timeout_cmd,
+	"l1-confirm-timeout (sys|phy|lchan) <100-60000>",
+	"Set the time to wait for the confirmation of a DSP request\n"
+	"System primitives\n"
+	"L1 primitives concerning the whole PHY\n"
+	"L1 primitives concerning a logical channel\n"
+	"Timeout in milliseconds\n")
+{
+	struct phy_instance *pinst = vty->index;
+	int cls = get_string_value(l1_conf_class_names, argv[0]);
+
+	pinst->u.oc2g.conf_timeout_ms[cls] = atoi(argv[1]);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_phy_dsp_alive_timer, cfg_phy_dsp_alive_timer_cmd,
 	"dsp-alive-period <0-60>",
 	"Set DSP alive timer period in second\n")
@@ -586,6 +614,17 @@ void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst
 	vty_out(vty, "  pedestal-mode %s%s",
 			get_value_string(oc2g_pedestal_mode_strs, pinst->u.oc2g.pedestal_mode) , VTY_NEWLINE);
 
+	if (pinst->u.oc2g.rx_batch != L1IF_RX_BATCH_DEFAULT)
+		vty_out(vty, "  dsp-rx-batch %u%s",
+			pinst->u.oc2g.rx_batch, VTY_NEWLINE);
+
+	for (i = 0; i < _NUM_L1_CONF_C; i++) {
+		if (pinst->u.oc2g.conf_timeout_ms[i])
+			vty_out(vty, "  l1-confirm-timeout %s %u%s",
+				get_value_string(l1_conf_class_names, i),
+				pinst->u.oc2g.conf_timeout_ms[i], VTY_NEWLINE);
+	}
+
 	vty_out(vty, "  dsp-alive-period %d%s",
 			pinst->u.oc2g.dsp_alive_period, VTY_NEWLINE);
 
@@ -667,6 +706,8 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_INST_NODE, &cfg_phy_cal_path_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_pedestal_mode_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_max_cell_size_cmd);
+	install_element(PHY_INST_NODE, &cfg_phy_rx_batch_cmd);
+	install_element(PHY_INST_NODE, &cfg_phy_conf_timeout_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_dsp_alive_timer_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_auto_tx_pwr_adj_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_tx_red_pwr_8psk_cmd);
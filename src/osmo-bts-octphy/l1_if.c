@@ -36,6 +36,7 @@
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/socket.h>
+#include <osmocom/core/rate_ctr.h>
 
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/bts_model.h>
@@ -69,12 +70,15 @@
 
 #define cPKTAPI_FIFO_ID_MSG                                0xAAAA0001
 
-/* maximum window of unacknowledged commands */
-#define UNACK_CMD_WINDOW	8
 /* maximum number of re-transmissions of a command */
 #define MAX_RETRANS		3
-/* timeout until which we expect PHY to respond */
+/* time a command is given to be answered, in seconds, and the upper bound
+ * of the retransmission timeout */
 #define CMD_TIMEOUT		5
+/* bounds and initial value of the retransmission timeout in us, adapted
+ * to the measured response times in between */
+#define CMD_RTO_MIN_US		50000
+#define CMD_RTO_INIT_US		1000000
 
 /* allocate a msgb for a Layer1 primitive */
 struct msgb *l1p_msgb_alloc(void)
@@ -172,6 +176,8 @@ struct wait_l1_conf {
 	struct llist_head list;
 	/* expiration timer */
 	struct osmo_timer_list timer;
+	/* back-pointer to the phy handle */
+	struct octphy_hdl *fl1h;
 	/* primtivie / command ID */
 	uint32_t prim_id;
 	/* transaction ID */
@@ -184,26 +190,23 @@ struct wait_l1_conf {
 	void *cb_data;
 	/* number of re-transmissions so far */
 	uint32_t num_retrans;
+	/* time of the most recent (re-)transmission */
+	struct timespec tx_time;
+	/* time of the first transmission, the deadline is CMD_TIMEOUT later */
+	struct timespec first_tx_time;
+	/* response received ahead of those to older commands, it is
+	 * processed once all of them have been */
+	struct msgb *resp;
 };
 
 static void release_wlc(struct wait_l1_conf *wlc)
 {
 	osmo_timer_del(&wlc->timer);
 	msgb_free(wlc->cmd_msg);
+	msgb_free(wlc->resp);
 	talloc_free(wlc);
 }
 
-static void l1if_req_timeout(void *data)
-{
-	struct wait_l1_conf *wlc = data;
-
-	/* FIXME: Implement re-transmission of command on timer expiration */
-
-	LOGP(DL1C, LOGL_FATAL, "Timeout waiting for L1 primitive %s\n",
-		get_value_string(octphy_cid_vals, wlc->prim_id));
-	exit(23);
-}
-
 /* FIXME: this should be in libosmocore */
 static struct llist_head *llist_first(struct llist_head *head)
 {
@@ -212,10 +215,167 @@ static struct llist_head *llist_first(struct llist_head *head)
 	return head->next;
 }
 
+static uint32_t us_since(const struct timespec *ts)
+{
+	struct timespec now;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	return (now.tv_sec - ts->tv_sec) * 1000000 + (now.tv_nsec - ts->tv_nsec) / 1000;
+}
+
+/* Take a response time sample, as per RFC 6298 */
+static void win_rtt_sample(struct octphy_hdl *fl1h, uint32_t rtt_us)
+{
+	uint32_t delta;
+
+	if (fl1h->win.srtt_us == 0) {
+		fl1h->win.srtt_us = rtt_us;
+		fl1h->win.rttvar_us = rtt_us / 2;
+	} else {
+		delta = fl1h->win.srtt_us > rtt_us ? fl1h->win.srtt_us - rtt_us
+						   : rtt_us - fl1h->win.srtt_us;
+		fl1h->win.rttvar_us = (3 * fl1h->win.rttvar_us + delta) / 4;
+		fl1h->win.srtt_us = (7 * fl1h->win.srtt_us + rtt_us) / 8;
+	}
+
+	fl1h->win.rto_us = OSMO_MAX(fl1h->win.srtt_us + 4 * fl1h->win.rttvar_us,
+				    CMD_RTO_MIN_US);
+	fl1h->win.rto_us = OSMO_MIN(fl1h->win.rto_us, CMD_TIMEOUT * 1000000);
+
+	if (fl1h->stats.rtt_min_us == 0 || rtt_us < fl1h->stats.rtt_min_us)
+		fl1h->stats.rtt_min_us = rtt_us;
+	if (rtt_us > fl1h->stats.rtt_max_us)
+		fl1h->stats.rtt_max_us = rtt_us;
+}
+
+/* A command was answered in order: slow start below ssthresh, one more
+ * command per window worth of responses above */
+static void win_grow(struct octphy_hdl *fl1h)
+{
+	if (fl1h->win.cwnd >= fl1h->win.max)
+		return;
+
+	if (fl1h->win.cwnd < fl1h->win.ssthresh) {
+		fl1h->win.cwnd++;
+	} else if (++fl1h->win.cwnd_acc >= fl1h->win.cwnd) {
+		fl1h->win.cwnd_acc = 0;
+		fl1h->win.cwnd++;
+	}
+}
+
+/* A command or its response got lost. Commands sent before the window was
+ * shrunk last time don't shrink it any further. */
+static void win_shrink(struct octphy_hdl *fl1h, uint32_t trans_id, bool timeout)
+{
+	if (fl1h->win.shrunk && (int32_t)(trans_id - fl1h->win.recover_trans_id) < 0)
+		return;
+
+	fl1h->win.ssthresh = OSMO_MAX(fl1h->win.cwnd / 2, 2);
+	fl1h->win.cwnd = timeout ? 1 : fl1h->win.ssthresh;
+	fl1h->win.cwnd_acc = 0;
+	fl1h->win.recover_trans_id = fl1h->next_trans_id;
+	fl1h->win.shrunk = true;
+	fl1h->stats.win_shrink++;
+}
+
+/* time left until the deadline of a command, in us */
+static uint32_t wlc_time_left(const struct wait_l1_conf *wlc)
+{
+	uint32_t elapsed_us = us_since(&wlc->first_tx_time);
+
+	if (elapsed_us >= CMD_TIMEOUT * 1000000)
+		return 0;
+	return CMD_TIMEOUT * 1000000 - elapsed_us;
+}
+
+/* (re-)start the retransmission timer, it never runs beyond the deadline */
+static void wlc_arm_timer(struct wait_l1_conf *wlc, uint32_t timeout_us)
+{
+	timeout_us = OSMO_MIN(timeout_us, wlc_time_left(wlc));
+	osmo_timer_schedule(&wlc->timer, timeout_us / 1000000, timeout_us % 1000000);
+}
+
+static void wlc_schedule(struct wait_l1_conf *wlc)
+{
+	osmo_clock_gettime(CLOCK_MONOTONIC, &wlc->tx_time);
+	wlc_arm_timer(wlc, wlc->fl1h->win.rto_us);
+}
+
+/* mark this message as RETRANSMIT of a previous msg */
+static void msg_set_retrans_flag(struct msgb *msg)
+{
+	tOCTVC1_MSG_HEADER *mh = (tOCTVC1_MSG_HEADER *) msg->l2h;
+	uint32_t type_r_cmdid = ntohl(mh->ul_Type_R_CmdId);
+	type_r_cmdid |= cOCTVC1_MSG_RETRANSMIT_FLAG;
+	mh->ul_Type_R_CmdId = htonl(type_r_cmdid);
+}
+
+/* Re-transmit a command, unless it was re-transmitted MAX_RETRANS times
+ * already. Returns 0 if the command was queued for transmission. */
+static int retransmit_wlc(struct octphy_hdl *fl1h, struct wait_l1_conf *wlc)
+{
+	struct msgb *msg;
+
+	if (wlc->num_retrans >= MAX_RETRANS)
+		return -EBUSY;
+
+	msg = msgb_copy(wlc->cmd_msg, "PHY CMD Retrans");
+	if (!msg)
+		return -ENOMEM;
+	msg_set_retrans_flag(msg);
+	if (osmo_wqueue_enqueue(&fl1h->phy_wq, msg) != 0) {
+		LOGP(DL1C, LOGL_ERROR, "Tx Write queue full, not re-transmitting "
+		     "%s (trans_id=%u)\n", get_value_string(octphy_cid_vals, wlc->prim_id),
+		     wlc->trans_id);
+		msgb_free(msg);
+		/* try again once the timeout expires */
+		wlc_arm_timer(wlc, fl1h->win.rto_us);
+		return -ENOSPC;
+	}
+	wlc->num_retrans++;
+	wlc_schedule(wlc);
+	LOGP(DL1C, LOGL_INFO, "Re-transmitting %s "
+	     "(trans_id=%u, attempt %u)\n",
+	     get_value_string(octphy_cid_vals, wlc->prim_id),
+	     wlc->trans_id, wlc->num_retrans);
+	return 0;
+}
+
+/* The PHY didn't respond in time: re-transmit just this command, with the
+ * timeout backed off */
+static void l1if_req_timeout(void *data)
+{
+	struct wait_l1_conf *wlc = data;
+	struct octphy_hdl *fl1h = wlc->fl1h;
+	uint32_t time_left_us = wlc_time_left(wlc);
+
+	if (time_left_us == 0) {
+		LOGP(DL1C, LOGL_FATAL, "Command %s (trans_id=%u): no response "
+		     "within %u seconds\n", get_value_string(octphy_cid_vals, wlc->prim_id),
+		     wlc->trans_id, CMD_TIMEOUT);
+		exit(24);
+	}
+
+	/* out of re-transmissions, wait for a response up to the deadline */
+	if (wlc->num_retrans >= MAX_RETRANS) {
+		wlc_arm_timer(wlc, time_left_us);
+		return;
+	}
+
+	LOGP(DL1C, LOGL_NOTICE, "Timeout waiting for L1 primitive %s "
+	     "(trans_id=%u)\n", get_value_string(octphy_cid_vals, wlc->prim_id),
+	     wlc->trans_id);
+
+	win_shrink(fl1h, wlc->trans_id, true);
+	fl1h->win.rto_us = OSMO_MIN(fl1h->win.rto_us * 2, CMD_TIMEOUT * 1000000);
+	if (retransmit_wlc(fl1h, wlc) == 0)
+		fl1h->stats.retrans_cmds_timeout++;
+}
+
 static void check_refill_window(struct octphy_hdl *fl1h, struct wait_l1_conf *recent)
 {
 	struct wait_l1_conf *wlc;
-	int space = UNACK_CMD_WINDOW - fl1h->wlc_list_len;
+	int space = fl1h->win.cwnd - fl1h->wlc_list_len;
 	int i;
 
 	for (i = 0; i < space; i++) {
@@ -233,6 +393,8 @@ static void check_refill_window(struct octphy_hdl *fl1h, struct wait_l1_conf *re
 		/* add to window */
 		llist_add_tail(&wlc->list, &fl1h->wlc_list);
 		fl1h->wlc_list_len++;
+		if (fl1h->wlc_list_len > fl1h->stats.wlc_inflight_max)
+			fl1h->stats.wlc_inflight_max = fl1h->wlc_list_len;
 
 		if (wlc != recent) {
 			LOGP(DL1C, LOGL_INFO, "Txing formerly postponed "
@@ -248,10 +410,9 @@ static void check_refill_window(struct octphy_hdl *fl1h, struct wait_l1_conf *re
 			msgb_free(msg);
 			exit(24);
 		}
-		/* schedule a timer for CMD_TIMEOUT seconds. If PHY fails to
-		 * respond, we terminate */
-		osmo_timer_schedule(&wlc->timer, CMD_TIMEOUT, 0);
-
+		/* re-transmit if the PHY fails to respond in time */
+		osmo_clock_gettime(CLOCK_MONOTONIC, &wlc->first_tx_time);
+		wlc_schedule(wlc);
 	}
 }
 
@@ -279,6 +440,7 @@ int l1if_req_compl(struct octphy_hdl *fl1h, struct msgb *msg,
 			       cOCTPKT_HDR_CONTROL_PROTOCOL_TYPE_ENUM_OCTVOCNET);
 
 	wlc = talloc_zero(fl1h, struct wait_l1_conf);
+	wlc->fl1h = fl1h;
 	wlc->cmd_msg = msg;
 	wlc->cb = cb;
 	wlc->cb_data = data;
@@ -1278,52 +1440,74 @@ static int rx_gsm_trx_time_ind(struct msgb *msg)
 	return handle_mph_time_ind(fl1h, tind->TrxId.byTrxId, tind->ulFrameNumber);
 }
 
-/* mark this message as RETRANSMIT of a previous msg */
-static void msg_set_retrans_flag(struct msgb *msg)
-{
-	tOCTVC1_MSG_HEADER *mh = (tOCTVC1_MSG_HEADER *) msg->l2h;
-	uint32_t type_r_cmdid = ntohl(mh->ul_Type_R_CmdId);
-	type_r_cmdid |= cOCTVC1_MSG_RETRANSMIT_FLAG;
-	mh->ul_Type_R_CmdId = htonl(type_r_cmdid);
-}
-
-/* re-transmit all commands in the window that have a transaction ID lower than
- * trans_id */
-static int retransmit_wlc_upto(struct octphy_hdl *fl1h, uint32_t trans_id)
+/* Re-transmit the commands in the window with a transaction ID from first
+ * to last, except those already answered. Unless all is set, commands sent
+ * less than a smoothed response time ago are still given a chance. */
+static int retransmit_wlc_range(struct octphy_hdl *fl1h, uint32_t first, uint32_t last,
+				bool all)
 {
 	struct wait_l1_conf *wlc;
 	int count = 0;
 
-	LOGP(DL1C, LOGL_INFO, "Retransmitting up to trans_id=%u\n", trans_id);
+	LOGP(DL1C, LOGL_INFO, "Retransmitting trans_id=%u..%u\n", first, last);
 
-	/* trans_id represents the trans_id of the just-received response, we
-	 * therefore need to re-send any commands with a lower trans_id */
 	llist_for_each_entry(wlc, &fl1h->wlc_list, list) {
-		if (wlc->trans_id <= trans_id) {
-			struct msgb *msg;
-			if (wlc->num_retrans >= MAX_RETRANS) {
-				LOGP(DL1C, LOGL_ERROR, "Command %s: maximum "
-				     "number of retransmissions reached\n",
-				     get_value_string(octphy_cid_vals,
-						      wlc->prim_id));
-				exit(24);
-			}
-			wlc->num_retrans++;
-			msg = msgb_copy(wlc->cmd_msg, "PHY CMD Retrans");
-			msg_set_retrans_flag(msg);
-			osmo_wqueue_enqueue(&fl1h->phy_wq, msg);
-			osmo_timer_schedule(&wlc->timer, CMD_TIMEOUT, 0);
+		if ((int32_t)(wlc->trans_id - first) < 0 ||
+		    (int32_t)(wlc->trans_id - last) > 0)
+			continue;
+		if (wlc->resp)
+			continue;
+		if (!all && us_since(&wlc->tx_time) < fl1h->win.srtt_us)
+			continue;
+		if (retransmit_wlc(fl1h, wlc) == 0)
 			count++;
-			LOGP(DL1C, LOGL_INFO, "Re-transmitting %s "
-			     "(trans_id=%u, attempt %u)\n",
-			     get_value_string(octphy_cid_vals, wlc->prim_id),
-			     wlc->trans_id, wlc->num_retrans);
-		}
 	}
 
 	return count;
 }
 
+/* Process the response to the oldest command of the window, plus those
+ * received before for the commands following it */
+static int process_wlc_resp(struct octphy_hdl *fl1h, struct wait_l1_conf *wlc,
+			    struct msgb *msg)
+{
+	struct llist_head *first;
+	int rc;
+
+	while (1) {
+		llist_del(&wlc->list);
+		fl1h->wlc_list_len--;
+
+		/* Karn's algorithm: no samples from re-transmitted commands */
+		if (wlc->num_retrans == 0)
+			win_rtt_sample(fl1h, us_since(&wlc->tx_time));
+		win_grow(fl1h);
+
+		if (wlc->cb) {
+			/* call-back function must take msgb
+			 * ownership. */
+			rc = wlc->cb(fl1h, msg, wlc->cb_data);
+		} else {
+			rc = 0;
+			msgb_free(msg);
+		}
+		release_wlc(wlc);
+
+		first = llist_first(&fl1h->wlc_list);
+		if (!first)
+			break;
+		wlc = llist_entry(first, struct wait_l1_conf, list);
+		if (!wlc->resp)
+			break;
+		msg = wlc->resp;
+		wlc->resp = NULL;
+	}
+
+	/* check if there are postponed wlcs and re-fill the window */
+	check_refill_window(fl1h, NULL);
+	return rc;
+}
+
 /* Receive a response (to a prior command) from the PHY */
 static int rx_octvc1_resp(struct msgb *msg, uint32_t msg_id, uint32_t trans_id)
 {
@@ -1343,20 +1527,7 @@ static int rx_octvc1_resp(struct msgb *msg, uint32_t msg_id, uint32_t trans_id)
 		wlc = llist_entry(first, struct wait_l1_conf, list);
 		if (wlc->trans_id == trans_id) {
 			/* process the received response */
-			llist_del(&wlc->list);
-			fl1h->wlc_list_len--;
-			if (wlc->cb) {
-				/* call-back function must take msgb
-				 * ownership. */
-				rc = wlc->cb(fl1h, msg, wlc->cb_data);
-			} else {
-				rc = 0;
-				msgb_free(msg);
-			}
-			release_wlc(wlc);
-			/* check if there are postponed wlcs and re-fill the window */
-			check_refill_window(fl1h, NULL);
-			return rc;
+			return process_wlc_resp(fl1h, wlc, msg);
 		}
 	}
 
@@ -1368,14 +1539,20 @@ static int rx_octvc1_resp(struct msgb *msg, uint32_t msg_id, uint32_t trans_id)
 	/* check if the response is for any of the other entries in wlc_list */
 	llist_for_each_entry(wlc, &fl1h->wlc_list, list) {
 		if (wlc->prim_id == msg_id && wlc->trans_id == trans_id) {
-			/* it is assumed that all of the previous response
-			 * message(s) have been lost, and we need to
-			 * re-transmit older messages from the window */
-			rc = retransmit_wlc_upto(fl1h, trans_id);
+			/* it is assumed that the response(s) to the older
+			 * commands have been lost. Keep this one until they
+			 * are in, and re-transmit only the older commands */
+			fl1h->stats.resp_out_of_order++;
+			if (!wlc->resp) {
+				wlc->resp = msg;
+				osmo_timer_del(&wlc->timer);
+			} else
+				msgb_free(msg);
+			win_shrink(fl1h, trans_id, false);
+			rc = retransmit_wlc_range(fl1h,
+				llist_entry(first, struct wait_l1_conf, list)->trans_id,
+				trans_id - 1, false);
 			fl1h->stats.retrans_cmds_trans_id += rc;
-			/* do not process the received response, we rather wait
-			 * for the in-order retransmissions to arrive */
-			msgb_free(msg);
 			return 0;
 		}
 	}
@@ -1553,7 +1730,11 @@ static int rx_octvc1_supv(struct msgb *msg, uint32_t msg_id, uint32_t trans_id)
 		     "ExpectedTID=0x%08x, RejectedCmdID=%s)\n",
 		     trans_id, rej->ulExpectedTransactionId,
 		     get_value_string(octphy_cid_vals, rejected_msg_id));
-		rc = retransmit_wlc_upto(fl1h, trans_id);
+		/* the PHY missed the commands from the expected one up to
+		 * the rejected one */
+		win_shrink(fl1h, rej->ulExpectedTransactionId, false);
+		rc = retransmit_wlc_range(fl1h, rej->ulExpectedTransactionId,
+					  trans_id, true);
 		fl1h->stats.retrans_cmds_supv += rc;
 		break;
 	default:
@@ -1709,6 +1890,7 @@ void bts_model_phy_link_set_defaults(struct phy_link *plink)
 	plink->u.octphy.rx_gain_db = 70;
 	plink->u.octphy.tx_atten_db = 0;
 	plink->u.octphy.over_sample_16x = true;
+	plink->u.octphy.cmd_window_max = UNACK_CMD_WINDOW_MAX;
 }
 
 void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
@@ -1746,23 +1928,43 @@ static int octphy_read_cb(struct osmo_fd *ofd)
 	return rx_octphy_msg(msg);
 }
 
-static int octphy_write_cb(struct osmo_fd *fd, struct msgb *msg)
+/* a frame in the receive ring, only valid during the call */
+static void octphy_rx_frame(const uint8_t *data, unsigned int len, void *cb_data)
 {
-	struct octphy_hdl *fl1h = fd->data;
-	int rc;
+	struct msgb *msg = msgb_alloc_headroom(len + 24, 24, "PHY Rx");
 
-	/* send the message down the socket */
-	rc = sendto(fd->fd, msg->data, msgb_length(msg), 0,
-		    (struct sockaddr *) &fl1h->phy_addr,
-		    sizeof(fl1h->phy_addr));
+	if (!msg)
+		return;
 
-	/* core write uqueue takes care of free() */
-	if (rc < 0) {
-		LOGP(DL1P, LOGL_ERROR, "Tx to PHY has failed: %s\n",
-			strerror(errno));
+	/* this is the fl1h over which the message was received */
+	msg->dst = cb_data;
+	memcpy(msgb_put(msg, len), data, len);
+
+	rx_octphy_msg(msg);
+}
+
+static int octphy_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct octphy_hdl *fl1h = ofd->data;
+
+	if (what & OSMO_FD_READ) {
+		if (fl1h->rx_ring)
+			octpkt_rx_ring_read(fl1h->rx_ring, octphy_rx_frame, fl1h);
+		else
+			octphy_read_cb(ofd);
 	}
 
-	return rc;
+	if (what & OSMO_FD_WRITE) {
+		ofd->when &= ~OSMO_FD_WRITE;
+
+		octpkt_tx_batch(ofd->fd, &fl1h->phy_wq, &fl1h->phy_addr,
+				fl1h->pkt_ctrs);
+
+		if (!llist_empty(&fl1h->phy_wq.msg_queue))
+			ofd->when |= OSMO_FD_WRITE;
+	}
+
+	return 0;
 }
 
 struct octphy_hdl *l1if_open(struct phy_link *plink)
@@ -1779,6 +1981,10 @@ struct octphy_hdl *l1if_open(struct phy_link *plink)
 	INIT_LLIST_HEAD(&fl1h->wlc_list);
 	INIT_LLIST_HEAD(&fl1h->wlc_postponed);
 	fl1h->phy_link = plink;
+	fl1h->win.cwnd = UNACK_CMD_WINDOW_INIT;
+	fl1h->win.ssthresh = plink->u.octphy.cmd_window_max;
+	fl1h->win.max = plink->u.octphy.cmd_window_max;
+	fl1h->win.rto_us = CMD_RTO_INIT_US;
 
 	if (!phy_dev) {
 		LOGP(DL1C, LOGL_ERROR, "You have to specify a octphy net-device\n");
@@ -1822,17 +2028,35 @@ struct octphy_hdl *l1if_open(struct phy_link *plink)
 	memcpy(fl1h->phy_addr.sll_addr, plink->u.octphy.phy_addr.sll_addr,
 		ETH_ALEN);
 
-	/* Write queue / osmo_fd registration */
-	osmo_wqueue_init(&fl1h->phy_wq, 10);
-	fl1h->phy_wq.write_cb = octphy_write_cb;
-	fl1h->phy_wq.read_cb = octphy_read_cb;
+	fl1h->pkt_ctrs = octpkt_ctrs_alloc(fl1h, plink->num);
+	if (!fl1h->pkt_ctrs) {
+		close(sfd);
+		talloc_free(fl1h);
+		return NULL;
+	}
+
+	if (plink->u.octphy.rx_ring_blocks) {
+		fl1h->rx_ring = octpkt_rx_ring_alloc(fl1h, sfd,
+						     plink->u.octphy.rx_ring_blocks,
+						     fl1h->pkt_ctrs);
+		if (!fl1h->rx_ring)
+			LOGP(DL1C, LOGL_NOTICE, "Reading from the PHY socket "
+			     "without a receive ring\n");
+	}
+
+	/* Write queue / osmo_fd registration, frames are read from the ring
+	 * or with recvfrom() and written with sendmmsg(). Only commands go
+	 * through it, room for the whole window and a re-transmission of
+	 * each command in it. */
+	osmo_wqueue_init(&fl1h->phy_wq, 2 * plink->u.octphy.cmd_window_max);
 	fl1h->phy_wq.bfd.fd = sfd;
 	fl1h->phy_wq.bfd.when = OSMO_FD_READ;
-	fl1h->phy_wq.bfd.cb = osmo_wqueue_bfd_cb;
+	fl1h->phy_wq.bfd.cb = octphy_fd_cb;
 	fl1h->phy_wq.bfd.data = fl1h;
 	rc = osmo_fd_register(&fl1h->phy_wq.bfd);
 	if (rc < 0) {
 		close(sfd);
+		rate_ctr_group_free(fl1h->pkt_ctrs);
 		talloc_free(fl1h);
 		return NULL;
 	}
@@ -1844,6 +2068,7 @@ int l1if_close(struct octphy_hdl *fl1h)
 {
 	osmo_fd_unregister(&fl1h->phy_wq.bfd);
 	close(fl1h->phy_wq.bfd.fd);
+	rate_ctr_group_free(fl1h->pkt_ctrs);
 	talloc_free(fl1h);
 
 	return 0;
@@ -17,14 +17,23 @@
 
 #include <octphy/octvc1/gsm/octvc1_gsm_api.h>
 
+/* initial and default maximum size of the unacknowledged command window */
+#define UNACK_CMD_WINDOW_INIT	8
+#define UNACK_CMD_WINDOW_MAX	64
+
 #define BER_10K	10000
 
+struct octpkt_rx_ring;
+
 struct octphy_hdl {
 	/* MAC address of the PHY */
 	struct sockaddr_ll phy_addr;
 
 	/* packet socket to talk with PHY */
 	struct osmo_wqueue phy_wq;
+	/* TPACKET_V3 ring of that socket, NULL when reading with recvfrom() */
+	struct octpkt_rx_ring *rx_ring;
+	struct rate_ctr_group *pkt_ctrs;
 
 	/* address parameters of the PHY */
 	uint32_t session_id;
@@ -60,8 +69,40 @@ struct octphy_hdl {
 		uint32_t retrans_cmds_supv;
 		/* number of commands/wlcs that we ever had to postpone */
 		uint32_t wlc_postponed;
+		/* messages retransmitted due to response timeout */
+		uint32_t retrans_cmds_timeout;
+		/* responses received ahead of those to older commands */
+		uint32_t resp_out_of_order;
+		/* number of times the window got shrunk */
+		uint32_t win_shrink;
+		/* most commands ever in flight at once */
+		uint32_t wlc_inflight_max;
+		/* range of the measured response times */
+		uint32_t rtt_min_us;
+		uint32_t rtt_max_us;
 	} stats;
 
+	/* Size of the unacknowledged command window, adapted to the response
+	 * times and losses in the fashion of TCP congestion control */
+	struct {
+		/* current size and its upper bound */
+		unsigned int cwnd;
+		unsigned int max;
+		/* responses counted towards growing cwnd beyond ssthresh */
+		unsigned int cwnd_acc;
+		/* slow start threshold */
+		unsigned int ssthresh;
+		/* smoothed response time, its variation and the resulting
+		 * retransmission timeout */
+		uint32_t srtt_us;
+		uint32_t rttvar_us;
+		uint32_t rto_us;
+		/* losses of commands sent before this one don't shrink the
+		 * window again */
+		uint32_t recover_trans_id;
+		bool shrunk;
+	} win;
+
 	/* This is a list of wait_la_conf that OsmoBTS wanted to transmit to
 	 * the PHY, but which couldn't yet been sent as the unacknowledged
 	 * command window was full. */
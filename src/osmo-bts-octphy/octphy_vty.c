@@ -171,6 +171,42 @@ DEFUN(cfg_phy_rx_gain_db, cfg_phy_rx_gain_db_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_rx_ring, cfg_phy_rx_ring_cmd,
+	"octphy rx-ring <0-256>",
+	OCT_STR "Read from the PHY socket through a TPACKET_V3 receive ring\n"
+	"Number of 64 KiB ring blocks, 0 to read frame by frame\n")
+{
+	struct phy_link *plink = vty->index;
+
+	if (plink->state != PHY_LINK_SHUTDOWN) {
+		vty_out(vty, "Can only reconfigure a PHY link that is down%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	plink->u.octphy.rx_ring_blocks = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_cmd_window_max, cfg_phy_cmd_window_max_cmd,
+	"octphy cmd-window-max <1-256>",
+	OCT_STR "Set the upper bound of the unacknowledged command window\n"
+	"Maximum number of commands awaiting a response from the PHY\n")
+{
+	struct phy_link *plink = vty->index;
+
+	if (plink->state != PHY_LINK_SHUTDOWN) {
+		vty_out(vty, "Can only reconfigure a PHY link that is down%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	plink->u.octphy.cmd_window_max = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN(cfg_phy_tx_atten_db, cfg_phy_tx_atten_db_cmd,
 	"octphy tx-attenuation (oml|<0-359>)",
 	OCT_STR "Set attenuation on transmitted RF\n"
@@ -376,6 +412,12 @@ void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 		VTY_NEWLINE);
 	vty_out(vty, " octphy rx-gain %u%s", plink->u.octphy.rx_gain_db,
 		VTY_NEWLINE);
+	if (plink->u.octphy.rx_ring_blocks)
+		vty_out(vty, " octphy rx-ring %u%s",
+			plink->u.octphy.rx_ring_blocks, VTY_NEWLINE);
+	if (plink->u.octphy.cmd_window_max != UNACK_CMD_WINDOW_MAX)
+		vty_out(vty, " octphy cmd-window-max %u%s",
+			plink->u.octphy.cmd_window_max, VTY_NEWLINE);
 
 	if (plink->u.octphy.tx_atten_flag) {
 		vty_out(vty, " octphy tx-attenuation %u%s",
@@ -436,6 +478,44 @@ DEFUN(show_sys_info, show_sys_info_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(show_cmd_window, show_cmd_window_cmd,
+	"show phy <0-255> cmd-window",
+	SHOW_TRX_STR "Display the state of the unacknowledged command window\n")
+{
+	int phy_nr = atoi(argv[0]);
+	struct phy_link *plink = phy_link_by_num(phy_nr);
+	struct octphy_hdl *fl1h;
+
+	if (!plink || !plink->u.octphy.hdl) {
+		vty_out(vty, "Cannot find PHY number %u%s",
+			phy_nr, VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+	fl1h = plink->u.octphy.hdl;
+
+	vty_out(vty, "Window: %u (max %u, slow start threshold %u)%s",
+		fl1h->win.cwnd, fl1h->win.max, fl1h->win.ssthresh, VTY_NEWLINE);
+	vty_out(vty, "Commands in flight: %d (most ever %u), postponed: %d%s",
+		fl1h->wlc_list_len, fl1h->stats.wlc_inflight_max,
+		fl1h->wlc_postponed_len, VTY_NEWLINE);
+	vty_out(vty, "Response time: smoothed %u us, variation %u us, "
+		"min %u us, max %u us%s", fl1h->win.srtt_us, fl1h->win.rttvar_us,
+		fl1h->stats.rtt_min_us, fl1h->stats.rtt_max_us, VTY_NEWLINE);
+	vty_out(vty, "Retransmission timeout: %u us%s", fl1h->win.rto_us,
+		VTY_NEWLINE);
+	vty_out(vty, "Commands postponed: %u%s", fl1h->stats.wlc_postponed,
+		VTY_NEWLINE);
+	vty_out(vty, "Retransmissions: %u on timeout, %u on out-of-order "
+		"response, %u on reject%s", fl1h->stats.retrans_cmds_timeout,
+		fl1h->stats.retrans_cmds_trans_id, fl1h->stats.retrans_cmds_supv,
+		VTY_NEWLINE);
+	vty_out(vty, "Out-of-order responses: %u, window shrunk: %u times%s",
+		fl1h->stats.resp_out_of_order, fl1h->stats.win_shrink,
+		VTY_NEWLINE);
+
+	return CMD_SUCCESS;
+}
+
 
 int bts_model_vty_init(struct gsm_bts *bts)
 {
@@ -449,6 +529,8 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_NODE, &cfg_phy_tx_ant_id_cmd);
 #endif
 	install_element(PHY_NODE, &cfg_phy_rx_gain_db_cmd);
+	install_element(PHY_NODE, &cfg_phy_rx_ring_cmd);
+	install_element(PHY_NODE, &cfg_phy_cmd_window_max_cmd);
 	install_element(PHY_NODE, &cfg_phy_tx_atten_db_cmd);
 #if OCTPHY_USE_16X_OVERSAMPLING == 1
 	install_element(PHY_NODE, &cfg_phy_over_sample_16x_cmd);
@@ -456,6 +538,7 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element_ve(&show_rf_port_stats_cmd);
 	install_element_ve(&show_clk_sync_stats_cmd);
 	install_element_ve(&show_sys_info_cmd);
+	install_element_ve(&show_cmd_window_cmd);
 
 	return 0;
 }
@@ -18,16 +18,25 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  *
  */
+#define _GNU_SOURCE
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
+#include <sys/mman.h>
 
 #include <arpa/inet.h>
 
 #include <osmocom/core/select.h>
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/socket.h>
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/rate_ctr.h>
+#include <osmocom/core/stat_item.h>
+#include <osmocom/core/write_queue.h>
 
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/logging.h>
 
 #include <octphy/octpkt/octpkt_hdr.h>
 #include <octphy/octpkt/octpkt_hdr_swap.h>
@@ -156,3 +165,238 @@ err:
 	close(sfd);
 	return -1;
 }
+
+/***********************************************************************
+ * TPACKET_V3 receive ring and batched transmit
+ ***********************************************************************/
+
+static const struct rate_ctr_desc octpkt_ctr_desc[] = {
+	[OCTPKT_CTR_RX_FRAMES] =	{"rx:frames", "Frames taken from the receive ring"},
+	[OCTPKT_CTR_RX_BLOCKS] =	{"rx:blocks", "Receive ring blocks retired"},
+	[OCTPKT_CTR_RX_DROPS] =		{"rx:drops", "Frames dropped by the kernel, ring full"},
+	[OCTPKT_CTR_RX_FREEZE] =	{"rx:freeze", "Times the receive ring was frozen"},
+	[OCTPKT_CTR_TX_SENDMMSG] =	{"tx:sendmmsg", "sendmmsg() calls"},
+	[OCTPKT_CTR_TX_FRAMES] =	{"tx:frames", "Frames sent"},
+	[OCTPKT_CTR_TX_ERROR] =		{"tx:error", "Frames dropped on a failed sendmmsg()"},
+};
+static const struct rate_ctr_group_desc octpkt_ctrg_desc = {
+	"octphy_pkt",
+	"OCTPHY packet socket",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(octpkt_ctr_desc),
+	octpkt_ctr_desc
+};
+
+struct rate_ctr_group *octpkt_ctrs_alloc(void *ctx, unsigned int idx)
+{
+	return rate_ctr_group_alloc(ctx, &octpkt_ctrg_desc, idx);
+}
+
+enum octpkt_stat {
+	OCTPKT_STAT_RX_BLOCK_FRAMES,
+};
+
+static const struct osmo_stat_item_desc octpkt_stat_desc[] = {
+	[OCTPKT_STAT_RX_BLOCK_FRAMES] = { "rx:block_frames", "Frames in a retired receive ring block",
+					  "", 16, 0 },
+};
+static const struct osmo_stat_item_group_desc octpkt_statg_desc = {
+	"octphy_pkt",
+	"OCTPHY packet socket",
+	OSMO_STATS_CLASS_GLOBAL,
+	ARRAY_SIZE(octpkt_stat_desc),
+	octpkt_stat_desc
+};
+
+struct octpkt_rx_ring {
+	uint8_t *map;
+	unsigned int block_nr;
+	/* next block we expect the kernel to hand over */
+	unsigned int cur;
+	int fd;
+	struct rate_ctr_group *ctrs;
+	struct osmo_stat_item_group *stats;
+	/* poll the kernel ring statistics */
+	struct osmo_timer_list stats_timer;
+};
+
+static void octpkt_rx_ring_stats(void *data)
+{
+	struct octpkt_rx_ring *ring = data;
+	struct tpacket_stats_v3 st;
+	socklen_t len = sizeof(st);
+
+	/* reading the statistics resets them in the kernel */
+	if (getsockopt(ring->fd, SOL_PACKET, PACKET_STATISTICS, &st, &len) == 0) {
+		rate_ctr_add2(ring->ctrs, OCTPKT_CTR_RX_DROPS, st.tp_drops);
+		rate_ctr_add2(ring->ctrs, OCTPKT_CTR_RX_FREEZE, st.tp_freeze_q_cnt);
+	}
+
+	osmo_timer_schedule(&ring->stats_timer, OCTPKT_RING_STATS_INTERVAL, 0);
+}
+
+static int octpkt_rx_ring_destructor(struct octpkt_rx_ring *ring)
+{
+	osmo_timer_del(&ring->stats_timer);
+	if (ring->stats)
+		osmo_stat_item_group_free(ring->stats);
+	if (ring->map)
+		munmap(ring->map, ring->block_nr * OCTPKT_RING_BLOCK_SIZE);
+	return 0;
+}
+
+/*! \brief Switch a packet socket over to a TPACKET_V3 receive ring
+ *  \param[in] ctx talloc context for the ring
+ *  \param[in] fd packet socket
+ *  \param[in] block_nr number of OCTPKT_RING_BLOCK_SIZE blocks in the ring
+ *  \param[in] ctrs counter group from octpkt_ctrs_alloc(), the stat items of
+ *  the ring get the same index
+ *  \returns the ring, NULL on error
+ */
+struct octpkt_rx_ring *octpkt_rx_ring_alloc(void *ctx, int fd, unsigned int block_nr,
+					    struct rate_ctr_group *ctrs)
+{
+	struct octpkt_rx_ring *ring;
+	struct tpacket_req3 req;
+	int ver = TPACKET_V3;
+	void *map;
+
+	ring = talloc_zero(ctx, struct octpkt_rx_ring);
+	if (!ring)
+		return NULL;
+	ring->fd = fd;
+	ring->ctrs = ctrs;
+	osmo_timer_setup(&ring->stats_timer, octpkt_rx_ring_stats, ring);
+	talloc_set_destructor(ring, octpkt_rx_ring_destructor);
+
+	ring->stats = osmo_stat_item_group_alloc(ring, &octpkt_statg_desc, ctrs->idx);
+	if (!ring->stats)
+		goto err;
+
+	if (setsockopt(fd, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0)
+		goto err;
+
+	memset(&req, 0, sizeof(req));
+	req.tp_block_size = OCTPKT_RING_BLOCK_SIZE;
+	req.tp_block_nr = block_nr;
+	req.tp_frame_size = OCTPKT_RING_FRAME_SIZE;
+	req.tp_frame_nr = block_nr * (OCTPKT_RING_BLOCK_SIZE / OCTPKT_RING_FRAME_SIZE);
+	req.tp_retire_blk_tov = OCTPKT_RING_BLOCK_TOV_MS;
+	if (setsockopt(fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0)
+		goto err;
+
+	map = mmap(NULL, block_nr * OCTPKT_RING_BLOCK_SIZE, PROT_READ | PROT_WRITE,
+		   MAP_SHARED, fd, 0);
+	if (map == MAP_FAILED)
+		goto err;
+	ring->map = map;
+	ring->block_nr = block_nr;
+
+	osmo_timer_schedule(&ring->stats_timer, OCTPKT_RING_STATS_INTERVAL, 0);
+	return ring;
+
+err:
+	LOGP(DL1C, LOGL_ERROR, "Cannot set up a receive ring of %u blocks: %s\n",
+	     block_nr, strerror(errno));
+	talloc_free(ring);
+	return NULL;
+}
+
+/*! \brief Pass the frames of all blocks the kernel has retired to cb
+ *
+ *  The frames are only valid during the call-back, their block is handed
+ *  back to the kernel right after the last of them was processed.
+ *  \returns number of frames processed
+ */
+int octpkt_rx_ring_read(struct octpkt_rx_ring *ring, octpkt_rx_cb *cb, void *cb_data)
+{
+	unsigned int blocks, frames = 0;
+
+	/* at most one round, so a busy PHY can't starve the main loop */
+	for (blocks = 0; blocks < ring->block_nr; blocks++) {
+		struct tpacket_block_desc *bd;
+		struct tpacket3_hdr *th;
+		uint32_t i, num;
+
+		bd = (struct tpacket_block_desc *) (ring->map + ring->cur * OCTPKT_RING_BLOCK_SIZE);
+		if (!(__atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE) & TP_STATUS_USER))
+			break;
+
+		num = bd->hdr.bh1.num_pkts;
+		th = (struct tpacket3_hdr *) ((uint8_t *) bd + bd->hdr.bh1.offset_to_first_pkt);
+		for (i = 0; i < num; i++) {
+			/* on a SOCK_DGRAM socket, the frame starts with the
+			 * OCTPKT header, the Ethernet header is stripped */
+			cb((uint8_t *) th + th->tp_mac, th->tp_snaplen, cb_data);
+			th = (struct tpacket3_hdr *) ((uint8_t *) th + th->tp_next_offset);
+		}
+		frames += num;
+
+		rate_ctr_add2(ring->ctrs, OCTPKT_CTR_RX_FRAMES, num);
+		rate_ctr_inc2(ring->ctrs, OCTPKT_CTR_RX_BLOCKS);
+		osmo_stat_item_set(ring->stats->items[OCTPKT_STAT_RX_BLOCK_FRAMES], num);
+
+		/* retire the block */
+		__atomic_store_n(&bd->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+		ring->cur = (ring->cur + 1) % ring->block_nr;
+	}
+
+	return frames;
+}
+
+/*! \brief Send up to OCTPKT_TX_BATCH frames of a write queue to dst with a
+ *  single sendmmsg(), the frames sent are removed from the queue
+ *  \returns 0 on success or if the socket is busy; negative on error
+ */
+int octpkt_tx_batch(int fd, struct osmo_wqueue *wq, const struct sockaddr_ll *dst,
+		    struct rate_ctr_group *ctrs)
+{
+	struct mmsghdr mmsg[OCTPKT_TX_BATCH];
+	struct iovec iov[OCTPKT_TX_BATCH];
+	struct msgb *msg;
+	unsigned int n = 0;
+	int rc;
+
+	memset(mmsg, 0, sizeof(mmsg));
+	llist_for_each_entry(msg, &wq->msg_queue, list) {
+		if (n >= ARRAY_SIZE(mmsg))
+			break;
+		iov[n].iov_base = msg->data;
+		iov[n].iov_len = msgb_length(msg);
+		mmsg[n].msg_hdr.msg_name = (void *) dst;
+		mmsg[n].msg_hdr.msg_namelen = sizeof(*dst);
+		mmsg[n].msg_hdr.msg_iov = &iov[n];
+		mmsg[n].msg_hdr.msg_iovlen = 1;
+		n++;
+	}
+
+	/* Nothing scheduled? This should not happen. */
+	if (n == 0)
+		return 0;
+
+	rc = sendmmsg(fd, mmsg, n, 0);
+	rate_ctr_inc2(ctrs, OCTPKT_CTR_TX_SENDMMSG);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		LOGP(DL1P, LOGL_ERROR, "Tx to PHY has failed: %s\n",
+			strerror(errno));
+		/* drop the frame at the head, like the write queue did */
+		rate_ctr_inc2(ctrs, OCTPKT_CTR_TX_ERROR);
+		n = 1;
+		rc = -errno;
+	} else {
+		rate_ctr_add2(ctrs, OCTPKT_CTR_TX_FRAMES, rc);
+		n = rc;
+		rc = 0;
+	}
+
+	while (n--) {
+		msg = llist_first_entry(&wq->msg_queue, struct msgb, list);
+		llist_del(&msg->list);
+		wq->current_length -= 1;
+		msgb_free(msg);
+	}
+
+	return rc;
+}
@@ -19,4 +19,37 @@ void octvocnet_push_ctl_hdr(struct msgb *msg, uint32_t dest_fifo_id,
 int osmo_sock_packet_init(uint16_t type, uint16_t proto, const char *bind_dev,
 			  unsigned int flags);
 
+/* TPACKET_V3 receive ring: blocks of 64 KiB, each one handed over to us
+ * once full or after OCTPKT_RING_BLOCK_TOV_MS */
+#define OCTPKT_RING_BLOCK_SIZE		(1 << 16)
+#define OCTPKT_RING_FRAME_SIZE		2048
+#define OCTPKT_RING_BLOCK_TOV_MS	1
+#define OCTPKT_RING_STATS_INTERVAL	1
+/* number of frames passed to a single sendmmsg() */
+#define OCTPKT_TX_BATCH			32
+
+enum octpkt_ctr {
+	OCTPKT_CTR_RX_FRAMES,
+	OCTPKT_CTR_RX_BLOCKS,
+	OCTPKT_CTR_RX_DROPS,
+	OCTPKT_CTR_RX_FREEZE,
+	OCTPKT_CTR_TX_SENDMMSG,
+	OCTPKT_CTR_TX_FRAMES,
+	OCTPKT_CTR_TX_ERROR,
+};
+
+struct octpkt_rx_ring;
+struct osmo_wqueue;
+struct rate_ctr_group;
+struct sockaddr_ll;
+
+typedef void octpkt_rx_cb(const uint8_t *data, unsigned int len, void *cb_data);
+
+struct rate_ctr_group *octpkt_ctrs_alloc(void *ctx, unsigned int idx);
+struct octpkt_rx_ring *octpkt_rx_ring_alloc(void *ctx, int fd, unsigned int block_nr,
+					    struct rate_ctr_group *ctrs);
+int octpkt_rx_ring_read(struct octpkt_rx_ring *ring, octpkt_rx_cb *cb, void *cb_data);
+int octpkt_tx_batch(int fd, struct osmo_wqueue *wq, const struct sockaddr_ll *dst,
+		    struct rate_ctr_group *ctrs);
+
 int tx_trx_open(struct gsm_bts_trx *trx);
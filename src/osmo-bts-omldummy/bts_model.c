@@ -35,6 +35,8 @@
 #include <osmo-bts/handover.h>
 #include <osmo-bts/l1sap.h>
 
+#include "omldummy.h"
+
 /* TODO: check if dummy method is sufficient, else implement */
 int bts_model_lchan_deactivate(struct gsm_lchan *lchan)
 {
@@ -194,7 +196,8 @@ void bts_model_print_help()
 
 void bts_model_abis_close(struct gsm_bts *bts)
 {
-	bts_shutdown(bts, "Abis close");
+	/* no shutdown, the instance connects again on its own */
+	omldummy_abis_close(bts);
 }
 
 void bts_model_phy_link_set_defaults(struct phy_link *plink)
@@ -207,6 +210,7 @@ void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
 
 int bts_model_oml_estab(struct gsm_bts *bts)
 {
+	omldummy_oml_estab(bts);
 	return 0;
 }
 
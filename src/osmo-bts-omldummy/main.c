@@ -1,59 +1,373 @@
 
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/application.h>
+#include <osmocom/core/linuxlist.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/abis/e1_input.h>
 #include <osmo-bts/logging.h>
 #include <osmo-bts/abis.h>
 #include <osmo-bts/bts.h>
 #include <osmo-bts/oml.h>
 
+#include "omldummy.h"
 
-int main(int argc, char **argv)
-{
+/* Any number of BTS instances share the process and its select loop, each
+ * one with its own Abis link towards the BSC.  Instance i uses the site_id
+ * given on the command line plus i, which is also how a BTS is mapped back
+ * to its instance.  For every (re)connect, the time until the OML link is
+ * up is recorded and reported as a distribution.  RSL is never connected
+ * by the OML dummy, so there is nothing to measure beyond OML. */
+
+/* upper bounds of the histogram buckets, in ms; one more for anything above */
+static const unsigned int hist_ms[] = {
+	50, 100, 200, 500, 1000, 2000, 5000, 10000, 30000
+};
+
+struct bringup_stats {
+	const char *name;
+	unsigned int count;
+	uint64_t sum_ms;
+	unsigned int min_ms;
+	unsigned int max_ms;
+	unsigned int hist[ARRAY_SIZE(hist_ms) + 1];
+};
+
+enum {
+	BRINGUP_OML,
+	_NUM_BRINGUP
+};
+
+struct omldummy_bts {
 	struct gsm_bts *bts;
-	struct gsm_bts_trx *trx;
 	struct e1inp_line *line;
-	int i;
+	struct osmo_timer_list connect_timer;
+	/* when the current connection attempt was started */
+	struct timespec connect_ts;
+	bool oml_up;
+};
+
+static struct {
+	char *dst_host;
+	unsigned int site_id;
+	unsigned int num_bts;
+	unsigned int num_trx;
+	unsigned int stagger_ms;
+	unsigned int reconnect_ms;
+	unsigned int report_interval;
+	bool exit_when_up;
+
+	struct omldummy_bts *inst;
+	unsigned int num_oml_up;
+	unsigned int num_link_down;
+	struct bringup_stats stats[_NUM_BRINGUP];
+	struct osmo_timer_list report_timer;
+} g = {
+	.num_bts = 1,
+	.num_trx = 8,
+	.stagger_ms = 10,
+	.reconnect_ms = 1000,
+	.report_interval = 10,
+	.stats = {
+		[BRINGUP_OML] = { .name = "OML up", .min_ms = UINT_MAX },
+	},
+};
+
+static volatile sig_atomic_t quit = 0;
+
+static struct omldummy_bts *inst_by_bts(const struct gsm_bts *bts)
+{
+	unsigned int i = bts->ip_access.site_id - g.site_id;
+
+	if (bts->ip_access.site_id < g.site_id || i >= g.num_bts)
+		return NULL;
+	return &g.inst[i];
+}
+
+static void stats_add(struct omldummy_bts *inst, int which)
+{
+	struct bringup_stats *st = &g.stats[which];
+	struct timespec now;
+	unsigned int ms, i;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	ms = (now.tv_sec - inst->connect_ts.tv_sec) * 1000
+	     + (now.tv_nsec - inst->connect_ts.tv_nsec) / 1000000;
+
+	st->count++;
+	st->sum_ms += ms;
+	if (ms < st->min_ms)
+		st->min_ms = ms;
+	if (ms > st->max_ms)
+		st->max_ms = ms;
+	for (i = 0; i < ARRAY_SIZE(hist_ms); i++) {
+		if (ms < hist_ms[i])
+			break;
+	}
+	st->hist[i]++;
+
+	LOGP(DOML, LOGL_INFO, "site %u: %s after %u ms\n",
+	     inst->bts->ip_access.site_id, st->name, ms);
+}
 
-	if (argc < 3) {
-		fprintf(stderr, "Usage: %s dst_host site_id [trx_num]\n", argv[0]);
-		return 1;
+static void stats_report(void)
+{
+	char buf[256];
+	int i, len;
+	unsigned int j;
+
+	LOGP(DOML, LOGL_NOTICE, "%u of %u BTS with OML up, %u link losses\n",
+	     g.num_oml_up, g.num_bts, g.num_link_down);
+
+	for (i = 0; i < _NUM_BRINGUP; i++) {
+		const struct bringup_stats *st = &g.stats[i];
+
+		if (!st->count)
+			continue;
+		len = 0;
+		for (j = 0; j < ARRAY_SIZE(st->hist) && len < sizeof(buf); j++) {
+			if (j < ARRAY_SIZE(hist_ms))
+				len += snprintf(buf + len, sizeof(buf) - len, " <%u:%u",
+						hist_ms[j], st->hist[j]);
+			else
+				len += snprintf(buf + len, sizeof(buf) - len, " >=%u:%u",
+						hist_ms[j - 1], st->hist[j]);
+		}
+		LOGP(DOML, LOGL_NOTICE, "%s: n=%u min=%u avg=%" PRIu64 " max=%u ms |%s\n",
+		     st->name, st->count, st->min_ms, st->sum_ms / st->count,
+		     st->max_ms, buf);
+	}
+}
+
+static void report_timer_cb(void *data)
+{
+	stats_report();
+	osmo_timer_schedule(&g.report_timer, g.report_interval, 0);
+}
+
+static void check_all_up(void)
+{
+	if (g.exit_when_up && g.num_oml_up == g.num_bts)
+		quit = 1;
+}
+
+static void connect_timer_cb(void *data)
+{
+	struct omldummy_bts *inst = data;
+
+	clock_gettime(CLOCK_MONOTONIC, &inst->connect_ts);
+
+	if (inst->line) {
+		/* e1inp_line_update() only connects a line the first time it
+		 * is called, later calls just take another reference.  Drop
+		 * the two references abis_open() took on the line of the lost
+		 * link and connect on a fresh one. */
+		e1inp_line_put(inst->line);
+		e1inp_line_put(inst->line);
+		inst->line = NULL;
 	}
 
-	char *dst_host = argv[1];
-	int site_id = atoi(argv[2]);
-	int trx_num = argc > 3 ? atoi(argv[3]) : 8;
+	inst->line = abis_open(inst->bts, g.dst_host, "OMLdummy");
+	if (!inst->line) {
+		LOGP(DOML, LOGL_ERROR, "site %u: unable to open Abis link\n",
+		     inst->bts->ip_access.site_id);
+		osmo_timer_schedule(&inst->connect_timer, g.reconnect_ms / 1000,
+				    (g.reconnect_ms % 1000) * 1000);
+	}
+}
+
+void omldummy_oml_estab(struct gsm_bts *bts)
+{
+	struct omldummy_bts *inst = inst_by_bts(bts);
+
+	if (!inst || inst->oml_up)
+		return;
+	inst->oml_up = true;
+	g.num_oml_up++;
+	stats_add(inst, BRINGUP_OML);
+	check_all_up();
+}
+
+void omldummy_abis_close(struct gsm_bts *bts)
+{
+	struct omldummy_bts *inst = inst_by_bts(bts);
+	struct gsm_bts_trx *trx;
+	struct msgb *msg, *msg2;
+
+	/* called once per signalling link that went down */
+	if (!inst || osmo_timer_pending(&inst->connect_timer))
+		return;
+
+	g.num_link_down++;
+	if (inst->oml_up)
+		g.num_oml_up--;
+	inst->oml_up = false;
+
+	/* like a real BTS losing RSL, so that the TRX come up again on the
+	 * next connection; what this queued for the lost OML link is stale */
+	llist_for_each_entry(trx, &bts->trx_list, list)
+		trx_link_estab(trx);
+	llist_for_each_entry_safe(msg, msg2, &bts->oml_queue, list) {
+		llist_del(&msg->list);
+		msgb_free(msg);
+	}
+
+	LOGP(DOML, LOGL_NOTICE, "site %u: Abis link lost, reconnecting in %u ms\n",
+	     bts->ip_access.site_id, g.reconnect_ms);
+	osmo_timer_schedule(&inst->connect_timer, g.reconnect_ms / 1000,
+			    (g.reconnect_ms % 1000) * 1000);
+}
+
+static void signal_handler(int signal)
+{
+	switch (signal) {
+	case SIGINT:
+	case SIGTERM:
+		quit = 1;
+		break;
+	default:
+		break;
+	}
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [options] dst_host site_id [trx_num]\n"
+		"  -n	--num-bts N		Number of BTS instances (default 1), with\n"
+		"				site_id, site_id+1, ... as unit IDs\n"
+		"  -s	--stagger MS		Delay between two instances connecting (default 10)\n"
+		"  -r	--reconnect MS		Delay before reconnecting a lost link (default 1000)\n"
+		"  -i	--report-interval S	Print the bring-up times every S seconds,\n"
+		"				0 for only on exit (default 10)\n"
+		"  -x	--exit-when-up		Exit once every instance has its OML link up\n"
+		"  -h	--help			This text\n", prog);
+}
+
+static void handle_options(int argc, char **argv)
+{
+	static const struct option long_options[] = {
+		{ "num-bts", 1, 0, 'n' },
+		{ "stagger", 1, 0, 's' },
+		{ "reconnect", 1, 0, 'r' },
+		{ "report-interval", 1, 0, 'i' },
+		{ "exit-when-up", 0, 0, 'x' },
+		{ "help", 0, 0, 'h' },
+		{ 0, 0, 0, 0 }
+	};
+	int c;
+
+	while ((c = getopt_long(argc, argv, "n:s:r:i:xh", long_options, NULL)) != -1) {
+		switch (c) {
+		case 'n':
+			g.num_bts = atoi(optarg);
+			break;
+		case 's':
+			g.stagger_ms = atoi(optarg);
+			break;
+		case 'r':
+			g.reconnect_ms = atoi(optarg);
+			break;
+		case 'i':
+			g.report_interval = atoi(optarg);
+			break;
+		case 'x':
+			g.exit_when_up = true;
+			break;
+		case 'h':
+			print_usage(argv[0]);
+			exit(0);
+		default:
+			print_usage(argv[0]);
+			exit(1);
+		}
+	}
+
+	if (argc - optind < 2) {
+		print_usage(argv[0]);
+		exit(1);
+	}
+
+	g.dst_host = argv[optind];
+	g.site_id = atoi(argv[optind + 1]);
+	if (argc - optind > 2)
+		g.num_trx = atoi(argv[optind + 2]);
+
+	if (g.num_bts < 1 || g.site_id + g.num_bts - 1 > UINT16_MAX) {
+		fprintf(stderr, "site_id + num-bts must not exceed %u\n", UINT16_MAX + 1);
+		exit(1);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	struct omldummy_bts *inst;
+	struct gsm_bts *bts;
+	struct gsm_bts_trx *trx;
+	unsigned int i, j;
+	uint64_t delay_ms;
+
+	handle_options(argc, argv);
 
 	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
 	msgb_talloc_ctx_init(tall_bts_ctx, 10*1024);
 
 	osmo_init_logging2(tall_bts_ctx, &bts_log_info);
 
-	bts = gsm_bts_alloc(tall_bts_ctx, 0);
-	if (!bts)
+	g.inst = talloc_zero_array(tall_bts_ctx, struct omldummy_bts, g.num_bts);
+	if (!g.inst)
 		exit(1);
-	bts->ip_access.site_id = site_id;
-	bts->ip_access.bts_id = 0;
 
-	/* Additional TRXs */
-	for (i = 1; i < trx_num; i++) {
-		trx = gsm_bts_trx_alloc(bts);
-		if (!trx)
+	for (i = 0; i < g.num_bts; i++) {
+		inst = &g.inst[i];
+
+		bts = gsm_bts_alloc(tall_bts_ctx, 0);
+		if (!bts)
 			exit(1);
-	}
+		bts->ip_access.site_id = g.site_id + i;
+		bts->ip_access.bts_id = 0;
 
-	if (bts_init(bts) < 0)
-		exit(1);
-	//btsb = bts_role_bts(bts);
-	abis_init(bts);
+		/* Additional TRXs */
+		for (j = 1; j < g.num_trx; j++) {
+			trx = gsm_bts_trx_alloc(bts);
+			if (!trx)
+				exit(1);
+		}
 
+		if (bts_init(bts) < 0)
+			exit(1);
+		abis_init(bts);
+
+		inst->bts = bts;
+		osmo_timer_setup(&inst->connect_timer, connect_timer_cb, inst);
+		delay_ms = (uint64_t)i * g.stagger_ms;
+		osmo_timer_schedule(&inst->connect_timer, delay_ms / 1000,
+				    (delay_ms % 1000) * 1000);
+	}
 
-	line = abis_open(bts, dst_host, "OMLdummy");
-	if (!line)
-		exit(2);
+	osmo_timer_setup(&g.report_timer, report_timer_cb, NULL);
+	if (g.report_interval)
+		osmo_timer_schedule(&g.report_timer, g.report_interval, 0);
 
-	while (1) {
+	signal(SIGINT, &signal_handler);
+	signal(SIGTERM, &signal_handler);
+	osmo_init_ignore_signals();
+
+	while (!quit) {
 		osmo_select_main(0);
 	}
 
+	stats_report();
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,7 @@
+#pragma once
+
+struct gsm_bts;
+
+/* called by bts_model.c on the Abis events of one BTS instance */
+void omldummy_oml_estab(struct gsm_bts *bts);
+void omldummy_abis_close(struct gsm_bts *bts);
@@ -1,5 +1,83 @@
+#pragma once
+
+#include <stdint.h>
+#include <sys/socket.h>
+
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/write_queue.h>
+
 #define L1FWD_L1_PORT	9999
 #define L1FWD_SYS_PORT	9998
 #define L1FWD_TCH_PORT	9997
 #define L1FWD_PDTCH_PORT 9996
 
+/* The primitives are coalesced into datagrams of at most L1FWD_DGRAM_MAX
+ * bytes, each one starting with a struct l1fwd_dgram_hdr, followed by
+ * num_prims times a struct l1fwd_prim_hdr and the primitive itself. */
+#define L1FWD_VERSION		1
+#define L1FWD_DGRAM_MAX		8192
+#define L1FWD_DGRAM_PRIMS	16
+/* number of datagrams per recvmmsg() / sendmmsg() */
+#define L1FWD_BATCH		8
+/* seconds between two statistics reports */
+#define L1FWD_STATS_INTERVAL	10
+
+struct l1fwd_dgram_hdr {
+	uint8_t version;
+	uint8_t num_prims;
+} __attribute__((packed));
+
+struct l1fwd_prim_hdr {
+	uint16_t len;		/* network byte order */
+} __attribute__((packed));
+
+enum l1fwd_ctr {
+	L1FWD_CTR_RX_DGRAM,
+	L1FWD_CTR_RX_PRIM,
+	L1FWD_CTR_RX_BYTES,
+	L1FWD_CTR_RX_ERR,
+	L1FWD_CTR_TX_DGRAM,
+	L1FWD_CTR_TX_PRIM,
+	L1FWD_CTR_TX_BYTES,
+	L1FWD_CTR_TX_ERR,
+	L1FWD_CTR_DROP,
+	_L1FWD_CTR_NUM
+};
+
+struct l1fwd_stats {
+	const char *name;
+	struct osmo_timer_list timer;
+	unsigned long long ctr[_L1FWD_CTR_NUM];
+	/* counter values at the previous report */
+	unsigned long long last[_L1FWD_CTR_NUM];
+};
+
+struct l1fwd_ring;
+struct l1fwd_link;
+
+/* called for every primitive received, takes ownership of msg */
+typedef int l1fwd_prim_cb(struct l1fwd_link *link, struct msgb *msg);
+
+/* One UDP socket and the write queue of primitives towards its peer */
+struct l1fwd_link {
+	struct osmo_wqueue *wq;
+	struct l1fwd_ring *ring;
+	struct l1fwd_stats *stats;
+	/* peer address, learnt from the received datagrams when the
+	 * socket is not connected */
+	struct sockaddr_storage remote_sa;
+	socklen_t remote_sa_len;
+	int learn_remote;
+
+	l1fwd_prim_cb *prim_cb;
+	void *data;
+	int q;
+};
+
+struct l1fwd_ring *l1fwd_ring_alloc(void *ctx);
+struct l1fwd_link *l1fwd_link_alloc(void *ctx, struct osmo_wqueue *wq, int q,
+				    struct l1fwd_ring *ring, struct l1fwd_stats *stats,
+				    l1fwd_prim_cb *prim_cb, void *data);
+void l1fwd_stats_start(struct l1fwd_stats *stats, const char *name);
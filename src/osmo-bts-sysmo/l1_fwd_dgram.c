@@ -0,0 +1,352 @@
+/* Batched datagram transport between l1fwd-proxy and osmo-bts-sysmo-remote */
+
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/bit16gen.h>
+#include <osmocom/core/msgb.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/write_queue.h>
+
+#include <osmo-bts/logging.h>
+
+#include <sysmocom/femtobts/superfemto.h>
+#include <sysmocom/femtobts/gsml1prim.h>
+
+#include "femtobts.h"
+#include "l1_fwd.h"
+
+/* Preallocated receive buffers for one recvmmsg(), shared by all links of
+ * a process as each batch is taken apart before the next one is read */
+struct l1fwd_ring {
+	uint8_t buf[L1FWD_BATCH][L1FWD_DGRAM_MAX];
+	struct iovec iov[L1FWD_BATCH];
+	struct sockaddr_storage sa[L1FWD_BATCH];
+	struct mmsghdr mmsg[L1FWD_BATCH];
+};
+
+struct l1fwd_ring *l1fwd_ring_alloc(void *ctx)
+{
+	struct l1fwd_ring *ring;
+	unsigned int i;
+
+	ring = talloc_zero(ctx, struct l1fwd_ring);
+	if (!ring)
+		return NULL;
+
+	for (i = 0; i < L1FWD_BATCH; i++) {
+		ring->iov[i].iov_base = ring->buf[i];
+		ring->iov[i].iov_len = sizeof(ring->buf[i]);
+		ring->mmsg[i].msg_hdr.msg_iov = &ring->iov[i];
+		ring->mmsg[i].msg_hdr.msg_iovlen = 1;
+		ring->mmsg[i].msg_hdr.msg_name = &ring->sa[i];
+	}
+
+	return ring;
+}
+
+/* Take a received datagram apart and pass on each primitive */
+static void l1fwd_dgram_rx(struct l1fwd_link *link, const uint8_t *buf, size_t len)
+{
+	const struct l1fwd_dgram_hdr *dh = (const struct l1fwd_dgram_hdr *) buf;
+	struct l1fwd_stats *st = link->stats;
+	size_t pos = sizeof(*dh);
+	unsigned int i;
+
+	st->ctr[L1FWD_CTR_RX_DGRAM]++;
+	st->ctr[L1FWD_CTR_RX_BYTES] += len;
+
+	if (len < sizeof(*dh) || dh->version != L1FWD_VERSION) {
+		LOGP(DL1C, LOGL_ERROR, "UDP: Dropping datagram of unknown format "
+		     "on queue %d\n", link->q);
+		st->ctr[L1FWD_CTR_RX_ERR]++;
+		return;
+	}
+
+	for (i = 0; i < dh->num_prims; i++) {
+		struct msgb *msg;
+		uint16_t plen;
+
+		if (pos + sizeof(struct l1fwd_prim_hdr) > len)
+			goto malformed;
+		plen = osmo_load16be(buf + pos);
+		pos += sizeof(struct l1fwd_prim_hdr);
+		if (plen == 0 || pos + plen > len)
+			goto malformed;
+
+		msg = msgb_alloc_headroom(SYSMOBTS_PRIM_SIZE, 128, "udp_rx");
+		if (!msg) {
+			st->ctr[L1FWD_CTR_DROP]++;
+			return;
+		}
+		if (plen > msgb_tailroom(msg)) {
+			msgb_free(msg);
+			goto malformed;
+		}
+		msg->l1h = msgb_put(msg, plen);
+		memcpy(msg->l1h, buf + pos, plen);
+		pos += plen;
+
+		st->ctr[L1FWD_CTR_RX_PRIM]++;
+		link->prim_cb(link, msg);
+	}
+	return;
+
+malformed:
+	LOGP(DL1C, LOGL_ERROR, "UDP: Malformed datagram on queue %d, dropping "
+	     "%u of %u primitives\n", link->q, dh->num_prims - i, dh->num_prims);
+	st->ctr[L1FWD_CTR_RX_ERR]++;
+}
+
+static int l1fwd_recv(struct osmo_fd *ofd, struct l1fwd_link *link)
+{
+	struct l1fwd_ring *ring = link->ring;
+	int i, rc;
+
+	for (i = 0; i < L1FWD_BATCH; i++) {
+		ring->mmsg[i].msg_hdr.msg_namelen = sizeof(ring->sa[i]);
+		ring->mmsg[i].msg_hdr.msg_flags = 0;
+	}
+
+	rc = recvmmsg(ofd->fd, ring->mmsg, L1FWD_BATCH, MSG_DONTWAIT, NULL);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		LOGP(DL1C, LOGL_ERROR, "UDP: Failed to read from queue %d: %s\n",
+		     link->q, strerror(errno));
+		link->stats->ctr[L1FWD_CTR_RX_ERR]++;
+		return -errno;
+	}
+
+	for (i = 0; i < rc; i++) {
+		struct msghdr *mh = &ring->mmsg[i].msg_hdr;
+
+		if (link->learn_remote) {
+			memcpy(&link->remote_sa, &ring->sa[i], mh->msg_namelen);
+			link->remote_sa_len = mh->msg_namelen;
+		}
+		if (mh->msg_flags & MSG_TRUNC) {
+			LOGP(DL1C, LOGL_ERROR, "UDP: Truncated datagram on queue %d\n",
+			     link->q);
+			link->stats->ctr[L1FWD_CTR_RX_ERR]++;
+			continue;
+		}
+		l1fwd_dgram_rx(link, ring->buf[i], ring->mmsg[i].msg_len);
+	}
+
+	return 0;
+}
+
+/* Drop the first num msgbs of the write queue */
+static void l1fwd_dequeue(struct osmo_wqueue *wq, unsigned int num)
+{
+	struct msgb *msg;
+
+	while (num-- && !llist_empty(&wq->msg_queue)) {
+		msg = llist_first_entry(&wq->msg_queue, struct msgb, list);
+		llist_del(&msg->list);
+		wq->current_length -= 1;
+		msgb_free(msg);
+	}
+}
+
+/* Coalesce the queued primitives into up to L1FWD_BATCH datagrams and send
+ * them with a single sendmmsg(). The iovecs point right into the msgbs, so
+ * the primitives are not copied on the way out. */
+static int l1fwd_send(struct osmo_fd *ofd, struct l1fwd_link *link)
+{
+	struct osmo_wqueue *wq = link->wq;
+	struct l1fwd_stats *st = link->stats;
+	struct mmsghdr mmsg[L1FWD_BATCH];
+	struct iovec iov[L1FWD_BATCH][1 + 2 * L1FWD_DGRAM_PRIMS];
+	struct l1fwd_dgram_hdr dh[L1FWD_BATCH];
+	struct l1fwd_prim_hdr ph[L1FWD_BATCH][L1FWD_DGRAM_PRIMS];
+	unsigned int num_prims[L1FWD_BATCH];
+	unsigned int d = 0, n = 0, bytes = sizeof(dh[0]);
+	unsigned int i, sent_prims = 0;
+	struct msgb *msg;
+	int rc;
+
+	memset(mmsg, 0, sizeof(mmsg));
+
+	llist_for_each_entry(msg, &wq->msg_queue, list) {
+		unsigned int len = msgb_l1len(msg);
+
+		/* start a new datagram if this primitive does not fit */
+		if (n > 0 && (n == L1FWD_DGRAM_PRIMS ||
+			      bytes + sizeof(ph[0][0]) + len > L1FWD_DGRAM_MAX)) {
+			num_prims[d++] = n;
+			n = 0;
+			bytes = sizeof(dh[0]);
+			if (d == L1FWD_BATCH)
+				break;
+		}
+
+		osmo_store16be(len, &ph[d][n].len);
+		iov[d][1 + 2 * n].iov_base = &ph[d][n];
+		iov[d][1 + 2 * n].iov_len = sizeof(ph[d][n]);
+		iov[d][2 + 2 * n].iov_base = msg->l1h;
+		iov[d][2 + 2 * n].iov_len = len;
+		n++;
+		bytes += sizeof(ph[0][0]) + len;
+	}
+	if (n > 0)
+		num_prims[d++] = n;
+
+	/* Nothing scheduled? This should not happen. */
+	if (d == 0)
+		return 0;
+
+	for (i = 0; i < d; i++) {
+		struct msghdr *mh = &mmsg[i].msg_hdr;
+
+		dh[i].version = L1FWD_VERSION;
+		dh[i].num_prims = num_prims[i];
+		iov[i][0].iov_base = &dh[i];
+		iov[i][0].iov_len = sizeof(dh[i]);
+
+		mh->msg_iov = iov[i];
+		mh->msg_iovlen = 1 + 2 * num_prims[i];
+		if (link->remote_sa_len) {
+			mh->msg_name = &link->remote_sa;
+			mh->msg_namelen = link->remote_sa_len;
+		}
+	}
+
+	rc = sendmmsg(ofd->fd, mmsg, d, MSG_DONTWAIT);
+	if (rc < 0) {
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		/* drop the first datagram, so we don't get stuck on it */
+		LOGP(DL1C, LOGL_ERROR, "UDP: Failed to write to queue %d: %s\n",
+		     link->q, strerror(errno));
+		st->ctr[L1FWD_CTR_TX_ERR]++;
+		st->ctr[L1FWD_CTR_DROP] += num_prims[0];
+		l1fwd_dequeue(wq, num_prims[0]);
+		return -errno;
+	}
+
+	for (i = 0; i < rc; i++) {
+		sent_prims += num_prims[i];
+		st->ctr[L1FWD_CTR_TX_BYTES] += mmsg[i].msg_len;
+	}
+	st->ctr[L1FWD_CTR_TX_DGRAM] += rc;
+	st->ctr[L1FWD_CTR_TX_PRIM] += sent_prims;
+	l1fwd_dequeue(wq, sent_prims);
+
+	return 0;
+}
+
+static int l1fwd_fd_cb(struct osmo_fd *ofd, unsigned int what)
+{
+	struct l1fwd_link *link = ofd->data;
+
+	if (what & OSMO_FD_READ)
+		l1fwd_recv(ofd, link);
+
+	if (what & OSMO_FD_WRITE) {
+		ofd->when &= ~OSMO_FD_WRITE;
+
+		l1fwd_send(ofd, link);
+
+		if (!llist_empty(&link->wq->msg_queue))
+			ofd->when |= OSMO_FD_WRITE;
+	}
+
+	return 0;
+}
+
+/*! \brief Set up a write queue for the batched datagram transport
+ *  \param[in] ctx talloc context for the link
+ *  \param[in] wq Write queue, its bfd is opened by the caller afterwards
+ *  \param[in] q Message queue number, for logging
+ *  \param[in] ring Receive buffers
+ *  \param[in] stats Statistics to account to
+ *  \param[in] prim_cb Call-back for each received primitive
+ *  \param[in] data Opaque pointer for prim_cb
+ *  \returns the link, NULL on error
+ */
+struct l1fwd_link *l1fwd_link_alloc(void *ctx, struct osmo_wqueue *wq, int q,
+				    struct l1fwd_ring *ring, struct l1fwd_stats *stats,
+				    l1fwd_prim_cb *prim_cb, void *data)
+{
+	struct l1fwd_link *link;
+
+	link = talloc_zero(ctx, struct l1fwd_link);
+	if (!link)
+		return NULL;
+
+	link->wq = wq;
+	link->q = q;
+	link->ring = ring;
+	link->stats = stats;
+	link->prim_cb = prim_cb;
+	link->data = data;
+
+	osmo_wqueue_init(wq, L1FWD_BATCH * L1FWD_DGRAM_PRIMS);
+	wq->bfd.cb = l1fwd_fd_cb;
+	wq->bfd.data = link;
+	wq->bfd.priv_nr = q;
+
+	return link;
+}
+
+static void l1fwd_stats_cb(void *data)
+{
+	struct l1fwd_stats *st = data;
+	unsigned long long d[_L1FWD_CTR_NUM];
+	unsigned int i;
+
+	for (i = 0; i < _L1FWD_CTR_NUM; i++) {
+		d[i] = st->ctr[i] - st->last[i];
+		st->last[i] = st->ctr[i];
+	}
+
+	LOGP(DL1C, LOGL_NOTICE, "%s: rx %llu dgram/s %llu prim/s %llu kbit/s, "
+	     "tx %llu dgram/s %llu prim/s %llu kbit/s, errors rx %llu tx %llu, "
+	     "drops %llu (total rx %llu tx %llu drops %llu)\n", st->name,
+	     d[L1FWD_CTR_RX_DGRAM] / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_RX_PRIM] / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_RX_BYTES] * 8 / 1000 / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_TX_DGRAM] / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_TX_PRIM] / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_TX_BYTES] * 8 / 1000 / L1FWD_STATS_INTERVAL,
+	     d[L1FWD_CTR_RX_ERR], d[L1FWD_CTR_TX_ERR], d[L1FWD_CTR_DROP],
+	     st->ctr[L1FWD_CTR_RX_PRIM], st->ctr[L1FWD_CTR_TX_PRIM],
+	     st->ctr[L1FWD_CTR_DROP]);
+
+	osmo_timer_schedule(&st->timer, L1FWD_STATS_INTERVAL, 0);
+}
+
+/*! \brief Start the periodic report of the throughput and drop counters */
+void l1fwd_stats_start(struct l1fwd_stats *stats, const char *name)
+{
+	stats->name = name;
+	osmo_timer_setup(&stats->timer, l1fwd_stats_cb, stats);
+	osmo_timer_schedule(&stats->timer, L1FWD_STATS_INTERVAL, 0);
+}
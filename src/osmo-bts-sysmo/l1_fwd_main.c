@@ -63,10 +63,10 @@ static const uint16_t fwd_udp_ports[_NUM_MQ_WRITE] = {
 };
 
 struct l1fwd_hdl {
-	struct sockaddr_storage remote_sa[_NUM_MQ_WRITE];
-	socklen_t remote_sa_len[_NUM_MQ_WRITE];
-
 	struct osmo_wqueue udp_wq[_NUM_MQ_WRITE];
+	struct l1fwd_link *link[_NUM_MQ_WRITE];
+	struct l1fwd_ring *ring;
+	struct l1fwd_stats stats;
 
 	struct femtol1_hdl *fl1h;
 };
@@ -80,6 +80,7 @@ int l1if_handle_l1prim(int wq, struct femtol1_hdl *fl1h, struct msgb *msg)
 	/* Enqueue message to UDP socket */
 	if (osmo_wqueue_enqueue(&l1fh->udp_wq[wq], msg) != 0) {
 		LOGP(DL1C, LOGL_ERROR, "Write queue %d full. dropping msg\n", wq);
+		l1fh->stats.ctr[L1FWD_CTR_DROP]++;
 		msgb_free(msg);
 		return -EAGAIN;
 	}
@@ -94,6 +95,7 @@ int l1if_handle_sysprim(struct femtol1_hdl *fl1h, struct msgb *msg)
 	/* Enqueue message to UDP socket */
 	if (osmo_wqueue_enqueue(&l1fh->udp_wq[MQ_SYS_WRITE], msg) != 0) {
 		LOGP(DL1C, LOGL_ERROR, "MQ_SYS_WRITE ful. dropping msg\n");
+		l1fh->stats.ctr[L1FWD_CTR_DROP]++;
 		msgb_free(msg);
 		return -EAGAIN;
 	}
@@ -101,70 +103,26 @@ int l1if_handle_sysprim(struct femtol1_hdl *fl1h, struct msgb *msg)
 }
 
 
-/* data has arrived on the udp socket */
-static int udp_read_cb(struct osmo_fd *ofd)
+/* a primitive has arrived on the udp socket */
+static int udp_prim_cb(struct l1fwd_link *link, struct msgb *msg)
 {
-	struct msgb *msg = msgb_alloc_headroom(SYSMOBTS_PRIM_SIZE, 128, "udp_rx");
-	struct l1fwd_hdl *l1fh = ofd->data;
+	struct l1fwd_hdl *l1fh = link->data;
 	struct femtol1_hdl *fl1h = l1fh->fl1h;
-	int rc;
-
-	if (!msg)
-		return -ENOMEM;
-
-	msg->l1h = msg->data;
-
-	l1fh->remote_sa_len[ofd->priv_nr] = sizeof(l1fh->remote_sa[ofd->priv_nr]);
-	rc = recvfrom(ofd->fd, msg->l1h, msgb_tailroom(msg), 0,
-		      (struct sockaddr *) &l1fh->remote_sa[ofd->priv_nr], &l1fh->remote_sa_len[ofd->priv_nr]);
-	if (rc < 0) {
-		perror("read from udp");
-		msgb_free(msg);
-		return rc;
-	} else if (rc == 0) {
-		perror("len=0 read from udp");
-		msgb_free(msg);	
-		return rc;
-	}
-	msgb_put(msg, rc);
 
-	DEBUGP(DL1C, "UDP: Received %u bytes for queue %d\n", rc,
-		ofd->priv_nr);
+	DEBUGP(DL1C, "UDP: Received %u bytes for queue %d\n", msgb_l1len(msg),
+		link->q);
 
 	/* put the message into the right queue */
-	if (osmo_wqueue_enqueue(&fl1h->write_q[ofd->priv_nr], msg) != 0) {
+	if (osmo_wqueue_enqueue(&fl1h->write_q[link->q], msg) != 0) {
 		LOGP(DL1C, LOGL_ERROR, "Write queue %d full. dropping msg\n",
-			ofd->priv_nr);
+			link->q);
+		l1fh->stats.ctr[L1FWD_CTR_DROP]++;
 		msgb_free(msg);
 		return -EAGAIN;
 	}
 	return 0;
 }
 
-/* callback when we can write to the UDP socket */
-static int udp_write_cb(struct osmo_fd *ofd, struct msgb *msg)
-{
-	int rc;
-	struct l1fwd_hdl *l1fh = ofd->data;
-
-	DEBUGP(DL1C, "UDP: Writing %u bytes for queue %d\n", msgb_l1len(msg),
-		ofd->priv_nr);
-
-	rc = sendto(ofd->fd, msg->l1h, msgb_l1len(msg), 0,
-		    (const struct sockaddr *)&l1fh->remote_sa[ofd->priv_nr], l1fh->remote_sa_len[ofd->priv_nr]);
-	if (rc < 0) {
-		LOGP(DL1C, LOGL_ERROR, "error writing to L1 msg_queue: %s\n",
-			strerror(errno));
-		return rc;
-	} else if (rc < msgb_l1len(msg)) {
-		LOGP(DL1C, LOGL_ERROR, "short write to L1 msg_queue: "
-			"%u < %u\n", rc, msgb_l1len(msg));
-		return -EIO;
-	}
-
-	return 0;
-}
-
 int main(int argc, char **argv)
 {
 	struct l1fwd_hdl *l1fh;
@@ -190,13 +148,15 @@ int main(int argc, char **argv)
 
 	/* allocate new femtol1_handle */
 	fl1h = talloc_zero(ctx, struct femtol1_hdl);
-	INIT_LLIST_HEAD(&fl1h->wlc_list);
 
 	/* open the actual hardware transport */
 	for (i = 0; i < ARRAY_SIZE(fl1h->write_q); i++) {
 		rc = l1if_transport_open(i, fl1h);
 		if (rc < 0)
 			exit(1);
+		/* one recvmmsg() on the UDP side may carry this many
+		 * primitives for the DSP, all of them go in at once */
+		fl1h->write_q[i].max_length = L1FWD_BATCH * L1FWD_DGRAM_PRIMS;
 	}
 
 	/* create our fwd handle */
@@ -205,17 +165,22 @@ int main(int argc, char **argv)
 	l1fh->fl1h = fl1h;
 	fl1h->priv = l1fh;
 
+	l1fh->ring = l1fwd_ring_alloc(l1fh);
+	if (!l1fh->ring)
+		exit(1);
+
 	/* Open UDP */
 	for (i = 0; i < ARRAY_SIZE(l1fh->udp_wq); i++) {
 		struct osmo_wqueue *wq = &l1fh->udp_wq[i];
 
-		osmo_wqueue_init(wq, 10);
-		wq->write_cb = udp_write_cb;
-		wq->read_cb = udp_read_cb;
+		l1fh->link[i] = l1fwd_link_alloc(l1fh, wq, i, l1fh->ring,
+						 &l1fh->stats, udp_prim_cb, l1fh);
+		if (!l1fh->link[i])
+			exit(1);
+		/* the BTS is wherever the last datagram came from */
+		l1fh->link[i]->learn_remote = 1;
 
 		wq->bfd.when |= OSMO_FD_READ;
-		wq->bfd.data = l1fh;
-		wq->bfd.priv_nr = i;
 		rc = osmo_sock_init_ofd(&wq->bfd, AF_UNSPEC, SOCK_DGRAM,
 					IPPROTO_UDP, NULL, fwd_udp_ports[i],
 					OSMO_SOCK_F_BIND);
@@ -225,6 +190,8 @@ int main(int argc, char **argv)
 		}
 	}
 
+	l1fwd_stats_start(&l1fh->stats, "l1fwd-proxy");
+
 	while (1) {
 		rc = osmo_select_main(0);		
 		if (rc < 0) {
@@ -42,6 +42,7 @@
 
 #include <osmo-bts/logging.h>
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/bts.h>
 
 #include <sysmocom/femtobts/superfemto.h>
 #include <sysmocom/femtobts/gsml1prim.h>
@@ -62,40 +63,18 @@ static const uint16_t fwd_udp_ports[] = {
 #endif
 };
 
-static int fwd_read_cb(struct osmo_fd *ofd)
-{
-	struct msgb *msg = msgb_alloc_headroom(SYSMOBTS_PRIM_SIZE, 128, "udp_rx");
-	struct femtol1_hdl *fl1h = ofd->data;
-	int rc;
+/* receive buffers and statistics shared by all queues */
+static struct l1fwd_ring *fwd_ring;
+static struct l1fwd_stats fwd_stats;
 
-	if (!msg)
-		return -ENOMEM;
-
-	msg->l1h = msg->data;
-	rc = read(ofd->fd, msg->l1h, msgb_tailroom(msg));
-	if (rc < 0) {
-		LOGP(DL1C, LOGL_ERROR, "Short read from UDP\n");
-		msgb_free(msg);
-		return rc;
-	} else if (rc == 0) {
-		LOGP(DL1C, LOGL_ERROR, "Len=0 from UDP\n");
-		msgb_free(msg);
-		return rc;
-	}
-	msgb_put(msg, rc);
+static int fwd_prim_cb(struct l1fwd_link *link, struct msgb *msg)
+{
+	struct femtol1_hdl *fl1h = link->data;
 
-	if (ofd->priv_nr == MQ_SYS_WRITE)
-		rc = l1if_handle_sysprim(fl1h, msg);
+	if (link->q == MQ_SYS_WRITE)
+		return l1if_handle_sysprim(fl1h, msg);
 	else
-		rc = l1if_handle_l1prim(ofd->priv_nr, fl1h, msg);
-
-	return rc;
-}
-
-static int prim_write_cb(struct osmo_fd *ofd, struct msgb *msg)
-{
-	/* write to the fd */
-	return write(ofd->fd, msg->l1h, msgb_l1len(msg));
+		return l1if_handle_l1prim(link->q, fl1h, msg);
 }
 
 int l1if_transport_open(int q, struct femtol1_hdl *fl1h)
@@ -122,19 +101,26 @@ int l1if_transport_open(int q, struct femtol1_hdl *fl1h)
 	struct osmo_wqueue *wq = &fl1h->write_q[q];
 	struct osmo_fd *ofd = &wq->bfd;
 
-	osmo_wqueue_init(wq, 10);
-	wq->write_cb = prim_write_cb;
-	wq->read_cb = fwd_read_cb;
+	if (!fwd_ring) {
+		fwd_ring = l1fwd_ring_alloc(tall_bts_ctx);
+		if (!fwd_ring)
+			return -ENOMEM;
+		l1fwd_stats_start(&fwd_stats, "l1fwd");
+	}
+
+	if (!l1fwd_link_alloc(fl1h, wq, q, fwd_ring, &fwd_stats, fwd_prim_cb, fl1h))
+		return -ENOMEM;
 
-	ofd->data = fl1h;
-	ofd->priv_nr = q;
 	ofd->when |= OSMO_FD_READ;
 
 	rc = osmo_sock_init_ofd(ofd, AF_UNSPEC, SOCK_DGRAM, IPPROTO_UDP,
 				bts_host, fwd_udp_ports[q],
 				OSMO_SOCK_F_CONNECT);
-	if (rc < 0)
+	if (rc < 0) {
+		talloc_free(ofd->data);
+		ofd->data = NULL;
 		return rc;
+	}
 
 	return 0;
 }
@@ -147,6 +133,8 @@ int l1if_transport_close(int q, struct femtol1_hdl *fl1h)
 	osmo_wqueue_clear(wq);
 	osmo_fd_unregister(ofd);
 	close(ofd->fd);
+	talloc_free(ofd->data);
+	ofd->data = NULL;
 	
 	return 0;
 }
@@ -37,6 +37,8 @@
 
 #include <osmo-bts/logging.h>
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/l1_wqueue.h>
+#include <osmo-bts/l1_rx_pool.h>
 
 #include <sysmocom/femtobts/superfemto.h>
 #include <sysmocom/femtobts/gsml1prim.h>
@@ -89,74 +91,6 @@ static const char *wr_devnames[] = {
 osmo_static_assert(sizeof(GsmL1_Prim_t) + 128 <= SYSMOBTS_PRIM_SIZE, l1_prim)
 osmo_static_assert(sizeof(SuperFemto_Prim_t) + 128 <= SYSMOBTS_PRIM_SIZE, super_prim)
 
-static int wqueue_vector_cb(struct osmo_fd *fd, unsigned int what)
-{
-	struct osmo_wqueue *queue;
-
-	queue = container_of(fd, struct osmo_wqueue, bfd);
-
-	if (what & OSMO_FD_READ)
-		queue->read_cb(fd);
-
-	if (what & OSMO_FD_EXCEPT)
-		queue->except_cb(fd);
-
-	if (what & OSMO_FD_WRITE) {
-		struct iovec iov[5];
-		struct msgb *msg, *tmp;
-		int written, count = 0;
-
-		fd->when &= ~OSMO_FD_WRITE;
-
-		llist_for_each_entry(msg, &queue->msg_queue, list) {
-			/* more writes than we have */
-			if (count >= ARRAY_SIZE(iov))
-				break;
-
-			iov[count].iov_base = msg->l1h;
-			iov[count].iov_len = msgb_l1len(msg);
-			count += 1;
-		}
-
-		/* TODO: check if all lengths are the same. */
-
-
-		/* Nothing scheduled? This should not happen. */
-		if (count == 0) {
-			if (!llist_empty(&queue->msg_queue))
-				fd->when |= OSMO_FD_WRITE;
-			return 0;
-		}
-
-		written = writev(fd->fd, iov, count);
-		if (written < 0) {
-			/* nothing written?! */
-			if (!llist_empty(&queue->msg_queue))
-				fd->when |= OSMO_FD_WRITE;
-			return 0;
-		}
-
-		/* now delete the written entries */
-		written = written / iov[0].iov_len;
-		count = 0;
-		llist_for_each_entry_safe(msg, tmp, &queue->msg_queue, list) {
-			queue->current_length -= 1;
-
-			llist_del(&msg->list);
-			msgb_free(msg);
-
-			count += 1;
-			if (count >= written)
-				break;
-		}
-
-		if (!llist_empty(&queue->msg_queue))
-			fd->when |= OSMO_FD_WRITE;
-	}
-
-	return 0;
-}
-
 static int prim_size_for_queue(int queue)
 {
 	switch (queue) {
@@ -200,62 +134,57 @@ static int read_dispatch_one(struct femtol1_hdl *fl1h, struct msgb *msg, int que
 
 static int l1if_fd_cb(struct osmo_fd *ofd, unsigned int what)
 {
-	int i, rc;
-
+	struct femtol1_hdl *fl1h = ofd->data;
+	struct l1_rx_pool *pool = fl1h->rx_pool[ofd->priv_nr];
 	const uint32_t prim_size = prim_size_for_queue(ofd->priv_nr);
-	uint32_t count;
+	unsigned int batch = fl1h->rx_batch;
+	unsigned int i, n, count;
+	int rc;
+
+	struct iovec iov[L1IF_RX_BATCH_MAX];
+	struct msgb *msg[L1IF_RX_BATCH_MAX];
 
-	struct iovec iov[3];
-	struct msgb *msg[ARRAY_SIZE(iov)];
+	if (batch == 0 || batch > L1IF_RX_BATCH_MAX)
+		batch = L1IF_RX_BATCH_DEFAULT;
 
-	for (i = 0; i < ARRAY_SIZE(iov); ++i) {
-		msg[i] = msgb_alloc_headroom(prim_size + 128, 128, "1l_fd");
-		msg[i]->l1h = msg[i]->data;
+	for (n = 0; n < batch; ++n) {
+		msg[n] = l1_rx_pool_get(pool);
+		if (!msg[n])
+			break;
+		msg[n]->l1h = msg[n]->data;
 
-		iov[i].iov_base = msg[i]->l1h;
-		iov[i].iov_len = msgb_tailroom(msg[i]);
+		iov[n].iov_base = msg[n]->l1h;
+		iov[n].iov_len = prim_size;
+	}
+	if (n == 0) {
+		l1_rx_pool_backoff(pool, ofd);
+		return 0;
 	}
 
-	rc = readv(ofd->fd, iov, ARRAY_SIZE(iov));
+	rc = readv(ofd->fd, iov, n);
 	if (rc < 0) {
 		LOGP(DL1C, LOGL_ERROR, "failed to read from fd: %s\n", strerror(errno));
-		/* N. B: we do not abort to let the cycle below cleanup allocated memory properly,
+		/* N. B: we do not abort to let the cycle below return the buffers to the pool,
 		   the return value is ignored by the caller anyway.
 		   TODO: use libexplain's explain_readv() to provide detailed error description */
 		count = 0;
 	} else
 		count = rc / prim_size;
 
+	l1_rx_pool_account(pool, count, batch);
+
+	/* return the buffers readv() did not fill */
+	for (i = n; i > count; --i)
+		msgb_free(msg[i - 1]);
+
 	for (i = 0; i < count; ++i) {
 		msgb_put(msg[i], prim_size);
-		read_dispatch_one(ofd->data, msg[i], ofd->priv_nr);
+		read_dispatch_one(fl1h, msg[i], ofd->priv_nr);
 	}
 
-	for (i = count; i < ARRAY_SIZE(iov); ++i)
-		msgb_free(msg[i]);
-
 	return 1;
 }
 
-/* callback when we can write to one of the l1 msg_queue devices */
-static int l1fd_write_cb(struct osmo_fd *ofd, struct msgb *msg)
-{
-	int rc;
-
-	rc = write(ofd->fd, msg->l1h, msgb_l1len(msg));
-	if (rc < 0) {
-		LOGP(DL1C, LOGL_ERROR, "error writing to L1 msg_queue: %s\n",
-			strerror(errno));
-		return rc;
-	} else if (rc < msg->len) {
-		LOGP(DL1C, LOGL_ERROR, "short write to L1 msg_queue: "
-			"%u < %u\n", rc, msg->len);
-		return -EIO;
-	}
-
-	return 0;
-}
-
 int l1if_transport_open(int q, struct femtol1_hdl *hdl)
 {
 	int rc;
@@ -265,11 +194,18 @@ int l1if_transport_open(int q, struct femtol1_hdl *hdl)
 	struct osmo_wqueue *wq = &hdl->write_q[q];
 	struct osmo_fd *write_ofd = &hdl->write_q[q].bfd;
 
+	/* one counter group per read queue of each PHY link */
+	hdl->rx_pool[q] = l1_rx_pool_alloc(hdl, prim_size_for_queue(q), 128,
+					   2 * L1IF_RX_BATCH_MAX,
+					   (hdl->phy_inst ? hdl->phy_inst->phy_link->num : 0) * _NUM_MQ_READ + q);
+	if (!hdl->rx_pool[q])
+		return -ENOMEM;
+
 	rc = open(rd_devnames[q], O_RDONLY);
 	if (rc < 0) {
 		LOGP(DL1C, LOGL_FATAL, "[%d] unable to open %s for reading: %s\n",
 		     q, rd_devnames[q], strerror(errno));
-		return rc;
+		goto out_pool;
 	}
 	read_ofd->fd = rc;
 	read_ofd->priv_nr = q;
@@ -280,7 +216,7 @@ int l1if_transport_open(int q, struct femtol1_hdl *hdl)
 	if (rc < 0) {
 		close(read_ofd->fd);
 		read_ofd->fd = -1;
-		return rc;
+		goto out_pool;
 	}
 
 	rc = open(wr_devnames[q], O_WRONLY);
@@ -289,15 +225,19 @@ int l1if_transport_open(int q, struct femtol1_hdl *hdl)
 		     q, wr_devnames[q], strerror(errno));
 		goto out_read;
 	}
-	osmo_wqueue_init(wq, 10);
-	wq->write_cb = l1fd_write_cb;
-	write_ofd->cb = wqueue_vector_cb;
 	write_ofd->fd = rc;
+	rc = l1_wqueue_init(wq, hdl, L1_WQUEUE_LEN,
+			    (hdl->phy_inst ? hdl->phy_inst->num : 0) * _NUM_MQ_WRITE + q);
+	if (rc < 0) {
+		close(write_ofd->fd);
+		write_ofd->fd = -1;
+		goto out_read;
+	}
 	write_ofd->priv_nr = q;
-	write_ofd->data = hdl;
 	write_ofd->when = OSMO_FD_WRITE;
 	rc = osmo_fd_register(write_ofd);
 	if (rc < 0) {
+		l1_wqueue_release(wq);
 		close(write_ofd->fd);
 		write_ofd->fd = -1;
 		goto out_read;
@@ -308,6 +248,9 @@ int l1if_transport_open(int q, struct femtol1_hdl *hdl)
 out_read:
 	close(hdl->read_ofd[q].fd);
 	osmo_fd_unregister(&hdl->read_ofd[q]);
+out_pool:
+	l1_rx_pool_release(hdl->rx_pool[q]);
+	hdl->rx_pool[q] = NULL;
 
 	return rc;
 }
@@ -321,9 +264,15 @@ int l1if_transport_close(int q, struct femtol1_hdl *hdl)
 	close(read_ofd->fd);
 	read_ofd->fd = -1;
 
+	if (hdl->rx_pool[q]) {
+		l1_rx_pool_release(hdl->rx_pool[q]);
+		hdl->rx_pool[q] = NULL;
+	}
+
 	osmo_fd_unregister(write_ofd);
 	close(write_ofd->fd);
 	write_ofd->fd = -1;
+	l1_wqueue_release(&hdl->write_q[q]);
 
 	return 0;
 }
@@ -189,6 +189,7 @@ void bts_model_phy_link_set_defaults(struct phy_link *plink)
 void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
 {
 	pinst->u.sysmobts.clk_use_eeprom = 1;
+	pinst->u.sysmobts.rx_batch = L1IF_RX_BATCH_DEFAULT;
 }
 
 void bts_model_abis_close(struct gsm_bts *bts)
@@ -149,6 +149,34 @@ DEFUN(cfg_phy_cal_path, cfg_phy_cal_path_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_rx_batch, cfg_phy_rx_batch_cmd,
+	"dsp-rx-batch <1-32>",
+	"Set the number of primitives read from a DSP queue per wakeup\n"
+	"Number of primitives\n")
+{
+	struct phy_instance *pinst = vty->index;
+
+	pinst->u.sysmobts.rx_batch = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_conf_timeout, cfg_phy_conf_timeout_cmd,
+	"l1-confirm-timeout (sys|phy|lchan) <100-60000>",
+	"Set the time to wait for the confirmation of a DSP request\n"
+	"System primitives\n"
+	"L1 primitives concerning the whole PHY\n"
+	"L1 primitives concerning a logical channel\n"
+	"Timeout in milliseconds\n")
+{
+	struct phy_instance *pinst = vty->index;
+	int cls = get_string_value(l1_conf_class_names, argv[0]);
+
+	pinst->u.sysmobts.conf_timeout_ms[cls] = atoi(argv[1]);
+
+	return CMD_SUCCESS;
+}
+
 DEFUN_DEPRECATED(cfg_trx_ul_power_target, cfg_trx_ul_power_target_cmd,
 	"uplink-power-target <-110-0>",
 	"Obsolete alias for bts uplink-power-target\n"
@@ -473,6 +501,15 @@ void bts_model_config_write_phy_inst(struct vty *vty, struct phy_instance *pinst
 		vty_out(vty, "  clock-source %s%s",
 			get_value_string(femtobts_clksrc_names,
 					 pinst->u.sysmobts.clk_src), VTY_NEWLINE);
+	if (pinst->u.sysmobts.rx_batch != L1IF_RX_BATCH_DEFAULT)
+		vty_out(vty, "  dsp-rx-batch %u%s",
+			pinst->u.sysmobts.rx_batch, VTY_NEWLINE);
+	for (i = 0; i < _NUM_L1_CONF_C; i++) {
+		if (pinst->u.sysmobts.conf_timeout_ms[i])
+			vty_out(vty, "  l1-confirm-timeout %s %u%s",
+				get_value_string(l1_conf_class_names, i),
+				pinst->u.sysmobts.conf_timeout_ms[i], VTY_NEWLINE);
+	}
 }
 
 int bts_model_vty_init(struct gsm_bts *bts)
@@ -538,6 +575,8 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_INST_NODE, &cfg_phy_clkcal_def_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_clksrc_cmd);
 	install_element(PHY_INST_NODE, &cfg_phy_cal_path_cmd);
+	install_element(PHY_INST_NODE, &cfg_phy_rx_batch_cmd);
+	install_element(PHY_INST_NODE, &cfg_phy_conf_timeout_cmd);
 
 	return 0;
 }
@@ -172,7 +172,7 @@ int tx_pdtch_fn(struct l1sched_trx *l1t, enum trx_chan_type chan,
 	}
 
 	/* get mac block from queue */
-	msg = _sched_dequeue_prim(l1t, br->tn, br->fn, chan);
+	msg = _sched_dequeue_pdtch(l1t, br->tn, br->fn, chan);
 	if (msg)
 		goto got_msg;
 
@@ -21,6 +21,7 @@
 
 #include <stdint.h>
 #include <errno.h>
+#include <string.h>
 
 #include <osmocom/core/bits.h>
 #include <osmocom/core/utils.h>
@@ -34,6 +35,36 @@
 
 #include <sched_utils.h>
 
+/* The BCCH only ever carries the handful of SI blocks of the rotation (see
+ * bts_sysinfo_update_bcch()), so keep their encoded bursts instead of running
+ * the channel encoder for every block.  Entries are keyed by content, so an SI
+ * update simply results in a miss. */
+#define BCCH_BURST_CACHE_SIZE	32
+
+static struct bcch_burst_cache {
+	bool valid;
+	uint8_t l2[GSM_MACBLOCK_LEN];
+	ubit_t bursts[464];
+} bcch_burst_cache[BCCH_BURST_CACHE_SIZE];
+
+static void bcch_encode_cached(ubit_t *bursts, const uint8_t *l2)
+{
+	struct bcch_burst_cache *ent;
+	unsigned int i, h = 0;
+
+	for (i = 0; i < GSM_MACBLOCK_LEN; i++)
+		h = h * 31 + l2[i];
+	ent = &bcch_burst_cache[h % BCCH_BURST_CACHE_SIZE];
+
+	if (!ent->valid || memcmp(ent->l2, l2, GSM_MACBLOCK_LEN)) {
+		gsm0503_xcch_encode(ent->bursts, l2);
+		memcpy(ent->l2, l2, GSM_MACBLOCK_LEN);
+		ent->valid = true;
+	}
+
+	memcpy(bursts, ent->bursts, sizeof(ent->bursts));
+}
+
 /*! \brief a single (SDCCH/SACCH) burst was received by the PHY, process it */
 int rx_data_fn(struct l1sched_trx *l1t, enum trx_chan_type chan,
 	       uint8_t bid, const struct trx_ul_burst_ind *bi)
@@ -210,7 +241,10 @@ got_msg:
 	}
 
 	/* encode bursts */
-	gsm0503_xcch_encode(*bursts_p, msg->l2h);
+	if (chan == TRXC_BCCH)
+		bcch_encode_cached(*bursts_p, msg->l2h);
+	else
+		gsm0503_xcch_encode(*bursts_p, msg->l2h);
 
 	/* free message */
 	msgb_free(msg);
@@ -44,7 +44,7 @@
 #include <osmo-bts/scheduler.h>
 #include "virtual_um.h"
 
-extern int vbts_sched_start(struct gsm_bts *bts);
+extern int vbts_sched_start(struct gsm_bts *bts, unsigned int clock_speed);
 
 static struct phy_instance *phy_instance_by_arfcn(struct phy_link *plink, uint16_t arfcn)
 {
@@ -202,7 +202,8 @@ int bts_model_phy_link_open(struct phy_link *plink)
 
 	phy_link_state_set(plink, PHY_LINK_CONNECTING);
 
-	plink->u.virt.virt_um = virt_um_init(plink, plink->u.virt.ms_mcast_group, plink->u.virt.ms_mcast_port,
+	plink->u.virt.virt_um = virt_um_init(plink, plink->num,
+					     plink->u.virt.ms_mcast_group, plink->u.virt.ms_mcast_port,
 					     plink->u.virt.bts_mcast_group, plink->u.virt.bts_mcast_port,
 					     plink->u.virt.ttl, plink->u.virt.mcast_dev, virt_um_rcv_cb);
 	if (!plink->u.virt.virt_um) {
@@ -221,7 +222,7 @@ int bts_model_phy_link_open(struct phy_link *plink)
 		/* Other TRX are activated via OML by a PRIM_INFO_MODIFY
 		 * / PRIM_INFO_ACTIVATE */
 		if (pinst->trx && pinst->trx == pinst->trx->bts->c0) {
-			vbts_sched_start(pinst->trx->bts);
+			vbts_sched_start(pinst->trx->bts, plink->u.virt.clock_speed);
 			/* init lapdm layer 3 callback for the trx on timeslot 0 == BCCH */
 			lchan_init_lapdm(&pinst->trx->ts[0].lchan[CCCH_LCHAN]);
 			/* FIXME: This is probably the wrong location to set the CCCH to active... the OML link def. needs to be reworked and fixed. */
@@ -10,6 +10,10 @@ struct bts_virt_priv {
 	uint32_t last_fn;
 	struct timeval tv_clock;
 	struct osmo_timer_list fn_timer;
+	/* clocks the frames when running faster than real time */
+	struct osmo_fd fn_timerfd;
+	/* multiple of real time, 0 for as fast as possible */
+	unsigned int clock_speed;
 };
 
 struct vbts_l1h {
@@ -24,4 +28,4 @@ void l1if_reset(struct vbts_l1h *l1h);
 
 int l1if_mph_time_ind(struct gsm_bts *bts, uint32_t fn);
 
-int vbts_sched_start(struct gsm_bts *bts);
+int vbts_sched_start(struct gsm_bts *bts, unsigned int clock_speed);
@@ -0,0 +1,468 @@
+/* Synthetic uplink load generator for the virtual OsmoBTS */
+
+/*
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Affero General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+/* The generator feeds GSMTAP bursts into the same receive call-back as the
+ * virtual Um socket, so the whole BTS stack above it sees them like bursts
+ * of real virtual MS:
+ *
+ *  - RACH bursts at a configurable rate, the latency up to the IMMEDIATE
+ *    ASSIGNMENT carrying their request reference is recorded;
+ *  - optionally on each assigned SDCCH a SABM carrying an IMSI DETACH, the
+ *    latency up to the UA is recorded;
+ *  - speech frames on active TCH lchans;
+ *  - uplink dummy control blocks on PDCH timeslots.
+ */
+
+#include <stdint.h>
+#include <inttypes.h>
+#include <string.h>
+#include <errno.h>
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/core/timer.h>
+#include <osmocom/core/gsmtap.h>
+#include <osmocom/core/gsmtap_util.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/gsm_04_08.h>
+
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/phy_link.h>
+#include <osmo-bts/logging.h>
+#include "virtual_um.h"
+#include "loadgen.h"
+
+/* signal strength and SNR the synthetic bursts are received with */
+#define LOADGEN_SIGNAL_DBM	63
+#define LOADGEN_SNR		63
+
+/* speech frame lengths, in the RTP format of the respective codec */
+#define LOADGEN_FR_LEN		33
+#define LOADGEN_HR_LEN		14
+#define LOADGEN_EFR_LEN		31
+
+struct vbts_loadgen *vbts_loadgen_alloc(struct phy_link *plink)
+{
+	struct vbts_loadgen *lg = talloc_zero(plink, struct vbts_loadgen);
+
+	if (!lg)
+		return NULL;
+	lg->plink = plink;
+	vbts_loadgen_reset_stats(lg);
+	return lg;
+}
+
+void vbts_loadgen_reset_stats(struct vbts_loadgen *lg)
+{
+	memset(&lg->stats, 0, sizeof(lg->stats));
+	memset(&lg->lat_imm_ass, 0, sizeof(lg->lat_imm_ass));
+	memset(&lg->lat_ua, 0, sizeof(lg->lat_ua));
+	lg->lat_imm_ass.min_us = UINT32_MAX;
+	lg->lat_ua.min_us = UINT32_MAX;
+}
+
+static void req_start(struct vbts_loadgen_req *req, uint32_t fn)
+{
+	req->in_use = true;
+	req->fn = fn;
+	osmo_clock_gettime(CLOCK_MONOTONIC, &req->ts);
+}
+
+static void req_done(struct vbts_loadgen_req *req, struct vbts_loadgen_lat *lat, uint32_t fn)
+{
+	struct timespec now;
+	uint32_t us, frames;
+
+	osmo_clock_gettime(CLOCK_MONOTONIC, &now);
+	us = (now.tv_sec - req->ts.tv_sec) * 1000000 + (now.tv_nsec - req->ts.tv_nsec) / 1000;
+	frames = GSM_TDMA_FN_SUB(fn, req->fn);
+
+	lat->count++;
+	lat->sum_us += us;
+	lat->sum_fn += frames;
+	if (us < lat->min_us)
+		lat->min_us = us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	if (frames > lat->max_fn)
+		lat->max_fn = frames;
+
+	req->in_use = false;
+}
+
+static void req_expire(struct vbts_loadgen_req *req, struct vbts_loadgen_lat *lat, uint32_t fn)
+{
+	if (!req->in_use || GSM_TDMA_FN_SUB(fn, req->fn) < VBTS_LOADGEN_TIMEOUT_FN)
+		return;
+	lat->timeout++;
+	req->in_use = false;
+}
+
+static int inject(struct vbts_loadgen *lg, uint16_t arfcn, uint8_t tn, uint8_t gsmtap_chan,
+		  uint8_t ss, uint32_t fn, const uint8_t *data, unsigned int len)
+{
+	struct virt_um_inst *vui = lg->plink->u.virt.virt_um;
+	int rc;
+
+	if (!vui)
+		return -ENODEV;
+
+	rc = virt_um_inject_gsmtap(vui, arfcn | GSMTAP_ARFCN_F_UPLINK, tn, gsmtap_chan, ss, fn,
+				   LOADGEN_SIGNAL_DBM, LOADGEN_SNR, data, len);
+	if (rc < 0)
+		lg->stats.inject_err++;
+	return rc;
+}
+
+/* Request Reference (3GPP TS 44.018, 10.5.2.30) of a RACH burst */
+static void req_ref_enc(uint8_t *out, uint8_t ra, uint32_t fn)
+{
+	struct gsm_time t;
+
+	gsm_fn2gsmtime(&t, fn);
+	out[0] = ra;
+	out[1] = (t.t1 & 0x1f) << 3 | (t.t3 >> 3);
+	out[2] = (t.t3 & 0x07) << 5 | (t.t2 & 0x1f);
+}
+
+static void rach_tick(struct vbts_loadgen *lg, struct gsm_bts *bts, uint32_t fn)
+{
+	unsigned int i;
+	uint8_t ra;
+
+	for (i = 0; i < ARRAY_SIZE(lg->rach); i++)
+		req_expire(&lg->rach[i], &lg->lat_imm_ass, fn);
+
+	if (!lg->rach_rate)
+		return;
+
+	/* spread rach_rate bursts evenly over the frames of a second */
+	lg->rach_acc += (uint64_t) lg->rach_rate * GSM_TDMA_FN_DURATION_uS;
+	while (lg->rach_acc >= 1000000) {
+		lg->rach_acc -= 1000000;
+
+		for (i = 0; i < ARRAY_SIZE(lg->rach); i++) {
+			if (!lg->rach[(lg->rach_next + i) % ARRAY_SIZE(lg->rach)].in_use)
+				break;
+		}
+		if (i == ARRAY_SIZE(lg->rach)) {
+			lg->stats.rach_busy++;
+			continue;
+		}
+		i = (lg->rach_next + i) % ARRAY_SIZE(lg->rach);
+		lg->rach_next = i + 1;
+
+		/* 000xxxxx: location updating, answered with an SDCCH. The
+		 * five low bits tell the requests in flight apart. */
+		ra = i & 0x1f;
+		if (inject(lg, bts->c0->arfcn, 0, GSMTAP_CHANNEL_RACH, 0, fn, &ra, 1) < 0)
+			continue;
+		req_start(&lg->rach[i], fn);
+		lg->stats.rach++;
+	}
+}
+
+static void sdcch_tick(struct vbts_loadgen *lg, uint32_t fn)
+{
+	/* SABM, SAPI 0, carrying an IMSI DETACH INDICATION with a TMSI */
+	static const uint8_t sabm[GSM_MACBLOCK_LEN] = {
+		0x01, 0x3f, (9 << 2) | 0x01,
+		GSM48_PDISC_MM, GSM48_MT_MM_IMSI_DETACH_IND, 0x33,
+		0x05, 0xf4, 0x00, 0x00, 0x00, 0x01,
+		0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b,
+	};
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(lg->sdcch_sess); i++) {
+		struct vbts_loadgen_sdcch *sess = &lg->sdcch_sess[i];
+
+		if (!sess->req.in_use)
+			continue;
+		if (!sess->sabm_sent) {
+			if (inject(lg, sess->arfcn, sess->tn, sess->gsmtap_chan, sess->ss, fn,
+				   sabm, sizeof(sabm)) < 0) {
+				sess->req.in_use = false;
+				continue;
+			}
+			req_start(&sess->req, fn);
+			sess->sabm_sent = true;
+			lg->stats.sabm++;
+			continue;
+		}
+		req_expire(&sess->req, &lg->lat_ua, fn);
+	}
+}
+
+static void tch_tick(struct vbts_loadgen *lg, struct gsm_bts *bts, uint32_t fn)
+{
+	uint8_t frame[1 + LOADGEN_FR_LEN];
+	struct gsm_bts_trx *trx;
+	unsigned int n = 0;
+	unsigned int tn, ss, len;
+
+	/* one speech frame per 20 ms, at the end of each TCH/F block */
+	switch (fn % 26) {
+	case 3: case 7: case 11: case 16: case 20: case 24:
+		break;
+	default:
+		return;
+	}
+
+	llist_for_each_entry(trx, &bts->trx_list, list) {
+		for (tn = 0; tn < ARRAY_SIZE(trx->ts); tn++) {
+			for (ss = 0; ss < 2; ss++) {
+				struct gsm_lchan *lchan = &trx->ts[tn].lchan[ss];
+				uint8_t chan;
+
+				if (n >= lg->tch_lchans)
+					return;
+				if (lchan->state != LCHAN_S_ACTIVE)
+					continue;
+
+				memset(frame, 0, sizeof(frame));
+				switch (lchan->tch_mode) {
+				case GSM48_CMODE_SPEECH_V1:
+					if (lchan->type == GSM_LCHAN_TCH_F) {
+						frame[0] = GSMTAP_UM_VOICE_FR;
+						frame[1] = 0xd0;
+						len = LOADGEN_FR_LEN;
+					} else if (lchan->type == GSM_LCHAN_TCH_H) {
+						frame[0] = GSMTAP_UM_VOICE_HR;
+						len = LOADGEN_HR_LEN;
+					} else
+						continue;
+					break;
+				case GSM48_CMODE_SPEECH_EFR:
+					if (lchan->type != GSM_LCHAN_TCH_F)
+						continue;
+					frame[0] = GSMTAP_UM_VOICE_EFR;
+					frame[1] = 0xc0;
+					len = LOADGEN_EFR_LEN;
+					break;
+				default:
+					continue;
+				}
+				chan = lchan->type == GSM_LCHAN_TCH_F ?
+					GSMTAP_CHANNEL_VOICE_F : GSMTAP_CHANNEL_VOICE_H;
+
+				n++;
+				if (inject(lg, trx->arfcn, tn, chan,
+					   lchan->type == GSM_LCHAN_TCH_H ? ss : 0,
+					   fn, frame, 1 + len) == 0)
+					lg->stats.tch++;
+			}
+		}
+	}
+}
+
+static void pdtch_tick(struct vbts_loadgen *lg, struct gsm_bts *bts, uint32_t fn)
+{
+	/* CS-1 uplink control block: PACKET UPLINK DUMMY CONTROL BLOCK */
+	static const uint8_t block[GSM_MACBLOCK_LEN] = {
+		0x40, 0x20, 0x00, 0x00, 0x00,
+		0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b,
+		0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b, 0x2b,
+	};
+	struct gsm_bts_trx *trx;
+	unsigned int n = 0;
+	unsigned int tn;
+
+	/* last frame of each radio block of the 52-multiframe */
+	switch (fn % 13) {
+	case 3: case 7: case 11:
+		break;
+	default:
+		return;
+	}
+
+	llist_for_each_entry(trx, &bts->trx_list, list) {
+		for (tn = 0; tn < ARRAY_SIZE(trx->ts); tn++) {
+			if (n >= lg->pdtch_ts)
+				return;
+			if (ts_pchan(&trx->ts[tn]) != GSM_PCHAN_PDCH)
+				continue;
+			n++;
+			if (inject(lg, trx->arfcn, tn, GSMTAP_CHANNEL_PDTCH, 0, fn,
+				   block, sizeof(block)) == 0)
+				lg->stats.pdtch++;
+		}
+	}
+}
+
+/*! \brief Generate the synthetic uplink bursts of a frame
+ *  \param[in] lg Load generator of the PHY link of C0
+ *  \param[in] bts BTS the frame is scheduled for
+ *  \param[in] fn Frame number
+ */
+void vbts_loadgen_fn(struct vbts_loadgen *lg, struct gsm_bts *bts, uint32_t fn)
+{
+	if (!lg || !lg->plink->u.virt.virt_um)
+		return;
+
+	rach_tick(lg, bts, fn);
+	sdcch_tick(lg, fn);
+	if (lg->tch_lchans)
+		tch_tick(lg, bts, fn);
+	if (lg->pdtch_ts)
+		pdtch_tick(lg, bts, fn);
+}
+
+static void sdcch_start(struct vbts_loadgen *lg, const uint8_t *chan_desc)
+{
+	struct vbts_loadgen_sdcch *sess = NULL;
+	uint8_t cbits, ss, tn;
+	unsigned int i;
+
+	/* hopping channels are not supported */
+	if (chan_desc[1] & 0x10)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(lg->sdcch_sess); i++) {
+		if (!lg->sdcch_sess[i].req.in_use) {
+			sess = &lg->sdcch_sess[i];
+			break;
+		}
+	}
+	if (!sess) {
+		lg->stats.sdcch_busy++;
+		return;
+	}
+
+	rsl_dec_chan_nr(chan_desc[0], &cbits, &ss, &tn);
+	memset(sess, 0, sizeof(*sess));
+	sess->chan_nr = chan_desc[0];
+	sess->arfcn = ((chan_desc[1] & 0x03) << 8) | chan_desc[2];
+	sess->tn = tn;
+	sess->ss = ss;
+	sess->gsmtap_chan = chantype_rsl2gsmtap2(cbits, 0, false);
+	/* the SABM goes out with the next frame */
+	sess->req.in_use = true;
+}
+
+static void rx_imm_ass(struct vbts_loadgen *lg, uint32_t fn, const uint8_t *data,
+		       unsigned int len)
+{
+	const struct gsm48_imm_ass *ia = (const struct gsm48_imm_ass *) data;
+	uint8_t ref[3];
+	unsigned int i;
+
+	if (len < sizeof(*ia))
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(lg->rach); i++) {
+		struct vbts_loadgen_req *req = &lg->rach[i];
+
+		if (!req->in_use)
+			continue;
+		req_ref_enc(ref, i & 0x1f, req->fn);
+		if (memcmp(ref, &ia->req_ref, sizeof(ref)))
+			continue;
+
+		req_done(req, &lg->lat_imm_ass, fn);
+		/* no SDCCH exchange on a packet assignment */
+		if (lg->sdcch && !(ia->page_mode & 0x10))
+			sdcch_start(lg, (const uint8_t *) &ia->chan_desc);
+		return;
+	}
+}
+
+/*! \brief Look at a downlink burst for the responses to synthetic requests
+ *  \param[in] lg Load generator of the PHY link the burst is sent on
+ *  \param[in] trx Transceiver the burst is sent on
+ *  \param[in] tn Timeslot number
+ *  \param[in] ss Sub-slot
+ *  \param[in] gsmtap_chan GSMTAP channel type of the burst
+ *  \param[in] fn Frame number of the burst
+ *  \param[in] data L2 frame
+ *  \param[in] len Length of data
+ */
+void vbts_loadgen_dl(struct vbts_loadgen *lg, const struct gsm_bts_trx *trx,
+		     uint8_t tn, uint8_t ss, uint8_t gsmtap_chan, uint32_t fn,
+		     const uint8_t *data, unsigned int len)
+{
+	unsigned int i;
+
+	if (!lg || len < 3)
+		return;
+
+	switch (gsmtap_chan) {
+	case GSMTAP_CHANNEL_AGCH:
+	case GSMTAP_CHANNEL_PCH:
+		if ((data[1] & 0x0f) != GSM48_PDISC_RR)
+			return;
+		switch (data[2]) {
+		case GSM48_MT_RR_IMM_ASS:
+			rx_imm_ass(lg, fn, data, len);
+			break;
+		case GSM48_MT_RR_IMM_ASS_REJ:
+			lg->stats.imm_ass_rej++;
+			break;
+		}
+		return;
+	}
+
+	/* UA, with or without the final bit */
+	if ((data[1] & ~0x10) != 0x63)
+		return;
+
+	for (i = 0; i < ARRAY_SIZE(lg->sdcch_sess); i++) {
+		struct vbts_loadgen_sdcch *sess = &lg->sdcch_sess[i];
+
+		if (!sess->req.in_use || !sess->sabm_sent)
+			continue;
+		if (sess->arfcn != trx->arfcn || sess->tn != tn || sess->ss != ss ||
+		    sess->gsmtap_chan != gsmtap_chan)
+			continue;
+		req_done(&sess->req, &lg->lat_ua, fn);
+		return;
+	}
+}
+
+static void lat_vty_show(struct vty *vty, const char *name, const struct vbts_loadgen_lat *lat)
+{
+	if (!lat->count) {
+		vty_out(vty, "  %s: no samples, %u timeouts%s", name, lat->timeout, VTY_NEWLINE);
+		return;
+	}
+	vty_out(vty, "  %s: %u samples, %u timeouts%s", name, lat->count, lat->timeout,
+		VTY_NEWLINE);
+	vty_out(vty, "    min %u us, avg %" PRIu64 " us, max %u us%s", lat->min_us,
+		lat->sum_us / lat->count, lat->max_us, VTY_NEWLINE);
+	vty_out(vty, "    avg %" PRIu64 " frames, max %u frames%s",
+		lat->sum_fn / lat->count, lat->max_fn, VTY_NEWLINE);
+}
+
+void vbts_loadgen_vty_show(struct vty *vty, const struct vbts_loadgen *lg)
+{
+	vty_out(vty, "Load generator: %u RACH/s, SDCCH exchange %s, %u TCH lchans, "
+		"%u PDCH timeslots%s", lg->rach_rate, lg->sdcch ? "on" : "off",
+		lg->tch_lchans, lg->pdtch_ts, VTY_NEWLINE);
+	vty_out(vty, " Injected: %u RACH (%u skipped, all in flight), %u SABM "
+		"(%u skipped), %u speech frames, %u PDTCH blocks, %u failed%s",
+		lg->stats.rach, lg->stats.rach_busy, lg->stats.sabm,
+		lg->stats.sdcch_busy, lg->stats.tch, lg->stats.pdtch,
+		lg->stats.inject_err, VTY_NEWLINE);
+	vty_out(vty, " IMMEDIATE ASSIGNMENT REJECT seen: %u%s",
+		lg->stats.imm_ass_rej, VTY_NEWLINE);
+	vty_out(vty, " Latencies:%s", VTY_NEWLINE);
+	lat_vty_show(vty, "RACH -> IMM ASS", &lg->lat_imm_ass);
+	lat_vty_show(vty, "SABM -> UA", &lg->lat_ua);
+}
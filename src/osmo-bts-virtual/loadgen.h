@@ -0,0 +1,85 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include <osmocom/vty/vty.h>
+
+struct gsm_bts;
+struct gsm_bts_trx;
+struct phy_link;
+
+/* number of RACH / SDCCH exchanges in flight at once */
+#define VBTS_LOADGEN_RACH_MAX	32
+#define VBTS_LOADGEN_SDCCH_MAX	64
+/* frames after which an unanswered request is given up */
+#define VBTS_LOADGEN_TIMEOUT_FN	(2 * 217)
+
+/* latency of one kind of request/response, in frames and in time */
+struct vbts_loadgen_lat {
+	uint32_t count;
+	uint64_t sum_us;
+	uint32_t min_us;
+	uint32_t max_us;
+	uint64_t sum_fn;
+	uint32_t max_fn;
+	uint32_t timeout;
+};
+
+struct vbts_loadgen_req {
+	bool in_use;
+	uint32_t fn;
+	struct timespec ts;
+};
+
+/* synthetic SDCCH exchange: SABM (IMSI DETACH) towards the BTS, UA back */
+struct vbts_loadgen_sdcch {
+	struct vbts_loadgen_req req;
+	bool sabm_sent;
+	uint16_t arfcn;
+	uint8_t chan_nr;
+	uint8_t gsmtap_chan;
+	uint8_t tn;
+	uint8_t ss;
+};
+
+/* plink->u.virt.loadgen, synthetic uplink traffic injected right into the
+ * virtual Um receive path */
+struct vbts_loadgen {
+	struct phy_link *plink;
+
+	/* configuration */
+	unsigned int rach_rate;		/* RACH bursts per second */
+	bool sdcch;			/* SDCCH exchange on each IMM ASS */
+	unsigned int tch_lchans;	/* TCH lchans to send speech frames on */
+	unsigned int pdtch_ts;		/* PDCH timeslots to send blocks on */
+
+	/* state */
+	uint64_t rach_acc;
+	unsigned int rach_next;
+	struct vbts_loadgen_req rach[VBTS_LOADGEN_RACH_MAX];
+	struct vbts_loadgen_sdcch sdcch_sess[VBTS_LOADGEN_SDCCH_MAX];
+
+	/* statistics */
+	struct {
+		uint32_t rach;
+		uint32_t rach_busy;
+		uint32_t imm_ass_rej;
+		uint32_t sabm;
+		uint32_t sdcch_busy;
+		uint32_t tch;
+		uint32_t pdtch;
+		uint32_t inject_err;
+	} stats;
+	struct vbts_loadgen_lat lat_imm_ass;
+	struct vbts_loadgen_lat lat_ua;
+};
+
+struct vbts_loadgen *vbts_loadgen_alloc(struct phy_link *plink);
+void vbts_loadgen_fn(struct vbts_loadgen *lg, struct gsm_bts *bts, uint32_t fn);
+void vbts_loadgen_dl(struct vbts_loadgen *lg, const struct gsm_bts_trx *trx,
+		     uint8_t tn, uint8_t ss, uint8_t gsmtap_chan, uint32_t fn,
+		     const uint8_t *data, unsigned int len);
+void vbts_loadgen_reset_stats(struct vbts_loadgen *lg);
+void vbts_loadgen_vty_show(struct vty *vty, const struct vbts_loadgen *lg);
@@ -48,6 +48,7 @@
 #include <osmo-bts/phy_link.h>
 #include "virtual_um.h"
 #include "l1_if.h"
+#include "loadgen.h"
 
 /* dummy, since no direct dsp support */
 uint32_t trx_get_hlayer1(struct gsm_bts_trx *trx)
@@ -124,6 +125,8 @@ void bts_model_phy_link_set_defaults(struct phy_link *plink)
 	plink->u.virt.ms_mcast_group = talloc_strdup(plink, DEFAULT_MS_MCAST_GROUP);
 	plink->u.virt.ms_mcast_port = DEFAULT_MS_MCAST_PORT;
 	plink->u.virt.ttl = -1; /* initialize to -1 to prevent us setting the TTL */
+	plink->u.virt.clock_speed = 1;
+	plink->u.virt.loadgen = vbts_loadgen_alloc(plink);
 }
 
 void bts_model_phy_instance_set_defaults(struct phy_instance *pinst)
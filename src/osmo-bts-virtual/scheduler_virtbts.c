@@ -25,9 +25,13 @@
 #include <errno.h>
 #include <stdint.h>
 #include <ctype.h>
+#include <inttypes.h>
+#include <time.h>
 
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
+#include <osmocom/core/select.h>
+#include <osmocom/core/timer.h>
 #include <osmocom/core/bits.h>
 #include <osmocom/core/gsmtap_util.h>
 #include <osmocom/core/gsmtap.h>
@@ -44,9 +48,17 @@
 #include <osmo-bts/scheduler_backend.h>
 #include "virtual_um.h"
 #include "l1_if.h"
+#include "loadgen.h"
 
 #define MODULO_HYPERFRAME 0
 
+/* Did a write to the virtual Um fail because its socket is gone, rather
+ * than because a burst did not make it? */
+static bool virt_um_tx_died(int rc)
+{
+	return rc == -EPIPE || rc == -EBADF || rc == -ENOTSOCK;
+}
+
 /**
  * Send a message over the virtual um interface.
  * This will at first wrap the msg with a GSMTAP header and then write it to the declared multicast socket.
@@ -56,7 +68,7 @@ static void _tx_to_virt_um(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 			   enum trx_chan_type chan, struct msgb *msg, bool is_voice_frame)
 {
 	const struct trx_chan_desc *chdesc = &trx_chan_desc[chan];
-	struct msgb *outmsg;			/* msg to send with gsmtap header prepended */
+	struct phy_instance *pinst = trx_phy_instance(l1t->trx);
 	uint16_t arfcn = l1t->trx->arfcn;	/* ARFCN of the transceiver the message is send with */
 	uint8_t signal_dbm = 63;		/* signal strength, 63 is best */
 	uint8_t snr = 63;			/* signal noise ratio, 63 is best */
@@ -66,6 +78,7 @@ static void _tx_to_virt_um(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	uint8_t subslot;			/* multiframe subslot to send msg in (tch -> 0-26, bcch/ccch -> 0-51) */
 	uint8_t timeslot;			/* TDMA timeslot to send in (0-7) */
 	uint8_t gsmtap_chantype;		/* the GSMTAP channel */
+	int rc;
 
 	rsl_dec_chan_nr(chdesc->chan_nr, &rsl_chantype, &subslot, &timeslot);
 	/* the timeslot is not encoded in the chan_nr of the chdesc, and so has to be overwritten */
@@ -90,23 +103,22 @@ static void _tx_to_virt_um(struct l1sched_trx *l1t, uint8_t tn, uint32_t fn,
 	fn %= 26 * 51;
 #endif
 
-	outmsg = gsmtap_makemsg(arfcn, timeslot, gsmtap_chantype, subslot, fn, signal_dbm, snr, data, data_len);
-
-	if (outmsg) {
-		struct phy_instance *pinst = trx_phy_instance(l1t->trx);
-		int rc;
-
-		rc = virt_um_write_msg(pinst->phy_link->u.virt.virt_um, outmsg);
-		if (rc < 0)
-			LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn,
-			       "GSMTAP msg could not send to virtual Um: %s\n", strerror(-rc));
-		else if (rc == 0)
-			bts_shutdown(l1t->trx->bts, "VirtPHY write socket died\n");
-		else
-			LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn,
-			       "Sending GSMTAP message to virtual Um\n");
-	} else
-		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn, "GSMTAP msg could not be created!\n");
+	vbts_loadgen_dl(pinst->phy_link->u.virt.loadgen, l1t->trx, timeslot, subslot,
+			gsmtap_chantype, fn, data, data_len);
+
+	/* queue the GSMTAP message, the ones of this frame are written to the
+	 * virtual Um at once by vbts_sched_fn() */
+	rc = virt_um_queue_gsmtap(pinst->phy_link->u.virt.virt_um, arfcn, timeslot,
+				  gsmtap_chantype, subslot, fn, signal_dbm, snr,
+				  data, data_len);
+	if (virt_um_tx_died(rc))
+		bts_shutdown(l1t->trx->bts, "VirtPHY write socket died\n");
+	else if (rc < 0)
+		LOGL1S(DL1P, LOGL_ERROR, l1t, tn, chan, fn,
+		       "GSMTAP msg could not send to virtual Um: %s\n", strerror(-rc));
+	else
+		LOGL1S(DL1P, LOGL_DEBUG, l1t, tn, chan, fn,
+		       "Sending GSMTAP message to virtual Um\n");
 
 	/* free incoming message */
 	msgb_free(msg);
@@ -233,7 +245,7 @@ int tx_pdtch_fn(struct l1sched_trx *l1t, enum trx_chan_type chan,
 		return 0;
 
 	/* get mac block from queue */
-	msg = _sched_dequeue_prim(l1t, br->tn, br->fn, chan);
+	msg = _sched_dequeue_pdtch(l1t, br->tn, br->fn, chan);
 	if (!msg) {
 		LOGL1S(DL1P, LOGL_INFO, l1t, br->tn, chan, br->fn, "has not been served !! No prim\n");
 		return -ENODEV;
@@ -545,6 +557,9 @@ static int vbts_sched_fn(struct gsm_bts *bts, uint32_t fn)
 	/* saving GSM time in BTS model, and more */
 	l1if_mph_time_ind(bts, fn);
 
+	/* synthetic uplink traffic, if configured */
+	vbts_loadgen_fn(trx_phy_instance(bts->c0)->phy_link->u.virt.loadgen, bts, fn);
+
 	/* advance the frame number? */
 	llist_for_each_entry(trx, &bts->trx_list, list) {
 		struct phy_instance *pinst = trx_phy_instance(trx);
@@ -570,9 +585,50 @@ static int vbts_sched_fn(struct gsm_bts *bts, uint32_t fn)
 		}
 	}
 
+	/* write the bursts of this frame to the virtual Um */
+	llist_for_each_entry(trx, &bts->trx_list, list) {
+		struct phy_instance *pinst = trx_phy_instance(trx);
+		struct virt_um_inst *vui = pinst->phy_link->u.virt.virt_um;
+		int rc;
+
+		if (!vui)
+			continue;
+		rc = virt_um_flush(vui);
+		if (virt_um_tx_died(rc))
+			bts_shutdown(bts, "VirtPHY write socket died\n");
+		else if (rc < 0)
+			LOGPFN(DL1P, LOGL_ERROR, fn, "GSMTAP msgs could not be sent to "
+			       "virtual Um: %s\n", strerror(-rc));
+	}
+
 	return 0;
 }
 
+/* Advance the virtual clock by one TDMA frame. The libosmocore timers, and
+ * with them everything timed by osmo_timer_list or osmo_gettimeofday(),
+ * follow it. */
+static void vbts_clock_advance(void)
+{
+	const struct timeval tv_frame = {
+		.tv_sec = 0,
+		.tv_usec = GSM_TDMA_FN_DURATION_uS,
+	};
+
+	timeradd(&osmo_gettimeofday_override_time, &tv_frame,
+		 &osmo_gettimeofday_override_time);
+	osmo_clock_override_add(CLOCK_MONOTONIC, 0, GSM_TDMA_FN_DURATION_nS);
+}
+
+static void vbts_clock_start(void)
+{
+	struct timespec *ts = osmo_clock_override_gettimespec(CLOCK_MONOTONIC);
+
+	gettimeofday(&osmo_gettimeofday_override_time, NULL);
+	osmo_gettimeofday_override = true;
+	clock_gettime(CLOCK_MONOTONIC, ts);
+	osmo_clock_override_enable(CLOCK_MONOTONIC, true);
+}
+
 static void vbts_fn_timer_cb(void *data)
 {
 	struct gsm_bts *bts = data;
@@ -581,6 +637,16 @@ static void vbts_fn_timer_cb(void *data)
 	struct timeval *tv_clock = &bts_virt->tv_clock;
 	int32_t elapsed_us;
 
+	/* as fast as possible: one frame per main loop iteration, so that
+	 * everything the virtual Um peers sent in between is received before
+	 * the next one */
+	if (bts_virt->clock_speed == 0) {
+		vbts_clock_advance();
+		vbts_sched_fn(bts, GSM_TDMA_FN_INC(bts_virt->last_fn));
+		osmo_timer_schedule(&bts_virt->fn_timer, 0, 0);
+		return;
+	}
+
 	gettimeofday(&tv_now, NULL);
 
 	/* check how much time elapsed till the last timer callback call.
@@ -612,18 +678,75 @@ static void vbts_fn_timer_cb(void *data)
 	osmo_timer_schedule(&bts_virt->fn_timer, 0, GSM_TDMA_FN_DURATION_uS - elapsed_us);
 }
 
-int vbts_sched_start(struct gsm_bts *bts)
+/* N times faster than real time: frames are clocked by a timerfd, which
+ * unlike the libosmocore timers isn't subject to the virtual clock */
+static int vbts_fn_timerfd_cb(struct osmo_fd *ofd, unsigned int what)
 {
+	struct gsm_bts *bts = ofd->data;
 	struct bts_virt_priv *bts_virt = (struct bts_virt_priv *)bts->model_priv;
+	uint64_t expire_count;
+	int rc;
+
+	rc = read(ofd->fd, &expire_count, sizeof(expire_count));
+	if (rc < 0) {
+		/* the expirations are still counted, pick them up next time */
+		if (errno == EAGAIN || errno == EINTR)
+			return 0;
+		rc = -errno;
+		LOGP(DL1P, LOGL_ERROR, "Cannot read from the frame clock timerfd: %s\n",
+		     strerror(-rc));
+		return rc;
+	}
+	OSMO_ASSERT(rc == sizeof(expire_count));
+
+	if (expire_count > 2)
+		LOGP(DL1P, LOGL_NOTICE, "virtual clock %" PRIu64 " frames behind\n",
+		     expire_count - 1);
+
+	while (expire_count--) {
+		vbts_clock_advance();
+		vbts_sched_fn(bts, GSM_TDMA_FN_INC(bts_virt->last_fn));
+	}
+
+	return 0;
+}
+
+int vbts_sched_start(struct gsm_bts *bts, unsigned int clock_speed)
+{
+	struct bts_virt_priv *bts_virt = (struct bts_virt_priv *)bts->model_priv;
+	struct timespec interval;
+	int rc;
+
 	LOGP(DL1P, LOGL_NOTICE, "starting VBTS scheduler\n");
 
 	memset(&bts_virt->fn_timer, 0, sizeof(bts_virt->fn_timer));
 	bts_virt->fn_timer.cb = vbts_fn_timer_cb;
 	bts_virt->fn_timer.data = bts;
+	bts_virt->clock_speed = clock_speed;
 
-	gettimeofday(&bts_virt->tv_clock, NULL);
-	/* trigger the first timer after 4615us (a frame duration) */
-	osmo_timer_schedule(&bts_virt->fn_timer, 0, GSM_TDMA_FN_DURATION_uS);
+	if (clock_speed == 1) {
+		gettimeofday(&bts_virt->tv_clock, NULL);
+		/* trigger the first timer after 4615us (a frame duration) */
+		osmo_timer_schedule(&bts_virt->fn_timer, 0, GSM_TDMA_FN_DURATION_uS);
+		return 0;
+	}
 
-	return 0;
+	vbts_clock_start();
+
+	if (clock_speed == 0) {
+		LOGP(DL1P, LOGL_NOTICE, "virtual clock running as fast as possible\n");
+		osmo_timer_schedule(&bts_virt->fn_timer, 0, 0);
+		return 0;
+	}
+
+	LOGP(DL1P, LOGL_NOTICE, "virtual clock running at %u times real time\n",
+	     clock_speed);
+	interval.tv_sec = 0;
+	interval.tv_nsec = GSM_TDMA_FN_DURATION_nS / clock_speed;
+	rc = osmo_timerfd_setup(&bts_virt->fn_timerfd, vbts_fn_timerfd_cb, bts);
+	if (rc < 0) {
+		LOGP(DL1P, LOGL_ERROR, "failed to set up the frame timerfd\n");
+		return rc;
+	}
+	return osmo_timerfd_schedule(&bts_virt->fn_timerfd, &interval, &interval);
 }
@@ -19,59 +19,128 @@
  *
  */
 
+#define _GNU_SOURCE
 #include <osmocom/core/select.h>
 #include <osmocom/core/utils.h>
 #include <osmocom/core/socket.h>
 #include <osmocom/core/gsmtap.h>
 #include <osmocom/core/msgb.h>
 #include <osmocom/core/talloc.h>
+#include <osmo-bts/l1_rx_pool.h>
 #include "osmo_mcast_sock.h"
 #include "virtual_um.h"
 
 #include <unistd.h>
 #include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+
+/* Downlink bursts, GSMTAP header included, to be written by one sendmmsg() */
+struct virt_um_tx_batch {
+	uint8_t buf[VIRT_UM_TX_BATCH][VIRT_UM_MSGB_SIZE];
+	struct iovec iov[VIRT_UM_TX_BATCH];
+	struct mmsghdr mmsg[VIRT_UM_TX_BATCH];
+	unsigned int count;
+};
 
 /**
  * Virtual UM interface file descriptor callback.
  * Should be called by select.c when the fd is ready for reading.
+ * Reads up to VIRT_UM_RX_BATCH datagrams per wakeup.
  */
 static int virt_um_fd_cb(struct osmo_fd *ofd, unsigned int what)
 {
 	struct virt_um_inst *vui = ofd->data;
+	struct mmsghdr mmsg[VIRT_UM_RX_BATCH];
+	struct iovec iov[VIRT_UM_RX_BATCH];
+	struct msgb *msg[VIRT_UM_RX_BATCH];
+	unsigned int i, n;
+	int rc;
 
-	if (what & OSMO_FD_READ) {
-		struct msgb *msg = msgb_alloc(VIRT_UM_MSGB_SIZE, "Virtual UM Rx");
-		int rc;
-
-		/* read message from fd into message buffer */
-		rc = mcast_bidir_sock_rx(vui->mcast_sock, msgb_data(msg), msgb_tailroom(msg));
-		if (rc > 0) {
-			msgb_put(msg, rc);
-			msg->l1h = msgb_data(msg);
-			/* call the l1 callback function for a received msg */
-			vui->recv_cb(vui, msg);
-		} else if (rc == 0) {
-			vui->recv_cb(vui, NULL);
-			osmo_fd_close(ofd);
-		} else
+	if (!(what & OSMO_FD_READ))
+		return 0;
+
+	memset(mmsg, 0, sizeof(mmsg));
+	for (n = 0; n < VIRT_UM_RX_BATCH; n++) {
+		msg[n] = l1_rx_pool_get(vui->rx_pool);
+		if (!msg[n])
+			break;
+		iov[n].iov_base = msgb_data(msg[n]);
+		iov[n].iov_len = msgb_tailroom(msg[n]);
+		mmsg[n].msg_hdr.msg_iov = &iov[n];
+		mmsg[n].msg_hdr.msg_iovlen = 1;
+	}
+	if (n == 0) {
+		l1_rx_pool_backoff(vui->rx_pool, ofd);
+		return 0;
+	}
+
+	/* read messages from fd into message buffers */
+	rc = recvmmsg(ofd->fd, mmsg, n, MSG_DONTWAIT, NULL);
+	if (rc < 0) {
+		if (errno != EAGAIN)
 			perror("Read from multicast socket");
+		rc = 0;
+	}
+	l1_rx_pool_account(vui->rx_pool, rc, n);
+
+	/* return the buffers recvmmsg() did not fill */
+	for (i = n; i > rc; i--)
+		msgb_free(msg[i - 1]);
 
+	for (i = 0; i < rc; i++) {
+		if (mmsg[i].msg_len == 0) {
+			/* the socket died, drop what's left of the batch */
+			for (; i < rc; i++)
+				msgb_free(msg[i]);
+			vui->recv_cb(vui, NULL);
+			osmo_fd_close(ofd);
+			break;
+		}
+		msgb_put(msg[i], mmsg[i].msg_len);
+		msg[i]->l1h = msgb_data(msg[i]);
+		/* call the l1 callback function for a received msg */
+		vui->recv_cb(vui, msg[i]);
 	}
 
 	return 0;
 }
 
-struct virt_um_inst *virt_um_init(void *ctx, char *tx_mcast_group, uint16_t tx_mcast_port,
+struct virt_um_inst *virt_um_init(void *ctx, unsigned int ctr_idx,
+				  char *tx_mcast_group, uint16_t tx_mcast_port,
 				  char *rx_mcast_group, uint16_t rx_mcast_port, int ttl, const char *dev_name,
 				  void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg))
 {
 	struct virt_um_inst *vui = talloc_zero(ctx, struct virt_um_inst);
+	unsigned int i;
 	int rc;
 
+	/* the pool may outlive vui, as long as received messages are held */
+	vui->rx_pool = l1_rx_pool_alloc(ctx, VIRT_UM_MSGB_SIZE, 0,
+					2 * VIRT_UM_RX_BATCH, ctr_idx);
+	if (!vui->rx_pool) {
+		talloc_free(vui);
+		return NULL;
+	}
+
+	vui->tx = talloc_zero(vui, struct virt_um_tx_batch);
+	if (!vui->tx) {
+		l1_rx_pool_release(vui->rx_pool);
+		talloc_free(vui);
+		return NULL;
+	}
+	for (i = 0; i < VIRT_UM_TX_BATCH; i++) {
+		vui->tx->mmsg[i].msg_hdr.msg_iov = &vui->tx->iov[i];
+		vui->tx->mmsg[i].msg_hdr.msg_iovlen = 1;
+		vui->tx->iov[i].iov_base = vui->tx->buf[i];
+	}
+
 	vui->mcast_sock = mcast_bidir_sock_setup(ctx, tx_mcast_group, tx_mcast_port,
 						 rx_mcast_group, rx_mcast_port, 1, virt_um_fd_cb, vui);
 	if (!vui->mcast_sock) {
 		perror("Unable to create VirtualUm multicast socket");
+		l1_rx_pool_release(vui->rx_pool);
 		talloc_free(vui);
 		return NULL;
 	}
@@ -103,28 +172,126 @@ struct virt_um_inst *virt_um_init(void *ctx, char *tx_mcast_group, uint16_t tx_m
 
 out_close:
 	mcast_bidir_sock_close(vui->mcast_sock);
+	l1_rx_pool_release(vui->rx_pool);
 	talloc_free(vui);
 	return NULL;
 }
 
 void virt_um_destroy(struct virt_um_inst *vui)
 {
+	virt_um_flush(vui);
 	mcast_bidir_sock_close(vui->mcast_sock);
+	l1_rx_pool_release(vui->rx_pool);
 	talloc_free(vui);
 }
 
+static void gsmtap_hdr_fill(struct gsmtap_hdr *gh, uint16_t arfcn, uint8_t ts,
+			    uint8_t chan_type, uint8_t ss, uint32_t fn,
+			    int8_t signal_dbm, uint8_t snr)
+{
+	gh->version = GSMTAP_VERSION;
+	gh->hdr_len = sizeof(*gh) / 4;
+	gh->type = GSMTAP_TYPE_UM;
+	gh->timeslot = ts;
+	gh->sub_slot = ss;
+	gh->arfcn = htons(arfcn);
+	gh->snr_db = snr;
+	gh->signal_dbm = signal_dbm;
+	gh->frame_number = htonl(fn);
+	gh->sub_type = chan_type;
+	gh->antenna_nr = 0;
+	gh->res = 0;
+}
+
 /**
- * Write msg to to multicast socket and free msg afterwards
+ * Queue a GSMTAP wrapped burst for transmission. It is written to the
+ * multicast socket along with the others of the same frame by
+ * virt_um_flush(), or right away when the batch is full.
  */
-int virt_um_write_msg(struct virt_um_inst *vui, struct msgb *msg)
+int virt_um_queue_gsmtap(struct virt_um_inst *vui, uint16_t arfcn, uint8_t ts,
+			 uint8_t chan_type, uint8_t ss, uint32_t fn,
+			 int8_t signal_dbm, uint8_t snr, const uint8_t *data,
+			 unsigned int len)
 {
+	struct virt_um_tx_batch *tx = vui->tx;
+	struct gsmtap_hdr *gh;
 	int rc;
 
-	rc = mcast_bidir_sock_tx(vui->mcast_sock, msgb_data(msg),
-	                msgb_length(msg));
-	if (rc < 0)
-		rc = -errno;
-	msgb_free(msg);
+	if (sizeof(*gh) + len > VIRT_UM_MSGB_SIZE)
+		return -EMSGSIZE;
 
-	return rc;
+	if (tx->count == VIRT_UM_TX_BATCH) {
+		rc = virt_um_flush(vui);
+		if (rc < 0)
+			return rc;
+	}
+
+	gh = (struct gsmtap_hdr *) tx->buf[tx->count];
+	gsmtap_hdr_fill(gh, arfcn, ts, chan_type, ss, fn, signal_dbm, snr);
+	memcpy(gh + 1, data, len);
+
+	tx->iov[tx->count].iov_len = sizeof(*gh) + len;
+	tx->count++;
+
+	return 0;
+}
+
+/**
+ * Write all queued bursts to the multicast socket with as few system
+ * calls as possible. Bursts the socket doesn't take are dropped.
+ * \returns number of bursts written, negative on error; -EPIPE if the
+ * socket took nothing at all, i.e. it died
+ */
+int virt_um_flush(struct virt_um_inst *vui)
+{
+	struct virt_um_tx_batch *tx = vui->tx;
+	unsigned int sent = 0;
+	int rc = 0;
+
+	while (sent < tx->count) {
+		rc = sendmmsg(vui->mcast_sock->tx_ofd.fd, &tx->mmsg[sent],
+			      tx->count - sent, 0);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			rc = -errno;
+			break;
+		}
+		if (rc == 0) {
+			rc = -EPIPE;
+			break;
+		}
+		sent += rc;
+	}
+
+	tx->count = 0;
+	return rc < 0 ? rc : sent;
+}
+
+/**
+ * Hand a GSMTAP wrapped burst to the receive call-back as if it had been
+ * received from the virtual Um, used to generate synthetic uplink load.
+ */
+int virt_um_inject_gsmtap(struct virt_um_inst *vui, uint16_t arfcn, uint8_t ts,
+			  uint8_t chan_type, uint8_t ss, uint32_t fn,
+			  int8_t signal_dbm, uint8_t snr, const uint8_t *data,
+			  unsigned int len)
+{
+	struct gsmtap_hdr *gh;
+	struct msgb *msg;
+
+	if (sizeof(*gh) + len > VIRT_UM_MSGB_SIZE)
+		return -EMSGSIZE;
+
+	msg = l1_rx_pool_get(vui->rx_pool);
+	if (!msg)
+		return -ENOMEM;
+
+	gh = (struct gsmtap_hdr *) msgb_put(msg, sizeof(*gh));
+	gsmtap_hdr_fill(gh, arfcn, ts, chan_type, ss, fn, signal_dbm, snr);
+	memcpy(msgb_put(msg, len), data, len);
+	msg->l1h = msgb_data(msg);
+
+	vui->recv_cb(vui, msg);
+	return 0;
 }
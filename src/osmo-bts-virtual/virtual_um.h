@@ -10,22 +10,41 @@
  *  ranges when defining scopes for private use." */
 
 #define VIRT_UM_MSGB_SIZE	256
+/* datagrams read per wakeup of the uplink socket */
+#define VIRT_UM_RX_BATCH	32
+/* bursts written per sendmmsg(), one frame of 8 TRX fits */
+#define VIRT_UM_TX_BATCH	64
 #define DEFAULT_MS_MCAST_GROUP	"239.193.23.1"
 #define DEFAULT_MS_MCAST_PORT 4729 /* IANA-registered port for GSMTAP */
 #define DEFAULT_BTS_MCAST_GROUP	"239.193.23.2"
 #define DEFAULT_BTS_MCAST_PORT 4729 /* IANA-registered port for GSMTAP */
 
+struct l1_rx_pool;
+struct virt_um_tx_batch;
+
 struct virt_um_inst {
 	void *priv;
 	struct mcast_bidir_sock *mcast_sock;
 	void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg);
+	/* recycled uplink receive buffers */
+	struct l1_rx_pool *rx_pool;
+	/* downlink bursts queued for the next virt_um_flush() */
+	struct virt_um_tx_batch *tx;
 };
 
 struct virt_um_inst *virt_um_init(
-                void *ctx, char *tx_mcast_group, uint16_t tx_mcast_port,
+                void *ctx, unsigned int ctr_idx, char *tx_mcast_group, uint16_t tx_mcast_port,
                 char *rx_mcast_group, uint16_t rx_mcast_port, int ttl, const char *dev_name,
                 void (*recv_cb)(struct virt_um_inst *vui, struct msgb *msg));
 
 void virt_um_destroy(struct virt_um_inst *vui);
 
-int virt_um_write_msg(struct virt_um_inst *vui, struct msgb *msg);
+int virt_um_queue_gsmtap(struct virt_um_inst *vui, uint16_t arfcn, uint8_t ts,
+			 uint8_t chan_type, uint8_t ss, uint32_t fn,
+			 int8_t signal_dbm, uint8_t snr, const uint8_t *data,
+			 unsigned int len);
+int virt_um_flush(struct virt_um_inst *vui);
+int virt_um_inject_gsmtap(struct virt_um_inst *vui, uint16_t arfcn, uint8_t ts,
+			  uint8_t chan_type, uint8_t ss, uint32_t fn,
+			  int8_t signal_dbm, uint8_t snr, const uint8_t *data,
+			  unsigned int len);
@@ -43,6 +43,7 @@
 #include <osmo-bts/logging.h>
 #include <osmo-bts/vty.h>
 #include "virtual_um.h"
+#include "loadgen.h"
 
 #define TRX_STR "Transceiver related commands\n" "TRX number\n"
 
@@ -84,6 +85,26 @@ void bts_model_config_write_phy(struct vty *vty, struct phy_link *plink)
 	if (plink->u.virt.bts_mcast_port != DEFAULT_MS_MCAST_PORT)
 		vty_out(vty, " virtual-um bts-udp-port %u%s",
 			plink->u.virt.bts_mcast_port, VTY_NEWLINE);
+	if (plink->u.virt.clock_speed == 0)
+		vty_out(vty, " virtual-clock speed max%s", VTY_NEWLINE);
+	else if (plink->u.virt.clock_speed != 1)
+		vty_out(vty, " virtual-clock speed %u%s",
+			plink->u.virt.clock_speed, VTY_NEWLINE);
+	if (plink->u.virt.loadgen) {
+		const struct vbts_loadgen *lg = plink->u.virt.loadgen;
+
+		if (lg->rach_rate)
+			vty_out(vty, " virtual-loadgen rach-rate %u%s",
+				lg->rach_rate, VTY_NEWLINE);
+		if (lg->sdcch)
+			vty_out(vty, " virtual-loadgen sdcch-exchange%s", VTY_NEWLINE);
+		if (lg->tch_lchans)
+			vty_out(vty, " virtual-loadgen tch-lchans %u%s",
+				lg->tch_lchans, VTY_NEWLINE);
+		if (lg->pdtch_ts)
+			vty_out(vty, " virtual-loadgen pdch-timeslots %u%s",
+				lg->pdtch_ts, VTY_NEWLINE);
+	}
 
 }
 
@@ -191,6 +212,147 @@ DEFUN(cfg_phy_mcast_ttl, cfg_phy_mcast_ttl_cmd,
 	return CMD_SUCCESS;
 }
 
+DEFUN(cfg_phy_clock_speed, cfg_phy_clock_speed_cmd,
+	"virtual-clock speed (<1-10000>|max)",
+	"Virtual clock driving the TDMA frames and all timers\n"
+	"Configure the speed of the virtual clock\n"
+	"Multiple of real time, 1 for real time\n"
+	"As fast as possible, one frame per main loop iteration\n")
+{
+	struct phy_link *plink = vty->index;
+
+	if (plink->state != PHY_LINK_SHUTDOWN) {
+		vty_out(vty, "Can only reconfigure a PHY link that is down%s",
+			VTY_NEWLINE);
+		return CMD_WARNING;
+	}
+
+	if (!strcmp(argv[0], "max"))
+		plink->u.virt.clock_speed = 0;
+	else
+		plink->u.virt.clock_speed = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+#define LOADGEN_STR "Synthetic uplink load generator\n"
+
+static struct vbts_loadgen *vty_loadgen(struct vty *vty)
+{
+	struct phy_link *plink = vty->index;
+
+	if (!plink->u.virt.loadgen)
+		vty_out(vty, "Load generator not available%s", VTY_NEWLINE);
+	return plink->u.virt.loadgen;
+}
+
+DEFUN(cfg_phy_loadgen_rach, cfg_phy_loadgen_rach_cmd,
+	"virtual-loadgen rach-rate <0-1000>",
+	LOADGEN_STR "Configure the rate of RACH bursts\n"
+	"RACH bursts per second, 0 for none\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen(vty);
+
+	if (!lg)
+		return CMD_WARNING;
+	lg->rach_rate = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_loadgen_sdcch, cfg_phy_loadgen_sdcch_cmd,
+	"virtual-loadgen sdcch-exchange",
+	LOADGEN_STR "Send a SABM with an IMSI DETACH on each SDCCH assigned to a RACH burst\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen(vty);
+
+	if (!lg)
+		return CMD_WARNING;
+	lg->sdcch = true;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_no_loadgen_sdcch, cfg_phy_no_loadgen_sdcch_cmd,
+	"no virtual-loadgen sdcch-exchange",
+	NO_STR LOADGEN_STR "Send a SABM with an IMSI DETACH on each SDCCH assigned to a RACH burst\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen(vty);
+
+	if (!lg)
+		return CMD_WARNING;
+	lg->sdcch = false;
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_loadgen_tch, cfg_phy_loadgen_tch_cmd,
+	"virtual-loadgen tch-lchans <0-256>",
+	LOADGEN_STR "Send speech frames on active TCH lchans\n"
+	"Maximum number of lchans, 0 for none\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen(vty);
+
+	if (!lg)
+		return CMD_WARNING;
+	lg->tch_lchans = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(cfg_phy_loadgen_pdtch, cfg_phy_loadgen_pdtch_cmd,
+	"virtual-loadgen pdch-timeslots <0-64>",
+	LOADGEN_STR "Send uplink blocks on PDCH timeslots\n"
+	"Maximum number of timeslots, 0 for none\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen(vty);
+
+	if (!lg)
+		return CMD_WARNING;
+	lg->pdtch_ts = atoi(argv[0]);
+
+	return CMD_SUCCESS;
+}
+
+static struct vbts_loadgen *vty_loadgen_by_num(struct vty *vty, const char *num)
+{
+	struct phy_link *plink = phy_link_by_num(atoi(num));
+
+	if (!plink || !plink->u.virt.loadgen) {
+		vty_out(vty, "Cannot find PHY number %s%s", num, VTY_NEWLINE);
+		return NULL;
+	}
+	return plink->u.virt.loadgen;
+}
+
+DEFUN(show_loadgen, show_loadgen_cmd,
+	"show phy <0-255> loadgen",
+	SHOW_STR "Display information about a PHY link\n" "PHY link number\n"
+	"Display the state and the latencies of the load generator\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen_by_num(vty, argv[0]);
+
+	if (!lg)
+		return CMD_WARNING;
+	vbts_loadgen_vty_show(vty, lg);
+
+	return CMD_SUCCESS;
+}
+
+DEFUN(reset_loadgen, reset_loadgen_cmd,
+	"phy <0-255> loadgen reset-stats",
+	"PHY link related commands\n" "PHY link number\n"
+	LOADGEN_STR "Reset the statistics and latencies of the load generator\n")
+{
+	struct vbts_loadgen *lg = vty_loadgen_by_num(vty, argv[0]);
+
+	if (!lg)
+		return CMD_WARNING;
+	vbts_loadgen_reset_stats(lg);
+
+	return CMD_SUCCESS;
+}
+
 int bts_model_vty_init(struct gsm_bts *bts)
 {
 	vty_bts = bts;
@@ -201,6 +363,15 @@ int bts_model_vty_init(struct gsm_bts *bts)
 	install_element(PHY_NODE, &cfg_phy_bts_mcast_port_cmd);
 	install_element(PHY_NODE, &cfg_phy_mcast_dev_cmd);
 	install_element(PHY_NODE, &cfg_phy_mcast_ttl_cmd);
+	install_element(PHY_NODE, &cfg_phy_clock_speed_cmd);
+	install_element(PHY_NODE, &cfg_phy_loadgen_rach_cmd);
+	install_element(PHY_NODE, &cfg_phy_loadgen_sdcch_cmd);
+	install_element(PHY_NODE, &cfg_phy_no_loadgen_sdcch_cmd);
+	install_element(PHY_NODE, &cfg_phy_loadgen_tch_cmd);
+	install_element(PHY_NODE, &cfg_phy_loadgen_pdtch_cmd);
+
+	install_element_ve(&show_loadgen_cmd);
+	install_element(ENABLE_NODE, &reset_loadgen_cmd);
 
 	return 0;
 }
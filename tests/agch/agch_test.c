@@ -21,13 +21,18 @@
  */
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/application.h>
+#include <osmocom/core/signal.h>
+#include <osmocom/core/timer.h>
 
 #include <osmo-bts/bts.h>
 #include <osmo-bts/logging.h>
 #include <osmo-bts/gsm_data.h>
+#include <osmo-bts/paging.h>
+#include <osmo-bts/signal.h>
 
 #include <inttypes.h>
 #include <unistd.h>
+#include <sys/time.h>
 
 static struct gsm_bts *bts;
 
@@ -122,6 +127,11 @@ static void test_agch_queue(void)
 	bts->agch_queue.high_level = 30;
 	bts->agch_queue.thresh_level = 60;
 
+	/* The request references are spread over all of T1, which makes them
+	 * up to ~3 minutes apart.  This test is not about expiry, keep them all
+	 * (half of the 26 * 51 * 32 frame modulus is the oldest possible age). */
+	bts->agch_queue.max_age = 26 * 51 * 32;
+
 	for (round = 1; round <= num_rounds; round++) {
 		for (idx = 0; idx < num_ima_per_round; idx++) {
 			msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
@@ -188,6 +198,207 @@ static void test_agch_queue(void)
 	       bts->agch_queue.pch_msgs);
 }
 
+static void test_agch_queue_expiry(void)
+{
+	struct msgb *msg;
+	uint64_t dropped = bts->agch_queue.dropped_msgs;
+	int delivered;
+
+	printf("Testing AGCH message expiry.\n");
+
+	/* all test messages refer to a RACH in frame 0 (T1 = 0) */
+	bts->agch_queue.max_age = GSM_BTS_AGCH_MAX_AGE_DEFAULT;
+	bts->gsm_time.fn = bts->agch_queue.max_age;
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, 0);
+	bts_agch_enqueue(bts, msg);
+	msg = bts_agch_dequeue(bts);
+	delivered = msg ? 1 : 0;
+	if (msg)
+		msgb_free(msg);
+	printf("age %d: delivered %d, dropped %"PRIu64"\n", bts->agch_queue.max_age,
+	       delivered, bts->agch_queue.dropped_msgs - dropped);
+
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, 0);
+	bts_agch_enqueue(bts, msg);
+	bts->gsm_time.fn = bts->agch_queue.max_age + 1;
+	msg = bts_agch_dequeue(bts);
+	delivered = msg ? 1 : 0;
+	if (msg)
+		msgb_free(msg);
+	printf("age %d: delivered %d, dropped %"PRIu64"\n", bts->agch_queue.max_age + 1,
+	       delivered, bts->agch_queue.dropped_msgs - dropped);
+
+	printf("deleted: expired %"PRIu64", congestion %"PRIu64", full %"PRIu64"\n",
+	       bts->ctrs->ctr[BTS_CTR_AGCH_DEL_EXPIRED].current,
+	       bts->ctrs->ctr[BTS_CTR_AGCH_DEL_CONGESTION].current,
+	       bts->ctrs->ctr[BTS_CTR_AGCH_DEL_FULL].current);
+
+	bts->gsm_time.fn = 0;
+}
+
+/* an IMM ASS REJ with four different request references, which is full and
+ * can not be merged with anything */
+static void put_full_imm_ass_rej(struct msgb *msg)
+{
+	struct gsm48_imm_ass_rej *rej;
+
+	put_imm_ass_rej(msg, 0, 10);
+	rej = (struct gsm48_imm_ass_rej *)msg->l3h;
+	rej->req_ref1.ra = 1;
+	rej->req_ref2.ra = 2;
+	rej->req_ref3.ra = 3;
+	rej->req_ref4.ra = 4;
+}
+
+static void test_agch_queue_priority(void)
+{
+	struct gsm48_imm_ass *ima;
+	struct msgb *msg;
+	uint64_t dropped = bts->agch_queue.dropped_msgs;
+	uint64_t rejected = bts->agch_queue.rejected_msgs;
+	int i, rc;
+	int imm_ass_count = 0, imm_ass_rej_count = 0, interleaved = 0;
+
+	printf("Testing AGCH priority classes.\n");
+
+	/* only the hard limit of 100 messages applies */
+	bts->agch_queue.thresh_level = GSM_BTS_AGCH_QUEUE_THRESH_LEVEL_DISABLE;
+
+	for (i = 0; i < 100; i++) {
+		msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+		if (i < 50)
+			put_full_imm_ass_rej(msg);
+		else
+			put_imm_ass(msg, 0);
+		bts_agch_enqueue(bts, msg);
+	}
+
+	/* an assignment replaces the oldest reject */
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, 0);
+	rc = bts_agch_enqueue(bts, msg);
+	printf("IMM ASS at hard limit: %s, occupied %d, dropped %"PRIu64"\n",
+	       rc < 0 ? "refused" : "queued", bts->agch_queue.length,
+	       bts->agch_queue.dropped_msgs - dropped);
+
+	/* a reject is refused */
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_full_imm_ass_rej(msg);
+	rc = bts_agch_enqueue(bts, msg);
+	if (rc < 0)
+		msgb_free(msg);
+	printf("IMM ASS REJ at hard limit: %s, occupied %d, rejected %"PRIu64"\n",
+	       rc < 0 ? "refused" : "queued", bts->agch_queue.length,
+	       bts->agch_queue.rejected_msgs - rejected);
+
+	/* all assignments go out before any reject */
+	while ((msg = bts_agch_dequeue(bts))) {
+		ima = msgb_l3(msg);
+		if (ima->msg_type == GSM48_MT_RR_IMM_ASS) {
+			imm_ass_count++;
+			if (imm_ass_rej_count)
+				interleaved++;
+		} else
+			imm_ass_rej_count++;
+		msgb_free(msg);
+	}
+	printf("dequeued imm.ass %d, then imm.ass.rej %d, interleaved %d\n",
+	       imm_ass_count, imm_ass_rej_count, interleaved);
+}
+
+/* BS_PA_MFRMS of 9 multiframes make a paging cycle of 3 s (rounded up) */
+static void set_si3(uint8_t bs_ag_blks_res)
+{
+	struct gsm48_system_information_type_3 *si3 = GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+
+	memset(si3, 0, sizeof(*si3));
+	si3->control_channel_desc.ccch_conf = RSL_BCCH_CCCH_CONF_1_NC;
+	si3->control_channel_desc.bs_ag_blks_res = bs_ag_blks_res;
+	si3->control_channel_desc.bs_pa_mfrms = 9 - 2;
+	bts->si_valid |= (1 << SYSINFO_TYPE_3);
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_SYSINFO, bts);
+}
+
+static void check_ccch_winner(const char *desc, struct gsm_time *g_time, bool expect_agch)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm48_imm_ass *ima = (struct gsm48_imm_ass *)out_buf;
+	bool agch;
+	int rc;
+
+	memset(out_buf, 0, sizeof(out_buf));
+	rc = bts_ccch_copy_msg(bts, out_buf, g_time, 0);
+	OSMO_ASSERT(rc == GSM_MACBLOCK_LEN);
+	agch = ima->msg_type == GSM48_MT_RR_IMM_ASS;
+	OSMO_ASSERT(agch || ima->msg_type == GSM48_MT_RR_PAG_REQ_1);
+
+	printf("%s: %s\n", desc, agch ? "AGCH" : "PCH");
+	OSMO_ASSERT(agch == expect_agch);
+}
+
+static void test_ccch_arbitration(void)
+{
+	static const uint8_t imsi_ilv[] = {
+		0x08, 0x59, 0x51, 0x30, 0x99, 0x00, 0x00, 0x00, 0x19
+	};
+	static const uint8_t imsi2_ilv[] = {
+		0x08, 0x59, 0x51, 0x30, 0x99, 0x00, 0x00, 0x00, 0x29
+	};
+	struct gsm_time g_time;
+	struct msgb *msg;
+	time_t t0;
+
+	printf("Testing CCCH arbitration between AGCH and PCH.\n");
+
+	osmo_gettimeofday_override = true;
+	gettimeofday(&osmo_gettimeofday_override_time, NULL);
+	t0 = osmo_gettimeofday_override_time.tv_sec;
+
+	/* one reserved AGCH block, block 1 is the first paging block */
+	set_si3(1);
+	paging_set_lifetime(bts->paging_state, 10);
+	g_time.fn = 0;
+	g_time.t1 = 0;
+	g_time.t2 = 0;
+	g_time.t3 = 12;
+
+	/* paging records live until t0 + 10 once sent */
+	OSMO_ASSERT(paging_add_identity(bts->paging_state, 0, imsi_ilv, 0) == 0);
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, 0);
+	bts_agch_enqueue(bts, msg);
+
+	bts->gsm_time.fn = 0;
+	check_ccch_winner("IMM ASS in time, paging in time", &g_time, false);
+
+	/* fewer frames left than there are reserved blocks for the queue */
+	bts->gsm_time.fn = bts->agch_queue.max_age - 10;
+	check_ccch_winner("IMM ASS about to expire, paging in time", &g_time, true);
+
+	/* the record's last paging occasion before it expires */
+	msg = msgb_alloc(GSM_MACBLOCK_LEN, __FUNCTION__);
+	put_imm_ass(msg, 0);
+	bts_agch_enqueue(bts, msg);
+	osmo_gettimeofday_override_time.tv_sec = t0 + 8;
+	check_ccch_winner("IMM ASS about to expire, paging about to expire", &g_time, false);
+
+	/* no reserved AGCH block, block 0 is the first paging block */
+	set_si3(0);
+	g_time.t3 = 6;
+	osmo_gettimeofday_override_time.tv_sec = t0 + 11;
+	OSMO_ASSERT(paging_add_identity(bts->paging_state, 0, imsi2_ilv, 0) == 0);
+	check_ccch_winner("no reserved AGCH block, IMM ASS in time for all CCCH blocks",
+			  &g_time, false);
+
+	bts->gsm_time.fn = bts->agch_queue.max_age - 5;
+	check_ccch_winner("no reserved AGCH block, IMM ASS about to expire", &g_time, true);
+
+	bts->gsm_time.fn = 0;
+	osmo_gettimeofday_override = false;
+}
+
 static void test_agch_queue_length_computation(void)
 {
 	static const int ccch_configs[] = {
@@ -233,6 +444,9 @@ int main(int argc, char **argv)
 
 	test_agch_queue_length_computation();
 	test_agch_queue();
+	test_agch_queue_expiry();
+	test_agch_queue_priority();
+	test_ccch_arbitration();
 	printf("Success\n");
 
 	return 0;
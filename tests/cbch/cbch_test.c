@@ -0,0 +1,160 @@
+/* testing the CBCH scheduling */
+
+/*
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <osmocom/core/talloc.h>
+#include <osmocom/core/application.h>
+#include <osmocom/core/utils.h>
+#include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/protocol/gsm_04_12.h>
+#include <osmocom/gsm/protocol/gsm_08_58.h>
+
+#include <osmo-bts/bts.h>
+#include <osmo-bts/logging.h>
+#include <osmo-bts/gsm_data.h>
+#include <osmo-bts/cbch.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static struct gsm_bts *bts;
+static uint32_t cycle;
+
+/* serial number (first octet) of the messages used below */
+enum {
+	SERIAL_NORMAL1 = 0x10,
+	SERIAL_NORMAL2 = 0x20,
+	SERIAL_EMERG1 = 0x30,
+	SERIAL_EMERG2 = 0x31,
+};
+
+static const struct value_string serial_names[] = {
+	{ SERIAL_NORMAL1,	"normal 1" },
+	{ SERIAL_NORMAL2,	"normal 2" },
+	{ SERIAL_EMERG1,	"emergency 1" },
+	{ SERIAL_EMERG2,	"emergency 2" },
+	{ 0, NULL }
+};
+
+/* queue a normal SMSCB command with a four block CBS page */
+static void put_smscb(uint8_t serial, uint16_t msg_id)
+{
+	const struct rsl_ie_cb_cmd_type cmd_type = {
+		.command = RSL_CB_CMD_TYPE_NORMAL,
+		.last_block = RSL_CB_CMD_LASTBLOCK_4,
+	};
+	uint8_t msg[GSM412_MSG_LEN];
+
+	memset(msg, 0x2b, sizeof(msg));
+	msg[0] = serial;
+	msg[1] = 0x01;
+	msg[2] = msg_id >> 8;
+	msg[3] = msg_id & 0xff;
+	msg[4] = 0x01;	/* DCS */
+	msg[5] = 0x11;	/* page 1 of 1 */
+
+	OSMO_ASSERT(bts_process_smscb_cmd(bts, cmd_type, false, sizeof(msg), msg) == 0);
+}
+
+/* run one CBCH cycle of the basic CBCH, i.e. the four multiframes TB = 0..3,
+ * and print which message was sent */
+static void run_cycle(void)
+{
+	struct gsm412_block_type *block_type;
+	uint8_t out[GSM_MACBLOCK_LEN];
+	uint8_t serial = 0;
+	struct gsm_time g_time;
+	unsigned int tb;
+	int rc;
+
+	cycle++;
+	for (tb = 0; tb < 4; tb++) {
+		gsm_fn2gsmtime(&g_time, (cycle * 8 + tb) * 51);
+		rc = bts_cbch_get(bts, out, &g_time);
+		block_type = (struct gsm412_block_type *) out;
+
+		if (block_type->seq_nr == GSM412_SEQ_NULL_MSG) {
+			OSMO_ASSERT(tb == 0 || serial == 0);
+			continue;
+		}
+		/* a complete message, block by block */
+		OSMO_ASSERT(block_type->seq_nr == tb);
+		OSMO_ASSERT(block_type->lb == (tb == 3));
+		OSMO_ASSERT(rc == (tb == 3));
+		if (tb == 0)
+			serial = out[1];
+	}
+
+	printf(" cycle %u: %s\n", cycle, serial ? get_value_string(serial_names, serial) : "NULL");
+}
+
+static void test_cbch_sched(void)
+{
+	size_t blocks;
+
+	printf("Testing CBCH scheduling\n");
+
+	blocks = talloc_total_blocks(bts);
+
+	/* normal 1 three times, emergency 1 twice: they are stored once and
+	 * repeated after the repetition period of their priority */
+	put_smscb(SERIAL_NORMAL1, 0x0032);
+	put_smscb(SERIAL_NORMAL1, 0x0032);
+	put_smscb(SERIAL_NORMAL1, 0x0032);
+	put_smscb(SERIAL_NORMAL2, 0x0033);
+	put_smscb(SERIAL_EMERG1, 0x1112);
+	put_smscb(SERIAL_EMERG1, 0x1112);
+	OSMO_ASSERT(talloc_total_blocks(bts) == blocks + 3);
+	OSMO_ASSERT(bts->smscb_basic.queue_len == 6);
+
+	run_cycle();
+	run_cycle();
+	run_cycle();
+	run_cycle();
+	run_cycle();
+
+	/* a new emergency message fills the gap between two repetitions */
+	put_smscb(SERIAL_EMERG2, 0x1113);
+	run_cycle();
+	run_cycle();
+	run_cycle();
+	OSMO_ASSERT(bts->smscb_basic.queue_len == 0);
+
+	/* every message is released once it has been sent completely */
+	printf(" %zu messages still allocated\n", talloc_total_blocks(bts) - blocks);
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	osmo_init_logging2(tall_bts_ctx, &bts_log_info);
+
+	bts = gsm_bts_alloc(tall_bts_ctx, 0);
+	if (bts_init(bts) < 0) {
+		fprintf(stderr, "unable to open bts\n");
+		exit(1);
+	}
+
+	test_cbch_sched();
+	printf("Success\n");
+
+	return 0;
+}
@@ -1,9 +1,16 @@
 #include <stdio.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/application.h>
+#include <osmocom/core/utils.h>
 #include <osmocom/gsm/gsm_utils.h>
+#include <osmocom/gsm/rsl.h>
+#include <osmocom/gsm/protocol/ipaccess.h>
+
+#include <arpa/inet.h>
 
 #include <osmo-bts/gsm_data.h>
 #include <osmo-bts/logging.h>
@@ -488,6 +495,339 @@ static void test_ts45008_83_is_sub_single(uint8_t ts, uint8_t ss, bool fr)
 	printf("\n");
 }
 
+/* Reference implementation of the measurement computation, which works on
+ * the full list of received measurements the way lchan_meas_check_compute()
+ * used to do it before the measurements were accumulated on reception. */
+struct ref_meas_result {
+	struct gsm_meas_rep_unidir ul_res;
+	int16_t ms_toa256;
+	int16_t toa256_min;
+	int16_t toa256_max;
+	uint16_t toa256_std_dev;
+};
+
+static uint8_t ref_ber10k_to_rxqual(uint32_t ber10k)
+{
+	if (ber10k < 20)
+		return 0;
+	if (ber10k < 40)
+		return 1;
+	if (ber10k < 80)
+		return 2;
+	if (ber10k < 160)
+		return 3;
+	if (ber10k < 320)
+		return 4;
+	if (ber10k < 640)
+		return 5;
+	if (ber10k < 1280)
+		return 6;
+	return 7;
+}
+
+static void ref_meas_compute(struct ref_meas_result *res, const struct bts_ul_meas *ulm, unsigned int num,
+			     unsigned int num_expect, unsigned int num_sub_expect, bool amr, int16_t ms_toa256)
+{
+	uint32_t ber_full_sum = 0, irssi_full_sum = 0, ber_sub_sum = 0, irssi_sub_sum = 0;
+	int32_t ta256b_sum = 0;
+	unsigned int num_meas_sub = 0, num_meas_sub_actual = 0, num_actual = 0;
+	unsigned int excess = num > num_expect ? num - num_expect : 0;
+	uint64_t sq_diff_sum = 0;
+	unsigned int i;
+
+	for (i = 0; i < num_expect; i++) {
+		bool is_sub = false;
+		uint16_t ber10k = 10000;
+
+		if (i < num) {
+			const struct bts_ul_meas *m = &ulm[i + excess];
+			if (m->is_sub) {
+				irssi_sub_sum += m->inv_rssi;
+				num_meas_sub_actual++;
+				is_sub = true;
+			}
+			irssi_full_sum += m->inv_rssi;
+			ta256b_sum += m->ta_offs_256bits;
+			ber10k = m->ber10k;
+			num_actual++;
+		} else if (!amr && num_expect - i <= num_sub_expect - num_meas_sub)
+			is_sub = true;
+
+		ber_full_sum += ber10k;
+		if (is_sub) {
+			num_meas_sub++;
+			ber_sub_sum += ber10k;
+		}
+	}
+
+	ber_full_sum /= num_expect;
+	irssi_full_sum = irssi_full_sum ? irssi_full_sum / num_actual : 109;
+	ta256b_sum = num_actual ? ta256b_sum / (signed)num_actual : ms_toa256;
+	ber_sub_sum = num_meas_sub ? ber_sub_sum / num_meas_sub : 10000;
+	irssi_sub_sum = num_meas_sub_actual ? irssi_sub_sum / num_meas_sub_actual : 109;
+
+	res->ul_res.full.rx_lev = dbm2rxlev((int)irssi_full_sum * -1);
+	res->ul_res.sub.rx_lev = dbm2rxlev((int)irssi_sub_sum * -1);
+	res->ul_res.full.rx_qual = ref_ber10k_to_rxqual(ber_full_sum);
+	res->ul_res.sub.rx_qual = ref_ber10k_to_rxqual(ber_sub_sum);
+	res->ms_toa256 = ta256b_sum;
+
+	if (!num_actual)
+		return;
+
+	res->toa256_min = INT16_MAX;
+	res->toa256_max = INT16_MIN;
+	for (i = 0; i < num_actual; i++) {
+		const struct bts_ul_meas *m = &ulm[i + excess];
+		uint32_t diff_abs = labs((int32_t)m->ta_offs_256bits - (int32_t)res->ms_toa256);
+		sq_diff_sum += diff_abs * diff_abs;
+		if (m->ta_offs_256bits > res->toa256_max)
+			res->toa256_max = m->ta_offs_256bits;
+		if (m->ta_offs_256bits < res->toa256_min)
+			res->toa256_min = m->ta_offs_256bits;
+	}
+	res->toa256_std_dev = osmo_isqrt32(sq_diff_sum / num_actual);
+}
+
+static uint32_t equiv_rand_state = 1;
+
+static uint32_t equiv_rand(uint32_t max)
+{
+	equiv_rand_state = equiv_rand_state * 1103515245 + 12345;
+	return ((equiv_rand_state >> 16) & 0x7fff) % max;
+}
+
+/* Feed pseudo-random measurements into lchan_new_ul_meas() and check that
+ * lchan_meas_check_compute() yields exactly what the reference computation
+ * over the full list of measurements yields. */
+static void test_meas_compute_equivalence(void)
+{
+	static const struct {
+		enum gsm_phys_chan_config pchan;
+		enum gsm_chan_t type;
+		uint8_t ts;
+		uint32_t final_fn;
+		unsigned int num_expect;
+		unsigned int num_sub_expect;
+	} chans[] = {
+		{ GSM_PCHAN_TCH_F, GSM_LCHAN_TCH_F, 1, 25, 25, 3 },
+		{ GSM_PCHAN_TCH_H, GSM_LCHAN_TCH_H, 2, 38, 25, 5 },
+		{ GSM_PCHAN_CCCH_SDCCH4, GSM_LCHAN_SDCCH, 0, 88, 3, 3 },
+		{ GSM_PCHAN_SDCCH8_SACCH8C, GSM_LCHAN_SDCCH, 0, 66, 3, 3 },
+	};
+	struct bts_ul_meas ulm[40];
+	struct ref_meas_result ref;
+	struct gsm_lchan *lchan;
+	unsigned int c, k, i, num, cases = 0;
+	int16_t ms_toa256;
+	bool amr;
+
+	printf("\n\n");
+	printf("===========================================================\n");
+	printf("Testing equivalence of accumulated measurement computation\n");
+
+	for (c = 0; c < 400; c++) {
+		k = c % ARRAY_SIZE(chans);
+		amr = chans[k].type != GSM_LCHAN_SDCCH && (c / ARRAY_SIZE(chans)) % 2;
+
+		lchan = &trx->ts[chans[k].ts].lchan[0];
+		lchan->ts->pchan = chans[k].pchan;
+		lchan->type = chans[k].type;
+		lchan->tch_mode = amr ? GSM48_CMODE_SPEECH_AMR :
+			(chans[k].type == GSM_LCHAN_SDCCH ? GSM48_CMODE_SIGN : GSM48_CMODE_SPEECH_V1);
+		reset_lchan_meas(lchan);
+		lchan->meas.ms_toa256 = ms_toa256 = equiv_rand(512) - 256;
+
+		num = equiv_rand(chans[k].num_expect + 15);
+		for (i = 0; i < num; i++) {
+			ulm[i].ber10k = equiv_rand(4) ? equiv_rand(1500) : 10000;
+			ulm[i].ta_offs_256bits = equiv_rand(8) ? equiv_rand(2048) - 1024 :
+				(equiv_rand(2) ? INT16_MAX : INT16_MIN + 1);
+			ulm[i].c_i = 0;
+			ulm[i].is_sub = !equiv_rand(6);
+			ulm[i].inv_rssi = 40 + equiv_rand(80);
+			OSMO_ASSERT(lchan_new_ul_meas(lchan, &ulm[i], i) == 0);
+		}
+
+		OSMO_ASSERT(lchan_meas_check_compute(lchan, chans[k].final_fn) == 1);
+
+		memset(&ref, 0, sizeof(ref));
+		ref_meas_compute(&ref, ulm, num, chans[k].num_expect, chans[k].num_sub_expect, amr, ms_toa256);
+
+		OSMO_ASSERT(!memcmp(&lchan->meas.ul_res, &ref.ul_res, sizeof(ref.ul_res)));
+		OSMO_ASSERT(lchan->meas.ms_toa256 == ref.ms_toa256);
+		if (num) {
+			OSMO_ASSERT(lchan->meas.ext.toa256_min == ref.toa256_min);
+			OSMO_ASSERT(lchan->meas.ext.toa256_max == ref.toa256_max);
+			OSMO_ASSERT(lchan->meas.ext.toa256_std_dev == ref.toa256_std_dev);
+		}
+		cases++;
+	}
+
+	printf("%u measurement periods computed identically\n", cases);
+}
+
+/* Reference encoder of the RSL MEASurement RESult, the way rsl_tx_meas_res()
+ * used to compose it IE by IE before the per-lchan template was introduced */
+struct ref_supp_meas_info {
+	int16_t toa256_mean;
+	int16_t toa256_min;
+	int16_t toa256_max;
+	uint16_t toa256_std_dev;
+} __attribute__((packed));
+
+static struct msgb *ref_meas_res_enc(struct gsm_lchan *lchan, const uint8_t *l3, int l3_len,
+				     const struct lapdm_entity *le)
+{
+	struct abis_rsl_dchan_hdr *dch;
+	struct msgb *msg;
+	uint8_t meas_res[16];
+	size_t ie_len;
+
+	msg = msgb_alloc_headroom(600 + sizeof(*dch) + sizeof(struct ipaccess_head),
+				  sizeof(*dch) + sizeof(struct ipaccess_head), "RSL");
+	msg->l3h = msg->data;
+	msgb_tv_put(msg, RSL_IE_MEAS_RES_NR, lchan->meas.res_nr++);
+	ie_len = gsm0858_rsl_ul_meas_enc(&lchan->meas.ul_res, lchan->tch.dtx.dl_active, meas_res);
+	lchan->tch.dtx.dl_active = false;
+	if (ie_len >= 3) {
+		if (lchan->ts->trx->bts->supp_meas_toa256 && lchan->meas.flags & LC_UL_M_F_OSMO_EXT_VALID) {
+			struct ref_supp_meas_info *smi = (struct ref_supp_meas_info *) &meas_res[ie_len];
+			int16_t ta256 = lchan_get_ta(lchan) * 256;
+			ie_len += sizeof(*smi);
+			smi->toa256_mean = htons(ta256 + lchan->meas.ms_toa256);
+			smi->toa256_min = htons(ta256 + lchan->meas.ext.toa256_min);
+			smi->toa256_max = htons(ta256 + lchan->meas.ext.toa256_max);
+			smi->toa256_std_dev = htons(lchan->meas.ext.toa256_std_dev);
+			lchan->meas.flags &= ~LC_UL_M_F_OSMO_EXT_VALID;
+		}
+		msgb_tlv_put(msg, RSL_IE_UPLINK_MEAS, ie_len, meas_res);
+		lchan->meas.flags &= ~LC_UL_M_F_RES_VALID;
+	}
+	msgb_tv_put(msg, RSL_IE_BS_POWER, lchan->bs_power_red / 2);
+	if (lchan->meas.flags & LC_UL_M_F_L1_VALID) {
+		msgb_tv_fixed_put(msg, RSL_IE_L1_INFO, 2, lchan->meas.l1_info);
+		lchan->meas.flags &= ~LC_UL_M_F_L1_VALID;
+	}
+	if (l3 && l3_len > 0)
+		msgb_tl16v_put(msg, RSL_IE_L3_INFO, l3_len, l3);
+	if (lchan->ms_t_offs >= 0 || lchan->p_offs >= 0) {
+		if (l3 && l3_len > 0)
+			msgb_tv_put(msg, RSL_IE_MS_TIMING_OFFSET, (lchan->ms_t_offs >= 0) ?
+				    lchan->ms_t_offs : (lchan->p_offs - le->ta));
+		lchan->ms_t_offs = -1;
+		lchan->p_offs = -1;
+	}
+
+	dch = (struct abis_rsl_dchan_hdr *) msgb_push(msg, sizeof(*dch));
+	dch->c.msg_discr = ABIS_RSL_MDISC_DED_CHAN;
+	dch->c.msg_type = RSL_MT_MEAS_RES;
+	dch->ie_chan = RSL_IE_CHAN_NR;
+	dch->chan_nr = gsm_lchan2chan_nr(lchan);
+
+	return msg;
+}
+
+/* set up the lchan state which rsl_meas_res_enc() consumes, the bits of 'opt'
+ * select the optional parts of the message */
+static void meas_res_setup(struct gsm_lchan *lchan, unsigned int opt, unsigned int n)
+{
+	bts->supp_meas_toa256 = opt & 1;
+	lchan->meas.flags = LC_UL_M_F_RES_VALID;
+	if (opt & 2)
+		lchan->meas.flags |= LC_UL_M_F_OSMO_EXT_VALID;
+	if (opt & 4)
+		lchan->meas.flags |= LC_UL_M_F_L1_VALID;
+	lchan->tch.dtx.dl_active = opt & 8;
+	lchan->ms_t_offs = opt & 16 ? 63 + n % 7 : -1;
+	lchan->p_offs = opt & 32 ? 63 + n % 5 : -1;
+	lchan->meas.res_nr = 250 + n;
+	lchan->meas.ul_res.full.rx_lev = n % 64;
+	lchan->meas.ul_res.sub.rx_lev = (n * 7) % 64;
+	lchan->meas.ul_res.full.rx_qual = n % 8;
+	lchan->meas.ul_res.sub.rx_qual = (n / 8) % 8;
+	lchan->meas.l1_info[0] = n;
+	lchan->meas.l1_info[1] = n % 64;
+	lchan->meas.ms_toa256 = n * 3 - 200;
+	lchan->meas.ext.toa256_min = -300 - n;
+	lchan->meas.ext.toa256_max = 300 + n;
+	lchan->meas.ext.toa256_std_dev = n;
+	lchan->bs_power_red = n % 30;
+}
+
+/* Check that rsl_meas_res_enc() composes exactly the same MEASurement RESult
+ * (and leaves the lchan in the same state) as the reference encoder, for all
+ * combinations of optional IEs */
+static void test_meas_res_enc(void)
+{
+	static const struct {
+		enum gsm_phys_chan_config pchan;
+		uint8_t ts;
+		uint8_t ss;
+	} chans[] = {
+		{ GSM_PCHAN_TCH_F, 1, 0 },
+		{ GSM_PCHAN_TCH_H, 2, 1 },
+		{ GSM_PCHAN_SDCCH8_SACCH8C, 0, 5 },
+	};
+	static const uint8_t l3[] = { 0x06, 0x15, 0x3a, 0x3a, 0x00, 0x00, 0x00, 0x00 };
+	struct lapdm_entity le = { .ta = 3 };
+	struct msgb *msg, *ref_msg;
+	struct gsm_lchan *lchan;
+	unsigned int opt, k, n, cases = 0;
+	uint8_t ref_res_nr, ref_flags;
+	int16_t ref_ms_t_offs, ref_p_offs;
+	bool ref_dtx, with_l3;
+
+	printf("\n\n");
+	printf("===========================================================\n");
+	printf("Testing MEAS RES encoding\n");
+
+	for (opt = 0; opt < 64; opt++) {
+		for (k = 0; k < ARRAY_SIZE(chans); k++) {
+			lchan = &trx->ts[chans[k].ts].lchan[chans[k].ss];
+			lchan->ts->pchan = chans[k].pchan;
+			reset_lchan_meas(lchan);
+
+			/* two results per lchan, the second one from the already built template */
+			for (n = opt * 2; n < opt * 2 + 2; n++) {
+				with_l3 = n % 4;
+
+				meas_res_setup(lchan, opt, n);
+				ref_msg = ref_meas_res_enc(lchan, with_l3 ? l3 : NULL, with_l3 ? sizeof(l3) : 0, &le);
+				ref_res_nr = lchan->meas.res_nr;
+				ref_flags = lchan->meas.flags;
+				ref_dtx = lchan->tch.dtx.dl_active;
+				ref_ms_t_offs = lchan->ms_t_offs;
+				ref_p_offs = lchan->p_offs;
+
+				meas_res_setup(lchan, opt, n);
+				msg = rsl_meas_res_enc(lchan, with_l3 ? l3 : NULL, with_l3 ? sizeof(l3) : 0, &le);
+				OSMO_ASSERT(msg);
+
+				if (msg->len != ref_msg->len || memcmp(msg->data, ref_msg->data, msg->len)) {
+					printf("MEAS RES mismatch (opt 0x%02x, n %u):\n", opt, n);
+					printf(" expected %s\n", msgb_hexdump(ref_msg));
+					printf(" got      %s\n", msgb_hexdump(msg));
+					OSMO_ASSERT(false);
+				}
+				OSMO_ASSERT(msgb_l3len(msg) == msgb_l3len(ref_msg));
+				OSMO_ASSERT(msgb_headroom(msg) >= sizeof(struct ipaccess_head));
+				OSMO_ASSERT(lchan->meas.res_nr == ref_res_nr);
+				OSMO_ASSERT(lchan->meas.flags == ref_flags);
+				OSMO_ASSERT(lchan->tch.dtx.dl_active == ref_dtx);
+				OSMO_ASSERT(lchan->ms_t_offs == ref_ms_t_offs);
+				OSMO_ASSERT(lchan->p_offs == ref_p_offs);
+
+				msgb_free(ref_msg);
+				msgb_free(msg);
+				cases++;
+			}
+		}
+	}
+
+	printf("%u MEAS RES messages encoded identically\n", cases);
+}
+
 static void test_ts45008_83_is_sub(void)
 {
 	unsigned int i;
@@ -583,6 +923,8 @@ int main(int argc, char **argv)
 	test_lchan_meas_process_measurement(false, true);
 	test_lchan_meas_process_measurement(true, true);
 	test_ts45008_83_is_sub();
+	test_meas_compute_equivalence();
+	test_meas_res_enc();
 
 	printf("Success\n");
 
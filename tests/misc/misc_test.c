@@ -23,8 +23,11 @@
 #include <osmo-bts/bts.h>
 #include <osmo-bts/msg_utils.h>
 #include <osmo-bts/logging.h>
+#include <osmo-bts/signal.h>
+#include <osmo-bts/l1_conf.h>
 
 #include <osmocom/core/application.h>
+#include <osmocom/core/signal.h>
 #include <osmocom/gsm/protocol/ipaccess.h>
 
 #include <stdlib.h>
@@ -185,6 +188,277 @@ static void test_bts_supports_cm(void)
 	talloc_free(bts);
 }
 
+static void dtx_dl_amr_check(struct osmo_fsm_inst *fi, struct dtx_dl_amr_sm *sm,
+			     enum dtx_dl_amr_fsm_events e)
+{
+	int rc_fsm, rc_sm;
+
+	rc_fsm = osmo_fsm_inst_dispatch(fi, e, NULL);
+	rc_sm = dtx_dl_amr_sm_dispatch(sm, e);
+	if ((rc_fsm < 0) != (rc_sm < 0) || fi->state != sm->state) {
+		printf("Mismatch on %s: FSM %d/%s, table %d/%s\n",
+		       get_value_string(dtx_dl_amr_fsm_event_names, e),
+		       rc_fsm, osmo_fsm_inst_state_name(fi),
+		       rc_sm, dtx_dl_amr_sm_state_name(sm));
+		OSMO_ASSERT(0);
+	}
+}
+
+static void test_dtx_dl_amr_sm(void)
+{
+	static const enum dtx_dl_amr_fsm_events seq[] = {
+		E_SID_F, E_FIRST, E_COMPL, E_COMPL, E_INHIB, E_COMPL, E_VOICE,
+		E_SID_U, E_FACCH, E_COMPL, E_COMPL, E_COMPL, E_ONSET, E_COMPL,
+		E_COMPL,
+	};
+	struct osmo_fsm_inst *fi;
+	struct dtx_dl_amr_sm sm;
+	unsigned int st, e, i, permitted = 0;
+
+	printf("Testing DTX DL AMR state machine\n");
+
+	OSMO_ASSERT(osmo_fsm_register(&dtx_dl_amr_fsm) == 0);
+	fi = osmo_fsm_inst_alloc(&dtx_dl_amr_fsm, ctx, NULL, LOGL_DEBUG, "dtx");
+	OSMO_ASSERT(fi);
+
+	/* every event in every state */
+	for (st = 0; st < dtx_dl_amr_fsm.num_states; st++) {
+		for (e = E_VOICE; e <= E_SID_U; e++) {
+			fi->state = st;
+			sm.state = st;
+			dtx_dl_amr_check(fi, &sm, e);
+			if (dtx_dl_amr_fsm.states[st].in_event_mask & X(e))
+				permitted++;
+		}
+	}
+	printf(" %u permitted events\n", permitted);
+
+	/* a talk spurt with SID, inhibition, FACCH and ONSET */
+	fi->state = ST_VOICE;
+	dtx_dl_amr_sm_init(&sm);
+	for (i = 0; i < ARRAY_SIZE(seq); i++) {
+		printf(" %s --%s--> ", dtx_dl_amr_sm_state_name(&sm),
+		       get_value_string(dtx_dl_amr_fsm_event_names, seq[i]));
+		dtx_dl_amr_check(fi, &sm, seq[i]);
+		printf("%s\n", dtx_dl_amr_sm_state_name(&sm));
+	}
+
+	osmo_fsm_inst_free(fi);
+}
+
+/* copy of the former per-frame selection of the SI on BCCH Norm, with its
+ * rotation counters, to compare bts_sysinfo_get() against */
+static uint8_t ref_tc4_ctr, ref_si2q_index;
+
+static uint8_t *ref_get_si2q_inc_index(struct gsm_bts *bts)
+{
+	uint8_t i = ref_si2q_index;
+	ref_si2q_index = (ref_si2q_index + 1) % (bts->si2q_count + 1);
+	return (uint8_t *)GSM_BTS_SI2Q(bts, i);
+}
+
+static uint8_t *ref_sysinfo_get(struct gsm_bts *bts, uint8_t tc)
+{
+	unsigned int tc4_cnt = 0;
+	unsigned int tc4_sub[4];
+
+	switch (tc) {
+	case 0:
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_1))
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_1);
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	case 1:
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	case 2:
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+	case 3:
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_4);
+	case 4:
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter) && GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis))
+			tc4_sub[tc4_cnt++] = SYSINFO_TYPE_2ter;
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) &&
+		    (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) || GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter)))
+			tc4_sub[tc4_cnt++] = SYSINFO_TYPE_2quater;
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_13))
+			tc4_sub[tc4_cnt++] = SYSINFO_TYPE_13;
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_9))
+			tc4_sub[tc4_cnt++] = SYSINFO_TYPE_9;
+		if (tc4_cnt == 0)
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+		ref_tc4_ctr = (ref_tc4_ctr + 1) % tc4_cnt;
+		if (tc4_sub[ref_tc4_ctr] == SYSINFO_TYPE_2quater)
+			return ref_get_si2q_inc_index(bts);
+		return GSM_BTS_SI(bts, tc4_sub[ref_tc4_ctr]);
+	case 5:
+		if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_2bis);
+		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis))
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_2ter);
+		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_2bis);
+		else if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater) &&
+			 !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2bis) && !GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2ter))
+			return ref_get_si2q_inc_index(bts);
+		else
+			return GSM_BTS_SI(bts, SYSINFO_TYPE_2);
+	case 6:
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_3);
+	case 7:
+		return GSM_BTS_SI(bts, SYSINFO_TYPE_4);
+	}
+	OSMO_ASSERT(0);
+}
+
+static const char *bcch_si_name(struct gsm_bts *bts, const uint8_t *si)
+{
+	static char buf[16];
+	int i;
+
+	for (i = 0; i <= bts->si2q_count; i++) {
+		if (si == (uint8_t *) GSM_BTS_SI2Q(bts, i)) {
+			snprintf(buf, sizeof(buf), "2quater/%d", i);
+			return buf;
+		}
+	}
+	for (i = 0; i < _MAX_SYSINFO_TYPE; i++) {
+		if (si == GSM_BTS_SI(bts, i))
+			return get_value_string(osmo_sitype_strs, i);
+	}
+	return "?";
+}
+
+#define BCCH_TEST_CYCLES	(2 * BTS_SI_BCCH_ROT_MAX / 8)
+
+/* Set up the given SI, and compare the BCCH rotation of bts_sysinfo_get()
+ * with the former per-frame selection.  The rotations on TC = 4 and 5 may
+ * start at a different point, but have to be the same sequence. */
+static void test_bcch_rotation(struct gsm_bts *bts, uint32_t si_valid, uint8_t si2q_count)
+{
+	static const uint8_t *ref[8][BCCH_TEST_CYCLES];
+	struct gsm_time g_time;
+	unsigned int n, tc, shift, period;
+	int i;
+
+	bts->si_valid = si_valid;
+	bts->si2q_count = si2q_count;
+	osmo_signal_dispatch(SS_GLOBAL, S_NEW_SYSINFO, bts);
+
+	printf(" SI");
+	for (i = 0; i < _MAX_SYSINFO_TYPE; i++) {
+		if (GSM_BTS_HAS_SI(bts, i))
+			printf(" %s", get_value_string(osmo_sitype_strs, i));
+	}
+	if (GSM_BTS_HAS_SI(bts, SYSINFO_TYPE_2quater))
+		printf(" (%u instances)", si2q_count + 1);
+	printf("\n");
+
+	ref_tc4_ctr = ref_si2q_index = 0;
+	for (n = 0; n < BCCH_TEST_CYCLES; n++) {
+		for (tc = 0; tc < 8; tc++)
+			ref[tc][n] = ref_sysinfo_get(bts, tc);
+	}
+
+	/* the table covers whole 8-TC cycles, repeating with the hyperframe */
+	OSMO_ASSERT(bts->si.bcch_len % 8 == 0);
+	period = bts->si.bcch_len / 8;
+	OSMO_ASSERT(period <= BCCH_TEST_CYCLES / 2);
+
+	for (tc = 0; tc < 8; tc++) {
+		for (shift = 0; shift < period; shift++) {
+			for (n = 0; n < period; n++) {
+				gsm_fn2gsmtime(&g_time, (n * 8 + tc) * 51);
+				if (bts_sysinfo_get(bts, &g_time) != ref[tc][n + shift])
+					break;
+			}
+			if (n == period)
+				break;
+		}
+		OSMO_ASSERT(shift < period);
+
+		printf("  TC%u:", tc);
+		for (n = 0; n < period; n++) {
+			gsm_fn2gsmtime(&g_time, (n * 8 + tc) * 51);
+			printf(" %s", bcch_si_name(bts, bts_sysinfo_get(bts, &g_time)));
+		}
+		printf("\n");
+	}
+}
+
+static void test_bts_sysinfo_bcch(void)
+{
+	const uint32_t si_base = (1 << SYSINFO_TYPE_2) | (1 << SYSINFO_TYPE_3) | (1 << SYSINFO_TYPE_4);
+	struct gsm_bts *bts;
+
+	printf("Testing BCCH rotation\n");
+
+	bts = gsm_bts_alloc(ctx, 0);
+	OSMO_ASSERT(bts_init(bts) == 0);
+
+	/* every change is signalled with S_NEW_SYSINFO, which has to
+	 * recompute the rotation */
+	test_bcch_rotation(bts, si_base | (1 << SYSINFO_TYPE_1), 0);
+	test_bcch_rotation(bts, si_base | (1 << SYSINFO_TYPE_1) | (1 << SYSINFO_TYPE_2bis)
+			   | (1 << SYSINFO_TYPE_2ter) | (1 << SYSINFO_TYPE_2quater)
+			   | (1 << SYSINFO_TYPE_13) | (1 << SYSINFO_TYPE_9), 2);
+	test_bcch_rotation(bts, si_base | (1 << SYSINFO_TYPE_1) | (1 << SYSINFO_TYPE_2bis)
+			   | (1 << SYSINFO_TYPE_2ter) | (1 << SYSINFO_TYPE_2quater), 2);
+	test_bcch_rotation(bts, si_base | (1 << SYSINFO_TYPE_2quater) | (1 << SYSINFO_TYPE_13), 1);
+}
+
+static void l1_conf_test_timeout(struct l1_conf_wait *wlc)
+{
+	printf(" timeout of %s\n", (const char *) wlc->cb_data);
+}
+
+static void test_l1_conf_take(struct l1_conf *lc, bool is_sys_prim,
+			      unsigned int conf_prim_id, uint32_t conf_hLayer3)
+{
+	struct l1_conf_wait *wlc;
+
+	wlc = l1_conf_take(lc, is_sys_prim, conf_prim_id, conf_hLayer3);
+	printf(" %s prim %u hLayer3 0x%04x: %s\n", is_sys_prim ? "sys" : "l1",
+	       conf_prim_id, conf_hLayer3, wlc ? (const char *) wlc->cb_data : "none");
+	if (wlc)
+		l1_conf_release(wlc);
+}
+
+static void test_l1_conf(void)
+{
+	struct l1_conf *lc;
+
+	printf("Testing L1 confirmation matching\n");
+
+	lc = l1_conf_alloc(ctx, 0, l1_conf_test_timeout);
+	OSMO_ASSERT(lc);
+
+	/* three requests waiting for the same confirmation, and one for
+	 * another hLayer3 that hashes to the same bucket */
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_LCHAN, false, 5, 0x1234, NULL, "A"));
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_LCHAN, false, 5, 0x128d, NULL, "D"));
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_LCHAN, false, 5, 0x1234, NULL, "B"));
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_LCHAN, false, 5, 0x1234, NULL, "C"));
+	/* system primitives are matched by their id only */
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_SYS, true, 5, 0x1234, NULL, "S1"));
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_SYS, true, 5, 0x4321, NULL, "S2"));
+
+	test_l1_conf_take(lc, false, 5, 0x1234);
+	test_l1_conf_take(lc, false, 5, 0x128d);
+	test_l1_conf_take(lc, false, 5, 0x128d);
+	test_l1_conf_take(lc, false, 5, 0x1234);
+	test_l1_conf_take(lc, true, 5, 0x4321);
+	test_l1_conf_take(lc, false, 6, 0x1234);
+
+	/* a request added now queues up behind C */
+	OSMO_ASSERT(l1_conf_add(lc, L1_CONF_C_LCHAN, false, 5, 0x1234, NULL, "E"));
+	test_l1_conf_take(lc, false, 5, 0x1234);
+	test_l1_conf_take(lc, false, 5, 0x1234);
+	test_l1_conf_take(lc, false, 5, 0x1234);
+	test_l1_conf_take(lc, true, 5, 0);
+	test_l1_conf_take(lc, true, 5, 0);
+
+	talloc_free(lc);
+}
+
 int main(int argc, char **argv)
 {
 	ctx = talloc_named_const(NULL, 0, "misc_test");
@@ -195,5 +469,8 @@ int main(int argc, char **argv)
 	test_msg_utils_ipa();
 	test_msg_utils_oml();
 	test_bts_supports_cm();
+	test_dtx_dl_amr_sm();
+	test_bts_sysinfo_bcch();
+	test_l1_conf();
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,125 @@
+/* testing the unacknowledged command window of osmo-bts-octphy */
+
+/*
+ * All Rights Reserved
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU Affero General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU Affero General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ */
+
+#include <osmocom/core/application.h>
+
+/* the response handling is static */
+#include "l1_if.c"
+
+#define TEST_CID	cOCTVC1_GSM_MSG_TRX_ACTIVATE_LOGICAL_CHANNEL_CID
+
+static struct octphy_hdl *fl1h;
+
+static int test_compl_cb(struct octphy_hdl *fl1, struct msgb *resp, void *data)
+{
+	tOCTVC1_MSG_HEADER *mh = (tOCTVC1_MSG_HEADER *) resp->l2h;
+
+	printf("  completed trans_id=%u\n", ntohl(mh->ulTransactionId));
+	msgb_free(resp);
+	return 0;
+}
+
+static void test_tx_cmd(void)
+{
+	struct msgb *msg = l1p_msgb_alloc();
+	tOCTVC1_MSG_HEADER *mh;
+
+	mh = (tOCTVC1_MSG_HEADER *) msgb_put(msg, sizeof(*mh));
+	l1if_fill_msg_hdr(mh, msg, fl1h, cOCTVC1_MSG_TYPE_COMMAND, TEST_CID);
+	printf(" Tx command trans_id=%u\n", mh->ulTransactionId);
+	mh->ulTransactionId = htonl(mh->ulTransactionId);
+	mh->ul_Type_R_CmdId = htonl(mh->ul_Type_R_CmdId);
+
+	OSMO_ASSERT(l1if_req_compl(fl1h, msg, test_compl_cb, NULL) == 0);
+}
+
+static void test_rx_resp(uint32_t trans_id)
+{
+	struct msgb *msg = l1p_msgb_alloc();
+	tOCTVC1_MSG_HEADER *mh;
+
+	mh = (tOCTVC1_MSG_HEADER *) msgb_put(msg, sizeof(*mh));
+	memset(mh, 0, sizeof(*mh));
+	mh->ulTransactionId = htonl(trans_id);
+	mh->ulReturnCode = htonl(cOCTVC1_RC_OK);
+	msg->dst = fl1h;
+
+	printf(" Rx response trans_id=%u\n", trans_id);
+	rx_octvc1_resp(msg, TEST_CID, trans_id);
+}
+
+static void test_print_window(void)
+{
+	printf(" in flight %d, queued for the PHY %u, out of order %u, "
+	       "re-transmitted %u\n", fl1h->wlc_list_len,
+	       fl1h->phy_wq.current_length, fl1h->stats.resp_out_of_order,
+	       fl1h->stats.retrans_cmds_trans_id);
+}
+
+static void test_resp_order(void)
+{
+	printf("Testing out of order and late responses\n");
+
+	fl1h = talloc_zero(tall_bts_ctx, struct octphy_hdl);
+	INIT_LLIST_HEAD(&fl1h->wlc_list);
+	INIT_LLIST_HEAD(&fl1h->wlc_postponed);
+	fl1h->win.cwnd = UNACK_CMD_WINDOW_INIT;
+	fl1h->win.ssthresh = UNACK_CMD_WINDOW_MAX;
+	fl1h->win.max = UNACK_CMD_WINDOW_MAX;
+	fl1h->win.rto_us = CMD_RTO_INIT_US;
+	osmo_wqueue_init(&fl1h->phy_wq, 2 * UNACK_CMD_WINDOW_MAX);
+
+	test_tx_cmd();
+	test_tx_cmd();
+	test_tx_cmd();
+	test_print_window();
+
+	/* the response to 0 is missing: 1 is held back, 0 re-transmitted */
+	test_rx_resp(1);
+	test_print_window();
+
+	/* 0 comes in, 1 is completed right after it */
+	test_rx_resp(0);
+	test_print_window();
+
+	/* the response to the re-transmission of 0 is late, ignore it */
+	test_rx_resp(0);
+	test_print_window();
+
+	test_rx_resp(2);
+	test_print_window();
+
+	/* nothing is waiting anymore */
+	test_rx_resp(1);
+	test_print_window();
+}
+
+int main(int argc, char **argv)
+{
+	tall_bts_ctx = talloc_named_const(NULL, 1, "OsmoBTS context");
+	msgb_talloc_ctx_init(tall_bts_ctx, 0);
+
+	osmo_init_logging2(tall_bts_ctx, &bts_log_info);
+
+	test_resp_order();
+
+	printf("Success\n");
+	return EXIT_SUCCESS;
+}
@@ -20,6 +20,7 @@
  */
 #include <osmocom/core/talloc.h>
 #include <osmocom/core/application.h>
+#include <osmocom/core/timer.h>
 
 #include <osmo-bts/bts.h>
 #include <osmo-bts/logging.h>
@@ -28,6 +29,9 @@
 #include <osmo-bts/l1sap.h>
 
 #include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/time.h>
 
 static struct gsm_bts *bts;
 
@@ -124,6 +128,124 @@ static void test_paging_sleep(void)
 	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 0);
 }
 
+static void test_paging_queue_resize(void)
+{
+	uint8_t ilv[sizeof(static_ilv)];
+	int i, rc;
+	printf("Testing that the paging queue can be resized.\n");
+
+	memcpy(ilv, static_ilv, sizeof(ilv));
+	paging_set_queue_max(bts->paging_state, 4);
+
+	/* fill the queue, the fifth record must be dropped */
+	for (i = 0; i < 5; i++) {
+		ilv[8] = i;
+		rc = paging_add_identity(bts->paging_state, 0, ilv, 0);
+		ASSERT_TRUE(rc == (i < 4 ? 0 : -ENOSPC));
+	}
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 4);
+	ASSERT_TRUE(paging_buffer_space(bts->paging_state) == 0);
+
+	/* growing keeps all records and creates space */
+	paging_set_queue_max(bts->paging_state, 6);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 4);
+	ASSERT_TRUE(paging_buffer_space(bts->paging_state) == 2);
+
+	/* shrinking drops the records which no longer fit */
+	paging_set_queue_max(bts->paging_state, 2);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 2);
+	ASSERT_TRUE(paging_buffer_space(bts->paging_state) == 0);
+
+	paging_reset(bts->paging_state);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 0);
+	ASSERT_TRUE(paging_group_queue_empty(bts->paging_state, 0));
+
+	paging_set_queue_max(bts->paging_state, 200);
+}
+
+static void test_paging_wheel_expiry(void)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time = { .fn = 0, .t1 = 0, .t2 = 0, .t3 = 6 };
+	time_t t0;
+	int rc, is_empty;
+	printf("Testing that only sent paging records expire on the timing wheel.\n");
+
+	osmo_gettimeofday_override = true;
+	gettimeofday(&osmo_gettimeofday_override_time, NULL);
+	t0 = osmo_gettimeofday_override_time.tv_sec;
+
+	/* a record whose lifetime passed before it was sent is still paged once */
+	paging_set_lifetime(bts->paging_state, 1);
+	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0);
+	ASSERT_TRUE(rc == 0);
+	osmo_gettimeofday_override_time.tv_sec = t0 + 5;
+	rc = paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+	ASSERT_TRUE(rc == 23);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 0);
+
+	/* a record whose lifetime passes after it was sent is dropped by the
+	 * wheel, without being sent again */
+	paging_set_lifetime(bts->paging_state, 10);
+	rc = paging_add_identity(bts->paging_state, 0, static_ilv, 0);
+	ASSERT_TRUE(rc == 0);
+	rc = paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+	ASSERT_TRUE(rc == 23);
+	ASSERT_TRUE(is_empty == 0);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 1);
+	osmo_gettimeofday_override_time.tv_sec = t0 + 16;
+	rc = paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+	ASSERT_TRUE(rc > 0);
+	ASSERT_TRUE(is_empty == 1);
+	ASSERT_TRUE(paging_queue_length(bts->paging_state) == 0);
+
+	paging_set_lifetime(bts->paging_state, 0);
+	osmo_gettimeofday_override = false;
+}
+
+/* Page the identities given as a string of 'T' (TMSI) and 'I' (IMSI),
+ * head of the group queue first, and report how well they were packed */
+static void test_paging_pack(const char *pattern)
+{
+	uint8_t out_buf[GSM_MACBLOCK_LEN];
+	struct gsm_time g_time = { .fn = 0, .t1 = 0, .t2 = 0, .t3 = 6 };
+	unsigned int n_blocks = 0, n_ids = 0, pages_per_sec;
+	int i, rc, is_empty;
+	printf("Testing paging block packing of %s.\n", pattern);
+
+	/* records are added to the head of the queue, so add them in reverse */
+	for (i = strlen(pattern) - 1; i >= 0; i--) {
+		uint8_t tmsi_lv[] = { 0x05, 0xF4, 0x00, 0x00, 0x00, i };
+		uint8_t imsi_lv[sizeof(static_ilv)];
+
+		memcpy(imsi_lv, static_ilv, sizeof(imsi_lv));
+		imsi_lv[8] = i;
+		rc = paging_add_identity(bts->paging_state, 0,
+					 pattern[i] == 'T' ? tmsi_lv : imsi_lv, 0);
+		ASSERT_TRUE(rc == 0);
+	}
+
+	while (!paging_group_queue_empty(bts->paging_state, 0)) {
+		int len_before = paging_queue_length(bts->paging_state);
+
+		rc = paging_gen_msg(bts->paging_state, out_buf, &g_time, &is_empty);
+		ASSERT_TRUE(rc > 0);
+		ASSERT_TRUE(is_empty == 0);
+
+		printf(" block %u: type 0x%02x, %d identities\n", n_blocks, out_buf[2],
+		       len_before - paging_queue_length(bts->paging_state));
+		n_ids += len_before - paging_queue_length(bts->paging_state);
+		n_blocks++;
+	}
+
+	/* 9 paging blocks per 51-multiframe of 51 * 4.615ms on a CCCH without
+	 * reserved AGCH blocks */
+	pages_per_sec = n_ids * 9 * 1000000 / (n_blocks * 51 * 4615);
+	printf(" %u identities in %u blocks, %u pages/s per CCCH\n",
+	       n_ids, n_blocks, pages_per_sec);
+}
+
 /* Set up a dummy trx with a valid setting for bs_ag_blks_res in SI3 */
 static struct gsm_bts_trx *test_is_ccch_for_agch_setup(uint8_t bs_ag_blks_res)
 {
@@ -192,6 +314,10 @@ int main(int argc, char **argv)
 
 	test_paging_smoke();
 	test_paging_sleep();
+	test_paging_queue_resize();
+	test_paging_wheel_expiry();
+	test_paging_pack("ITTITTTTIT");
+	test_paging_pack("TTTTTTTT");
 	test_is_ccch_for_agch();
 	printf("Success\n");
 